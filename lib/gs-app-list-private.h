@@ -20,6 +20,7 @@ G_BEGIN_DECLS
  * @GS_APP_LIST_FLAG_WATCH_APPS:		Applications will be monitored
  * @GS_APP_LIST_FLAG_WATCH_APPS_RELATED:	Applications related apps will be monitored
  * @GS_APP_LIST_FLAG_WATCH_APPS_ADDONS:		Applications addon apps will be monitored
+ * @GS_APP_LIST_FLAG_IS_PARTIAL:		Some plugins were skipped or did not finish in time
  *
  * Flags used to describe the list.
  **/
@@ -30,6 +31,7 @@ typedef enum {
 	GS_APP_LIST_FLAG_WATCH_APPS		= 1 << 2,
 	GS_APP_LIST_FLAG_WATCH_APPS_RELATED	= 1 << 3,
 	GS_APP_LIST_FLAG_WATCH_APPS_ADDONS	= 1 << 4,
+	GS_APP_LIST_FLAG_IS_PARTIAL		= 1 << 5,
 	GS_APP_LIST_FLAG_LAST  /*< skip >*/
 } GsAppListFlags;
 
@@ -37,6 +39,9 @@ GsAppList	*gs_app_list_copy		(GsAppList	*list);
 guint		 gs_app_list_get_size_peak	(GsAppList	*list);
 void		 gs_app_list_filter_duplicates	(GsAppList	*list,
 						 GsAppListFilterFlags flags);
+void		 gs_app_list_filter_duplicates_incremental (GsAppList *list,
+						 GHashTable	*seen,
+						 GsAppListFilterFlags flags);
 void		 gs_app_list_randomize		(GsAppList	*list);
 void		 gs_app_list_remove_all		(GsAppList	*list);
 void		 gs_app_list_truncate		(GsAppList	*list,
@@ -47,5 +52,6 @@ void		 gs_app_list_add_flag		(GsAppList	*list,
 						 GsAppListFlags	 flag);
 GsAppState	 gs_app_list_get_state		(GsAppList	*list);
 guint		 gs_app_list_get_progress	(GsAppList	*list);
+guint		 gs_app_list_get_instance_count	(void);
 
 G_END_DECLS
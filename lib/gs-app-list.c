@@ -20,6 +20,7 @@
 #include "config.h"
 
 #include <glib.h>
+#include <string.h>
 
 #include "gs-app-private.h"
 #include "gs-app-list-private.h"
@@ -30,15 +31,51 @@ struct _GsAppList
 {
 	GObject			 parent_instance;
 	GPtrArray		*array;
+	gboolean		 array_shared;	/* @array is also owned by a snapshot or copy */
+	GHashTable		*index;		/* (nullable) (element-type utf8 GPtrArray): built on demand */
+	GPtrArray		*unindexed;	/* (nullable): apps without a unique ID when indexed */
+	guint			 index_serial;	/* gs_app_get_id_serial() when @index was built */
 	GMutex			 mutex;
 	guint			 size_peak;
 	GsAppListFlags		 flags;
 	GsAppState		 state;
 	guint			 progress;  /* 0–100 inclusive, or %GS_APP_PROGRESS_UNKNOWN */
+
+	/* aggregates of the watched apps, kept up to date as they change */
+	GHashTable		*watched;	/* (element-type GsApp GsAppListWatch) */
+	GHashTable		*watched_roots;	/* (element-type GsApp GsAppListWatchRoot) */
+	guint			 watched_cnt;
+	guint			 progress_unknown_cnt;
+	guint64			 progress_sum;
+	guint			 state_cnt[GS_APP_STATE_LAST];
+	gint64			 progress_notify_time;
+	guint			 progress_notify_id;
+	gint			 watched_refresh_pending;	/* atomic */
 };
 
+/* the last values seen for an app that is watched @cnt times, e.g. as the
+ * addon of more than one app in the list */
+typedef struct {
+	guint			 cnt;
+	guint			 progress;
+	GsAppState		 state;
+} GsAppListWatch;
+
+/* the apps watched on behalf of an app in the list that was added @cnt times,
+ * kept so that exactly the same apps are unwatched when it is removed */
+typedef struct {
+	guint			 cnt;
+	GPtrArray		*apps;		/* (element-type GsApp) */
+} GsAppListWatchRoot;
+
+#define GS_APP_LIST_PROGRESS_NOTIFY_INTERVAL	100	/* ms */
+
 G_DEFINE_TYPE (GsAppList, gs_app_list, G_TYPE_OBJECT)
 
+static gint gs_app_list_instance_count = 0;	/* atomic */
+
+static GsAppList *gs_app_list_copy_safe (GsAppList *list);
+
 enum {
 	PROP_STATE = 1,
 	PROP_PROGRESS,
@@ -47,6 +84,7 @@ enum {
 
 enum {
 	SIGNAL_APP_STATE_CHANGED,
+	SIGNAL_CHANGED,
 	SIGNAL_LAST
 };
 
@@ -98,19 +136,19 @@ static void
 gs_app_list_add_watched_for_app (GsAppList *list, GPtrArray *apps, GsApp *app)
 {
 	if (list->flags & GS_APP_LIST_FLAG_WATCH_APPS)
-		g_ptr_array_add (apps, app);
+		g_ptr_array_add (apps, g_object_ref (app));
 	if (list->flags & GS_APP_LIST_FLAG_WATCH_APPS_ADDONS) {
 		GsAppList *list2 = gs_app_get_addons (app);
 		for (guint i = 0; i < gs_app_list_length (list2); i++) {
 			GsApp *app2 = gs_app_list_index (list2, i);
-			g_ptr_array_add (apps, app2);
+			g_ptr_array_add (apps, g_object_ref (app2));
 		}
 	}
 	if (list->flags & GS_APP_LIST_FLAG_WATCH_APPS_RELATED) {
 		GsAppList *list2 = gs_app_get_related (app);
 		for (guint i = 0; i < gs_app_list_length (list2); i++) {
 			GsApp *app2 = gs_app_list_index (list2, i);
-			g_ptr_array_add (apps, app2);
+			g_ptr_array_add (apps, g_object_ref (app2));
 		}
 	}
 }
@@ -118,114 +156,299 @@ gs_app_list_add_watched_for_app (GsAppList *list, GPtrArray *apps, GsApp *app)
 static GPtrArray *
 gs_app_list_get_watched_for_app (GsAppList *list, GsApp *app)
 {
-	GPtrArray *apps = g_ptr_array_new ();
+	GPtrArray *apps = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
 	gs_app_list_add_watched_for_app (list, apps, app);
 	return apps;
 }
 
-static GPtrArray *
-gs_app_list_get_watched (GsAppList *list)
+static void
+gs_app_list_watch_root_free (GsAppListWatchRoot *root)
 {
-	GPtrArray *apps = g_ptr_array_new ();
-	for (guint i = 0; i < list->array->len; i++) {
-		GsApp *app_tmp = g_ptr_array_index (list->array, i);
-		gs_app_list_add_watched_for_app (list, apps, app_tmp);
-	}
-	return apps;
+	g_ptr_array_unref (root->apps);
+	g_free (root);
 }
 
 static void
-gs_app_list_invalidate_progress (GsAppList *self)
+gs_app_list_watch_account (GsAppList *self, GsAppListWatch *watch, gint cnt)
 {
-	guint progress = 0;
-	g_autoptr(GPtrArray) apps = gs_app_list_get_watched (self);
+	self->watched_cnt += cnt;
+	if (watch->progress == GS_APP_PROGRESS_UNKNOWN)
+		self->progress_unknown_cnt += cnt;
+	else
+		self->progress_sum += (gint64) watch->progress * cnt;
+	if (watch->state < GS_APP_STATE_LAST)
+		self->state_cnt[watch->state] += cnt;
+}
 
-	/* find the average percentage complete of the list */
-	if (apps->len > 0) {
-		guint64 pc_cnt = 0;
-		gboolean unknown_seen = FALSE;
+static gboolean
+gs_app_list_progress_notify_cb (gpointer user_data)
+{
+	GsAppList *self = GS_APP_LIST (user_data);
+
+	g_mutex_lock (&self->mutex);
+	self->progress_notify_id = 0;
+	self->progress_notify_time = g_get_monotonic_time ();
+	g_mutex_unlock (&self->mutex);
+	g_object_notify (G_OBJECT (self), "progress");
+	return G_SOURCE_REMOVE;
+}
 
-		for (guint i = 0; i < apps->len; i++) {
-			GsApp *app_tmp = g_ptr_array_index (apps, i);
-			guint app_progress = gs_app_get_progress (app_tmp);
+/* progress can change many times a second for each app, so only notify
+ * every so often, but always with the latest value; called with the mutex
+ * held, and returns %TRUE if the property has to be notified right now */
+static gboolean
+gs_app_list_notify_progress_locked (GsAppList *self)
+{
+	gint64 now = g_get_monotonic_time ();
+	gint64 elapsed = now - self->progress_notify_time;
 
-			if (app_progress == GS_APP_PROGRESS_UNKNOWN) {
-				unknown_seen = TRUE;
-				break;
-			}
-			pc_cnt += gs_app_get_progress (app_tmp);
-		}
+	if (self->progress_notify_id != 0)
+		return FALSE;
+	if (elapsed >= GS_APP_LIST_PROGRESS_NOTIFY_INTERVAL * G_TIME_SPAN_MILLISECOND) {
+		self->progress_notify_time = now;
+		return TRUE;
+	}
+	self->progress_notify_id =
+		g_timeout_add_full (G_PRIORITY_DEFAULT,
+				    GS_APP_LIST_PROGRESS_NOTIFY_INTERVAL - (guint) (elapsed / G_TIME_SPAN_MILLISECOND),
+				    gs_app_list_progress_notify_cb,
+				    g_object_ref (self),
+				    (GDestroyNotify) g_object_unref);
+	return FALSE;
+}
 
-		progress = (!unknown_seen) ? pc_cnt / apps->len : GS_APP_PROGRESS_UNKNOWN;
-	} else {
+
+/* returns %TRUE if the property has to be notified */
+static gboolean
+gs_app_list_update_progress (GsAppList *self)
+{
+	guint progress;
+
+	/* the average percentage complete of the list */
+	if (self->watched_cnt > 0 && self->progress_unknown_cnt == 0)
+		progress = (guint) (self->progress_sum / self->watched_cnt);
+	else
 		progress = GS_APP_PROGRESS_UNKNOWN;
-	}
+	if (self->progress == progress)
+		return FALSE;
+	self->progress = progress;
+	return TRUE;
+}
+
+static gboolean
+gs_app_list_update_state (GsAppList *self)
+{
+	GsAppState state = GS_APP_STATE_UNKNOWN;
 
-	if (self->progress != progress) {
-		self->progress = progress;
+	/* any action state of the list */
+	if (self->state_cnt[GS_APP_STATE_INSTALLING] > 0)
+		state = GS_APP_STATE_INSTALLING;
+	else if (self->state_cnt[GS_APP_STATE_REMOVING] > 0)
+		state = GS_APP_STATE_REMOVING;
+	if (self->state == state)
+		return FALSE;
+	self->state = state;
+	return TRUE;
+}
+
+static void
+gs_app_list_invalidate_progress (GsAppList *self)
+{
+	if (gs_app_list_update_progress (self) &&
+	    gs_app_list_notify_progress_locked (self))
 		g_object_notify (G_OBJECT (self), "progress");
-	}
 }
 
 static void
 gs_app_list_invalidate_state (GsAppList *self)
 {
-	GsAppState state = GS_APP_STATE_UNKNOWN;
-	g_autoptr(GPtrArray) apps = gs_app_list_get_watched (self);
-
-	/* find any action state of the list */
-	for (guint i = 0; i < apps->len; i++) {
-		GsApp *app_tmp = g_ptr_array_index (apps, i);
-		GsAppState state_tmp = gs_app_get_state (app_tmp);
-		if (state_tmp == GS_APP_STATE_INSTALLING ||
-		    state_tmp == GS_APP_STATE_REMOVING) {
-			state = state_tmp;
-			break;
-		}
+	if (gs_app_list_update_state (self))
+		g_object_notify (G_OBJECT (self), "state");
+}
+
+static void
+gs_app_list_app_progress_notify_cb (GsApp *app, GParamSpec *pspec, GsAppList *self)
+{
+	GsAppListWatch *watch;
+	gboolean changed = FALSE;
+
+	g_mutex_lock (&self->mutex);
+	watch = g_hash_table_lookup (self->watched, app);
+	if (watch != NULL) {
+		gs_app_list_watch_account (self, watch, -(gint) watch->cnt);
+		watch->progress = gs_app_get_progress (app);
+		gs_app_list_watch_account (self, watch, (gint) watch->cnt);
+		changed = gs_app_list_update_progress (self) &&
+			  gs_app_list_notify_progress_locked (self);
 	}
-	if (self->state != state) {
-		self->state = state;
+	g_mutex_unlock (&self->mutex);
+	if (changed)
+		g_object_notify (G_OBJECT (self), "progress");
+}
+
+static void
+gs_app_list_app_state_notify_cb (GsApp *app, GParamSpec *pspec, GsAppList *self)
+{
+	GsAppListWatch *watch;
+	gboolean changed = FALSE;
+
+	g_mutex_lock (&self->mutex);
+	watch = g_hash_table_lookup (self->watched, app);
+	if (watch != NULL) {
+		gs_app_list_watch_account (self, watch, -(gint) watch->cnt);
+		watch->state = gs_app_get_state (app);
+		gs_app_list_watch_account (self, watch, (gint) watch->cnt);
+		changed = gs_app_list_update_state (self);
+	}
+	g_mutex_unlock (&self->mutex);
+	if (changed)
 		g_object_notify (G_OBJECT (self), "state");
+
+	g_signal_emit (self, signals[SIGNAL_APP_STATE_CHANGED], 0, app);
+}
+
+static void
+gs_app_list_watch_app_tmp (GsAppList *list, GsApp *app_tmp)
+{
+	GsAppListWatch *watch = g_hash_table_lookup (list->watched, app_tmp);
+
+	if (watch != NULL) {
+		gs_app_list_watch_account (list, watch, 1);
+		watch->cnt++;
+		return;
 	}
+	watch = g_new0 (GsAppListWatch, 1);
+	watch->cnt = 1;
+	watch->progress = gs_app_get_progress (app_tmp);
+	watch->state = gs_app_get_state (app_tmp);
+	gs_app_list_watch_account (list, watch, 1);
+	g_hash_table_insert (list->watched, g_object_ref (app_tmp), watch);
+	g_signal_connect_object (app_tmp, "notify::progress",
+				 G_CALLBACK (gs_app_list_app_progress_notify_cb),
+				 list, 0);
+	g_signal_connect_object (app_tmp, "notify::state",
+				 G_CALLBACK (gs_app_list_app_state_notify_cb),
+				 list, 0);
 }
 
 static void
-gs_app_list_progress_notify_cb (GsApp *app, GParamSpec *pspec, GsAppList *self)
+gs_app_list_unwatch_app_tmp (GsAppList *list, GsApp *app_tmp)
 {
-	gs_app_list_invalidate_progress (self);
+	GsAppListWatch *watch = g_hash_table_lookup (list->watched, app_tmp);
+
+	if (watch == NULL)
+		return;
+	gs_app_list_watch_account (list, watch, -1);
+	if (--watch->cnt > 0)
+		return;
+	g_signal_handlers_disconnect_by_data (app_tmp, list);
+	g_hash_table_remove (list->watched, app_tmp);
 }
 
+/* watch the addons and related apps the app has now, rather than the ones
+ * it had when it was added to the list */
 static void
-gs_app_list_state_notify_cb (GsApp *app, GParamSpec *pspec, GsAppList *self)
+gs_app_list_watch_root_refresh (GsAppList *list, GsApp *app, GsAppListWatchRoot *root)
 {
-	gs_app_list_invalidate_state (self);
+	g_autoptr(GPtrArray) apps = gs_app_list_get_watched_for_app (list, app);
 
-	g_signal_emit (self, signals[SIGNAL_APP_STATE_CHANGED], 0, app);
+	/* watch the new ones first so apps in both are not disconnected */
+	for (guint n = 0; n < root->cnt; n++) {
+		for (guint i = 0; i < apps->len; i++)
+			gs_app_list_watch_app_tmp (list, g_ptr_array_index (apps, i));
+		for (guint i = 0; i < root->apps->len; i++)
+			gs_app_list_unwatch_app_tmp (list, g_ptr_array_index (root->apps, i));
+	}
+	g_ptr_array_unref (root->apps);
+	root->apps = g_steal_pointer (&apps);
+}
+
+static gboolean
+gs_app_list_watched_refresh_cb (gpointer user_data)
+{
+	GsAppList *self = GS_APP_LIST (user_data);
+	GHashTableIter iter;
+	gpointer key, value;
+	gboolean changed_state;
+	gboolean changed_progress;
+
+	g_atomic_int_set (&self->watched_refresh_pending, FALSE);
+	g_mutex_lock (&self->mutex);
+	g_hash_table_iter_init (&iter, self->watched_roots);
+	while (g_hash_table_iter_next (&iter, &key, &value))
+		gs_app_list_watch_root_refresh (self, GS_APP (key), value);
+	changed_state = gs_app_list_update_state (self);
+	changed_progress = gs_app_list_update_progress (self) &&
+			   gs_app_list_notify_progress_locked (self);
+	g_mutex_unlock (&self->mutex);
+	if (changed_state)
+		g_object_notify (G_OBJECT (self), "state");
+	if (changed_progress)
+		g_object_notify (G_OBJECT (self), "progress");
+	return G_SOURCE_REMOVE;
+}
+
+/* addons and related apps are often added from a plugin thread with the app
+ * locked, so don't take the list lock here but refresh the watched apps from
+ * the main context, just like the property notifications of #GsApp */
+static void
+gs_app_list_watched_list_changed_cb (GsAppList *list2, GsAppList *self)
+{
+	if (!g_atomic_int_compare_and_exchange (&self->watched_refresh_pending, FALSE, TRUE))
+		return;
+	g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+			 gs_app_list_watched_refresh_cb,
+			 g_object_ref (self),
+			 (GDestroyNotify) g_object_unref);
 }
 
 static void
 gs_app_list_maybe_watch_app (GsAppList *list, GsApp *app)
 {
-	g_autoptr(GPtrArray) apps = gs_app_list_get_watched_for_app (list, app);
-	for (guint i = 0; i < apps->len; i++) {
-		GsApp *app_tmp = g_ptr_array_index (apps, i);
-		g_signal_connect_object (app_tmp, "notify::progress",
-					 G_CALLBACK (gs_app_list_progress_notify_cb),
-					 list, 0);
-		g_signal_connect_object (app_tmp, "notify::state",
-					 G_CALLBACK (gs_app_list_state_notify_cb),
-					 list, 0);
+	GsAppListWatchRoot *root;
+
+	if ((list->flags & (GS_APP_LIST_FLAG_WATCH_APPS |
+			    GS_APP_LIST_FLAG_WATCH_APPS_ADDONS |
+			    GS_APP_LIST_FLAG_WATCH_APPS_RELATED)) == 0)
+		return;
+
+	root = g_hash_table_lookup (list->watched_roots, app);
+	if (root == NULL) {
+		root = g_new0 (GsAppListWatchRoot, 1);
+		root->apps = gs_app_list_get_watched_for_app (list, app);
+		g_hash_table_insert (list->watched_roots, g_object_ref (app), root);
+		if (list->flags & GS_APP_LIST_FLAG_WATCH_APPS_ADDONS) {
+			g_signal_connect_object (gs_app_get_addons (app), "changed",
+						 G_CALLBACK (gs_app_list_watched_list_changed_cb),
+						 list, 0);
+		}
+		if (list->flags & GS_APP_LIST_FLAG_WATCH_APPS_RELATED) {
+			g_signal_connect_object (gs_app_get_related (app), "changed",
+						 G_CALLBACK (gs_app_list_watched_list_changed_cb),
+						 list, 0);
+		}
 	}
+	root->cnt++;
+	for (guint i = 0; i < root->apps->len; i++)
+		gs_app_list_watch_app_tmp (list, g_ptr_array_index (root->apps, i));
 }
 
+/* unwatches exactly what gs_app_list_maybe_watch_app() watched for @app, even
+ * if its addons or related apps have changed since */
 static void
 gs_app_list_maybe_unwatch_app (GsAppList *list, GsApp *app)
 {
-	g_autoptr(GPtrArray) apps = gs_app_list_get_watched_for_app (list, app);
-	for (guint i = 0; i < apps->len; i++) {
-		GsApp *app_tmp = g_ptr_array_index (apps, i);
-		g_signal_handlers_disconnect_by_data (app_tmp, list);
-	}
+	GsAppListWatchRoot *root = g_hash_table_lookup (list->watched_roots, app);
+
+	if (root == NULL)
+		return;
+	for (guint i = 0; i < root->apps->len; i++)
+		gs_app_list_unwatch_app_tmp (list, g_ptr_array_index (root->apps, i));
+	if (--root->cnt > 0)
+		return;
+	g_signal_handlers_disconnect_by_data (gs_app_get_addons (app), list);
+	g_signal_handlers_disconnect_by_data (gs_app_get_related (app), list);
+	g_hash_table_remove (list->watched_roots, app);
 }
 
 /**
@@ -244,17 +467,157 @@ gs_app_list_get_size_peak (GsAppList *list)
 	return list->size_peak;
 }
 
+/* the wildcard rules of as_utils_data_id_equal() never apply to the ID part
+ * of a unique ID unless it is literally "*", so use that as the index key */
+static gchar *
+gs_app_list_get_index_key (const gchar *unique_id)
+{
+	const gchar *start = unique_id;
+	const gchar *end;
+	guint sections = 1;
+
+	for (const gchar *p = unique_id; *p != '\0'; p++) {
+		if (*p == '/')
+			sections++;
+	}
+	if (sections != 5)
+		return g_strdup (unique_id);
+	for (guint i = 0; i < 3; i++)
+		start = strchr (start, '/') + 1;
+	end = strchr (start, '/');
+	return g_strndup (start, (gsize) (end - start));
+}
+
+static void
+gs_app_list_index_add (GsAppList *list, GsApp *app)
+{
+	GPtrArray *bucket;
+	const gchar *unique_id = gs_app_get_unique_id (app);
+	g_autofree gchar *key = NULL;
+
+	/* lazy-loaded ID, so check again when looking up */
+	if (unique_id == NULL) {
+		g_ptr_array_add (list->unindexed, app);
+		return;
+	}
+	key = gs_app_list_get_index_key (unique_id);
+	bucket = g_hash_table_lookup (list->index, key);
+	if (bucket == NULL) {
+		bucket = g_ptr_array_new ();
+		g_hash_table_insert (list->index, g_steal_pointer (&key), bucket);
+	}
+	g_ptr_array_add (bucket, app);
+}
+
+static void
+gs_app_list_index_invalidate (GsAppList *list)
+{
+	g_clear_pointer (&list->index, g_hash_table_unref);
+	g_clear_pointer (&list->unindexed, g_ptr_array_unref);
+}
+
+static void
+gs_app_list_index_remove (GsAppList *list, GsApp *app)
+{
+	GPtrArray *bucket;
+	const gchar *unique_id;
+	g_autofree gchar *key = NULL;
+
+	if (list->index == NULL)
+		return;
+	if (g_ptr_array_remove (list->unindexed, app))
+		return;
+
+	/* the unique ID may have changed since the app was added */
+	unique_id = gs_app_get_unique_id (app);
+	if (unique_id != NULL) {
+		key = gs_app_list_get_index_key (unique_id);
+		bucket = g_hash_table_lookup (list->index, key);
+		if (bucket != NULL && g_ptr_array_remove (bucket, app)) {
+			if (bucket->len == 0)
+				g_hash_table_remove (list->index, key);
+			return;
+		}
+	}
+	gs_app_list_index_invalidate (list);
+}
+
+static void
+gs_app_list_index_ensure (GsAppList *list)
+{
+	guint serial = gs_app_get_id_serial ();
+
+	/* an app may have been given a new ID since it was filed, which is rare
+	 * enough that the whole index can be rebuilt */
+	if (list->index != NULL) {
+		if (list->index_serial == serial)
+			return;
+		gs_app_list_index_invalidate (list);
+	}
+	list->index = g_hash_table_new_full (g_str_hash, g_str_equal,
+					     g_free, (GDestroyNotify) g_ptr_array_unref);
+	list->unindexed = g_ptr_array_new ();
+	list->index_serial = serial;
+	for (guint i = 0; i < list->array->len; i++)
+		gs_app_list_index_add (list, g_ptr_array_index (list->array, i));
+}
+
 static GsApp *
-gs_app_list_lookup_safe (GsAppList *list, const gchar *unique_id)
+gs_app_list_lookup_bucket (GPtrArray *bucket, const gchar *unique_id)
 {
-	for (guint i = 0; i < list->array->len; i++) {
-		GsApp *app = g_ptr_array_index (list->array, i);
+	if (bucket == NULL)
+		return NULL;
+	for (guint i = 0; i < bucket->len; i++) {
+		GsApp *app = g_ptr_array_index (bucket, i);
 		if (as_utils_data_id_equal (gs_app_get_unique_id (app), unique_id))
 			return app;
 	}
 	return NULL;
 }
 
+/* buckets keep the list order, but more than one bucket can match, and the
+ * first match in the whole list has to win as it did before the index */
+static GsApp *
+gs_app_list_lookup_earliest (GsAppList *list, GsApp *app1, GsApp *app2)
+{
+	if (app1 == NULL)
+		return app2;
+	if (app2 == NULL)
+		return app1;
+	for (guint i = 0; i < list->array->len; i++) {
+		GsApp *app = g_ptr_array_index (list->array, i);
+		if (app == app1 || app == app2)
+			return app;
+	}
+	return app1;
+}
+
+static GsApp *
+gs_app_list_lookup_safe (GsAppList *list, const gchar *unique_id)
+{
+	GsApp *app;
+	g_autofree gchar *key = gs_app_list_get_index_key (unique_id);
+
+	/* a wildcard ID could match anything */
+	if (g_strcmp0 (key, "*") == 0) {
+		for (guint i = 0; i < list->array->len; i++) {
+			app = g_ptr_array_index (list->array, i);
+			if (as_utils_data_id_equal (gs_app_get_unique_id (app), unique_id))
+				return app;
+		}
+		return NULL;
+	}
+
+	/* only apps with the same ID or a wildcard ID can match */
+	gs_app_list_index_ensure (list);
+	app = gs_app_list_lookup_bucket (g_hash_table_lookup (list->index, key), unique_id);
+	app = gs_app_list_lookup_earliest (list, app,
+					   gs_app_list_lookup_bucket (g_hash_table_lookup (list->index, "*"),
+								      unique_id));
+	return gs_app_list_lookup_earliest (list, app,
+					    gs_app_list_lookup_bucket (list->unindexed, unique_id));
+}
+
 /**
  * gs_app_list_lookup:
  * @list: A #GsAppList
@@ -305,15 +668,33 @@ gs_app_list_has_flag (GsAppList *list, GsAppListFlags flag)
 void
 gs_app_list_add_flag (GsAppList *list, GsAppListFlags flag)
 {
+	g_autoptr(GMutexLocker) locker = NULL;
+
 	if (list->flags & flag)
 		return;
-	list->flags |= flag;
+
+	/* nothing is watched differently */
+	if (list->array->len == 0 ||
+	    (flag & (GS_APP_LIST_FLAG_WATCH_APPS |
+		     GS_APP_LIST_FLAG_WATCH_APPS_ADDONS |
+		     GS_APP_LIST_FLAG_WATCH_APPS_RELATED)) == 0) {
+		list->flags |= flag;
+		return;
+	}
 
 	/* turn this on for existing apps */
+	locker = g_mutex_locker_new (&list->mutex);
+	for (guint i = 0; i < list->array->len; i++) {
+		GsApp *app = g_ptr_array_index (list->array, i);
+		gs_app_list_maybe_unwatch_app (list, app);
+	}
+	list->flags |= flag;
 	for (guint i = 0; i < list->array->len; i++) {
 		GsApp *app = g_ptr_array_index (list->array, i);
 		gs_app_list_maybe_watch_app (list, app);
 	}
+	gs_app_list_invalidate_state (list);
+	gs_app_list_invalidate_progress (list);
 }
 
 static gboolean
@@ -324,13 +705,25 @@ gs_app_list_check_for_duplicate (GsAppList *list, GsApp *app)
 
 	/* adding a wildcard */
 	if (gs_app_has_quirk (app, GS_APP_QUIRK_IS_WILDCARD)) {
-		for (guint i = 0; i < list->array->len; i++) {
-			GsApp *app_tmp = g_ptr_array_index (list->array, i);
+		GPtrArray *bucket;
+		g_autofree gchar *key = NULL;
+
+		/* exactly the same wildcard has to be in the same bucket,
+		 * and ones without a unique ID are all unindexed */
+		id = gs_app_get_unique_id (app);
+		gs_app_list_index_ensure (list);
+		if (id != NULL) {
+			key = gs_app_list_get_index_key (id);
+			bucket = g_hash_table_lookup (list->index, key);
+		} else {
+			bucket = list->unindexed;
+		}
+		for (guint i = 0; bucket != NULL && i < bucket->len; i++) {
+			GsApp *app_tmp = g_ptr_array_index (bucket, i);
 			if (!gs_app_has_quirk (app_tmp, GS_APP_QUIRK_IS_WILDCARD))
 				continue;
 			/* not adding exactly the same wildcard */
-			if (g_strcmp0 (gs_app_get_unique_id (app_tmp),
-				       gs_app_get_unique_id (app)) == 0)
+			if (g_strcmp0 (gs_app_get_unique_id (app_tmp), id) == 0)
 				return FALSE;
 		}
 		return TRUE;
@@ -365,6 +758,22 @@ typedef enum {
 	GS_APP_LIST_ADD_FLAG_LAST
 } GsAppListAddFlag;
 
+/* copy-on-write: called with the mutex held before @array is modified */
+static void
+gs_app_list_make_writable (GsAppList *list)
+{
+	GPtrArray *array;
+
+	if (!list->array_shared)
+		return;
+	array = g_ptr_array_new_full (list->array->len, (GDestroyNotify) g_object_unref);
+	for (guint i = 0; i < list->array->len; i++)
+		g_ptr_array_add (array, g_object_ref (g_ptr_array_index (list->array, i)));
+	g_ptr_array_unref (list->array);
+	list->array = array;
+	list->array_shared = FALSE;
+}
+
 static void
 gs_app_list_add_safe (GsAppList *list, GsApp *app, GsAppListAddFlag flag)
 {
@@ -374,6 +783,11 @@ gs_app_list_add_safe (GsAppList *list, GsApp *app, GsAppListAddFlag flag)
 	if ((flag & GS_APP_LIST_ADD_FLAG_CHECK_FOR_DUPE) > 0 &&
 	    !gs_app_list_check_for_duplicate (list, app))
 		return;
+	gs_app_list_make_writable (list);
+
+	/* keep the index up to date if it has already been built */
+	if (list->index != NULL)
+		gs_app_list_index_add (list, app);
 
 	/* if we're lazy-loading the ID then we can't use the ID hash */
 	id = gs_app_get_unique_id (app);
@@ -419,6 +833,8 @@ gs_app_list_add (GsAppList *list, GsApp *app)
 	/* recalculate global state */
 	gs_app_list_invalidate_state (list);
 	gs_app_list_invalidate_progress (list);
+	g_clear_pointer (&locker, g_mutex_locker_free);
+	g_signal_emit (list, signals[SIGNAL_CHANGED], 0);
 }
 
 /**
@@ -440,12 +856,16 @@ gs_app_list_remove (GsAppList *list, GsApp *app)
 	g_return_if_fail (GS_IS_APP (app));
 
 	locker = g_mutex_locker_new (&list->mutex);
-	g_ptr_array_remove (list->array, app);
+	gs_app_list_index_remove (list, app);
+	gs_app_list_make_writable (list);
 	gs_app_list_maybe_unwatch_app (list, app);
+	g_ptr_array_remove (list->array, app);
 
 	/* recalculate global state */
 	gs_app_list_invalidate_state (list);
 	gs_app_list_invalidate_progress (list);
+	g_clear_pointer (&locker, g_mutex_locker_free);
+	g_signal_emit (list, signals[SIGNAL_CHANGED], 0);
 }
 
 /**
@@ -478,6 +898,8 @@ gs_app_list_add_list (GsAppList *list, GsAppList *donor)
 	/* recalculate global state */
 	gs_app_list_invalidate_state (list);
 	gs_app_list_invalidate_progress (list);
+	g_clear_pointer (&locker, g_mutex_locker_free);
+	g_signal_emit (list, signals[SIGNAL_CHANGED], 0);
 }
 
 /**
@@ -521,7 +943,17 @@ gs_app_list_remove_all_safe (GsAppList *list)
 		GsApp *app = g_ptr_array_index (list->array, i);
 		gs_app_list_maybe_unwatch_app (list, app);
 	}
-	g_ptr_array_set_size (list->array, 0);
+	if (list->array_shared) {
+		g_ptr_array_unref (list->array);
+		list->array = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+		list->array_shared = FALSE;
+	} else {
+		g_ptr_array_set_size (list->array, 0);
+	}
+	if (list->index != NULL) {
+		g_hash_table_remove_all (list->index);
+		g_ptr_array_set_size (list->unindexed, 0);
+	}
 	gs_app_list_invalidate_state (list);
 	gs_app_list_invalidate_progress (list);
 }
@@ -541,6 +973,8 @@ gs_app_list_remove_all (GsAppList *list)
 	g_return_if_fail (GS_IS_APP_LIST (list));
 	locker = g_mutex_locker_new (&list->mutex);
 	gs_app_list_remove_all_safe (list);
+	g_clear_pointer (&locker, g_mutex_locker_free);
+	g_signal_emit (list, signals[SIGNAL_CHANGED], 0);
 }
 
 /**
@@ -566,8 +1000,8 @@ gs_app_list_filter (GsAppList *list, GsAppListFilterFunc func, gpointer user_dat
 
 	locker = g_mutex_locker_new (&list->mutex);
 
-	/* deep copy to a temp list and clear the current one */
-	old = gs_app_list_copy (list);
+	/* copy to a temp list and clear the current one */
+	old = gs_app_list_copy_safe (list);
 	gs_app_list_remove_all_safe (list);
 
 	/* see if any of the apps need filtering */
@@ -576,6 +1010,12 @@ gs_app_list_filter (GsAppList *list, GsAppListFilterFunc func, gpointer user_dat
 		if (func (app, user_data))
 			gs_app_list_add_safe (list, app, GS_APP_LIST_ADD_FLAG_NONE);
 	}
+
+	/* recalculate global state */
+	gs_app_list_invalidate_state (list);
+	gs_app_list_invalidate_progress (list);
+	g_clear_pointer (&locker, g_mutex_locker_free);
+	g_signal_emit (list, signals[SIGNAL_CHANGED], 0);
 }
 
 typedef struct {
@@ -589,7 +1029,7 @@ gs_app_list_sort_cb (gconstpointer a, gconstpointer b, gpointer user_data)
 	GsApp *app1 = GS_APP (*(GsApp **) a);
 	GsApp *app2 = GS_APP (*(GsApp **) b);
 	GsAppListSortHelper *helper = (GsAppListSortHelper *) user_data;
-	return helper->func (app1, app2, user_data);
+	return helper->func (app1, app2, helper->user_data);
 }
 
 /**
@@ -611,7 +1051,95 @@ gs_app_list_sort (GsAppList *list, GsAppListSortFunc func, gpointer user_data)
 	locker = g_mutex_locker_new (&list->mutex);
 	helper.func = func;
 	helper.user_data = user_data;
+	gs_app_list_make_writable (list);
 	g_ptr_array_sort_with_data (list->array, gs_app_list_sort_cb, &helper);
+
+	/* lookups return the first match in list order */
+	gs_app_list_index_invalidate (list);
+}
+
+typedef struct {
+	GsApp		*app;
+	guint		 idx;
+	guint		 offset;
+	guint		 len;
+} GsAppListSortKey;
+
+static gint
+gs_app_list_sort_key_cb (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+	const GsAppListSortKey *key1 = a;
+	const GsAppListSortKey *key2 = b;
+	const guint8 *data = user_data;
+	gint rc;
+
+	rc = memcmp (data + key1->offset, data + key2->offset, MIN (key1->len, key2->len));
+	if (rc != 0)
+		return rc;
+	if (key1->len != key2->len)
+		return key1->len < key2->len ? -1 : 1;
+
+	/* keep the existing order for equal keys */
+	if (key1->idx != key2->idx)
+		return key1->idx < key2->idx ? -1 : 1;
+	return 0;
+}
+
+/**
+ * gs_app_list_sort_by_key:
+ * @list: A #GsAppList
+ * @func: (scope call): A #GsAppListSortKeyFunc
+ * @user_data: user data to pass to @func
+ *
+ * Sorts the application list by a binary key which @func builds for each
+ * application. Keys are compared bytewise, shorter keys sorting before any
+ * longer key they are a prefix of, and applications with equal keys keep
+ * their relative order.
+ *
+ * Unlike gs_app_list_sort(), @func is only called once per application, so
+ * this is preferable when the sort order depends on values which are
+ * expensive to compute or compare.
+ *
+ * Since: 40
+ **/
+void
+gs_app_list_sort_by_key (GsAppList *list, GsAppListSortKeyFunc func, gpointer user_data)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+	g_autoptr(GByteArray) buf = NULL;
+	g_autoptr(GArray) keys = NULL;
+
+	g_return_if_fail (GS_IS_APP_LIST (list));
+	g_return_if_fail (func != NULL);
+
+	locker = g_mutex_locker_new (&list->mutex);
+	if (list->array->len < 2)
+		return;
+
+	/* build all the keys into one buffer */
+	buf = g_byte_array_sized_new (list->array->len * 16);
+	keys = g_array_sized_new (FALSE, FALSE, sizeof (GsAppListSortKey), list->array->len);
+	for (guint i = 0; i < list->array->len; i++) {
+		GsAppListSortKey key;
+		key.app = g_ptr_array_index (list->array, i);
+		key.idx = i;
+		key.offset = buf->len;
+		func (key.app, buf, user_data);
+		key.len = buf->len - key.offset;
+		g_array_append_val (keys, key);
+	}
+	g_qsort_with_data (keys->data, keys->len, sizeof (GsAppListSortKey),
+			   gs_app_list_sort_key_cb, buf->data);
+
+	/* the array owns the refs, so just put the pointers back in order */
+	gs_app_list_make_writable (list);
+	for (guint i = 0; i < keys->len; i++) {
+		GsAppListSortKey *key = &g_array_index (keys, GsAppListSortKey, i);
+		list->array->pdata[i] = key->app;
+	}
+
+	/* lookups return the first match in list order */
+	gs_app_list_index_invalidate (list);
 }
 
 /**
@@ -643,22 +1171,33 @@ gs_app_list_truncate (GsAppList *list, guint length)
 
 	/* remove the apps in the positions larger than the length */
 	locker = g_mutex_locker_new (&list->mutex);
+	gs_app_list_make_writable (list);
+	for (guint i = length; i < list->array->len; i++) {
+		GsApp *app = g_ptr_array_index (list->array, i);
+		gs_app_list_maybe_unwatch_app (list, app);
+	}
 	g_ptr_array_set_size (list->array, length);
+	gs_app_list_index_invalidate (list);
+
+	/* recalculate global state */
+	gs_app_list_invalidate_state (list);
+	gs_app_list_invalidate_progress (list);
+	g_clear_pointer (&locker, g_mutex_locker_free);
+	g_signal_emit (list, signals[SIGNAL_CHANGED], 0);
 }
 
 static gint
 gs_app_list_randomize_cb (gconstpointer a, gconstpointer b, gpointer user_data)
 {
-	GsApp *app1 = GS_APP (*(GsApp **) a);
-	GsApp *app2 = GS_APP (*(GsApp **) b);
-	const gchar *k1;
-	const gchar *k2;
-	g_autofree gchar *key = NULL;
-
-	key = g_strdup_printf ("Plugin::sort-key[%p]", user_data);
-	k1 = gs_app_get_metadata_item (app1, key);
-	k2 = gs_app_get_metadata_item (app2, key);
-	return g_strcmp0 (k1, k2);
+	GHashTable *sort_keys = user_data;
+	guint k1 = GPOINTER_TO_UINT (g_hash_table_lookup (sort_keys, *(GsApp **) a));
+	guint k2 = GPOINTER_TO_UINT (g_hash_table_lookup (sort_keys, *(GsApp **) b));
+
+	if (k1 < k2)
+		return -1;
+	if (k1 > k2)
+		return 1;
+	return 0;
 }
 
 /**
@@ -676,9 +1215,8 @@ gs_app_list_randomize (GsAppList *list)
 	guint i;
 	GRand *rand;
 	GsApp *app;
-	gchar sort_key[] = { '\0', '\0', '\0', '\0' };
 	g_autoptr(GDateTime) date = NULL;
-	g_autofree gchar *key = NULL;
+	g_autoptr(GHashTable) sort_keys = NULL;
 	g_autoptr(GMutexLocker) locker = NULL;
 
 	g_return_if_fail (GS_IS_APP_LIST (list));
@@ -688,22 +1226,23 @@ gs_app_list_randomize (GsAppList *list)
 	/* mark this list as random */
 	list->flags |= GS_APP_LIST_FLAG_IS_RANDOMIZED;
 
-	key = g_strdup_printf ("Plugin::sort-key[%p]", list);
+	/* the sort keys are only needed while sorting, so keep them here
+	 * rather than in the metadata of each app */
+	sort_keys = g_hash_table_new (g_direct_hash, g_direct_equal);
 	rand = g_rand_new ();
 	date = g_date_time_new_now_utc ();
 	g_rand_set_seed (rand, (guint32) g_date_time_get_day_of_year (date));
 	for (i = 0; i < gs_app_list_length (list); i++) {
+		guint sort_key = 0;
 		app = gs_app_list_index (list, i);
-		sort_key[0] = (gchar) g_rand_int_range (rand, (gint32) 'A', (gint32) 'Z');
-		sort_key[1] = (gchar) g_rand_int_range (rand, (gint32) 'A', (gint32) 'Z');
-		sort_key[2] = (gchar) g_rand_int_range (rand, (gint32) 'A', (gint32) 'Z');
-		gs_app_set_metadata (app, key, sort_key);
-	}
-	g_ptr_array_sort_with_data (list->array, gs_app_list_randomize_cb, list);
-	for (i = 0; i < gs_app_list_length (list); i++) {
-		app = gs_app_list_index (list, i);
-		gs_app_set_metadata (app, key, NULL);
+		for (guint j = 0; j < 3; j++)
+			sort_key = (sort_key << 8) | (guint) g_rand_int_range (rand, (gint32) 'A', (gint32) 'Z');
+		if (!g_hash_table_contains (sort_keys, app))
+			g_hash_table_insert (sort_keys, app, GUINT_TO_POINTER (sort_key));
 	}
+	gs_app_list_make_writable (list);
+	g_ptr_array_sort_with_data (list->array, gs_app_list_randomize_cb, sort_keys);
+	gs_app_list_index_invalidate (list);
 	g_rand_free (rand);
 }
 
@@ -844,8 +1383,8 @@ gs_app_list_filter_duplicates (GsAppList *list, GsAppListFilterFlags flags)
 		continue;
 	}
 
-	/* deep copy to a temp list and clear the current one */
-	old = gs_app_list_copy (list);
+	/* copy to a temp list and clear the current one */
+	old = gs_app_list_copy_safe (list);
 	gs_app_list_remove_all_safe (list);
 
 	/* add back the apps we want to keep */
@@ -854,13 +1393,84 @@ gs_app_list_filter_duplicates (GsAppList *list, GsAppListFilterFlags flags)
 		if (g_hash_table_contains (kept_apps, app))
 			gs_app_list_add_safe (list, app, GS_APP_LIST_ADD_FLAG_NONE);
 	}
+
+	/* recalculate global state */
+	gs_app_list_invalidate_state (list);
+	gs_app_list_invalidate_progress (list);
+	g_clear_pointer (&locker, g_mutex_locker_free);
+	g_signal_emit (list, signals[SIGNAL_CHANGED], 0);
+}
+
+/**
+ * gs_app_list_filter_duplicates_incremental:
+ * @list: A #GsAppList
+ * @seen: (element-type utf8 utf8): keys of apps kept from earlier lists
+ * @flags: a #GsAppListFilterFlags, e.g. GS_APP_LIST_FILTER_KEY_ID
+ *
+ * Filter any duplicate applications from the list, and also any that have
+ * the same key as an application that was kept from an earlier list. The
+ * keys of the applications that are kept are added to @seen, which should
+ * be created with g_str_hash, g_str_equal and g_free for the key.
+ *
+ * Applications already kept from an earlier list are never replaced, even if
+ * a later duplicate would have been preferred by @flags.
+ **/
+void
+gs_app_list_filter_duplicates_incremental (GsAppList *list,
+					   GHashTable *seen,
+					   GsAppListFilterFlags flags)
+{
+	g_autoptr(GsAppList) old = NULL;
+
+	g_return_if_fail (GS_IS_APP_LIST (list));
+	g_return_if_fail (seen != NULL);
+
+	/* pick the best of the duplicates within this list first */
+	gs_app_list_filter_duplicates (list, flags);
+
+	old = gs_app_list_copy (list);
+	gs_app_list_remove_all (list);
+	for (guint i = 0; i < gs_app_list_length (old); i++) {
+		GsApp *app = gs_app_list_index (old, i);
+		gboolean found = FALSE;
+		g_autoptr(GPtrArray) keys = gs_app_list_filter_app_get_keys (app, flags);
+
+		for (guint j = 0; j < keys->len; j++) {
+			if (g_hash_table_contains (seen, g_ptr_array_index (keys, j))) {
+				found = TRUE;
+				break;
+			}
+		}
+		if (found)
+			continue;
+		for (guint j = 0; j < keys->len; j++)
+			g_hash_table_add (seen, g_strdup (g_ptr_array_index (keys, j)));
+		gs_app_list_add (list, app);
+	}
+}
+
+/* called with the mutex held; the new list shares the array until either
+ * of them is modified */
+static GsAppList *
+gs_app_list_copy_safe (GsAppList *list)
+{
+	GsAppList *new = gs_app_list_new ();
+
+	g_ptr_array_unref (new->array);
+	new->array = g_ptr_array_ref (list->array);
+	new->array_shared = TRUE;
+	new->size_peak = list->array->len;
+	list->array_shared = TRUE;
+	return new;
 }
 
 /**
  * gs_app_list_copy:
  * @list: A #GsAppList
  *
- * Returns a deep copy of the application list.
+ * Returns a copy of the application list. The applications are not copied,
+ * and the array of applications is only copied when either list is next
+ * modified.
  *
  * Returns: A newly allocated #GsAppList
  *
@@ -869,17 +1479,38 @@ gs_app_list_filter_duplicates (GsAppList *list, GsAppListFilterFlags flags)
 GsAppList *
 gs_app_list_copy (GsAppList *list)
 {
-	GsAppList *new;
-	guint i;
+	g_autoptr(GMutexLocker) locker = NULL;
 
 	g_return_val_if_fail (GS_IS_APP_LIST (list), NULL);
 
-	new = gs_app_list_new ();
-	for (i = 0; i < gs_app_list_length (list); i++) {
-		GsApp *app = gs_app_list_index (list, i);
-		gs_app_list_add_safe (new, app, GS_APP_LIST_ADD_FLAG_NONE);
-	}
-	return new;
+	locker = g_mutex_locker_new (&list->mutex);
+	return gs_app_list_copy_safe (list);
+}
+
+/**
+ * gs_app_list_snapshot:
+ * @list: A #GsAppList
+ *
+ * Gets the applications currently in the list, without copying them. The
+ * returned array is never modified, even if @list is, so it can be iterated
+ * without holding any lock while other threads add to or remove from @list.
+ *
+ * The array must not be modified by the caller.
+ *
+ * Returns: (transfer container) (element-type GsApp): the applications
+ *
+ * Since: 40
+ **/
+GPtrArray *
+gs_app_list_snapshot (GsAppList *list)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_val_if_fail (GS_IS_APP_LIST (list), NULL);
+
+	locker = g_mutex_locker_new (&list->mutex);
+	list->array_shared = TRUE;
+	return g_ptr_array_ref (list->array);
 }
 
 static void
@@ -913,7 +1544,11 @@ static void
 gs_app_list_finalize (GObject *object)
 {
 	GsAppList *list = GS_APP_LIST (object);
+	g_atomic_int_add (&gs_app_list_instance_count, -1);
+	gs_app_list_index_invalidate (list);
 	g_ptr_array_unref (list->array);
+	g_hash_table_unref (list->watched_roots);
+	g_hash_table_unref (list->watched);
 	g_mutex_clear (&list->mutex);
 	G_OBJECT_CLASS (gs_app_list_parent_class)->finalize (object);
 }
@@ -962,13 +1597,41 @@ gs_app_list_class_init (GsAppListClass *klass)
 			      G_TYPE_FROM_CLASS (object_class), G_SIGNAL_RUN_LAST,
 			      0, NULL, NULL, g_cclosure_marshal_generic,
 			      G_TYPE_NONE, 1, GS_TYPE_APP);
+
+	/**
+	 * GsAppList::changed:
+	 *
+	 * Emitted after applications may have been added to or removed from
+	 * the list. It may be emitted from any thread, without the list
+	 * locked.
+	 *
+	 * Since: 40
+	 */
+	signals [SIGNAL_CHANGED] =
+		g_signal_new ("changed",
+			      G_TYPE_FROM_CLASS (object_class), G_SIGNAL_RUN_LAST,
+			      0, NULL, NULL, g_cclosure_marshal_VOID__VOID,
+			      G_TYPE_NONE, 0);
 }
 
 static void
 gs_app_list_init (GsAppList *list)
 {
+	g_atomic_int_inc (&gs_app_list_instance_count);
 	g_mutex_init (&list->mutex);
 	list->array = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	list->watched = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+					       g_object_unref, g_free);
+	list->watched_roots = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+						     g_object_unref,
+						     (GDestroyNotify) gs_app_list_watch_root_free);
+}
+
+/* only used for profiling */
+guint
+gs_app_list_get_instance_count (void)
+{
+	return (guint) g_atomic_int_get (&gs_app_list_instance_count);
 }
 
 /**
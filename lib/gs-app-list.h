@@ -49,6 +49,9 @@ G_DECLARE_FINAL_TYPE (GsAppList, gs_app_list, GS, APP_LIST, GObject)
 typedef gboolean (*GsAppListSortFunc)		(GsApp		*app1,
 						 GsApp		*app2,
 						 gpointer	 user_data);
+typedef void (*GsAppListSortKeyFunc)		(GsApp		*app,
+						 GByteArray	*key,
+						 gpointer	 user_data);
 typedef gboolean (*GsAppListFilterFunc)		(GsApp		*app,
 						 gpointer	 user_data);
 
@@ -64,9 +67,13 @@ GsApp		*gs_app_list_index		(GsAppList	*list,
 GsApp		*gs_app_list_lookup		(GsAppList	*list,
 						 const gchar	*unique_id);
 guint		 gs_app_list_length		(GsAppList	*list);
+GPtrArray	*gs_app_list_snapshot		(GsAppList	*list);
 void		 gs_app_list_sort		(GsAppList	*list,
 						 GsAppListSortFunc func,
 						 gpointer	 user_data);
+void		 gs_app_list_sort_by_key	(GsAppList	*list,
+						 GsAppListSortKeyFunc func,
+						 gpointer	 user_data);
 void		 gs_app_list_filter		(GsAppList	*list,
 						 GsAppListFilterFunc func,
 						 gpointer	 user_data);
@@ -26,5 +26,16 @@ void		 gs_app_set_pending_action	(GsApp		*app,
 						 GsPluginAction	 action);
 gint		 gs_app_compare_priority	(GsApp		*app1,
 						 GsApp		*app2);
+gboolean	 gs_app_get_refined_flags	(GsApp		*app,
+						 guint		 generation,
+						 GsPluginRefineFlags *refine_flags);
+void		 gs_app_add_refined_flags	(GsApp		*app,
+						 guint		 generation,
+						 GsPluginRefineFlags refine_flags);
+guint		 gs_app_get_instance_count	(void);
+guint		 gs_app_get_id_serial		(void);
+const gchar	*gs_app_get_name_sort_key	(GsApp		*app);
+void		 gs_app_ensure_key_colors	(GsApp		*app,
+						 GCancellable	*cancellable);
 
 G_END_DECLS
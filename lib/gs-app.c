@@ -39,6 +39,7 @@
 #include <string.h>
 #include <gtk/gtk.h>
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 
 #include "gs-app-collation.h"
 #include "gs-app-private.h"
@@ -58,15 +59,16 @@ typedef struct
 	gchar			*id;
 	gchar			*unique_id;
 	gboolean		 unique_id_valid;
-	gchar			*branch;
+	const gchar		*branch;	/* interned */
 	gchar			*name;
+	gchar			*name_sort_key;	/* (nullable) (owned), cached from @name */
 	gchar			*renamed_from;
 	GsAppQuality		 name_quality;
 	GPtrArray		*icons;  /* (nullable) (owned) (element-type AsIcon), sorted by pixel size, smallest first */
 	GPtrArray		*sources;
 	GPtrArray		*source_ids;
-	gchar			*project_group;
-	gchar			*developer_name;
+	const gchar		*project_group;	/* interned */
+	const gchar		*developer_name;	/* interned */
 	gchar			*agreement;
 	gchar			*version;
 	gchar			*version_ui;
@@ -81,19 +83,19 @@ typedef struct
 	GHashTable		*urls;
 	GHashTable		*launchables;
 	gchar			*url_missing;
-	gchar			*license;
+	const gchar		*license;	/* interned */
 	GsAppQuality		 license_quality;
 	gchar			**menu_path;
-	gchar			*origin;
-	gchar			*origin_ui;
+	const gchar		*origin;	/* interned */
+	const gchar		*origin_ui;	/* interned */
 	gchar			*origin_appstream;
-	gchar			*origin_hostname;
+	const gchar		*origin_hostname;	/* interned */
 	gchar			*update_version;
 	gchar			*update_version_ui;
 	gchar			*update_details;
 	AsUrgencyKind		 update_urgency;
 	GsAppPermissions         update_permissions;
-	gchar			*management_plugin;
+	const gchar		*management_plugin;	/* interned */
 	guint			 match_value;
 	guint			 priority;
 	gint			 rating;
@@ -126,6 +128,8 @@ typedef struct
 	AsScreenshot		*action_screenshot;  /* (nullable) (owned) */
 	GCancellable		*cancellable;
 	GsPluginAction		 pending_action;
+	GsPluginRefineFlags	 refined_flags;
+	guint			 refined_generation;
 	GsAppPermissions         permissions;
 	gboolean		 is_update_downloaded;
 	GPtrArray		*version_history; /* (element-type AsRelease) */
@@ -158,6 +162,9 @@ static GParamSpec *obj_props[PROP_LAST] = { NULL, };
 
 G_DEFINE_TYPE_WITH_PRIVATE (GsApp, gs_app, G_TYPE_OBJECT)
 
+static gint gs_app_instance_count = 0;	/* atomic */
+static gint gs_app_id_serial = 0;	/* atomic, see gs_app_get_id_serial() */
+
 static gboolean
 _g_set_str (gchar **str_ptr, const gchar *new_str)
 {
@@ -168,6 +175,41 @@ _g_set_str (gchar **str_ptr, const gchar *new_str)
 	return TRUE;
 }
 
+/* for low-cardinality fields such as the origin or branch: thousands of
+ * apps share a few dozen values, so keep one copy for the whole process */
+static gboolean
+_g_set_interned_str (const gchar **str_ptr, const gchar *new_str)
+{
+	const gchar *interned = g_intern_string (new_str);
+	if (*str_ptr == interned)
+		return FALSE;
+	*str_ptr = interned;
+	return TRUE;
+}
+
+/* metadata keys: the same few are set on every app, so share one copy where
+ * GLib allows; unlike g_intern_string() this is freed once no app uses it, as
+ * plugins and AppStream files can also set keys that are only used once */
+static gchar *
+gs_app_metadata_key_new (const gchar *key)
+{
+#if GLIB_CHECK_VERSION(2, 58, 0)
+	return g_ref_string_new_intern (key);
+#else
+	return g_strdup (key);
+#endif
+}
+
+static void
+gs_app_metadata_key_free (gchar *key)
+{
+#if GLIB_CHECK_VERSION(2, 58, 0)
+	g_ref_string_release (key);
+#else
+	g_free (key);
+#endif
+}
+
 static gboolean
 _g_set_strv (gchar ***strv_ptr, gchar **new_strv)
 {
@@ -782,6 +824,8 @@ gs_app_set_id (GsApp *app, const gchar *id)
 	g_autoptr(GMutexLocker) locker = NULL;
 	g_return_if_fail (GS_IS_APP (app));
 	locker = g_mutex_locker_new (&priv->mutex);
+	if (priv->id != NULL && g_strcmp0 (priv->id, id) != 0)
+		g_atomic_int_inc (&gs_app_id_serial);
 	if (_g_set_str (&priv->id, id))
 		priv->unique_id_valid = FALSE;
 }
@@ -1381,6 +1425,8 @@ gs_app_set_unique_id (GsApp *app, const gchar *unique_id)
 	if (!as_utils_data_id_valid (unique_id))
 		g_warning ("unique_id %s not valid", unique_id);
 
+	if (priv->unique_id != NULL && g_strcmp0 (priv->unique_id, unique_id) != 0)
+		g_atomic_int_inc (&gs_app_id_serial);
 	g_free (priv->unique_id);
 	priv->unique_id = g_strdup (unique_id);
 	priv->unique_id_valid = TRUE;
@@ -1427,8 +1473,36 @@ gs_app_set_name (GsApp *app, GsAppQuality quality, const gchar *name)
 	if (quality < priv->name_quality)
 		return;
 	priv->name_quality = quality;
-	if (_g_set_str (&priv->name, name))
+	if (_g_set_str (&priv->name, name)) {
+		g_clear_pointer (&priv->name_sort_key, g_free);
 		g_object_notify_by_pspec (G_OBJECT (app), obj_props[PROP_NAME]);
+	}
+}
+
+/**
+ * gs_app_get_name_sort_key:
+ * @app: a #GsApp
+ *
+ * Gets the collation key for the application name, as returned by
+ * gs_utils_sort_key(). The key is computed the first time it is needed and
+ * then cached until the name changes, so that sorting large lists does not
+ * have to collate the same names over and over again.
+ *
+ * Keys can be compared using strcmp().
+ *
+ * Returns: a string, or %NULL if the name is unset
+ **/
+const gchar *
+gs_app_get_name_sort_key (GsApp *app)
+{
+	GsAppPrivate *priv = gs_app_get_instance_private (app);
+	g_autoptr(GMutexLocker) locker = NULL;
+	g_return_val_if_fail (GS_IS_APP (app), NULL);
+
+	locker = g_mutex_locker_new (&priv->mutex);
+	if (priv->name_sort_key == NULL && priv->name != NULL)
+		priv->name_sort_key = gs_utils_sort_key (priv->name);
+	return priv->name_sort_key;
 }
 
 /**
@@ -1503,7 +1577,7 @@ gs_app_set_branch (GsApp *app, const gchar *branch)
 	g_autoptr(GMutexLocker) locker = NULL;
 	g_return_if_fail (GS_IS_APP (app));
 	locker = g_mutex_locker_new (&priv->mutex);
-	if (_g_set_str (&priv->branch, branch))
+	if (_g_set_interned_str (&priv->branch, branch))
 		priv->unique_id_valid = FALSE;
 }
 
@@ -1755,7 +1829,7 @@ gs_app_set_project_group (GsApp *app, const gchar *project_group)
 	g_autoptr(GMutexLocker) locker = NULL;
 	g_return_if_fail (GS_IS_APP (app));
 	locker = g_mutex_locker_new (&priv->mutex);
-	_g_set_str (&priv->project_group, project_group);
+	_g_set_interned_str (&priv->project_group, project_group);
 }
 
 /**
@@ -1774,7 +1848,7 @@ gs_app_set_developer_name (GsApp *app, const gchar *developer_name)
 	g_autoptr(GMutexLocker) locker = NULL;
 	g_return_if_fail (GS_IS_APP (app));
 	locker = g_mutex_locker_new (&priv->mutex);
-	_g_set_str (&priv->developer_name, developer_name);
+	_g_set_interned_str (&priv->developer_name, developer_name);
 }
 
 /**
@@ -2645,7 +2719,7 @@ gs_app_set_license (GsApp *app, GsAppQuality quality, const gchar *license)
 
 	priv->license_is_free = as_license_is_free_license (license);
 
-	_g_set_str (&priv->license, license);
+	_g_set_interned_str (&priv->license, license);
 }
 
 /**
@@ -2823,8 +2897,7 @@ gs_app_set_origin (GsApp *app, const gchar *origin)
 		return;
 	}
 
-	g_free (priv->origin);
-	priv->origin = g_strdup (origin);
+	priv->origin = g_intern_string (origin);
 
 	/* no longer valid */
 	priv->unique_id_valid = FALSE;
@@ -2923,7 +2996,6 @@ gs_app_set_origin_hostname (GsApp *app, const gchar *origin_hostname)
 	/* same */
 	if (g_strcmp0 (origin_hostname, priv->origin_hostname) == 0)
 		return;
-	g_free (priv->origin_hostname);
 
 	/* use libsoup to convert a URL */
 	uri = soup_uri_new (origin_hostname);
@@ -2941,7 +3013,7 @@ gs_app_set_origin_hostname (GsApp *app, const gchar *origin_hostname)
 		origin_hostname = "localhost";
 
 	/* success */
-	priv->origin_hostname = g_strdup (origin_hostname);
+	priv->origin_hostname = g_intern_string (origin_hostname);
 }
 
 /**
@@ -3198,8 +3270,7 @@ gs_app_set_management_plugin (GsApp *app, const gchar *management_plugin)
 		return;
 	}
 
-	g_free (priv->management_plugin);
-	priv->management_plugin = g_strdup (management_plugin);
+	priv->management_plugin = g_intern_string (management_plugin);
 }
 
 /**
@@ -3636,7 +3707,7 @@ gs_app_set_metadata_variant (GsApp *app, const gchar *key, GVariant *value)
 		}
 		return;
 	}
-	g_hash_table_insert (priv->metadata, g_strdup (key), g_variant_ref (value));
+	g_hash_table_insert (priv->metadata, gs_app_metadata_key_new (key), g_variant_ref (value));
 }
 
 /**
@@ -4061,59 +4132,197 @@ gs_app_get_is_update_downloaded (GsApp *app)
 	return priv->is_update_downloaded;
 }
 
+/* Look for an override first. Parse and use it if possible. This is
+ * typically specified in the appdata for an app as:
+ * |[
+ * <component>
+ *   <custom>
+ *     <value key="GnomeSoftware::key-colors">[(124, 53, 77), (99, 16, 0)]</value>
+ *   </custom>
+ * </component>
+ * ]|
+ */
+static GArray *
+gs_app_get_key_colors_override (GsApp *app)
+{
+	const gchar *overrides_str;
+	GArray *key_colors;
+	g_autoptr(GVariant) overrides = NULL;
+	g_autoptr(GError) local_error = NULL;
+	GVariantIter iter;
+	guint8 red, green, blue;
+
+	overrides_str = gs_app_get_metadata_item (app, "GnomeSoftware::key-colors");
+	if (overrides_str == NULL)
+		return NULL;
+
+	overrides = g_variant_parse (G_VARIANT_TYPE ("a(yyy)"),
+				     overrides_str,
+				     NULL,
+				     NULL,
+				     &local_error);
+	if (overrides == NULL || g_variant_n_children (overrides) == 0) {
+		g_warning ("Invalid value for GnomeSoftware::key-colors for %s: %s",
+			   gs_app_get_id (app),
+			   local_error != NULL ? local_error->message : "no colors");
+		return NULL;
+	}
+
+	key_colors = g_array_new (FALSE, FALSE, sizeof (GdkRGBA));
+	g_variant_iter_init (&iter, overrides);
+	while (g_variant_iter_loop (&iter, "(yyy)", &red, &green, &blue)) {
+		GdkRGBA rgba;
+		rgba.red = (gdouble) red / 255.0;
+		rgba.green = (gdouble) green / 255.0;
+		rgba.blue = (gdouble) blue / 255.0;
+		rgba.alpha = 1.0;
+		g_array_append_val (key_colors, rgba);
+	}
+	return key_colors;
+}
+
+/* cached key colors are recalculated after this long, and anything older is
+ * deleted so entries for icons which are no longer used do not pile up */
+#define GS_APP_KEY_COLORS_CACHE_AGE_MAX		2592000 /* 30 days */
+
+static void
+gs_app_prune_key_colors_cache (const gchar *cache_fn)
+{
+	const gchar *name;
+	g_autofree gchar *dirname = g_path_get_dirname (cache_fn);
+	g_autoptr(GDir) dir = g_dir_open (dirname, 0, NULL);
+
+	if (dir == NULL)
+		return;
+	while ((name = g_dir_read_name (dir)) != NULL) {
+		g_autofree gchar *fn = g_build_filename (dirname, name, NULL);
+		g_autoptr(GFile) file = g_file_new_for_path (fn);
+
+		if (gs_utils_get_file_age (file) < GS_APP_KEY_COLORS_CACHE_AGE_MAX)
+			continue;
+		if (g_unlink (fn) != 0)
+			g_debug ("failed to prune key colors %s", fn);
+	}
+}
+
+/* The key colors of loadable icons are cached on disk, keyed by a hash of the
+ * icon data, so the k-means clustering only runs once per icon rather than on
+ * every launch. This does not need GTK, so can be called from any thread. */
+static GArray *
+gs_app_calculate_key_colors_for_loadable_icon (GLoadableIcon *icon,
+					       GCancellable *cancellable)
+{
+	GArray *key_colors;
+	g_autoptr(GInputStream) icon_stream = NULL;
+	g_autoptr(GOutputStream) data_stream = NULL;
+	g_autoptr(GInputStream) pixbuf_stream = NULL;
+	g_autoptr(GBytes) data = NULL;
+	g_autoptr(GdkPixbuf) pb_small = NULL;
+	g_autoptr(GVariant) cached = NULL;
+	g_autoptr(GVariantBuilder) builder = NULL;
+	g_autofree gchar *checksum = NULL;
+	g_autofree gchar *cache_fn = NULL;
+	g_autoptr(GError) error_local = NULL;
+
+	/* read the whole icon, it is only small */
+	icon_stream = g_loadable_icon_load (icon, 32, NULL, cancellable, NULL);
+	if (icon_stream == NULL)
+		return NULL;
+	data_stream = g_memory_output_stream_new_resizable ();
+	if (g_output_stream_splice (data_stream, icon_stream,
+				    G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+				    G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+				    cancellable, NULL) < 0)
+		return NULL;
+	data = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (data_stream));
+
+	/* already calculated */
+	checksum = g_compute_checksum_for_bytes (G_CHECKSUM_SHA256, data);
+	cache_fn = gs_utils_get_cache_filename ("key-colors", checksum,
+						GS_UTILS_CACHE_FLAG_WRITEABLE |
+						GS_UTILS_CACHE_FLAG_CREATE_DIRECTORY,
+						NULL);
+	if (cache_fn != NULL) {
+		g_autoptr(GFile) cache_file = g_file_new_for_path (cache_fn);
+		g_autoptr(GMappedFile) mapped = NULL;
+
+		if (gs_utils_get_file_age (cache_file) < GS_APP_KEY_COLORS_CACHE_AGE_MAX)
+			mapped = g_mapped_file_new (cache_fn, FALSE, NULL);
+		if (mapped != NULL) {
+			g_autoptr(GBytes) cached_data = g_mapped_file_get_bytes (mapped);
+			cached = g_variant_new_from_bytes (G_VARIANT_TYPE ("a(dddd)"),
+							   cached_data, FALSE);
+		}
+	}
+	if (cached != NULL && g_variant_n_children (cached) > 0) {
+		GVariantIter iter;
+		GdkRGBA rgba;
+
+		key_colors = g_array_sized_new (FALSE, FALSE, sizeof (GdkRGBA),
+						g_variant_n_children (cached));
+		g_variant_iter_init (&iter, cached);
+		while (g_variant_iter_next (&iter, "(dddd)",
+					    &rgba.red, &rgba.green,
+					    &rgba.blue, &rgba.alpha))
+			g_array_append_val (key_colors, rgba);
+		return key_colors;
+	}
+
+	/* get a list of key colors */
+	pixbuf_stream = g_memory_input_stream_new_from_bytes (data);
+	pb_small = gdk_pixbuf_new_from_stream_at_scale (pixbuf_stream, 32, 32, TRUE,
+							cancellable, NULL);
+	if (pb_small == NULL) {
+		g_debug ("pixbuf couldn’t be loaded, so no key colors");
+		return NULL;
+	}
+	key_colors = gs_calculate_key_colors (pb_small);
+
+	/* save for next time, dropping stale entries once per run */
+	if (cache_fn != NULL && key_colors->len > 0) {
+		static gsize pruned = 0;
+		g_autoptr(GVariant) value = NULL;
+
+		if (g_once_init_enter (&pruned)) {
+			gs_app_prune_key_colors_cache (cache_fn);
+			g_once_init_leave (&pruned, 1);
+		}
+		builder = g_variant_builder_new (G_VARIANT_TYPE ("a(dddd)"));
+		for (guint i = 0; i < key_colors->len; i++) {
+			GdkRGBA *rgba = &g_array_index (key_colors, GdkRGBA, i);
+			g_variant_builder_add (builder, "(dddd)",
+					       rgba->red, rgba->green,
+					       rgba->blue, rgba->alpha);
+		}
+		value = g_variant_ref_sink (g_variant_builder_end (builder));
+		if (!g_file_set_contents (cache_fn,
+					  g_variant_get_data (value),
+					  (gssize) g_variant_get_size (value),
+					  &error_local)) {
+			g_debug ("failed to save key colors: %s",
+				 error_local->message);
+		}
+	}
+	return key_colors;
+}
+
 static void
 calculate_key_colors (GsApp *app)
 {
 	GsAppPrivate *priv = gs_app_get_instance_private (app);
 	g_autoptr(GIcon) icon_small = NULL;
 	g_autoptr(GdkPixbuf) pb_small = NULL;
-	const gchar *overrides_str;
+	GArray *key_colors;
 
 	/* Lazily create the array */
 	if (priv->key_colors == NULL)
 		priv->key_colors = g_array_new (FALSE, FALSE, sizeof (GdkRGBA));
 
-	/* Look for an override first. Parse and use it if possible. This is
-	 * typically specified in the appdata for an app as:
-	 * |[
-	 * <component>
-	 *   <custom>
-	 *     <value key="GnomeSoftware::key-colors">[(124, 53, 77), (99, 16, 0)]</value>
-	 *   </custom>
-	 * </component>
-	 * ]|
-	 */
-	overrides_str = gs_app_get_metadata_item (app, "GnomeSoftware::key-colors");
-	if (overrides_str != NULL) {
-		g_autoptr(GVariant) overrides = NULL;
-		g_autoptr(GError) local_error = NULL;
-
-		overrides = g_variant_parse (G_VARIANT_TYPE ("a(yyy)"),
-					     overrides_str,
-					     NULL,
-					     NULL,
-					     &local_error);
-
-		if (overrides != NULL && g_variant_n_children (overrides) > 0) {
-			GVariantIter iter;
-			guint8 red, green, blue;
-
-			g_variant_iter_init (&iter, overrides);
-			while (g_variant_iter_loop (&iter, "(yyy)", &red, &green, &blue)) {
-				GdkRGBA rgba;
-				rgba.red = (gdouble) red / 255.0;
-				rgba.green = (gdouble) green / 255.0;
-				rgba.blue = (gdouble) blue / 255.0;
-				rgba.alpha = 1.0;
-				g_array_append_val (priv->key_colors, rgba);
-			}
-
-			return;
-		} else {
-			g_warning ("Invalid value for GnomeSoftware::key-colors for %s: %s",
-				   gs_app_get_id (app), local_error->message);
-			/* fall through */
-		}
+	key_colors = gs_app_get_key_colors_override (app);
+	if (key_colors != NULL) {
+		g_clear_pointer (&priv->key_colors, g_array_unref);
+		priv->key_colors = key_colors;
+		return;
 	}
 
 	/* Try and load the pixbuf. */
@@ -4123,8 +4332,12 @@ calculate_key_colors (GsApp *app)
 		g_debug ("no pixbuf, so no key colors");
 		return;
 	} else if (G_IS_LOADABLE_ICON (icon_small)) {
-		g_autoptr(GInputStream) icon_stream = g_loadable_icon_load (G_LOADABLE_ICON (icon_small), 32, NULL, NULL, NULL);
-		pb_small = gdk_pixbuf_new_from_stream_at_scale (icon_stream, 32, 32, TRUE, NULL, NULL);
+		key_colors = gs_app_calculate_key_colors_for_loadable_icon (G_LOADABLE_ICON (icon_small), NULL);
+		if (key_colors != NULL) {
+			g_clear_pointer (&priv->key_colors, g_array_unref);
+			priv->key_colors = key_colors;
+		}
+		return;
 	} else if (G_IS_THEMED_ICON (icon_small)) {
 		g_autoptr(GtkIconTheme) theme = NULL;
 		g_autoptr(GtkIconInfo) icon_info = NULL;
@@ -4168,6 +4381,54 @@ calculate_key_colors (GsApp *app)
 	priv->key_colors = gs_calculate_key_colors (pb_small);
 }
 
+/**
+ * gs_app_ensure_key_colors:
+ * @app: a #GsApp
+ * @cancellable: a #GCancellable, or %NULL
+ *
+ * Works out the key colors of the application icon, unless they are already
+ * known. This is safe to call from a worker thread, so that the UI does not
+ * have to decode icons or cluster colors when they are first shown.
+ *
+ * Themed icons need the GTK icon theme, so those are left for
+ * gs_app_get_key_colors() to do on the main thread.
+ **/
+void
+gs_app_ensure_key_colors (GsApp *app, GCancellable *cancellable)
+{
+	GsAppPrivate *priv = gs_app_get_instance_private (app);
+	g_autoptr(GArray) key_colors = NULL;
+	g_autoptr(GIcon) icon_small = NULL;
+
+	g_return_if_fail (GS_IS_APP (app));
+
+	g_mutex_lock (&priv->mutex);
+	if (priv->key_colors != NULL) {
+		g_mutex_unlock (&priv->mutex);
+		return;
+	}
+	g_mutex_unlock (&priv->mutex);
+
+	key_colors = gs_app_get_key_colors_override (app);
+	if (key_colors == NULL) {
+		icon_small = gs_app_get_icon_for_size (app, 32, 1, NULL);
+		if (icon_small == NULL || !G_IS_LOADABLE_ICON (icon_small))
+			return;
+		key_colors = gs_app_calculate_key_colors_for_loadable_icon (G_LOADABLE_ICON (icon_small),
+									    cancellable);
+		if (key_colors == NULL)
+			return;
+	}
+
+	/* the main thread may have got there first */
+	g_mutex_lock (&priv->mutex);
+	if (priv->key_colors == NULL) {
+		priv->key_colors = g_steal_pointer (&key_colors);
+		gs_app_queue_notify (app, obj_props[PROP_KEY_COLORS]);
+	}
+	g_mutex_unlock (&priv->mutex);
+}
+
 /**
  * gs_app_get_key_colors:
  * @app: a #GsApp
@@ -4619,6 +4880,55 @@ gs_app_set_pending_action (GsApp *app,
 	gs_app_set_pending_action_internal (app, action);
 }
 
+/**
+ * gs_app_get_refined_flags:
+ * @app: a #GsApp
+ * @generation: the current refine generation
+ * @refine_flags: (out): the #GsPluginRefineFlags already refined
+ *
+ * Gets the refine flags @app has already been refined with, as long as
+ * nothing invalidated them since.
+ *
+ * Returns: %TRUE if @app has been refined in @generation
+ **/
+gboolean
+gs_app_get_refined_flags (GsApp *app, guint generation, GsPluginRefineFlags *refine_flags)
+{
+	GsAppPrivate *priv = gs_app_get_instance_private (app);
+	g_autoptr(GMutexLocker) locker = NULL;
+	g_return_val_if_fail (GS_IS_APP (app), FALSE);
+	locker = g_mutex_locker_new (&priv->mutex);
+	if (priv->refined_generation != generation) {
+		*refine_flags = GS_PLUGIN_REFINE_FLAGS_DEFAULT;
+		return FALSE;
+	}
+	*refine_flags = priv->refined_flags;
+	return TRUE;
+}
+
+/**
+ * gs_app_add_refined_flags:
+ * @app: a #GsApp
+ * @generation: the refine generation at the start of the refine
+ * @refine_flags: a #GsPluginRefineFlags
+ *
+ * Records that @app has been refined with @refine_flags, forgetting any
+ * flags recorded for an older generation.
+ **/
+void
+gs_app_add_refined_flags (GsApp *app, guint generation, GsPluginRefineFlags refine_flags)
+{
+	GsAppPrivate *priv = gs_app_get_instance_private (app);
+	g_autoptr(GMutexLocker) locker = NULL;
+	g_return_if_fail (GS_IS_APP (app));
+	locker = g_mutex_locker_new (&priv->mutex);
+	if (priv->refined_generation != generation) {
+		priv->refined_generation = generation;
+		priv->refined_flags = 0;
+	}
+	priv->refined_flags |= refine_flags;
+}
+
 static void
 gs_app_get_property (GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
 {
@@ -4787,25 +5097,20 @@ gs_app_finalize (GObject *object)
 	GsApp *app = GS_APP (object);
 	GsAppPrivate *priv = gs_app_get_instance_private (app);
 
+	g_atomic_int_add (&gs_app_instance_count, -1);
 	g_mutex_clear (&priv->mutex);
 	g_free (priv->id);
 	g_free (priv->unique_id);
-	g_free (priv->branch);
 	g_free (priv->name);
+	g_free (priv->name_sort_key);
 	g_free (priv->renamed_from);
 	g_free (priv->url_missing);
 	g_hash_table_unref (priv->urls);
 	g_hash_table_unref (priv->launchables);
-	g_free (priv->license);
 	g_strfreev (priv->menu_path);
-	g_free (priv->origin);
-	g_free (priv->origin_ui);
 	g_free (priv->origin_appstream);
-	g_free (priv->origin_hostname);
 	g_ptr_array_unref (priv->sources);
 	g_ptr_array_unref (priv->source_ids);
-	g_free (priv->project_group);
-	g_free (priv->developer_name);
 	g_free (priv->agreement);
 	g_free (priv->version);
 	g_free (priv->version_ui);
@@ -4815,7 +5120,6 @@ gs_app_finalize (GObject *object)
 	g_free (priv->update_version);
 	g_free (priv->update_version_ui);
 	g_free (priv->update_details);
-	g_free (priv->management_plugin);
 	g_hash_table_unref (priv->metadata);
 	g_ptr_array_unref (priv->categories);
 	g_clear_pointer (&priv->key_colors, g_array_unref);
@@ -4996,6 +5300,7 @@ static void
 gs_app_init (GsApp *app)
 {
 	GsAppPrivate *priv = gs_app_get_instance_private (app);
+	g_atomic_int_inc (&gs_app_instance_count);
 	priv->rating = -1;
 	priv->sources = g_ptr_array_new_with_free_func (g_free);
 	priv->source_ids = g_ptr_array_new_with_free_func (g_free);
@@ -5008,7 +5313,7 @@ gs_app_init (GsApp *app)
 	priv->provided = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
 	priv->metadata = g_hash_table_new_full (g_str_hash,
 	                                        g_str_equal,
-	                                        g_free,
+	                                        (GDestroyNotify) gs_app_metadata_key_free,
 	                                        (GDestroyNotify) g_variant_unref);
 	priv->urls = g_hash_table_new_full (g_str_hash,
 	                                    g_str_equal,
@@ -5022,6 +5327,21 @@ gs_app_init (GsApp *app)
 	g_mutex_init (&priv->mutex);
 }
 
+/* only used for profiling */
+guint
+gs_app_get_instance_count (void)
+{
+	return (guint) g_atomic_int_get (&gs_app_instance_count);
+}
+
+/* changes whenever the ID of any app that already had one is changed, so
+ * that indexes keyed on the ID know they may be out of date */
+guint
+gs_app_get_id_serial (void)
+{
+	return (guint) g_atomic_int_get (&gs_app_id_serial);
+}
+
 /**
  * gs_app_new:
  * @id: an application ID, or %NULL, e.g. "org.gnome.Software.desktop"
@@ -5191,8 +5511,7 @@ gs_app_set_origin_ui (GsApp *app,
 	if (g_strcmp0 (priv->origin_ui, origin_ui) == 0)
 		return;
 
-	g_free (priv->origin_ui);
-	priv->origin_ui = g_strdup (origin_ui);
+	priv->origin_ui = g_intern_string (origin_ui);
 }
 
 /**
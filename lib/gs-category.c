@@ -161,6 +161,28 @@ gs_category_increment_size (GsCategory *category)
 	g_object_notify_by_pspec (G_OBJECT (category), obj_props[PROP_SIZE]);
 }
 
+/**
+ * gs_category_add_size:
+ * @category: a #GsCategory
+ * @size: the number of applications to add
+ *
+ * Adds @size to the size count, which is cheaper than calling
+ * gs_category_increment_size() @size times.
+ *
+ * Since: 40
+ **/
+void
+gs_category_add_size (GsCategory *category, guint size)
+{
+	g_return_if_fail (GS_IS_CATEGORY (category));
+
+	if (size == 0)
+		return;
+
+	category->size += size;
+	g_object_notify_by_pspec (G_OBJECT (category), obj_props[PROP_SIZE]);
+}
+
 /**
  * gs_category_get_id:
  * @category: a #GsCategory
@@ -40,5 +40,7 @@ GPtrArray	*gs_category_get_children	(GsCategory	*category);
 
 guint		 gs_category_get_size		(GsCategory	*category);
 void		 gs_category_increment_size	(GsCategory	*category);
+void		 gs_category_add_size		(GsCategory	*category,
+						 guint		 size);
 
 G_END_DECLS
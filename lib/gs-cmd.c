@@ -117,8 +117,7 @@ gs_cmd_refine_flag_from_string (const gchar *flag, GError **error)
 	if (g_strcmp0 (flag, "review-ratings") == 0)
 		return GS_PLUGIN_REFINE_FLAGS_REQUIRE_REVIEW_RATINGS;
 	if (g_strcmp0 (flag, "key-colors") == 0)
-		/* no longer supported by itself; derived automatically from the icon */
-		return GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON;
+		return GS_PLUGIN_REFINE_FLAGS_REQUIRE_KEY_COLORS;
 	if (g_strcmp0 (flag, "icon") == 0)
 		return GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON;
 	if (g_strcmp0 (flag, "permissions") == 0)
@@ -270,6 +269,59 @@ gs_cmd_action_exec (GsCmdSelf *self, GsPluginAction action, const gchar *name, G
 					    NULL, error);
 }
 
+/* ask the running instance, as the stats of this process are not interesting */
+static GVariant *
+gs_cmd_get_stats (GsCmdSelf *self)
+{
+	g_autoptr(GDBusConnection) connection = NULL;
+	g_autoptr(GVariant) reply = NULL;
+	g_autoptr(GError) error_local = NULL;
+
+	connection = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, &error_local);
+	if (connection != NULL) {
+		reply = g_dbus_connection_call_sync (connection,
+						     "org.gnome.Software",
+						     "/org/gnome/Software",
+						     "org.gnome.Software.Stats",
+						     "GetPluginStats",
+						     NULL,
+						     G_VARIANT_TYPE ("(a(ssuuuuuu))"),
+						     G_DBUS_CALL_FLAGS_NO_AUTO_START,
+						     -1,
+						     NULL,
+						     &error_local);
+	}
+	if (reply != NULL)
+		return g_variant_get_child_value (reply, 0);
+	g_print ("Using local stats as gnome-software is not running: %s\n",
+		 error_local->message);
+	return gs_plugin_loader_get_stats (self->plugin_loader);
+}
+
+static void
+gs_cmd_show_stats (GVariant *stats)
+{
+	GVariantIter iter;
+	const gchar *plugin_name;
+	const gchar *action;
+	guint32 calls, errors, cancellations, p50, p95, p99;
+
+	g_print ("%-20s %-24s %7s %7s %7s %10s %10s %10s\n",
+		 "plugin", "action", "calls", "errors", "cancel",
+		 "p50/ms", "p95/ms", "p99/ms");
+	g_variant_iter_init (&iter, stats);
+	while (g_variant_iter_next (&iter, "(&s&suuuuuu)",
+				    &plugin_name, &action,
+				    &calls, &errors, &cancellations,
+				    &p50, &p95, &p99)) {
+		g_print ("%-20s %-24s %7u %7u %7u %10.1f %10.1f %10.1f\n",
+			 plugin_name, action, calls, errors, cancellations,
+			 (gdouble) p50 / 1000.f,
+			 (gdouble) p95 / 1000.f,
+			 (gdouble) p99 / 1000.f);
+	}
+}
+
 static void
 gs_cmd_self_free (GsCmdSelf *self)
 {
@@ -682,6 +734,10 @@ main (int argc, char **argv)
 			g_print ("%s\n", user_hash);
 			ret = TRUE;
 		}
+	} else if (argc == 2 && g_strcmp0 (argv[1], "stats") == 0) {
+		g_autoptr(GVariant) stats = gs_cmd_get_stats (self);
+		gs_cmd_show_stats (stats);
+		ret = TRUE;
 	} else {
 		ret = FALSE;
 		g_set_error_literal (&error,
@@ -691,7 +747,7 @@ main (int argc, char **argv)
 				     "'updates', 'popular', 'get-categories', "
 				     "'get-category-apps', 'get-alternates', 'filename-to-app', "
 				     "'action install', 'action remove', "
-				     "'sources', 'refresh', 'launch' or 'search'");
+				     "'sources', 'refresh', 'launch', 'stats' or 'search'");
 	}
 	if (!ret) {
 		g_print ("Failed: %s\n", error->message);
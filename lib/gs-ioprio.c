@@ -142,6 +142,14 @@ gs_ioprio_init (void)
 	}
 }
 
+void
+gs_ioprio_reset (void)
+{
+	/* go back to the priority derived from the CPU nice value */
+	if (ioprio_set (IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_NONE << IOPRIO_CLASS_SHIFT) == -1)
+		g_message ("Could not reset IO priority");
+}
+
 #else  /* __linux__ */
 
 void
@@ -149,4 +157,9 @@ gs_ioprio_init (void)
 {
 }
 
+void
+gs_ioprio_reset (void)
+{
+}
+
 #endif /* __linux__ */
@@ -27,5 +27,6 @@
 G_BEGIN_DECLS
 
 void gs_ioprio_init (void);
+void gs_ioprio_reset (void);
 
 G_END_DECLS
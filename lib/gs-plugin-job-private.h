@@ -29,6 +29,7 @@ guint			 gs_plugin_job_get_max_results		(GsPluginJob	*self);
 guint			 gs_plugin_job_get_timeout		(GsPluginJob	*self);
 guint64			 gs_plugin_job_get_age			(GsPluginJob	*self);
 GsAppListSortFunc	 gs_plugin_job_get_sort_func		(GsPluginJob	*self);
+GsAppListSortKeyFunc	 gs_plugin_job_get_sort_key_func	(GsPluginJob	*self);
 gpointer		 gs_plugin_job_get_sort_func_data	(GsPluginJob	*self);
 const gchar		*gs_plugin_job_get_search		(GsPluginJob	*self);
 GsApp			*gs_plugin_job_get_app			(GsPluginJob	*self);
@@ -38,6 +39,7 @@ GsPlugin		*gs_plugin_job_get_plugin		(GsPluginJob	*self);
 GsCategory		*gs_plugin_job_get_category		(GsPluginJob	*self);
 AsReview		*gs_plugin_job_get_review		(GsPluginJob	*self);
 gchar			*gs_plugin_job_to_string		(GsPluginJob	*self);
+gchar			*gs_plugin_job_to_key			(GsPluginJob	*self);
 void			 gs_plugin_job_set_action		(GsPluginJob	*self,
 								 GsPluginAction	 action);
 
@@ -28,6 +28,7 @@ struct _GsPluginJob
 	GsPlugin		*plugin;
 	GsPluginAction		 action;
 	GsAppListSortFunc	 sort_func;
+	GsAppListSortKeyFunc	 sort_key_func;
 	gpointer		 sort_func_data;
 	gchar			*search;
 	GsApp			*app;
@@ -135,6 +136,72 @@ gs_plugin_job_to_string (GsPluginJob *self)
 	return g_string_free (str, FALSE);
 }
 
+/* used to find identical jobs; unlike gs_plugin_job_to_string() this
+ * includes everything that can affect the result, and nothing that changes
+ * over the lifetime of the job; objects are identified by their IDs rather
+ * than by address, as an address can be reused once the object is freed, so
+ * %NULL is returned if any of them has no ID */
+gchar *
+gs_plugin_job_to_key (GsPluginJob *self)
+{
+	g_autoptr(GString) str = g_string_new (NULL);
+
+	/* the sort data is opaque, so could be anything */
+	if (self->sort_func_data != NULL)
+		return NULL;
+
+	g_string_append_printf (str, "%s;%s;%" G_GUINT64_FORMAT ";%" G_GUINT64_FORMAT ";%" G_GUINT64_FORMAT ";%i;%u;%u;%" G_GUINT64_FORMAT,
+				gs_plugin_action_to_string (self->action),
+				self->plugin != NULL ? gs_plugin_get_name (self->plugin) : "",
+				(guint64) self->refine_flags,
+				(guint64) self->filter_flags,
+				(guint64) self->dedupe_flags,
+				self->interactive,
+				self->max_results,
+				self->timeout,
+				self->age);
+
+	/* functions are never freed while the loader is running */
+	g_string_append_printf (str, ";%p;%p", (gpointer) self->sort_func,
+				(gpointer) self->sort_key_func);
+	g_string_append_printf (str, ";%s", self->search != NULL ? self->search : "");
+	if (self->app != NULL) {
+		if (gs_app_get_unique_id (self->app) == NULL)
+			return NULL;
+		g_string_append_printf (str, ";%s", gs_app_get_unique_id (self->app));
+	} else {
+		g_string_append (str, ";");
+	}
+	g_string_append (str, ";");
+	for (GsCategory *category = self->category;
+	     category != NULL;
+	     category = gs_category_get_parent (category)) {
+		if (gs_category_get_id (category) == NULL)
+			return NULL;
+		g_string_append_printf (str, "/%s", gs_category_get_id (category));
+	}
+	if (self->review != NULL) {
+		if (as_review_get_id (self->review) == NULL)
+			return NULL;
+		g_string_append_printf (str, ";%s", as_review_get_id (self->review));
+	} else {
+		g_string_append (str, ";");
+	}
+	if (self->file != NULL) {
+		g_autofree gchar *uri = g_file_get_uri (self->file);
+		g_string_append_printf (str, ";%s", uri);
+	} else {
+		g_string_append (str, ";");
+	}
+	for (guint i = 0; self->list != NULL && i < gs_app_list_length (self->list); i++) {
+		GsApp *app = gs_app_list_index (self->list, i);
+		if (gs_app_get_unique_id (app) == NULL)
+			return NULL;
+		g_string_append_printf (str, ";%s", gs_app_get_unique_id (app));
+	}
+	return g_string_free (g_steal_pointer (&str), FALSE);
+}
+
 void
 gs_plugin_job_set_refine_flags (GsPluginJob *self, GsPluginRefineFlags refine_flags)
 {
@@ -282,6 +349,20 @@ gs_plugin_job_get_sort_func (GsPluginJob *self)
 	return self->sort_func;
 }
 
+void
+gs_plugin_job_set_sort_key_func (GsPluginJob *self, GsAppListSortKeyFunc sort_key_func)
+{
+	g_return_if_fail (GS_IS_PLUGIN_JOB (self));
+	self->sort_key_func = sort_key_func;
+}
+
+GsAppListSortKeyFunc
+gs_plugin_job_get_sort_key_func (GsPluginJob *self)
+{
+	g_return_val_if_fail (GS_IS_PLUGIN_JOB (self), NULL);
+	return self->sort_key_func;
+}
+
 void
 gs_plugin_job_set_sort_func_data (GsPluginJob *self, gpointer sort_func_data)
 {
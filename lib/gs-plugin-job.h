@@ -36,6 +36,8 @@ void		 gs_plugin_job_set_age			(GsPluginJob	*self,
 							 guint64	 age);
 void		 gs_plugin_job_set_sort_func		(GsPluginJob	*self,
 							 GsAppListSortFunc sort_func);
+void		 gs_plugin_job_set_sort_key_func	(GsPluginJob	*self,
+							 GsAppListSortKeyFunc sort_key_func);
 void		 gs_plugin_job_set_sort_func_data	(GsPluginJob	*self,
 							 gpointer	 sort_func_data);
 void		 gs_plugin_job_set_search		(GsPluginJob	*self,
@@ -13,6 +13,7 @@
 #include <glib/gi18n.h>
 #include <appstream.h>
 #include <math.h>
+#include <string.h>
 
 #ifdef HAVE_SYSPROF
 #include <sysprof-capture.h>
@@ -33,6 +34,37 @@
 
 #define GS_PLUGIN_LOADER_UPDATES_CHANGED_DELAY	3	/* s */
 #define GS_PLUGIN_LOADER_RELOAD_DELAY		5	/* s */
+#define GS_PLUGIN_LOADER_PLUGIN_THREADS_MAX	16
+#define GS_PLUGIN_LOADER_FOREGROUND_JOBS_MAX	20
+#define GS_PLUGIN_LOADER_BACKGROUND_JOBS_MAX	6
+#define GS_PLUGIN_LOADER_LANE_AGING_TIME	5	/* s */
+#define GS_PLUGIN_LOADER_STATS_SAMPLES		256	/* per plugin and action */
+#define GS_PLUGIN_LOADER_SYSPROF_INTERVAL	100	/* ms */
+#define GS_PLUGIN_LOADER_THAW_SLICE		5	/* ms per main loop iteration */
+#define GS_PLUGIN_LOADER_BREAKER_STRIKES	3	/* over-budget calls in a row */
+#define GS_PLUGIN_LOADER_BREAKER_BACKOFF_MIN	30	/* s */
+#define GS_PLUGIN_LOADER_BREAKER_BACKOFF_MAX	600	/* s */
+
+/* the scheduler lane a job is queued in */
+typedef enum {
+	GS_PLUGIN_LOADER_LANE_INTERACTIVE,	/* jobs the user explicitly asked for */
+	GS_PLUGIN_LOADER_LANE_FOREGROUND,	/* queries used to populate the UI */
+	GS_PLUGIN_LOADER_LANE_BACKGROUND,	/* refreshes, downloads and updates */
+	GS_PLUGIN_LOADER_LANE_LAST
+} GsPluginLoaderLane;
+
+/* per-lane limits on the number of running jobs; interactive jobs are never
+ * held back by the other lanes, and the thread pool grows as required so
+ * that a full lane can never block another */
+static const guint gs_plugin_loader_lane_max[GS_PLUGIN_LOADER_LANE_LAST] = {
+	G_MAXUINT,
+	GS_PLUGIN_LOADER_FOREGROUND_JOBS_MAX,
+	GS_PLUGIN_LOADER_BACKGROUND_JOBS_MAX,
+};
+
+/* set while a thread is running a job, so that jobs started from inside
+ * another job are never queued behind it */
+static GPrivate gs_plugin_loader_job_thread;
 
 struct _GsPluginLoader
 {
@@ -51,7 +83,17 @@ struct _GsPluginLoader
 	GMutex			 pending_apps_mutex;
 	GPtrArray		*pending_apps;
 
-	GThreadPool		*queued_ops_pool;
+	GMutex			 scheduler_mutex;
+	GThreadPool		*jobs_pool;
+	GQueue			 scheduler_queue[GS_PLUGIN_LOADER_LANE_LAST];
+	guint			 scheduler_running[GS_PLUGIN_LOADER_LANE_LAST];
+	guint			 scheduler_running_total;
+	guint			 scheduler_ops_running;
+	guint			 scheduler_ops_max;
+	GThreadPool		*plugins_pool;
+
+	GRecMutex		 inflight_mutex;
+	GHashTable		*inflight_jobs;		/* key : GsPluginLoaderInflight */
 
 	GSettings		*settings;
 
@@ -73,11 +115,48 @@ struct _GsPluginLoader
 
 	GsCategoryManager	*category_manager;
 
+	GMutex			 stats_mutex;
+	GHashTable		*stats;			/* "plugin:action" : GsPluginLoaderStats */
+
+	GMutex			 thaw_mutex;
+	GQueue			 thaw_queue;		/* (element-type GsApp) (owned) */
+	guint			 thaw_id;
+
+	GMutex			 breakers_mutex;
+	GHashTable		*breakers;		/* plugin-name : GsPluginLoaderBreaker */
+
+	GMainContext		*setup_context;		/* (owned) (nullable) */
+	GMutex			 setup_sources_mutex;
+	GPtrArray		*setup_sources;		/* (element-type GSource) (nullable) */
+
 #ifdef HAVE_SYSPROF
 	SysprofCaptureWriter	*sysprof_writer;  /* (owned) (nullable) */
+	GThread			*sysprof_sampler;  /* (owned) (nullable) */
+	GMutex			 sysprof_sampler_mutex;
+	GCond			 sysprof_sampler_cond;
+	gboolean		 sysprof_sampler_stop;
 #endif
 };
 
+/* rolling latency samples for one plugin doing one action */
+typedef struct {
+	gchar			*plugin_name;
+	GsPluginAction		 action;
+	guint			 calls;
+	guint			 errors;
+	guint			 cancellations;
+	guint			 samples_len;
+	guint			 samples_idx;
+	guint32			 samples[GS_PLUGIN_LOADER_STATS_SAMPLES];	/* µs */
+} GsPluginLoaderStats;
+
+/* skips a plugin that keeps going over its share of the job deadline */
+typedef struct {
+	guint			 strikes;
+	guint			 backoff;	/* s */
+	gint64			 open_until;	/* monotonic µs */
+} GsPluginLoaderBreaker;
+
 static void gs_plugin_loader_monitor_network (GsPluginLoader *plugin_loader);
 static void add_app_to_install_queue (GsPluginLoader *plugin_loader, GsApp *app);
 static void gs_plugin_loader_process_in_thread_pool_cb (gpointer data, gpointer user_data);
@@ -201,7 +280,17 @@ typedef struct {
 	gboolean			 anything_ran;
 	guint				 timeout_id;
 	gboolean			 timeout_triggered;
+	gint64				 deadline;	/* monotonic µs, or 0 */
+	gint64				 deadline_reserve;	/* µs */
+	gboolean			 partial;	/* atomic */
+	gboolean			 plugin_failed;	/* atomic */
 	gchar				**tokens;
+	GsPluginLoaderBatchFunc		 batch_func;
+	gpointer			 batch_data;
+	GMainContext			*batch_context;
+	GHashTable			*batch_apps;	/* (element-type GsApp) */
+	GHashTable			*batch_keys;	/* (element-type utf8) */
+	guint				 batch_cnt;
 } GsPluginLoaderHelper;
 
 static GsPluginLoaderHelper *
@@ -277,6 +366,12 @@ gs_plugin_loader_helper_free (GsPluginLoaderHelper *helper)
 		g_object_unref (helper->cancellable_caller);
 	if (helper->catlist != NULL)
 		g_ptr_array_unref (helper->catlist);
+	if (helper->batch_context != NULL)
+		g_main_context_unref (helper->batch_context);
+	if (helper->batch_apps != NULL)
+		g_hash_table_unref (helper->batch_apps);
+	if (helper->batch_keys != NULL)
+		g_hash_table_unref (helper->batch_keys);
 	g_strfreev (helper->tokens);
 	g_slice_free (GsPluginLoaderHelper, helper);
 }
@@ -290,10 +385,237 @@ gs_plugin_loader_job_debug (GsPluginLoaderHelper *helper)
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(GsPluginLoaderHelper, gs_plugin_loader_helper_free)
 
-static gint
-gs_plugin_loader_app_sort_name_cb (GsApp *app1, GsApp *app2, gpointer user_data)
+/* a job shared by all the callers that asked for the same thing while it
+ * was running; the helper is not attached to any of their tasks so that one
+ * caller cancelling does not affect the others */
+typedef struct {
+	GsPluginLoader		*plugin_loader;	/* (not owned) */
+	gchar			*key;
+	GsPluginLoaderHelper	*helper;
+	GCancellable		*cancellable;
+	GPtrArray		*waiters;	/* of GsPluginLoaderWaiter */
+} GsPluginLoaderInflight;
+
+typedef struct {
+	GsPluginLoaderInflight	*inflight;	/* (not owned) */
+	GTask			*task;
+	GCancellable		*cancellable;
+	gulong			 cancelled_id;
+	gboolean		 returned;
+} GsPluginLoaderWaiter;
+
+static void
+gs_plugin_loader_waiter_free (GsPluginLoaderWaiter *waiter)
+{
+	g_object_unref (waiter->task);
+	g_clear_object (&waiter->cancellable);
+	g_slice_free (GsPluginLoaderWaiter, waiter);
+}
+
+static void
+gs_plugin_loader_inflight_free (GsPluginLoaderInflight *inflight)
+{
+	g_free (inflight->key);
+	g_object_unref (inflight->cancellable);
+	if (inflight->helper != NULL)
+		gs_plugin_loader_helper_free (inflight->helper);
+	g_ptr_array_unref (inflight->waiters);
+	g_slice_free (GsPluginLoaderInflight, inflight);
+}
+
+/* a job waiting in, or dispatched from, one of the scheduler lanes */
+typedef struct {
+	GsPluginLoaderHelper	*helper;	/* (not owned) */
+	GTask			*task;		/* (nullable) */
+	GsPluginLoaderInflight	*inflight;	/* (nullable) */
+	GsPluginLoaderLane	 lane;
+	gboolean		 is_op;
+	gint64			 queued;	/* monotonic, us */
+} GsPluginLoaderQueuedJob;
+
+static void gs_plugin_loader_scheduler_run_locked (GsPluginLoader *plugin_loader,
+						   GsPluginLoaderQueuedJob *job);
+
+static void
+gs_plugin_loader_queued_job_free (GsPluginLoaderQueuedJob *job)
+{
+	if (job->task != NULL)
+		g_object_unref (job->task);
+	if (job->inflight != NULL)
+		gs_plugin_loader_inflight_free (job->inflight);
+	g_slice_free (GsPluginLoaderQueuedJob, job);
+}
+
+static void
+gs_plugin_loader_waiter_cancelled_cb (GCancellable *cancellable,
+				      GsPluginLoaderWaiter *waiter)
+{
+	GsPluginLoaderInflight *inflight = waiter->inflight;
+	GsPluginLoader *plugin_loader = inflight->plugin_loader;
+	gboolean all_cancelled = TRUE;
+	g_autoptr(GError) error = NULL;
+
+	g_rec_mutex_lock (&plugin_loader->inflight_mutex);
+	if (waiter->returned) {
+		g_rec_mutex_unlock (&plugin_loader->inflight_mutex);
+		return;
+	}
+	waiter->returned = TRUE;
+	for (guint i = 0; i < inflight->waiters->len; i++) {
+		GsPluginLoaderWaiter *waiter_tmp = g_ptr_array_index (inflight->waiters, i);
+		if (!waiter_tmp->returned) {
+			all_cancelled = FALSE;
+			break;
+		}
+	}
+
+	/* nobody wants the results now, so don't let anyone else join */
+	if (all_cancelled &&
+	    g_hash_table_lookup (plugin_loader->inflight_jobs, inflight->key) == inflight)
+		g_hash_table_remove (plugin_loader->inflight_jobs, inflight->key);
+	g_rec_mutex_unlock (&plugin_loader->inflight_mutex);
+
+	/* only this caller gets the error, the job keeps running for the rest */
+	g_cancellable_set_error_if_cancelled (cancellable, &error);
+	g_task_return_error (waiter->task, g_steal_pointer (&error));
+	if (all_cancelled) {
+		g_debug ("all callers cancelled %s", inflight->key);
+		g_cancellable_cancel (inflight->cancellable);
+	}
+}
+
+/* returns TRUE if @task was attached to an identical job that is already
+ * running, otherwise @task is the first waiter of a new job that the caller
+ * has to set up and schedule */
+static gboolean
+gs_plugin_loader_inflight_join (GsPluginLoader *plugin_loader,
+				const gchar *key,
+				GTask *task,
+				GCancellable *cancellable,
+				GsPluginLoaderInflight **inflight_out)
+{
+	GsPluginLoaderInflight *inflight;
+	GsPluginLoaderWaiter *waiter;
+	gboolean joined;
+
+	g_rec_mutex_lock (&plugin_loader->inflight_mutex);
+	inflight = g_hash_table_lookup (plugin_loader->inflight_jobs, key);
+	joined = inflight != NULL;
+	if (inflight == NULL) {
+		inflight = g_slice_new0 (GsPluginLoaderInflight);
+		inflight->plugin_loader = plugin_loader;
+		inflight->key = g_strdup (key);
+		inflight->cancellable = g_cancellable_new ();
+		inflight->waiters = g_ptr_array_new_with_free_func ((GDestroyNotify) gs_plugin_loader_waiter_free);
+		g_hash_table_insert (plugin_loader->inflight_jobs, inflight->key, inflight);
+	} else {
+		g_debug ("joining in-flight job %s", key);
+	}
+	waiter = g_slice_new0 (GsPluginLoaderWaiter);
+	waiter->inflight = inflight;
+	waiter->task = g_object_ref (task);
+	g_ptr_array_add (inflight->waiters, waiter);
+
+	/* this calls the handler right away if already cancelled, which is
+	 * why the mutex is recursive */
+	if (cancellable != NULL) {
+		waiter->cancellable = g_object_ref (cancellable);
+		waiter->cancelled_id =
+			g_cancellable_connect (cancellable,
+					       G_CALLBACK (gs_plugin_loader_waiter_cancelled_cb),
+					       waiter, NULL);
+	}
+	g_rec_mutex_unlock (&plugin_loader->inflight_mutex);
+
+	*inflight_out = inflight;
+	return joined;
+}
+
+static void
+gs_plugin_loader_inflight_complete (GsPluginLoaderInflight *inflight,
+				    GsAppList *list,
+				    const GError *error)
+{
+	GsPluginLoader *plugin_loader = inflight->plugin_loader;
+	g_autoptr(GPtrArray) waiters = g_ptr_array_new ();
+
+	g_rec_mutex_lock (&plugin_loader->inflight_mutex);
+	if (g_hash_table_lookup (plugin_loader->inflight_jobs, inflight->key) == inflight)
+		g_hash_table_remove (plugin_loader->inflight_jobs, inflight->key);
+	for (guint i = 0; i < inflight->waiters->len; i++) {
+		GsPluginLoaderWaiter *waiter = g_ptr_array_index (inflight->waiters, i);
+		if (waiter->returned)
+			continue;
+		waiter->returned = TRUE;
+		g_ptr_array_add (waiters, waiter);
+	}
+	g_rec_mutex_unlock (&plugin_loader->inflight_mutex);
+
+	/* this also waits for any handler running in another thread */
+	for (guint i = 0; i < inflight->waiters->len; i++) {
+		GsPluginLoaderWaiter *waiter = g_ptr_array_index (inflight->waiters, i);
+		if (waiter->cancelled_id != 0) {
+			g_cancellable_disconnect (waiter->cancellable, waiter->cancelled_id);
+			waiter->cancelled_id = 0;
+		}
+	}
+
+	if (waiters->len > 1)
+		g_debug ("sharing %s with %u callers", inflight->key, waiters->len);
+	for (guint i = 0; i < waiters->len; i++) {
+		GsPluginLoaderWaiter *waiter = g_ptr_array_index (waiters, i);
+		GsAppList *list_copy;
+
+		if (list == NULL) {
+			g_task_return_error (waiter->task, g_error_copy (error));
+			continue;
+		}
+
+		/* each caller is free to modify its own list */
+		list_copy = gs_app_list_copy (list);
+		if (gs_app_list_has_flag (list, GS_APP_LIST_FLAG_IS_TRUNCATED))
+			gs_app_list_add_flag (list_copy, GS_APP_LIST_FLAG_IS_TRUNCATED);
+		if (gs_app_list_has_flag (list, GS_APP_LIST_FLAG_IS_RANDOMIZED))
+			gs_app_list_add_flag (list_copy, GS_APP_LIST_FLAG_IS_RANDOMIZED);
+		if (gs_app_list_has_flag (list, GS_APP_LIST_FLAG_IS_PARTIAL))
+			gs_app_list_add_flag (list_copy, GS_APP_LIST_FLAG_IS_PARTIAL);
+		g_task_return_pointer (waiter->task, list_copy, (GDestroyNotify) g_object_unref);
+	}
+}
+
+static void
+gs_plugin_loader_app_sort_name_key_cb (GsApp *app, GByteArray *key, gpointer user_data)
+{
+	const gchar *sort_key = gs_app_get_name_sort_key (app);
+	if (sort_key != NULL)
+		g_byte_array_append (key, (const guint8 *) sort_key, strlen (sort_key));
+}
+
+static gboolean
+gs_plugin_loader_job_has_sort (GsPluginJob *plugin_job)
+{
+	return gs_plugin_job_get_sort_func (plugin_job) != NULL ||
+	       gs_plugin_job_get_sort_key_func (plugin_job) != NULL;
+}
+
+/* returns FALSE if the job has no sort order */
+static gboolean
+gs_plugin_loader_job_sort (GsPluginJob *plugin_job, GsAppList *list)
 {
-	return gs_utils_sort_strcmp (gs_app_get_name (app1), gs_app_get_name (app2));
+	GsAppListSortKeyFunc sort_key_func = gs_plugin_job_get_sort_key_func (plugin_job);
+	GsAppListSortFunc sort_func = gs_plugin_job_get_sort_func (plugin_job);
+	gpointer sort_func_data = gs_plugin_job_get_sort_func_data (plugin_job);
+
+	/* prefer the key, as it is only computed once per app */
+	if (sort_key_func != NULL) {
+		gs_app_list_sort_by_key (list, sort_key_func, sort_func_data);
+		return TRUE;
+	}
+	if (sort_func != NULL) {
+		gs_app_list_sort (list, sort_func, sort_func_data);
+		return TRUE;
+	}
+	return FALSE;
 }
 
 GsPlugin *
@@ -504,31 +826,475 @@ gs_plugin_loader_review_score_sort_cb (gconstpointer a, gconstpointer b)
 }
 
 static gboolean
-gs_plugin_loader_call_vfunc (GsPluginLoaderHelper *helper,
-			     GsPlugin *plugin,
-			     GsApp *app,
-			     GsAppList *list,
-			     GsPluginRefineFlags refine_flags,
-			     GCancellable *cancellable,
-			     GError **error)
+gs_plugin_loader_app_is_managed_by (GsApp *app, GsPlugin *plugin)
+{
+	return g_strcmp0 (gs_app_get_management_plugin (app),
+			  gs_plugin_get_name (plugin)) == 0;
+}
+
+/* dispatches everything attached to another main context, for contexts
+ * that are no longer iterated by the thread that pushed them */
+typedef struct {
+	GSource			 source;
+	GMainContext		*context;
+	GPollFD			*fds;
+	gint			 fds_len;
+	gint			 fds_size;
+	gint			 priority;
+} GsPluginLoaderContextSource;
+
+static gboolean
+gs_plugin_loader_context_source_prepare (GSource *source, gint *timeout)
+{
+	GsPluginLoaderContextSource *csource = (GsPluginLoaderContextSource *) source;
+	gboolean ready;
+
+	*timeout = -1;
+	if (!g_main_context_acquire (csource->context))
+		return FALSE;
+	ready = g_main_context_prepare (csource->context, &csource->priority);
+
+	/* poll whatever the context wants to poll this time round */
+	for (gint i = 0; i < csource->fds_len; i++)
+		g_source_remove_poll (source, &csource->fds[i]);
+	for (;;) {
+		csource->fds_len = g_main_context_query (csource->context,
+							 csource->priority,
+							 timeout,
+							 csource->fds,
+							 csource->fds_size);
+		if (csource->fds_len <= csource->fds_size)
+			break;
+		csource->fds_size = csource->fds_len;
+		csource->fds = g_renew (GPollFD, csource->fds, csource->fds_size);
+	}
+	for (gint i = 0; i < csource->fds_len; i++)
+		g_source_add_poll (source, &csource->fds[i]);
+	g_main_context_release (csource->context);
+
+	/* the context only knows what to dispatch once it has been checked */
+	if (ready)
+		*timeout = 0;
+	return FALSE;
+}
+
+static gboolean
+gs_plugin_loader_context_source_check (GSource *source)
+{
+	GsPluginLoaderContextSource *csource = (GsPluginLoaderContextSource *) source;
+	gboolean ready;
+
+	if (!g_main_context_acquire (csource->context))
+		return FALSE;
+	ready = g_main_context_check (csource->context,
+				      csource->priority,
+				      csource->fds,
+				      csource->fds_len);
+	g_main_context_release (csource->context);
+	return ready;
+}
+
+static gboolean
+gs_plugin_loader_context_source_dispatch (GSource *source,
+					  GSourceFunc callback,
+					  gpointer user_data)
+{
+	GsPluginLoaderContextSource *csource = (GsPluginLoaderContextSource *) source;
+
+	if (g_main_context_acquire (csource->context)) {
+		g_main_context_dispatch (csource->context);
+		g_main_context_release (csource->context);
+	}
+	return G_SOURCE_CONTINUE;
+}
+
+static void
+gs_plugin_loader_context_source_finalize (GSource *source)
+{
+	GsPluginLoaderContextSource *csource = (GsPluginLoaderContextSource *) source;
+
+	g_main_context_unref (csource->context);
+	g_free (csource->fds);
+}
+
+static GSourceFuncs gs_plugin_loader_context_source_funcs = {
+	gs_plugin_loader_context_source_prepare,
+	gs_plugin_loader_context_source_check,
+	gs_plugin_loader_context_source_dispatch,
+	gs_plugin_loader_context_source_finalize,
+	NULL,
+	NULL
+};
+
+static void
+gs_plugin_loader_setup_source_free (GSource *source)
+{
+	g_source_destroy (source);
+	g_source_unref (source);
+}
+
+/* each plugin is set up with a new main context pushed, so that anything it
+ * waits for while setting up is dispatched in the thread doing the setup;
+ * whatever is still attached to it afterwards, such as file monitors, is
+ * dispatched from the context gs_plugin_loader_setup() was called from, just
+ * as if the plugin had been set up from there */
+static void
+gs_plugin_loader_forward_setup_context (GsPluginLoader *plugin_loader,
+					GMainContext *context)
+{
+	GsPluginLoaderContextSource *csource;
+	g_autoptr(GSource) source = NULL;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&plugin_loader->setup_sources_mutex);
+
+	/* being disposed */
+	if (plugin_loader->setup_sources == NULL)
+		return;
+
+	source = g_source_new (&gs_plugin_loader_context_source_funcs,
+			       sizeof (GsPluginLoaderContextSource));
+	csource = (GsPluginLoaderContextSource *) source;
+	csource->context = g_main_context_ref (context);
+	g_source_set_name (source, "[gnome-software] plugin setup");
+	g_source_attach (source, plugin_loader->setup_context);
+	g_ptr_array_add (plugin_loader->setup_sources, g_steal_pointer (&source));
+}
+
+/* returns FALSE if @plugin is set up lazily and should be skipped for this
+ * job, either because it is not needed yet or because its setup failed */
+static gboolean
+gs_plugin_loader_ensure_lazy_setup (GsPluginLoaderHelper *helper,
+				    GsPlugin *plugin,
+				    GsApp *app,
+				    GsAppList *list,
+				    GCancellable *cancellable)
+{
+	GsPluginAction action = gs_plugin_job_get_action (helper->plugin_job);
+	gboolean ret;
+	gint64 begin_time;
+	g_autoptr(GError) error_local = NULL;
+	g_autoptr(GMainContext) context = NULL;
+	g_autoptr(GsMainContextPusher) pusher = NULL;
+
+	switch (action) {
+	case GS_PLUGIN_ACTION_INITIALIZE:
+	case GS_PLUGIN_ACTION_DESTROY:
+		return TRUE;
+	case GS_PLUGIN_ACTION_SETUP:
+		/* this happens on first use instead */
+		return FALSE;
+	default:
+		break;
+	}
+	if (gs_plugin_get_setup_done (plugin))
+		return TRUE;
+	if (!gs_plugin_has_setup_action (plugin, action))
+		return FALSE;
+
+	/* only refining apps the plugin manages, including ones it adopted,
+	 * needs it to be set up */
+	if (action == GS_PLUGIN_ACTION_REFINE) {
+		gboolean found = app != NULL && gs_plugin_loader_app_is_managed_by (app, plugin);
+		for (guint i = 0; !found && list != NULL && i < gs_app_list_length (list); i++)
+			found = gs_plugin_loader_app_is_managed_by (gs_app_list_index (list, i), plugin);
+		if (!found)
+			return FALSE;
+	}
+
+	/* the main context of the job is dropped when the job finishes, so
+	 * set up with one of its own as gs_plugin_loader_setup() does */
+	begin_time = g_get_monotonic_time ();
+	context = g_main_context_new ();
+	pusher = gs_main_context_pusher_new (context);
+	ret = gs_plugin_ensure_setup (plugin, cancellable, &error_local);
+	g_clear_pointer (&pusher, gs_main_context_pusher_free);
+	gs_plugin_loader_forward_setup_context (helper->plugin_loader, context);
+	if (!ret) {
+		if (g_cancellable_is_cancelled (cancellable))
+			return FALSE;
+		g_debug ("disabling %s as setup failed: %s",
+			 gs_plugin_get_name (plugin),
+			 error_local->message);
+		gs_plugin_set_enabled (plugin, FALSE);
+		return FALSE;
+	}
+	g_debug ("setup of %s for %s took %.1fms",
+		 gs_plugin_get_name (plugin),
+		 gs_plugin_action_to_string (action),
+		 (gdouble) (g_get_monotonic_time () - begin_time) / 1000.f);
+	return TRUE;
+}
+
+static void
+gs_plugin_loader_stats_free (GsPluginLoaderStats *stats)
+{
+	g_free (stats->plugin_name);
+	g_free (stats);
+}
+
+static void
+gs_plugin_loader_stats_add (GsPluginLoader *plugin_loader,
+			    GsPlugin *plugin,
+			    GsPluginAction action,
+			    gdouble elapsed,
+			    const GError *error)
+{
+	GsPluginLoaderStats *stats;
+	g_autofree gchar *key = NULL;
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	key = g_strdup_printf ("%s:%s",
+			       gs_plugin_get_name (plugin),
+			       gs_plugin_action_to_string (action));
+	locker = g_mutex_locker_new (&plugin_loader->stats_mutex);
+	stats = g_hash_table_lookup (plugin_loader->stats, key);
+	if (stats == NULL) {
+		stats = g_new0 (GsPluginLoaderStats, 1);
+		stats->plugin_name = g_strdup (gs_plugin_get_name (plugin));
+		stats->action = action;
+		g_hash_table_insert (plugin_loader->stats, g_steal_pointer (&key), stats);
+	}
+
+	/* cancelled calls say nothing about how fast the plugin is */
+	stats->calls++;
+	if (g_error_matches (error, GS_PLUGIN_ERROR, GS_PLUGIN_ERROR_CANCELLED)) {
+		stats->cancellations++;
+		return;
+	}
+	if (error != NULL)
+		stats->errors++;
+
+	/* overwrite the oldest sample once the ring is full */
+	stats->samples[stats->samples_idx] = (guint32) MIN (elapsed * G_USEC_PER_SEC, G_MAXUINT32);
+	stats->samples_idx = (stats->samples_idx + 1) % GS_PLUGIN_LOADER_STATS_SAMPLES;
+	stats->samples_len = MIN (stats->samples_len + 1, GS_PLUGIN_LOADER_STATS_SAMPLES);
+}
+
+/* nearest-rank percentile of an already sorted array */
+static guint32
+gs_plugin_loader_stats_percentile (const guint32 *sorted, guint len, guint pct)
+{
+	guint rank;
+	if (len == 0)
+		return 0;
+	rank = (len * pct + 99) / 100;
+	return sorted[MAX (rank, 1) - 1];
+}
+
+static gint
+gs_plugin_loader_stats_sample_cmp (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+	guint32 sample_a = *((const guint32 *) a);
+	guint32 sample_b = *((const guint32 *) b);
+	if (sample_a < sample_b)
+		return -1;
+	if (sample_a > sample_b)
+		return 1;
+	return 0;
+}
+
+static gint
+gs_plugin_loader_stats_cmp (gconstpointer a, gconstpointer b)
+{
+	GsPluginLoaderStats *stats_a = *((GsPluginLoaderStats **) a);
+	GsPluginLoaderStats *stats_b = *((GsPluginLoaderStats **) b);
+	gint rc = g_strcmp0 (stats_a->plugin_name, stats_b->plugin_name);
+	if (rc != 0)
+		return rc;
+	return (gint) stats_a->action - (gint) stats_b->action;
+}
+
+/**
+ * gs_plugin_loader_get_stats:
+ * @plugin_loader: a #GsPluginLoader
+ *
+ * Gets the latency of each plugin for each action it has been asked to do,
+ * calculated over the last few hundred calls. Cancelled calls are counted
+ * but are not included in the percentiles.
+ *
+ * The returned variant has the type `a(ssuuuuuu)`, where each entry is the
+ * plugin name, the action, the number of calls, errors and cancellations
+ * and then the p50, p95 and p99 latencies in microseconds.
+ *
+ * Returns: (transfer full): a #GVariant, sorted by plugin name and action
+ **/
+GVariant *
+gs_plugin_loader_get_stats (GsPluginLoader *plugin_loader)
+{
+	GVariantBuilder builder;
+	g_autoptr(GPtrArray) array = g_ptr_array_new ();
+	g_autoptr(GMutexLocker) locker = NULL;
+	GHashTableIter iter;
+	gpointer value;
+
+	g_return_val_if_fail (GS_IS_PLUGIN_LOADER (plugin_loader), NULL);
+
+	locker = g_mutex_locker_new (&plugin_loader->stats_mutex);
+	g_hash_table_iter_init (&iter, plugin_loader->stats);
+	while (g_hash_table_iter_next (&iter, NULL, &value))
+		g_ptr_array_add (array, value);
+	g_ptr_array_sort (array, gs_plugin_loader_stats_cmp);
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ssuuuuuu)"));
+	for (guint i = 0; i < array->len; i++) {
+		GsPluginLoaderStats *stats = g_ptr_array_index (array, i);
+		guint32 sorted[GS_PLUGIN_LOADER_STATS_SAMPLES];
+
+		memcpy (sorted, stats->samples, stats->samples_len * sizeof (guint32));
+		g_qsort_with_data (sorted, (gint) stats->samples_len, sizeof (guint32),
+				   gs_plugin_loader_stats_sample_cmp, NULL);
+		g_variant_builder_add (&builder, "(ssuuuuuu)",
+				       stats->plugin_name,
+				       gs_plugin_action_to_string (stats->action),
+				       stats->calls,
+				       stats->errors,
+				       stats->cancellations,
+				       gs_plugin_loader_stats_percentile (sorted, stats->samples_len, 50),
+				       gs_plugin_loader_stats_percentile (sorted, stats->samples_len, 95),
+				       gs_plugin_loader_stats_percentile (sorted, stats->samples_len, 99));
+	}
+	return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+static gboolean
+gs_plugin_loader_breaker_is_open (GsPluginLoader *plugin_loader, GsPlugin *plugin)
+{
+	GsPluginLoaderBreaker *breaker;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&plugin_loader->breakers_mutex);
+
+	breaker = g_hash_table_lookup (plugin_loader->breakers, gs_plugin_get_name (plugin));
+	if (breaker == NULL)
+		return FALSE;
+	return breaker->open_until > g_get_monotonic_time ();
+}
+
+static void
+gs_plugin_loader_breaker_add (GsPluginLoader *plugin_loader,
+			      GsPlugin *plugin,
+			      gboolean over_budget)
+{
+	GsPluginLoaderBreaker *breaker;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&plugin_loader->breakers_mutex);
+
+	breaker = g_hash_table_lookup (plugin_loader->breakers, gs_plugin_get_name (plugin));
+	if (breaker == NULL) {
+		if (!over_budget)
+			return;
+		breaker = g_new0 (GsPluginLoaderBreaker, 1);
+		g_hash_table_insert (plugin_loader->breakers,
+				     g_strdup (gs_plugin_get_name (plugin)),
+				     breaker);
+	}
+
+	/* one call within the budget closes the breaker again */
+	if (!over_budget) {
+		breaker->strikes = 0;
+		breaker->backoff = 0;
+		return;
+	}
+
+	/* back off for longer each time the plugin is still too slow when
+	 * it is tried again */
+	if (++breaker->strikes < GS_PLUGIN_LOADER_BREAKER_STRIKES)
+		return;
+	if (breaker->backoff == 0)
+		breaker->backoff = GS_PLUGIN_LOADER_BREAKER_BACKOFF_MIN;
+	else
+		breaker->backoff = MIN (breaker->backoff * 2, GS_PLUGIN_LOADER_BREAKER_BACKOFF_MAX);
+	breaker->open_until = g_get_monotonic_time () + breaker->backoff * G_USEC_PER_SEC;
+	g_debug ("skipping %s for %us as it keeps going over its budget",
+		 gs_plugin_get_name (plugin), breaker->backoff);
+}
+
+static gboolean
+gs_plugin_loader_budget_timeout_cb (gpointer user_data)
+{
+	GCancellable *cancellable = G_CANCELLABLE (user_data);
+	g_cancellable_cancel (cancellable);
+	return G_SOURCE_REMOVE;
+}
+
+static void
+gs_plugin_loader_budget_cancelled_cb (GCancellable *cancellable, gpointer user_data)
+{
+	GCancellable *cancellable_plugin = G_CANCELLABLE (user_data);
+	g_cancellable_cancel (cancellable_plugin);
+}
+
+/* this may be called from several threads for the same helper, so it must not
+ * modify anything in @helper other than ->anything_ran and ->partial */
+static gboolean
+gs_plugin_loader_call_vfunc_full (GsPluginLoaderHelper *helper,
+				  GsPlugin *plugin,
+				  const gchar *function_name,
+				  GsApp *app,
+				  GsAppList *list,
+				  GsPluginRefineFlags refine_flags,
+				  GCancellable *cancellable,
+				  GError **error)
 {
 	GsPluginLoader *plugin_loader = helper->plugin_loader;
 	GsPluginAction action = gs_plugin_job_get_action (helper->plugin_job);
 	gboolean ret = TRUE;
 	gpointer func = NULL;
+	gint64 budget = 0;
+	gulong cancellable_id = 0;
+	GCancellable *cancellable_job = cancellable;
+	g_autoptr(GCancellable) cancellable_plugin = NULL;
 	g_autoptr(GError) error_local = NULL;
+	g_autoptr(GSource) budget_source = NULL;
 	g_autoptr(GTimer) timer = g_timer_new ();
 #ifdef HAVE_SYSPROF
 	gint64 begin_time_nsec = SYSPROF_CAPTURE_CURRENT_TIME;
 #endif
 
 	/* load the possible symbol */
-	func = gs_plugin_get_symbol (plugin, helper->function_name);
+	func = gs_plugin_get_symbol (plugin, function_name);
 	if (func == NULL)
 		return TRUE;
 
+	/* plugins that are set up lazily are skipped until they are needed */
+	if (gs_plugin_get_setup_lazy (plugin)) {
+		if (!gs_plugin_loader_ensure_lazy_setup (helper, plugin,
+							 app != NULL ? app : gs_plugin_job_get_app (helper->plugin_job),
+							 list != NULL ? list : gs_plugin_job_get_list (helper->plugin_job),
+							 cancellable))
+			return TRUE;
+	}
+
 	/* at least one plugin supports this vfunc */
-	helper->anything_ran = TRUE;
+	g_atomic_int_set (&helper->anything_ran, TRUE);
+
+	/* each plugin only gets what is left of the job deadline, keeping
+	 * some back for refining the results, so that one slow plugin can
+	 * not make the whole job time out */
+	if (helper->deadline != 0) {
+		if (gs_plugin_loader_breaker_is_open (plugin_loader, plugin)) {
+			g_debug ("skipping %s as it has been too slow recently",
+				 gs_plugin_get_name (plugin));
+			g_atomic_int_set (&helper->partial, TRUE);
+			return TRUE;
+		}
+		budget = helper->deadline - helper->deadline_reserve - g_get_monotonic_time ();
+		if (budget <= 0) {
+			g_debug ("skipping %s as the deadline has passed",
+				 gs_plugin_get_name (plugin));
+			g_atomic_int_set (&helper->partial, TRUE);
+			return TRUE;
+		}
+		cancellable_plugin = g_cancellable_new ();
+		if (cancellable_job != NULL) {
+			cancellable_id = g_cancellable_connect (cancellable_job,
+								G_CALLBACK (gs_plugin_loader_budget_cancelled_cb),
+								cancellable_plugin, NULL);
+		}
+		budget_source = g_timeout_source_new ((guint) (budget / 1000));
+		g_source_set_callback (budget_source,
+				       gs_plugin_loader_budget_timeout_cb,
+				       g_object_ref (cancellable_plugin),
+				       (GDestroyNotify) g_object_unref);
+		g_source_attach (budget_source, NULL);
+		cancellable = cancellable_plugin;
+	}
 
 	/* fallback if unset */
 	if (app == NULL)
@@ -538,9 +1304,6 @@ gs_plugin_loader_call_vfunc (GsPluginLoaderHelper *helper,
 	if (refine_flags == GS_PLUGIN_REFINE_FLAGS_DEFAULT)
 		refine_flags = gs_plugin_job_get_refine_flags (helper->plugin_job);
 
-	/* set what plugin is running on the job */
-	gs_plugin_job_set_plugin (helper->plugin_job, plugin);
-
 	/* run the correct vfunc */
 	if (gs_plugin_job_get_interactive (helper->plugin_job))
 		gs_plugin_interactive_inc (plugin);
@@ -559,41 +1322,41 @@ gs_plugin_loader_call_vfunc (GsPluginLoaderHelper *helper,
 		}
 		break;
 	case GS_PLUGIN_ACTION_REFINE:
-		if (g_strcmp0 (helper->function_name, "gs_plugin_refine_wildcard") == 0) {
+		if (g_strcmp0 (function_name, "gs_plugin_refine_wildcard") == 0) {
 			GsPluginRefineWildcardFunc plugin_func = func;
 			ret = plugin_func (plugin, app, list, refine_flags, cancellable, &error_local);
-		} else if (g_strcmp0 (helper->function_name, "gs_plugin_refine") == 0) {
+		} else if (g_strcmp0 (function_name, "gs_plugin_refine") == 0) {
 			GsPluginRefineFunc plugin_func = func;
 			ret = plugin_func (plugin, list, refine_flags, cancellable, &error_local);
 		} else {
 			g_critical ("function_name %s invalid for %s",
-				    helper->function_name,
+				    function_name,
 				    gs_plugin_action_to_string (action));
 		}
 		break;
 	case GS_PLUGIN_ACTION_UPDATE:
-		if (g_strcmp0 (helper->function_name, "gs_plugin_update_app") == 0) {
+		if (g_strcmp0 (function_name, "gs_plugin_update_app") == 0) {
 			GsPluginActionFunc plugin_func = func;
 			ret = plugin_func (plugin, app, cancellable, &error_local);
-		} else if (g_strcmp0 (helper->function_name, "gs_plugin_update") == 0) {
+		} else if (g_strcmp0 (function_name, "gs_plugin_update") == 0) {
 			GsPluginUpdateFunc plugin_func = func;
 			ret = plugin_func (plugin, list, cancellable, &error_local);
 		} else {
 			g_critical ("function_name %s invalid for %s",
-				    helper->function_name,
+				    function_name,
 				    gs_plugin_action_to_string (action));
 		}
 		break;
 	case GS_PLUGIN_ACTION_DOWNLOAD:
-		if (g_strcmp0 (helper->function_name, "gs_plugin_download_app") == 0) {
+		if (g_strcmp0 (function_name, "gs_plugin_download_app") == 0) {
 			GsPluginActionFunc plugin_func = func;
 			ret = plugin_func (plugin, app, cancellable, &error_local);
-		} else if (g_strcmp0 (helper->function_name, "gs_plugin_download") == 0) {
+		} else if (g_strcmp0 (function_name, "gs_plugin_download") == 0) {
 			GsPluginUpdateFunc plugin_func = func;
 			ret = plugin_func (plugin, list, cancellable, &error_local);
 		} else {
 			g_critical ("function_name %s invalid for %s",
-				    helper->function_name,
+				    function_name,
 				    gs_plugin_action_to_string (action));
 		}
 		break;
@@ -717,12 +1480,29 @@ gs_plugin_loader_call_vfunc (GsPluginLoaderHelper *helper,
 		}
 		break;
 	default:
-		g_critical ("no handler for %s", helper->function_name);
+		g_critical ("no handler for %s", function_name);
 		break;
 	}
 	if (gs_plugin_job_get_interactive (helper->plugin_job))
 		gs_plugin_interactive_dec (plugin);
 
+	/* a plugin cut off at the end of its budget does not fail the job,
+	 * but the results are missing whatever it would have returned */
+	if (budget_source != NULL) {
+		g_source_destroy (budget_source);
+		if (cancellable_id != 0)
+			g_cancellable_disconnect (cancellable_job, cancellable_id);
+		if (!g_cancellable_is_cancelled (cancellable_job)) {
+			gboolean over_budget = g_timer_elapsed (timer, NULL) * G_USEC_PER_SEC > budget;
+			gs_plugin_loader_breaker_add (plugin_loader, plugin, over_budget);
+			if (over_budget) {
+				g_debug ("%s went over its budget of %" G_GINT64_FORMAT "ms",
+					 gs_plugin_get_name (plugin), budget / 1000);
+				g_atomic_int_set (&helper->partial, TRUE);
+			}
+		}
+	}
+
 	/* plugin did not return error on cancellable abort */
 	if (ret && g_cancellable_set_error_if_cancelled (cancellable, &error_local)) {
 		g_debug ("plugin %s did not return error with cancellable set",
@@ -746,11 +1526,19 @@ gs_plugin_loader_call_vfunc (GsPluginLoaderHelper *helper,
 				     "too long to return results",
 				     gs_plugin_get_name (plugin));
 		}
+		gs_plugin_loader_stats_add (plugin_loader, plugin, action,
+					    g_timer_elapsed (timer, NULL),
+					    error_local);
+
+		/* the results are incomplete even if the error is not fatal */
+		g_atomic_int_set (&helper->plugin_failed, TRUE);
 		return gs_plugin_error_handle_failure (helper,
 							plugin,
 							error_local,
 							error);
 	}
+	gs_plugin_loader_stats_add (plugin_loader, plugin, action,
+				    g_timer_elapsed (timer, NULL), NULL);
 
 	/* add app to the pending installation queue if necessary */
 	if (action == GS_PLUGIN_ACTION_INSTALL &&
@@ -807,11 +1595,234 @@ gs_plugin_loader_call_vfunc (GsPluginLoaderHelper *helper,
 }
 
 static gboolean
-gs_plugin_loader_app_is_non_wildcard (GsApp *app, gpointer user_data)
+gs_plugin_loader_call_vfunc (GsPluginLoaderHelper *helper,
+			     GsPlugin *plugin,
+			     GsApp *app,
+			     GsAppList *list,
+			     GsPluginRefineFlags refine_flags,
+			     GCancellable *cancellable,
+			     GError **error)
+{
+	/* set what plugin is running on the job */
+	if (gs_plugin_get_symbol (plugin, helper->function_name) != NULL)
+		gs_plugin_job_set_plugin (helper->plugin_job, plugin);
+
+	return gs_plugin_loader_call_vfunc_full (helper, plugin,
+						 helper->function_name,
+						 app, list, refine_flags,
+						 cancellable, error);
+}
+
+static gboolean
+gs_plugin_loader_app_is_non_wildcard (GsApp *app, gpointer user_data)
 {
 	return !gs_app_has_quirk (app, GS_APP_QUIRK_IS_WILDCARD);
 }
 
+static gboolean
+gs_plugin_loader_refine_plugin (GsPluginLoaderHelper *helper,
+				GsPlugin *plugin,
+				GsAppList *list,
+				GsAppList *wildcards,
+				GsPluginRefineFlags refine_flags,
+				GCancellable *cancellable,
+				GError **error)
+{
+	g_autoptr(GsAppList) app_list = NULL;
+
+	/* run the batched plugin symbol then refine wildcards per-app */
+	if (!gs_plugin_loader_call_vfunc_full (helper, plugin, "gs_plugin_refine",
+					       NULL, list, refine_flags,
+					       cancellable, error)) {
+		return FALSE;
+	}
+
+	if (gs_plugin_get_symbol (plugin, "gs_plugin_refine_wildcard") == NULL)
+		return TRUE;
+
+	/* use a copy of the list for the loop because a function called
+	 * on the plugin may affect the list which can lead to problems
+	 * (e.g. inserting an app in the list on every call results in
+	 * an infinite loop) */
+	app_list = gs_app_list_copy (list);
+	for (guint j = 0; j < gs_app_list_length (app_list); j++) {
+		GsApp *app = gs_app_list_index (app_list, j);
+		if (gs_app_has_quirk (app, GS_APP_QUIRK_IS_WILDCARD) &&
+		    !gs_plugin_loader_call_vfunc_full (helper, plugin,
+						       "gs_plugin_refine_wildcard",
+						       app, wildcards, refine_flags,
+						       cancellable, error)) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/* the results of one plugin when run in parallel with others */
+typedef struct {
+	GsPluginLoaderHelper	*helper;
+	GsPlugin		*plugin;
+	GsAppList		*list;		/* (owned) */
+	GsPluginRefineFlags	 refine_flags;
+	GCancellable		*cancellable;
+	GError			*error;
+	gboolean		 ret;
+	gboolean		 done;
+	gboolean		 emitted;
+	GMutex			*mutex;
+	GCond			*cond;
+	guint			*pending;
+} GsPluginLoaderShard;
+
+static void
+gs_plugin_loader_shard_free (GsPluginLoaderShard *shard)
+{
+	g_object_unref (shard->list);
+	g_clear_error (&shard->error);
+	g_slice_free (GsPluginLoaderShard, shard);
+}
+
+static void
+gs_plugin_loader_run_shard_cb (gpointer data, gpointer user_data)
+{
+	GsPluginLoaderShard *shard = (GsPluginLoaderShard *) data;
+	GsPluginLoaderHelper *helper = shard->helper;
+	g_autoptr(GMainContext) context = g_main_context_new ();
+	g_autoptr(GsMainContextPusher) pusher = gs_main_context_pusher_new (context);
+
+	/* this is still part of the job */
+	g_private_set (&gs_plugin_loader_job_thread, shard);
+	shard->ret = gs_plugin_loader_call_vfunc_full (helper,
+						       shard->plugin,
+						       helper->function_name,
+						       NULL,
+						       shard->list,
+						       shard->refine_flags,
+						       shard->cancellable,
+						       &shard->error);
+	gs_plugin_status_update (shard->plugin, NULL, GS_PLUGIN_STATUS_FINISHED);
+	g_private_set (&gs_plugin_loader_job_thread, NULL);
+
+	g_mutex_lock (shard->mutex);
+	shard->done = TRUE;
+	(*shard->pending)--;
+	g_cond_signal (shard->cond);
+	g_mutex_unlock (shard->mutex);
+}
+
+/* apply the changes each plugin made to its copy of @list, in plugin order, so
+ * that the result does not depend on which plugin finished first */
+static void
+gs_plugin_loader_merge_shards (GsAppList *list, GPtrArray *shards)
+{
+	g_autoptr(GHashTable) base = g_hash_table_new (g_direct_hash, g_direct_equal);
+	g_autoptr(GHashTable) removed = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	for (guint i = 0; i < gs_app_list_length (list); i++)
+		g_hash_table_add (base, gs_app_list_index (list, i));
+
+	for (guint i = 0; i < shards->len; i++) {
+		GsPluginLoaderShard *shard = g_ptr_array_index (shards, i);
+		g_autoptr(GHashTable) present = g_hash_table_new (g_direct_hash, g_direct_equal);
+		GHashTableIter iter;
+		gpointer app;
+
+		for (guint j = 0; j < gs_app_list_length (shard->list); j++) {
+			GsApp *app_tmp = gs_app_list_index (shard->list, j);
+			g_hash_table_add (present, app_tmp);
+			if (!g_hash_table_contains (base, app_tmp))
+				gs_app_list_add (list, app_tmp);
+		}
+		g_hash_table_iter_init (&iter, base);
+		while (g_hash_table_iter_next (&iter, &app, NULL)) {
+			if (g_hash_table_contains (present, app) ||
+			    g_hash_table_contains (removed, app))
+				continue;
+			g_hash_table_add (removed, app);
+			gs_app_list_remove (list, GS_APP (app));
+		}
+	}
+}
+
+static void gs_plugin_loader_emit_batch (GsPluginLoaderHelper *helper,
+					 GsAppList *list,
+					 GCancellable *cancellable);
+
+static gboolean
+gs_plugin_loader_run_shards (GsPluginLoaderHelper *helper,
+			     GPtrArray *shards,
+			     GCancellable *cancellable,
+			     GError **error)
+{
+	GsPluginLoader *plugin_loader = helper->plugin_loader;
+	GMutex mutex;
+	GCond cond;
+	guint pending = shards->len;
+
+	g_mutex_init (&mutex);
+	g_cond_init (&cond);
+	for (guint i = 0; i < shards->len; i++) {
+		GsPluginLoaderShard *shard = g_ptr_array_index (shards, i);
+		shard->mutex = &mutex;
+		shard->cond = &cond;
+		shard->pending = &pending;
+		g_thread_pool_push (plugin_loader->plugins_pool, shard, NULL);
+	}
+	g_mutex_lock (&mutex);
+	while (pending > 0) {
+		GsPluginLoaderShard *finished = NULL;
+
+		/* send what each plugin found while the others are running */
+		for (guint i = 0; helper->batch_func != NULL && i < shards->len; i++) {
+			GsPluginLoaderShard *shard = g_ptr_array_index (shards, i);
+			if (shard->done && !shard->emitted) {
+				finished = shard;
+				break;
+			}
+		}
+		if (finished == NULL) {
+			g_cond_wait (&cond, &mutex);
+			continue;
+		}
+		finished->emitted = TRUE;
+		g_mutex_unlock (&mutex);
+		if (finished->ret)
+			gs_plugin_loader_emit_batch (helper, finished->list, cancellable);
+		g_mutex_lock (&mutex);
+	}
+	g_mutex_unlock (&mutex);
+	g_cond_clear (&cond);
+	g_mutex_clear (&mutex);
+
+	/* report the first failure in plugin order */
+	for (guint i = 0; i < shards->len; i++) {
+		GsPluginLoaderShard *shard = g_ptr_array_index (shards, i);
+		if (!shard->ret) {
+			g_propagate_error (error, g_steal_pointer (&shard->error));
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/* plugins with the same order have no RUN_AFTER or RUN_BEFORE rule between
+ * them, so they can all be run at the same time; returns the index of the
+ * first plugin not in the same level as @idx */
+static guint
+gs_plugin_loader_get_level_end (GsPluginLoader *plugin_loader, guint idx)
+{
+	GsPlugin *plugin = g_ptr_array_index (plugin_loader->plugins, idx);
+	guint order = gs_plugin_get_order (plugin);
+	guint i;
+
+	for (i = idx + 1; i < plugin_loader->plugins->len; i++) {
+		GsPlugin *plugin_tmp = g_ptr_array_index (plugin_loader->plugins, i);
+		if (gs_plugin_get_order (plugin_tmp) != order)
+			break;
+	}
+	return i;
+}
+
 static gboolean
 gs_plugin_loader_run_refine_filter (GsPluginLoaderHelper *helper,
 				    GsAppList *list,
@@ -820,165 +1831,202 @@ gs_plugin_loader_run_refine_filter (GsPluginLoaderHelper *helper,
 				    GError **error)
 {
 	GsPluginLoader *plugin_loader = helper->plugin_loader;
+	GsAppList *job_list = gs_plugin_job_get_list (helper->plugin_job);
 
-	/* run each plugin */
+	/* refining modifies the apps in @list, so each plugin runs in turn */
 	for (guint i = 0; i < plugin_loader->plugins->len; i++) {
 		GsPlugin *plugin = g_ptr_array_index (plugin_loader->plugins, i);
-		g_autoptr(GsAppList) app_list = NULL;
-
-		/* run the batched plugin symbol then refine wildcards per-app */
-		helper->function_name = "gs_plugin_refine";
-		if (!gs_plugin_loader_call_vfunc (helper, plugin, NULL, list,
-						  refine_flags, cancellable, error)) {
+		if (gs_plugin_get_symbol (plugin, "gs_plugin_refine") != NULL ||
+		    gs_plugin_get_symbol (plugin, "gs_plugin_refine_wildcard") != NULL)
+			gs_plugin_job_set_plugin (helper->plugin_job, plugin);
+		if (!gs_plugin_loader_refine_plugin (helper, plugin,
+						     list, job_list,
+						     refine_flags,
+						     cancellable, error))
 			return FALSE;
-		}
-
-		if (gs_plugin_get_symbol (plugin, "gs_plugin_refine_wildcard") != NULL) {
-			/* use a copy of the list for the loop because a function called
-			 * on the plugin may affect the list which can lead to problems
-			 * (e.g. inserting an app in the list on every call results in
-			 * an infinite loop) */
-			app_list = gs_app_list_copy (list);
-			helper->function_name = "gs_plugin_refine_wildcard";
-
-			for (guint j = 0; j < gs_app_list_length (app_list); j++) {
-				GsApp *app = gs_app_list_index (app_list, j);
-				if (gs_app_has_quirk (app, GS_APP_QUIRK_IS_WILDCARD) &&
-				    !gs_plugin_loader_call_vfunc (helper, plugin, app, NULL,
-								  refine_flags, cancellable, error)) {
-					return FALSE;
-				}
-			}
-		}
-
 		gs_plugin_status_update (plugin, NULL, GS_PLUGIN_STATUS_FINISHED);
 	}
 
-
 	/* filter any wildcard apps left in the list */
 	gs_app_list_filter (list, gs_plugin_loader_app_is_non_wildcard, NULL);
 	return TRUE;
 }
 
+static void
+gs_plugin_loader_refine_batch_add (GsAppList *batch, GHashTable *seen, GsApp *app)
+{
+	if (g_hash_table_contains (seen, app))
+		return;
+	g_hash_table_add (seen, app);
+	gs_app_list_add (batch, app);
+}
+
+/* refines @list, then the addons, runtimes and related apps of those apps
+ * one layer deep, as batches so that each plugin only runs once for each */
 static gboolean
 gs_plugin_loader_run_refine_internal (GsPluginLoaderHelper *helper,
 				      GsAppList *list,
 				      GCancellable *cancellable,
 				      GError **error)
 {
-	/* try to adopt each application with a plugin */
-	gs_plugin_loader_run_adopt (helper->plugin_loader, list);
+	GsPluginRefineFlags refine_flags = gs_plugin_job_get_refine_flags (helper->plugin_job);
+	gboolean primary = TRUE;
+	g_autoptr(GHashTable) seen = g_hash_table_new (g_direct_hash, g_direct_equal);
+	g_autoptr(GsAppList) batch = g_object_ref (list);
 
-	/* run each plugin */
-	if (!gs_plugin_loader_run_refine_filter (helper, list,
-						 GS_PLUGIN_REFINE_FLAGS_DEFAULT,
-						 cancellable, error))
-		return FALSE;
+	while (gs_app_list_length (batch) > 0) {
+		g_autoptr(GsAppList) next = gs_app_list_new ();
 
-	/* ensure these are sorted by score */
-	if (gs_plugin_job_has_refine_flags (helper->plugin_job,
-						GS_PLUGIN_REFINE_FLAGS_REQUIRE_REVIEWS)) {
-		GPtrArray *reviews;
-		for (guint i = 0; i < gs_app_list_length (list); i++) {
-			GsApp *app = gs_app_list_index (list, i);
-			reviews = gs_app_get_reviews (app);
-			g_ptr_array_sort (reviews,
-					  gs_plugin_loader_review_score_sort_cb);
-		}
-	}
+		/* try to adopt each application with a plugin */
+		gs_plugin_loader_run_adopt (helper->plugin_loader, batch);
 
-	/* refine addons one layer deep */
-	if (gs_plugin_job_has_refine_flags (helper->plugin_job,
-						GS_PLUGIN_REFINE_FLAGS_REQUIRE_ADDONS)) {
-		g_autoptr(GsAppList) addons_list = NULL;
-		gs_plugin_job_remove_refine_flags (helper->plugin_job,
-						   GS_PLUGIN_REFINE_FLAGS_REQUIRE_ADDONS |
-						   GS_PLUGIN_REFINE_FLAGS_REQUIRE_REVIEWS |
-						   GS_PLUGIN_REFINE_FLAGS_REQUIRE_REVIEW_RATINGS);
-		addons_list = gs_app_list_new ();
-		for (guint i = 0; i < gs_app_list_length (list); i++) {
-			GsApp *app = gs_app_list_index (list, i);
-			GsAppList *addons = gs_app_get_addons (app);
-			for (guint j = 0; j < gs_app_list_length (addons); j++) {
-				GsApp *addon = gs_app_list_index (addons, j);
-				g_debug ("refining app %s addon %s",
-					 gs_app_get_id (app),
-					 gs_app_get_id (addon));
-				gs_app_list_add (addons_list, addon);
-			}
-		}
-		if (gs_app_list_length (addons_list) > 0) {
-			if (!gs_plugin_loader_run_refine_internal (helper,
-								   addons_list,
-								   cancellable,
-								   error)) {
-				return FALSE;
+		/* run each plugin */
+		gs_plugin_job_set_refine_flags (helper->plugin_job, refine_flags);
+		if (!gs_plugin_loader_run_refine_filter (helper, batch,
+							 GS_PLUGIN_REFINE_FLAGS_DEFAULT,
+							 cancellable, error))
+			return FALSE;
+
+		/* wildcards have been replaced by now */
+		for (guint i = 0; i < gs_app_list_length (batch); i++)
+			g_hash_table_add (seen, gs_app_list_index (batch, i));
+
+		/* ensure these are sorted by score */
+		if (refine_flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_REVIEWS) {
+			for (guint i = 0; i < gs_app_list_length (batch); i++) {
+				GsApp *app = gs_app_list_index (batch, i);
+				g_ptr_array_sort (gs_app_get_reviews (app),
+						  gs_plugin_loader_review_score_sort_cb);
 			}
 		}
-	}
 
-	/* also do runtime */
-	if (gs_plugin_job_has_refine_flags (helper->plugin_job,
-						GS_PLUGIN_REFINE_FLAGS_REQUIRE_RUNTIME)) {
-		g_autoptr(GsAppList) list2 = gs_app_list_new ();
-		for (guint i = 0; i < gs_app_list_length (list); i++) {
-			GsApp *runtime;
-			GsApp *app = gs_app_list_index (list, i);
-			runtime = gs_app_get_runtime (app);
-			if (runtime != NULL)
-				gs_app_list_add (list2, runtime);
-		}
-		if (gs_app_list_length (list2) > 0) {
-			if (!gs_plugin_loader_run_refine_internal (helper,
-								   list2,
-								   cancellable,
-								   error)) {
-				return FALSE;
-			}
+		/* do this here rather than when the UI first shows the app */
+		if (refine_flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_KEY_COLORS) {
+			for (guint i = 0; i < gs_app_list_length (batch); i++)
+				gs_app_ensure_key_colors (gs_app_list_index (batch, i), cancellable);
 		}
-	}
 
-	/* also do related packages one layer deep */
-	if (gs_plugin_job_has_refine_flags (helper->plugin_job,
-						GS_PLUGIN_REFINE_FLAGS_REQUIRE_RELATED)) {
-		g_autoptr(GsAppList) related_list = NULL;
-		gs_plugin_job_remove_refine_flags (helper->plugin_job,
-						   GS_PLUGIN_REFINE_FLAGS_REQUIRE_RELATED);
-		related_list = gs_app_list_new ();
-		for (guint i = 0; i < gs_app_list_length (list); i++) {
-			GsApp *app = gs_app_list_index (list, i);
-			GsAppList *related = gs_app_get_related (app);
-			for (guint j = 0; j < gs_app_list_length (related); j++) {
-				GsApp *app2 = gs_app_list_index (related, j);
-				g_debug ("refining related: %s[%s]",
-					 gs_app_get_id (app2),
-					 gs_app_get_source_default (app2));
-				gs_app_list_add (related_list, app2);
+		/* collect everything the next pass has to refine */
+		for (guint i = 0; i < gs_app_list_length (batch); i++) {
+			GsApp *app = gs_app_list_index (batch, i);
+
+			if (primary && (refine_flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_ADDONS)) {
+				GsAppList *addons = gs_app_get_addons (app);
+				for (guint j = 0; j < gs_app_list_length (addons); j++) {
+					GsApp *addon = gs_app_list_index (addons, j);
+					g_debug ("refining app %s addon %s",
+						 gs_app_get_id (app),
+						 gs_app_get_id (addon));
+					gs_plugin_loader_refine_batch_add (next, seen, addon);
+				}
 			}
-		}
-		if (gs_app_list_length (related_list) > 0) {
-			if (!gs_plugin_loader_run_refine_internal (helper,
-								   related_list,
-								   cancellable,
-								   error)) {
-				return FALSE;
+			if (refine_flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_RUNTIME) {
+				GsApp *runtime = gs_app_get_runtime (app);
+				if (runtime != NULL)
+					gs_plugin_loader_refine_batch_add (next, seen, runtime);
+			}
+			if (primary && (refine_flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_RELATED)) {
+				GsAppList *related = gs_app_get_related (app);
+				for (guint j = 0; j < gs_app_list_length (related); j++) {
+					GsApp *app2 = gs_app_list_index (related, j);
+					g_debug ("refining related: %s[%s]",
+						 gs_app_get_id (app2),
+						 gs_app_get_source_default (app2));
+					gs_plugin_loader_refine_batch_add (next, seen, app2);
+				}
 			}
 		}
+
+		/* addons and related apps are only refined one layer deep, but
+		 * the runtimes of anything refined are always followed */
+		refine_flags &= ~(GS_PLUGIN_REFINE_FLAGS_REQUIRE_ADDONS |
+				  GS_PLUGIN_REFINE_FLAGS_REQUIRE_RELATED |
+				  GS_PLUGIN_REFINE_FLAGS_REQUIRE_REVIEWS |
+				  GS_PLUGIN_REFINE_FLAGS_REQUIRE_REVIEW_RATINGS);
+		primary = FALSE;
+		g_set_object (&batch, next);
 	}
 
 	/* success */
 	return TRUE;
 }
 
+/* thaws the apps a few at a time so the main loop is never blocked for long,
+ * even after refining thousands of apps */
 static gboolean
-app_thaw_notify_idle (gpointer data)
+gs_plugin_loader_thaw_idle_cb (gpointer user_data)
 {
-	GsApp *app = GS_APP (data);
-	g_object_thaw_notify (G_OBJECT (app));
-	g_object_unref (app);
+	GsPluginLoader *plugin_loader = GS_PLUGIN_LOADER (user_data);
+	gint64 end_time = g_get_monotonic_time () + GS_PLUGIN_LOADER_THAW_SLICE * G_TIME_SPAN_MILLISECOND;
+
+	g_mutex_lock (&plugin_loader->thaw_mutex);
+	while (!g_queue_is_empty (&plugin_loader->thaw_queue)) {
+		g_autoptr(GsApp) app = g_queue_pop_head (&plugin_loader->thaw_queue);
+
+		/* the signals may cause more apps to be refined */
+		g_mutex_unlock (&plugin_loader->thaw_mutex);
+		g_object_thaw_notify (G_OBJECT (app));
+		g_mutex_lock (&plugin_loader->thaw_mutex);
+
+		if (g_get_monotonic_time () > end_time &&
+		    !g_queue_is_empty (&plugin_loader->thaw_queue)) {
+			g_mutex_unlock (&plugin_loader->thaw_mutex);
+			return G_SOURCE_CONTINUE;
+		}
+	}
+	plugin_loader->thaw_id = 0;
+	g_mutex_unlock (&plugin_loader->thaw_mutex);
 	return G_SOURCE_REMOVE;
 }
 
+/* each app is only queued once per freeze, and GObject already emits each
+ * changed property only once when the app is thawed */
+static void
+gs_plugin_loader_thaw_apps (GsPluginLoader *plugin_loader, GsAppList *list)
+{
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&plugin_loader->thaw_mutex);
+
+	for (guint i = 0; i < gs_app_list_length (list); i++) {
+		GsApp *app = gs_app_list_index (list, i);
+		g_queue_push_tail (&plugin_loader->thaw_queue, g_object_ref (app));
+	}
+	if (plugin_loader->thaw_id == 0 && !g_queue_is_empty (&plugin_loader->thaw_queue)) {
+		plugin_loader->thaw_id = g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+							  gs_plugin_loader_thaw_idle_cb,
+							  g_object_ref (plugin_loader),
+							  (GDestroyNotify) g_object_unref);
+	}
+}
+
+/* apps that were already refined with all the flags since the last time the
+ * refine generation changed are left alone; the others are refined with the
+ * flags that any of them are missing */
+static GsAppList *
+gs_plugin_loader_get_refine_list (GsAppList *list,
+				  GsPluginRefineFlags refine_flags,
+				  guint generation,
+				  GsPluginRefineFlags *missing_flags)
+{
+	GsAppList *refine_list = gs_app_list_new ();
+
+	*missing_flags = GS_PLUGIN_REFINE_FLAGS_DEFAULT;
+	for (guint i = 0; i < gs_app_list_length (list); i++) {
+		GsApp *app = gs_app_list_index (list, i);
+		GsPluginRefineFlags refined_flags;
+
+		if (!gs_app_has_quirk (app, GS_APP_QUIRK_IS_WILDCARD) &&
+		    gs_app_get_refined_flags (app, generation, &refined_flags)) {
+			if ((refined_flags & refine_flags) == refine_flags)
+				continue;
+			*missing_flags |= refine_flags & ~refined_flags;
+		} else {
+			*missing_flags |= refine_flags;
+		}
+		gs_app_list_add (refine_list, app);
+	}
+	return refine_list;
+}
+
 static gboolean
 gs_plugin_loader_run_refine (GsPluginLoaderHelper *helper,
 			     GsAppList *list,
@@ -986,7 +2034,10 @@ gs_plugin_loader_run_refine (GsPluginLoaderHelper *helper,
 			     GError **error)
 {
 	gboolean ret;
+	guint generation = gs_plugin_get_refine_generation ();
+	GsPluginRefineFlags missing_flags;
 	g_autoptr(GsAppList) freeze_list = NULL;
+	g_autoptr(GsAppList) refine_list = NULL;
 	g_autoptr(GsPluginLoaderHelper) helper2 = NULL;
 	g_autoptr(GsPluginJob) plugin_job = NULL;
 
@@ -994,8 +2045,26 @@ gs_plugin_loader_run_refine (GsPluginLoaderHelper *helper,
 	if (gs_app_list_length (list) == 0)
 		return TRUE;
 
+	/* only refine what has not been refined already */
+	refine_list = gs_plugin_loader_get_refine_list (list,
+							gs_plugin_job_get_refine_flags (helper->plugin_job),
+							generation,
+							&missing_flags);
+	if (gs_app_list_length (refine_list) == 0) {
+		g_debug ("all %u apps already refined", gs_app_list_length (list));
+		return TRUE;
+	}
+	if (gs_app_list_length (refine_list) == gs_app_list_length (list)) {
+		g_clear_object (&refine_list);
+		refine_list = g_object_ref (list);
+	} else {
+		g_debug ("refining %u of %u apps",
+			 gs_app_list_length (refine_list),
+			 gs_app_list_length (list));
+	}
+
 	/* freeze all apps */
-	freeze_list = gs_app_list_copy (list);
+	freeze_list = gs_app_list_copy (refine_list);
 	for (guint i = 0; i < gs_app_list_length (freeze_list); i++) {
 		GsApp *app = gs_app_list_index (freeze_list, i);
 		g_object_freeze_notify (G_OBJECT (app));
@@ -1003,19 +2072,41 @@ gs_plugin_loader_run_refine (GsPluginLoaderHelper *helper,
 
 	/* first pass */
 	plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_REFINE,
-					 "list", list,
-					 "refine-flags", gs_plugin_job_get_refine_flags (helper->plugin_job),
+					 "list", refine_list,
+					 "refine-flags", missing_flags,
 					 NULL);
 	helper2 = gs_plugin_loader_helper_new (helper->plugin_loader, plugin_job);
 	helper2->function_name_parent = helper->function_name;
-	ret = gs_plugin_loader_run_refine_internal (helper2, list, cancellable, error);
+	ret = gs_plugin_loader_run_refine_internal (helper2, refine_list, cancellable, error);
 	if (!ret)
 		goto out;
 
+	/* wildcards may have been replaced, so bring @list up to date */
+	if (refine_list != list) {
+		g_autoptr(GHashTable) refined = g_hash_table_new (g_direct_hash, g_direct_equal);
+		for (guint i = 0; i < gs_app_list_length (refine_list); i++)
+			g_hash_table_add (refined, gs_app_list_index (refine_list, i));
+		for (guint i = 0; i < gs_app_list_length (freeze_list); i++) {
+			GsApp *app = gs_app_list_index (freeze_list, i);
+			if (!g_hash_table_contains (refined, app))
+				gs_app_list_remove (list, app);
+		}
+		gs_app_list_add_list (list, refine_list);
+	}
+
+	/* record what was refined so the next job can skip it; if any plugin
+	 * failed then the apps are retried next time */
+	for (guint i = 0; i < gs_app_list_length (refine_list); i++) {
+		GsApp *app = gs_app_list_index (refine_list, i);
+		if (g_atomic_int_get (&helper2->plugin_failed))
+			break;
+		gs_app_add_refined_flags (app, generation, missing_flags);
+	}
+
 	/* remove any addons that have the same source as the parent app */
-	for (guint i = 0; i < gs_app_list_length (list); i++) {
+	for (guint i = 0; i < gs_app_list_length (refine_list); i++) {
 		g_autoptr(GPtrArray) to_remove = g_ptr_array_new ();
-		GsApp *app = gs_app_list_index (list, i);
+		GsApp *app = gs_app_list_index (refine_list, i);
 		GsAppList *addons = gs_app_get_addons (app);
 
 		/* find any apps with the same source */
@@ -1043,44 +2134,31 @@ gs_plugin_loader_run_refine (GsPluginLoaderHelper *helper,
 
 out:
 	/* now emit all the changed signals */
-	for (guint i = 0; i < gs_app_list_length (freeze_list); i++) {
-		GsApp *app = gs_app_list_index (freeze_list, i);
-		g_idle_add (app_thaw_notify_idle, g_object_ref (app));
-	}
+	gs_plugin_loader_thaw_apps (helper->plugin_loader, freeze_list);
 	return ret;
 }
 
 static void
 gs_plugin_loader_job_sorted_truncation_again (GsPluginLoaderHelper *helper)
 {
-	GsAppListSortFunc sort_func;
-	gpointer sort_func_data;
-
 	/* not valid */
 	if (gs_plugin_job_get_list (helper->plugin_job) == NULL)
 		return;
 
-	/* unset */
-	sort_func = gs_plugin_job_get_sort_func (helper->plugin_job);
-	if (sort_func == NULL)
-		return;
-	sort_func_data = gs_plugin_job_get_sort_func_data (helper->plugin_job);
-	gs_app_list_sort (gs_plugin_job_get_list (helper->plugin_job), sort_func, sort_func_data);
+	gs_plugin_loader_job_sort (helper->plugin_job,
+				   gs_plugin_job_get_list (helper->plugin_job));
 }
 
 static void
-gs_plugin_loader_job_sorted_truncation (GsPluginLoaderHelper *helper)
+gs_plugin_loader_job_sorted_truncation (GsPluginLoaderHelper *helper,
+					GsAppList *list,
+					guint max_results)
 {
-	GsAppListSortFunc sort_func;
-	guint max_results;
-	GsAppList *list = gs_plugin_job_get_list (helper->plugin_job);
-
 	/* not valid */
 	if (list == NULL)
 		return;
 
 	/* unset */
-	max_results = gs_plugin_job_get_max_results (helper->plugin_job);
 	if (max_results == 0)
 		return;
 
@@ -1091,43 +2169,122 @@ gs_plugin_loader_job_sorted_truncation (GsPluginLoaderHelper *helper)
 	/* nothing set */
 	g_debug ("truncating results to %u from %u",
 		 max_results, gs_app_list_length (list));
-	sort_func = gs_plugin_job_get_sort_func (helper->plugin_job);
-	if (sort_func == NULL) {
+	if (!gs_plugin_loader_job_sort (helper->plugin_job, list)) {
 		GsPluginAction action = gs_plugin_job_get_action (helper->plugin_job);
 		g_debug ("no ->sort_func() set for %s, using random!",
 			 gs_plugin_action_to_string (action));
 		gs_app_list_randomize (list);
-	} else {
-		gpointer sort_func_data;
-		sort_func_data = gs_plugin_job_get_sort_func_data (helper->plugin_job);
-		gs_app_list_sort (list, sort_func, sort_func_data);
 	}
 	gs_app_list_truncate (list, max_results);
 }
 
+static gboolean
+gs_plugin_loader_action_is_parallel (GsPluginAction action)
+{
+	switch (action) {
+	case GS_PLUGIN_ACTION_GET_ALTERNATES:
+	case GS_PLUGIN_ACTION_GET_CATEGORY_APPS:
+	case GS_PLUGIN_ACTION_GET_DISTRO_UPDATES:
+	case GS_PLUGIN_ACTION_GET_FEATURED:
+	case GS_PLUGIN_ACTION_GET_INSTALLED:
+	case GS_PLUGIN_ACTION_GET_LANGPACKS:
+	case GS_PLUGIN_ACTION_GET_POPULAR:
+	case GS_PLUGIN_ACTION_GET_RECENT:
+	case GS_PLUGIN_ACTION_GET_SOURCES:
+	case GS_PLUGIN_ACTION_GET_UNVOTED_REVIEWS:
+	case GS_PLUGIN_ACTION_GET_UPDATES:
+	case GS_PLUGIN_ACTION_GET_UPDATES_HISTORICAL:
+	case GS_PLUGIN_ACTION_SEARCH:
+	case GS_PLUGIN_ACTION_SEARCH_FILES:
+	case GS_PLUGIN_ACTION_SEARCH_PROVIDES:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+static guint
+gs_plugin_loader_count_symbol (GsPluginLoader *plugin_loader,
+			       guint start,
+			       guint end,
+			       const gchar *function_name)
+{
+	guint cnt = 0;
+	for (guint i = start; i < end; i++) {
+		GsPlugin *plugin = g_ptr_array_index (plugin_loader->plugins, i);
+		if (gs_plugin_get_symbol (plugin, function_name) != NULL)
+			cnt++;
+	}
+	return cnt;
+}
+
 static gboolean
 gs_plugin_loader_run_results (GsPluginLoaderHelper *helper,
 			      GCancellable *cancellable,
 			      GError **error)
 {
 	GsPluginLoader *plugin_loader = helper->plugin_loader;
+	GsAppList *list = gs_plugin_job_get_list (helper->plugin_job);
 #ifdef HAVE_SYSPROF
 	gint64 begin_time_nsec G_GNUC_UNUSED = SYSPROF_CAPTURE_CURRENT_TIME;
 #endif
 
 	/* run each plugin */
-	for (guint i = 0; i < plugin_loader->plugins->len; i++) {
-		GsPlugin *plugin = g_ptr_array_index (plugin_loader->plugins, i);
+	for (guint i = 0; i < plugin_loader->plugins->len;) {
+		guint level_end = gs_plugin_loader_get_level_end (plugin_loader, i);
+		g_autoptr(GPtrArray) shards = NULL;
+
 		if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
 			gs_utils_error_convert_gio (error);
 			return FALSE;
 		}
-		if (!gs_plugin_loader_call_vfunc (helper, plugin, NULL, NULL,
-						  GS_PLUGIN_REFINE_FLAGS_DEFAULT,
-						  cancellable, error)) {
-			return FALSE;
+
+		/* only actions that just return results can use a shard */
+		if (list == NULL ||
+		    !gs_plugin_loader_action_is_parallel (gs_plugin_job_get_action (helper->plugin_job)) ||
+		    gs_plugin_loader_count_symbol (plugin_loader, i, level_end,
+						   helper->function_name) < 2) {
+			for (; i < level_end; i++) {
+				GsPlugin *plugin = g_ptr_array_index (plugin_loader->plugins, i);
+				if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
+					gs_utils_error_convert_gio (error);
+					return FALSE;
+				}
+				if (!gs_plugin_loader_call_vfunc (helper, plugin, NULL, NULL,
+								  GS_PLUGIN_REFINE_FLAGS_DEFAULT,
+								  cancellable, error)) {
+					return FALSE;
+				}
+				gs_plugin_status_update (plugin, NULL, GS_PLUGIN_STATUS_FINISHED);
+				if (list != NULL)
+					gs_plugin_loader_emit_batch (helper, list, cancellable);
+			}
+			continue;
 		}
-		gs_plugin_status_update (plugin, NULL, GS_PLUGIN_STATUS_FINISHED);
+
+		/* each plugin gets its own copy of the results so far */
+		shards = g_ptr_array_new_with_free_func ((GDestroyNotify) gs_plugin_loader_shard_free);
+		for (; i < level_end; i++) {
+			GsPlugin *plugin = g_ptr_array_index (plugin_loader->plugins, i);
+			GsPluginLoaderShard *shard;
+
+			if (gs_plugin_get_symbol (plugin, helper->function_name) == NULL) {
+				gs_plugin_status_update (plugin, NULL, GS_PLUGIN_STATUS_FINISHED);
+				continue;
+			}
+			shard = g_slice_new0 (GsPluginLoaderShard);
+			shard->helper = helper;
+			shard->plugin = plugin;
+			shard->list = gs_app_list_copy (list);
+			shard->refine_flags = GS_PLUGIN_REFINE_FLAGS_DEFAULT;
+			shard->cancellable = cancellable;
+			g_ptr_array_add (shards, shard);
+		}
+		gs_plugin_job_set_plugin (helper->plugin_job, NULL);
+		if (!gs_plugin_loader_run_shards (helper, shards, cancellable, error))
+			return FALSE;
+		gs_plugin_loader_merge_shards (list, shards);
+		gs_plugin_loader_emit_batch (helper, list, cancellable);
 	}
 
 #ifdef HAVE_SYSPROF
@@ -2277,7 +3434,10 @@ gs_plugin_loader_setup_again (GsPluginLoader *plugin_loader)
 	/* call in order */
 	for (guint j = 0; actions[j] != GS_PLUGIN_ACTION_UNKNOWN; j++) {
 		for (guint i = 0; i < plugin_loader->plugins->len; i++) {
+			gboolean ret;
 			g_autoptr(GError) error_local = NULL;
+			g_autoptr(GMainContext) context = NULL;
+			g_autoptr(GsMainContextPusher) pusher = NULL;
 			g_autoptr(GsPluginLoaderHelper) helper = NULL;
 			g_autoptr(GsPluginJob) plugin_job = NULL;
 			GsPlugin *plugin = g_ptr_array_index (plugin_loader->plugins, i);
@@ -2286,16 +3446,27 @@ gs_plugin_loader_setup_again (GsPluginLoader *plugin_loader)
 
 			plugin_job = gs_plugin_job_newv (actions[j], NULL);
 			helper = gs_plugin_loader_helper_new (plugin_loader, plugin_job);
-			if (!gs_plugin_loader_call_vfunc (helper, plugin, NULL, NULL,
-							  GS_PLUGIN_REFINE_FLAGS_DEFAULT,
-							  NULL, &error_local)) {
+			if (actions[j] == GS_PLUGIN_ACTION_SETUP) {
+				context = g_main_context_new ();
+				pusher = gs_main_context_pusher_new (context);
+			}
+			ret = gs_plugin_loader_call_vfunc (helper, plugin, NULL, NULL,
+							   GS_PLUGIN_REFINE_FLAGS_DEFAULT,
+							   NULL, &error_local);
+			if (pusher != NULL) {
+				g_clear_pointer (&pusher, gs_main_context_pusher_free);
+				gs_plugin_loader_forward_setup_context (plugin_loader, context);
+			}
+			if (!ret) {
 				g_warning ("resetup of %s failed: %s",
 					   gs_plugin_get_name (plugin),
 					   error_local->message);
 				break;
 			}
-			if (actions[j] == GS_PLUGIN_ACTION_DESTROY)
+			if (actions[j] == GS_PLUGIN_ACTION_DESTROY) {
 				gs_plugin_clear_data (plugin);
+				gs_plugin_reset_setup (plugin);
+			}
 		}
 	}
 
@@ -2338,36 +3509,499 @@ gs_plugin_loader_find_plugins (const gchar *path, GError **error)
 	return g_steal_pointer (&fns);
 }
 
-/**
- * gs_plugin_loader_setup:
- * @plugin_loader: a #GsPluginLoader
- * @allowlist: list of plugin names, or %NULL
- * @blocklist: list of plugin names, or %NULL
- * @cancellable: A #GCancellable, or %NULL
- * @error: A #GError, or %NULL
- *
- * Sets up the plugin loader ready for use.
- *
- * Returns: %TRUE for success
- */
-gboolean
-gs_plugin_loader_setup (GsPluginLoader *plugin_loader,
-			gchar **allowlist,
-			gchar **blocklist,
-			GCancellable *cancellable,
-			GError **error)
+/* the rules between plugins as edges from each plugin to the plugins that
+ * have to come after it, indexed like the plugins array it was built from */
+typedef struct {
+	GPtrArray		*succs;		/* of GArray of guint */
+	GArray			*n_preds;	/* of guint */
+} GsPluginLoaderGraph;
+
+static void
+gs_plugin_loader_graph_free (GsPluginLoaderGraph *graph)
 {
-	const gchar *plugin_name;
-	gboolean changes;
-	GPtrArray *deps;
-	GsPlugin *dep;
-	GsPlugin *plugin;
-	guint dep_loop_check = 0;
-	guint i;
-	guint j;
-	g_autoptr(GsPluginLoaderHelper) helper = NULL;
-	g_autoptr(GsPluginJob) plugin_job = NULL;
-#ifdef HAVE_SYSPROF
+	g_ptr_array_unref (graph->succs);
+	g_array_unref (graph->n_preds);
+	g_slice_free (GsPluginLoaderGraph, graph);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(GsPluginLoaderGraph, gs_plugin_loader_graph_free)
+
+static void
+gs_plugin_loader_graph_add_edge (GsPluginLoaderGraph *graph, guint from, guint to)
+{
+	GArray *succs = g_ptr_array_index (graph->succs, from);
+	g_array_append_val (succs, to);
+	g_array_index (graph->n_preds, guint, to)++;
+}
+
+/* @rule_after orders the plugin after the plugin it names, and @rule_before
+ * orders it before; either can be %GS_PLUGIN_RULE_LAST for none */
+static GsPluginLoaderGraph *
+gs_plugin_loader_graph_new (GsPluginLoader *plugin_loader,
+			    GsPluginRule rule_after,
+			    GsPluginRule rule_before)
+{
+	GsPluginLoaderGraph *graph = g_slice_new0 (GsPluginLoaderGraph);
+	GPtrArray *plugins = plugin_loader->plugins;
+	g_autoptr(GHashTable) idxs = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	graph->succs = g_ptr_array_new_with_free_func ((GDestroyNotify) g_array_unref);
+	graph->n_preds = g_array_sized_new (FALSE, TRUE, sizeof(guint), plugins->len);
+	g_array_set_size (graph->n_preds, plugins->len);
+	for (guint i = 0; i < plugins->len; i++) {
+		g_ptr_array_add (graph->succs, g_array_new (FALSE, FALSE, sizeof(guint)));
+		g_hash_table_insert (idxs, g_ptr_array_index (plugins, i), GUINT_TO_POINTER (i));
+	}
+
+	for (guint i = 0; i < plugins->len; i++) {
+		GsPlugin *plugin = g_ptr_array_index (plugins, i);
+		GsPluginRule rules[] = { rule_after, rule_before };
+
+		for (guint k = 0; k < G_N_ELEMENTS (rules); k++) {
+			GPtrArray *deps;
+			if (rules[k] == GS_PLUGIN_RULE_LAST)
+				continue;
+			deps = gs_plugin_get_rules (plugin, rules[k]);
+			for (guint j = 0; j < deps->len; j++) {
+				const gchar *plugin_name = g_ptr_array_index (deps, j);
+				GsPlugin *dep = gs_plugin_loader_find_plugin (plugin_loader, plugin_name);
+				guint idx;
+				if (dep == NULL) {
+					g_debug ("cannot find plugin '%s' "
+						 "requested by '%s'",
+						 plugin_name,
+						 gs_plugin_get_name (plugin));
+					continue;
+				}
+				if (!gs_plugin_get_enabled (dep))
+					continue;
+				idx = GPOINTER_TO_UINT (g_hash_table_lookup (idxs, dep));
+				if (rules[k] == rule_after)
+					gs_plugin_loader_graph_add_edge (graph, idx, i);
+				else
+					gs_plugin_loader_graph_add_edge (graph, i, idx);
+			}
+		}
+	}
+	return graph;
+}
+
+/* a copy of the number of unvisited predecessors of each plugin */
+static GArray *
+gs_plugin_loader_graph_dup_n_preds (GsPluginLoaderGraph *graph)
+{
+	GArray *n_preds = g_array_sized_new (FALSE, FALSE, sizeof(guint), graph->n_preds->len);
+	g_array_append_vals (n_preds, graph->n_preds->data, graph->n_preds->len);
+	return n_preds;
+}
+
+/* called with the index of a plugin that has been dealt with; adds the
+ * plugins that now have nothing left to wait for to @ready */
+static void
+gs_plugin_loader_graph_complete (GsPluginLoaderGraph *graph,
+				 GArray *n_preds,
+				 guint idx,
+				 GQueue *ready)
+{
+	GArray *succs = g_ptr_array_index (graph->succs, idx);
+	for (guint i = 0; i < succs->len; i++) {
+		guint succ = g_array_index (succs, guint, i);
+		if (--g_array_index (n_preds, guint, succ) == 0)
+			g_queue_push_tail (ready, GUINT_TO_POINTER (succ));
+	}
+}
+
+typedef guint	(*GsPluginLoaderGraphGetFunc)	(GsPlugin	*plugin);
+typedef void	(*GsPluginLoaderGraphSetFunc)	(GsPlugin	*plugin,
+						 guint		 value);
+
+/* visits the plugins in dependency order, raising the value of each one to
+ * be greater than the value of everything it has to come after; returns
+ * %FALSE if the rules contain a cycle */
+static gboolean
+gs_plugin_loader_graph_assign (GsPluginLoaderGraph *graph,
+			       GPtrArray *plugins,
+			       GsPluginLoaderGraphGetFunc get_func,
+			       GsPluginLoaderGraphSetFunc set_func)
+{
+	guint n_visited = 0;
+	g_autoptr(GArray) n_preds = NULL;
+	g_auto(GQueue) ready = G_QUEUE_INIT;
+
+	n_preds = gs_plugin_loader_graph_dup_n_preds (graph);
+	for (guint i = 0; i < plugins->len; i++) {
+		if (g_array_index (n_preds, guint, i) == 0)
+			g_queue_push_tail (&ready, GUINT_TO_POINTER (i));
+	}
+	while (!g_queue_is_empty (&ready)) {
+		guint idx = GPOINTER_TO_UINT (g_queue_pop_head (&ready));
+		GsPlugin *plugin = g_ptr_array_index (plugins, idx);
+		GArray *succs = g_ptr_array_index (graph->succs, idx);
+
+		for (guint i = 0; i < succs->len; i++) {
+			GsPlugin *plugin_tmp = g_ptr_array_index (plugins, g_array_index (succs, guint, i));
+			if (get_func (plugin_tmp) <= get_func (plugin))
+				set_func (plugin_tmp, get_func (plugin) + 1);
+		}
+		gs_plugin_loader_graph_complete (graph, n_preds, idx, &ready);
+		n_visited++;
+	}
+	return n_visited == plugins->len;
+}
+
+/* a plugin being set up in the setup pool */
+typedef struct {
+	GsPluginLoaderHelper	*helper;
+	GsPlugin		*plugin;
+	guint			 idx;
+	GCancellable		*cancellable;
+	gint64			 begin_time;	/* monotonic, us */
+	gint64			 end_time;	/* monotonic, us */
+	GMutex			*mutex;
+	GCond			*cond;
+	GQueue			*finished;
+} GsPluginLoaderSetupJob;
+
+static void
+gs_plugin_loader_setup_plugin_cb (gpointer data, gpointer user_data)
+{
+	GsPluginLoaderSetupJob *job = (GsPluginLoaderSetupJob *) data;
+	g_autoptr(GError) error_local = NULL;
+	g_autoptr(GMainContext) context = g_main_context_new ();
+	g_autoptr(GsMainContextPusher) pusher = NULL;
+
+	job->begin_time = g_get_monotonic_time ();
+	pusher = gs_main_context_pusher_new (context);
+	if (!gs_plugin_loader_call_vfunc_full (job->helper, job->plugin,
+					       job->helper->function_name,
+					       NULL, NULL,
+					       GS_PLUGIN_REFINE_FLAGS_DEFAULT,
+					       job->cancellable, &error_local)) {
+		g_debug ("disabling %s as setup failed: %s",
+			 gs_plugin_get_name (job->plugin),
+			 error_local->message);
+		gs_plugin_set_enabled (job->plugin, FALSE);
+	} else {
+		gs_plugin_set_setup_done (job->plugin);
+	}
+	g_clear_pointer (&pusher, gs_main_context_pusher_free);
+	gs_plugin_loader_forward_setup_context (job->helper->plugin_loader, context);
+	job->end_time = g_get_monotonic_time ();
+
+	g_mutex_lock (job->mutex);
+	g_queue_push_tail (job->finished, job);
+	g_cond_signal (job->cond);
+	g_mutex_unlock (job->mutex);
+}
+
+/* sets up the plugins in parallel, each one only waiting for the plugins the
+ * graph says it has to run after; a plugin that fails is disabled, but the
+ * plugins that depend on it are still set up */
+static void
+gs_plugin_loader_run_setup (GsPluginLoaderHelper *helper,
+			    GsPluginLoaderGraph *graph,
+			    GCancellable *cancellable)
+{
+	GsPluginLoader *plugin_loader = helper->plugin_loader;
+	GPtrArray *plugins = plugin_loader->plugins;
+	GMutex mutex;
+	GCond cond;
+	GThreadPool *pool;
+	guint remaining = plugins->len;
+	g_autoptr(GArray) n_preds = gs_plugin_loader_graph_dup_n_preds (graph);
+	g_autoptr(GPtrArray) jobs = g_ptr_array_new_with_free_func (g_free);
+	g_auto(GQueue) ready = G_QUEUE_INIT;
+	g_auto(GQueue) finished = G_QUEUE_INIT;
+
+	g_mutex_init (&mutex);
+	g_cond_init (&cond);
+	pool = g_thread_pool_new (gs_plugin_loader_setup_plugin_cb, NULL,
+				  MAX (plugins->len, 1), FALSE, NULL);
+
+	for (guint i = 0; i < plugins->len; i++) {
+		if (g_array_index (n_preds, guint, i) == 0)
+			g_queue_push_tail (&ready, GUINT_TO_POINTER (i));
+	}
+
+	g_mutex_lock (&mutex);
+	while (remaining > 0) {
+		GsPluginLoaderSetupJob *job;
+
+		/* start everything that is not waiting for another plugin */
+		while (!g_queue_is_empty (&ready)) {
+			guint idx = GPOINTER_TO_UINT (g_queue_pop_head (&ready));
+			GsPlugin *plugin = g_ptr_array_index (plugins, idx);
+
+			if (gs_plugin_get_symbol (plugin, helper->function_name) == NULL ||
+			    gs_plugin_get_setup_lazy (plugin)) {
+				gs_plugin_loader_graph_complete (graph, n_preds, idx, &ready);
+				remaining--;
+				continue;
+			}
+			job = g_new0 (GsPluginLoaderSetupJob, 1);
+			job->helper = helper;
+			job->plugin = plugin;
+			job->idx = idx;
+			job->cancellable = cancellable;
+			job->mutex = &mutex;
+			job->cond = &cond;
+			job->finished = &finished;
+			g_ptr_array_add (jobs, job);
+			g_thread_pool_push (pool, job, NULL);
+		}
+		if (remaining == 0)
+			break;
+
+		/* the graph is acyclic, so something must be running */
+		while ((job = g_queue_pop_head (&finished)) == NULL)
+			g_cond_wait (&cond, &mutex);
+		g_debug ("setup of %s took %.1fms",
+			 gs_plugin_get_name (job->plugin),
+			 (gdouble) (job->end_time - job->begin_time) / 1000.f);
+		gs_plugin_loader_graph_complete (graph, n_preds, job->idx, &ready);
+		remaining--;
+	}
+	g_mutex_unlock (&mutex);
+
+	g_thread_pool_free (pool, FALSE, TRUE);
+	g_cond_clear (&cond);
+	g_mutex_clear (&mutex);
+
+#ifdef HAVE_SYSPROF
+	if (plugin_loader->sysprof_writer != NULL) {
+		gint64 offset = SYSPROF_CAPTURE_CURRENT_TIME - g_get_monotonic_time () * 1000;
+		for (guint i = 0; i < jobs->len; i++) {
+			GsPluginLoaderSetupJob *job = g_ptr_array_index (jobs, i);
+			g_autofree gchar *sysprof_name = NULL;
+
+			sysprof_name = g_strconcat ("setup:", gs_plugin_get_name (job->plugin), NULL);
+			sysprof_capture_writer_add_mark (plugin_loader->sysprof_writer,
+							 job->begin_time * 1000 + offset,
+							 sched_getcpu (),
+							 getpid (),
+							 (job->end_time - job->begin_time) * 1000,
+							 "gnome-software",
+							 sysprof_name,
+							 NULL);
+		}
+	}
+#endif  /* HAVE_SYSPROF */
+}
+
+#ifdef HAVE_SYSPROF
+/* the order of the counters that do not depend on the plugins */
+enum {
+	GS_PLUGIN_LOADER_COUNTER_QUEUED,
+	GS_PLUGIN_LOADER_COUNTER_RUNNING,
+	GS_PLUGIN_LOADER_COUNTER_JOB_THREADS,
+	GS_PLUGIN_LOADER_COUNTER_PLUGIN_THREADS,
+	GS_PLUGIN_LOADER_COUNTER_PLUGIN_UNPROCESSED,
+	GS_PLUGIN_LOADER_COUNTER_PENDING_APPS,
+	GS_PLUGIN_LOADER_COUNTER_APPS,
+	GS_PLUGIN_LOADER_COUNTER_APP_LISTS,
+	GS_PLUGIN_LOADER_COUNTER_LAST
+};
+
+/* per plugin, after the global counters */
+enum {
+	GS_PLUGIN_LOADER_PLUGIN_COUNTER_CACHE_HITS,
+	GS_PLUGIN_LOADER_PLUGIN_COUNTER_CACHE_MISSES,
+	GS_PLUGIN_LOADER_PLUGIN_COUNTER_SILO_REBUILDS,
+	GS_PLUGIN_LOADER_PLUGIN_COUNTER_LAST
+};
+
+static void
+gs_plugin_loader_sysprof_counter_init (SysprofCaptureCounter *counter,
+				       guint id,
+				       const gchar *category,
+				       const gchar *name,
+				       const gchar *description)
+{
+	g_strlcpy (counter->category, category, sizeof (counter->category));
+	g_strlcpy (counter->name, name, sizeof (counter->name));
+	g_strlcpy (counter->description, description, sizeof (counter->description));
+	counter->id = id;
+	counter->type = SYSPROF_CAPTURE_COUNTER_INT64;
+	counter->value.v64 = 0;
+}
+
+/* samples the loader state from its own thread, so that the counters keep
+ * being written even when the main thread is blocked */
+static gpointer
+gs_plugin_loader_sysprof_sampler_cb (gpointer user_data)
+{
+	GsPluginLoader *plugin_loader = GS_PLUGIN_LOADER (user_data);
+	g_autoptr(GPtrArray) plugins = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	g_autofree SysprofCaptureCounter *counters = NULL;
+	g_autofree SysprofCaptureCounterValue *values = NULL;
+	g_autofree guint *ids = NULL;
+	guint base;
+	guint n_counters;
+
+	/* the plugin list does not change once set up */
+	for (guint i = 0; i < plugin_loader->plugins->len; i++) {
+		GsPlugin *plugin = g_ptr_array_index (plugin_loader->plugins, i);
+		if (gs_plugin_get_enabled (plugin))
+			g_ptr_array_add (plugins, g_object_ref (plugin));
+	}
+	n_counters = GS_PLUGIN_LOADER_COUNTER_LAST +
+		     plugins->len * GS_PLUGIN_LOADER_PLUGIN_COUNTER_LAST;
+
+	/* define all the tracks */
+	base = sysprof_capture_writer_request_counter (plugin_loader->sysprof_writer, n_counters);
+	counters = g_new0 (SysprofCaptureCounter, n_counters);
+	gs_plugin_loader_sysprof_counter_init (&counters[GS_PLUGIN_LOADER_COUNTER_QUEUED],
+					       base + GS_PLUGIN_LOADER_COUNTER_QUEUED,
+					       "GNOME Software", "Queued jobs",
+					       "Jobs waiting in the scheduler");
+	gs_plugin_loader_sysprof_counter_init (&counters[GS_PLUGIN_LOADER_COUNTER_RUNNING],
+					       base + GS_PLUGIN_LOADER_COUNTER_RUNNING,
+					       "GNOME Software", "Running jobs",
+					       "Jobs running in the job thread pool");
+	gs_plugin_loader_sysprof_counter_init (&counters[GS_PLUGIN_LOADER_COUNTER_JOB_THREADS],
+					       base + GS_PLUGIN_LOADER_COUNTER_JOB_THREADS,
+					       "GNOME Software", "Job threads",
+					       "Threads in the job thread pool");
+	gs_plugin_loader_sysprof_counter_init (&counters[GS_PLUGIN_LOADER_COUNTER_PLUGIN_THREADS],
+					       base + GS_PLUGIN_LOADER_COUNTER_PLUGIN_THREADS,
+					       "GNOME Software", "Plugin threads",
+					       "Threads running plugins in parallel");
+	gs_plugin_loader_sysprof_counter_init (&counters[GS_PLUGIN_LOADER_COUNTER_PLUGIN_UNPROCESSED],
+					       base + GS_PLUGIN_LOADER_COUNTER_PLUGIN_UNPROCESSED,
+					       "GNOME Software", "Queued plugin calls",
+					       "Plugin calls waiting for a thread");
+	gs_plugin_loader_sysprof_counter_init (&counters[GS_PLUGIN_LOADER_COUNTER_PENDING_APPS],
+					       base + GS_PLUGIN_LOADER_COUNTER_PENDING_APPS,
+					       "GNOME Software", "Pending apps",
+					       "Apps in the install queue");
+	gs_plugin_loader_sysprof_counter_init (&counters[GS_PLUGIN_LOADER_COUNTER_APPS],
+					       base + GS_PLUGIN_LOADER_COUNTER_APPS,
+					       "GNOME Software", "GsApp objects",
+					       "Number of live GsApp objects");
+	gs_plugin_loader_sysprof_counter_init (&counters[GS_PLUGIN_LOADER_COUNTER_APP_LISTS],
+					       base + GS_PLUGIN_LOADER_COUNTER_APP_LISTS,
+					       "GNOME Software", "GsAppList objects",
+					       "Number of live GsAppList objects");
+	for (guint i = 0; i < plugins->len; i++) {
+		GsPlugin *plugin = g_ptr_array_index (plugins, i);
+		guint idx = GS_PLUGIN_LOADER_COUNTER_LAST + i * GS_PLUGIN_LOADER_PLUGIN_COUNTER_LAST;
+		g_autofree gchar *category = g_strdup_printf ("Plugin %s", gs_plugin_get_name (plugin));
+
+		gs_plugin_loader_sysprof_counter_init (&counters[idx + GS_PLUGIN_LOADER_PLUGIN_COUNTER_CACHE_HITS],
+						       base + idx + GS_PLUGIN_LOADER_PLUGIN_COUNTER_CACHE_HITS,
+						       category, "Cache hits",
+						       "Lookups found in the plugin cache");
+		gs_plugin_loader_sysprof_counter_init (&counters[idx + GS_PLUGIN_LOADER_PLUGIN_COUNTER_CACHE_MISSES],
+						       base + idx + GS_PLUGIN_LOADER_PLUGIN_COUNTER_CACHE_MISSES,
+						       category, "Cache misses",
+						       "Lookups not in the plugin cache");
+		gs_plugin_loader_sysprof_counter_init (&counters[idx + GS_PLUGIN_LOADER_PLUGIN_COUNTER_SILO_REBUILDS],
+						       base + idx + GS_PLUGIN_LOADER_PLUGIN_COUNTER_SILO_REBUILDS,
+						       category, "Silo rebuilds",
+						       "Number of times the silo was rebuilt");
+	}
+	sysprof_capture_writer_define_counters (plugin_loader->sysprof_writer,
+						SYSPROF_CAPTURE_CURRENT_TIME,
+						-1, getpid (),
+						counters, n_counters);
+
+	ids = g_new0 (guint, n_counters);
+	for (guint i = 0; i < n_counters; i++)
+		ids[i] = base + i;
+	values = g_new0 (SysprofCaptureCounterValue, n_counters);
+
+	g_mutex_lock (&plugin_loader->sysprof_sampler_mutex);
+	while (!plugin_loader->sysprof_sampler_stop) {
+		gint64 end_time;
+
+		g_mutex_unlock (&plugin_loader->sysprof_sampler_mutex);
+
+		g_mutex_lock (&plugin_loader->scheduler_mutex);
+		values[GS_PLUGIN_LOADER_COUNTER_QUEUED].v64 = 0;
+		for (guint i = 0; i < GS_PLUGIN_LOADER_LANE_LAST; i++)
+			values[GS_PLUGIN_LOADER_COUNTER_QUEUED].v64 += plugin_loader->scheduler_queue[i].length;
+		values[GS_PLUGIN_LOADER_COUNTER_RUNNING].v64 = plugin_loader->scheduler_running_total;
+		g_mutex_unlock (&plugin_loader->scheduler_mutex);
+		values[GS_PLUGIN_LOADER_COUNTER_JOB_THREADS].v64 = g_thread_pool_get_num_threads (plugin_loader->jobs_pool);
+		values[GS_PLUGIN_LOADER_COUNTER_PLUGIN_THREADS].v64 = g_thread_pool_get_num_threads (plugin_loader->plugins_pool);
+		values[GS_PLUGIN_LOADER_COUNTER_PLUGIN_UNPROCESSED].v64 = g_thread_pool_unprocessed (plugin_loader->plugins_pool);
+
+		g_mutex_lock (&plugin_loader->pending_apps_mutex);
+		values[GS_PLUGIN_LOADER_COUNTER_PENDING_APPS].v64 = plugin_loader->pending_apps->len;
+		g_mutex_unlock (&plugin_loader->pending_apps_mutex);
+
+		values[GS_PLUGIN_LOADER_COUNTER_APPS].v64 = gs_app_get_instance_count ();
+		values[GS_PLUGIN_LOADER_COUNTER_APP_LISTS].v64 = gs_app_list_get_instance_count ();
+
+		for (guint i = 0; i < plugins->len; i++) {
+			GsPlugin *plugin = g_ptr_array_index (plugins, i);
+			guint idx = GS_PLUGIN_LOADER_COUNTER_LAST + i * GS_PLUGIN_LOADER_PLUGIN_COUNTER_LAST;
+			values[idx + GS_PLUGIN_LOADER_PLUGIN_COUNTER_CACHE_HITS].v64 = gs_plugin_get_cache_hits (plugin);
+			values[idx + GS_PLUGIN_LOADER_PLUGIN_COUNTER_CACHE_MISSES].v64 = gs_plugin_get_cache_misses (plugin);
+			values[idx + GS_PLUGIN_LOADER_PLUGIN_COUNTER_SILO_REBUILDS].v64 = gs_plugin_get_silo_rebuilds (plugin);
+		}
+
+		sysprof_capture_writer_set_counters (plugin_loader->sysprof_writer,
+						     SYSPROF_CAPTURE_CURRENT_TIME,
+						     -1, getpid (),
+						     ids, values, n_counters);
+
+		/* wait for the next sample, or to be stopped */
+		end_time = g_get_monotonic_time () + GS_PLUGIN_LOADER_SYSPROF_INTERVAL * G_TIME_SPAN_MILLISECOND;
+		g_mutex_lock (&plugin_loader->sysprof_sampler_mutex);
+		while (!plugin_loader->sysprof_sampler_stop) {
+			if (!g_cond_wait_until (&plugin_loader->sysprof_sampler_cond,
+						&plugin_loader->sysprof_sampler_mutex,
+						end_time))
+				break;
+		}
+	}
+	g_mutex_unlock (&plugin_loader->sysprof_sampler_mutex);
+	return NULL;
+}
+
+static void
+gs_plugin_loader_sysprof_sampler_stop (GsPluginLoader *plugin_loader)
+{
+	if (plugin_loader->sysprof_sampler == NULL)
+		return;
+	g_mutex_lock (&plugin_loader->sysprof_sampler_mutex);
+	plugin_loader->sysprof_sampler_stop = TRUE;
+	g_cond_signal (&plugin_loader->sysprof_sampler_cond);
+	g_mutex_unlock (&plugin_loader->sysprof_sampler_mutex);
+	g_thread_join (g_steal_pointer (&plugin_loader->sysprof_sampler));
+}
+#endif  /* HAVE_SYSPROF */
+
+/**
+ * gs_plugin_loader_setup:
+ * @plugin_loader: a #GsPluginLoader
+ * @allowlist: list of plugin names, or %NULL
+ * @blocklist: list of plugin names, or %NULL
+ * @cancellable: A #GCancellable, or %NULL
+ * @error: A #GError, or %NULL
+ *
+ * Sets up the plugin loader ready for use.
+ *
+ * Returns: %TRUE for success
+ */
+gboolean
+gs_plugin_loader_setup (GsPluginLoader *plugin_loader,
+			gchar **allowlist,
+			gchar **blocklist,
+			GCancellable *cancellable,
+			GError **error)
+{
+	const gchar *plugin_name;
+	GPtrArray *deps;
+	GsPlugin *dep;
+	GsPlugin *plugin;
+	guint i;
+	guint j;
+	g_autoptr(GsPluginLoaderGraph) graph = NULL;
+	g_autoptr(GsPluginLoaderHelper) helper = NULL;
+	g_autoptr(GsPluginJob) plugin_job = NULL;
+#ifdef HAVE_SYSPROF
 	gint64 begin_time_nsec G_GNUC_UNUSED = SYSPROF_CAPTURE_CURRENT_TIME;
 #endif
 
@@ -2448,62 +4082,19 @@ gs_plugin_loader_setup (GsPluginLoader *plugin_loader,
 		return FALSE;
 
 	/* order by deps */
-	do {
-		changes = FALSE;
-		for (i = 0; i < plugin_loader->plugins->len; i++) {
-			plugin = g_ptr_array_index (plugin_loader->plugins, i);
-			deps = gs_plugin_get_rules (plugin, GS_PLUGIN_RULE_RUN_AFTER);
-			for (j = 0; j < deps->len && !changes; j++) {
-				plugin_name = g_ptr_array_index (deps, j);
-				dep = gs_plugin_loader_find_plugin (plugin_loader,
-								    plugin_name);
-				if (dep == NULL) {
-					g_debug ("cannot find plugin '%s' "
-						 "requested by '%s'",
-						 plugin_name,
-						 gs_plugin_get_name (plugin));
-					continue;
-				}
-				if (!gs_plugin_get_enabled (dep))
-					continue;
-				if (gs_plugin_get_order (plugin) <= gs_plugin_get_order (dep)) {
-					gs_plugin_set_order (plugin, gs_plugin_get_order (dep) + 1);
-					changes = TRUE;
-				}
-			}
-		}
-		for (i = 0; i < plugin_loader->plugins->len; i++) {
-			plugin = g_ptr_array_index (plugin_loader->plugins, i);
-			deps = gs_plugin_get_rules (plugin, GS_PLUGIN_RULE_RUN_BEFORE);
-			for (j = 0; j < deps->len && !changes; j++) {
-				plugin_name = g_ptr_array_index (deps, j);
-				dep = gs_plugin_loader_find_plugin (plugin_loader,
-								    plugin_name);
-				if (dep == NULL) {
-					g_debug ("cannot find plugin '%s' "
-						 "requested by '%s'",
-						 plugin_name,
-						 gs_plugin_get_name (plugin));
-					continue;
-				}
-				if (!gs_plugin_get_enabled (dep))
-					continue;
-				if (gs_plugin_get_order (plugin) >= gs_plugin_get_order (dep)) {
-					gs_plugin_set_order (dep, gs_plugin_get_order (plugin) + 1);
-					changes = TRUE;
-				}
-			}
-		}
-
-		/* check we're not stuck */
-		if (dep_loop_check++ > 100) {
-			g_set_error (error,
-				     GS_PLUGIN_ERROR,
-				     GS_PLUGIN_ERROR_PLUGIN_DEPSOLVE_FAILED,
-				     "got stuck in dep loop");
-			return FALSE;
-		}
-	} while (changes);
+	graph = gs_plugin_loader_graph_new (plugin_loader,
+					    GS_PLUGIN_RULE_RUN_AFTER,
+					    GS_PLUGIN_RULE_RUN_BEFORE);
+	if (!gs_plugin_loader_graph_assign (graph, plugin_loader->plugins,
+					    gs_plugin_get_order,
+					    gs_plugin_set_order)) {
+		g_set_error (error,
+			     GS_PLUGIN_ERROR,
+			     GS_PLUGIN_ERROR_PLUGIN_DEPSOLVE_FAILED,
+			     "got stuck in dep loop");
+		return FALSE;
+	}
+	g_clear_pointer (&graph, gs_plugin_loader_graph_free);
 
 	/* check for conflicts */
 	for (i = 0; i < plugin_loader->plugins->len; i++) {
@@ -2511,7 +4102,7 @@ gs_plugin_loader_setup (GsPluginLoader *plugin_loader,
 		if (!gs_plugin_get_enabled (plugin))
 			continue;
 		deps = gs_plugin_get_rules (plugin, GS_PLUGIN_RULE_CONFLICTS);
-		for (j = 0; j < deps->len && !changes; j++) {
+		for (j = 0; j < deps->len; j++) {
 			plugin_name = g_ptr_array_index (deps, j);
 			dep = gs_plugin_loader_find_plugin (plugin_loader,
 							    plugin_name);
@@ -2531,56 +4122,32 @@ gs_plugin_loader_setup (GsPluginLoader *plugin_loader,
 			  gs_plugin_loader_plugin_sort_fn);
 
 	/* assign priority values */
-	do {
-		changes = FALSE;
-		for (i = 0; i < plugin_loader->plugins->len; i++) {
-			plugin = g_ptr_array_index (plugin_loader->plugins, i);
-			deps = gs_plugin_get_rules (plugin, GS_PLUGIN_RULE_BETTER_THAN);
-			for (j = 0; j < deps->len && !changes; j++) {
-				plugin_name = g_ptr_array_index (deps, j);
-				dep = gs_plugin_loader_find_plugin (plugin_loader,
-								    plugin_name);
-				if (dep == NULL) {
-					g_debug ("cannot find plugin '%s' "
-						 "requested by '%s'",
-						 plugin_name,
-						 gs_plugin_get_name (plugin));
-					continue;
-				}
-				if (!gs_plugin_get_enabled (dep))
-					continue;
-				if (gs_plugin_get_priority (plugin) <= gs_plugin_get_priority (dep)) {
-					gs_plugin_set_priority (plugin, gs_plugin_get_priority (dep) + 1);
-					changes = TRUE;
-				}
-			}
-		}
+	graph = gs_plugin_loader_graph_new (plugin_loader,
+					    GS_PLUGIN_RULE_BETTER_THAN,
+					    GS_PLUGIN_RULE_LAST);
+	if (!gs_plugin_loader_graph_assign (graph, plugin_loader->plugins,
+					    gs_plugin_get_priority,
+					    gs_plugin_set_priority)) {
+		g_set_error (error,
+			     GS_PLUGIN_ERROR,
+			     GS_PLUGIN_ERROR_PLUGIN_DEPSOLVE_FAILED,
+			     "got stuck in priority loop");
+		return FALSE;
+	}
+	g_clear_pointer (&graph, gs_plugin_loader_graph_free);
 
-		/* check we're not stuck */
-		if (dep_loop_check++ > 100) {
-			g_set_error (error,
-				     GS_PLUGIN_ERROR,
-				     GS_PLUGIN_ERROR_PLUGIN_DEPSOLVE_FAILED,
-				     "got stuck in priority loop");
-			return FALSE;
-		}
-	} while (changes);
+	/* anything the plugins leave attached is dispatched from here */
+	g_clear_pointer (&plugin_loader->setup_context, g_main_context_unref);
+	plugin_loader->setup_context = g_main_context_ref_thread_default ();
 
-	/* run setup */
+	/* run setup, starting each plugin as soon as the plugins it has to
+	 * run after are set up */
 	gs_plugin_job_set_action (helper->plugin_job, GS_PLUGIN_ACTION_SETUP);
 	helper->function_name = "gs_plugin_setup";
-	for (i = 0; i < plugin_loader->plugins->len; i++) {
-		g_autoptr(GError) error_local = NULL;
-		plugin = g_ptr_array_index (plugin_loader->plugins, i);
-		if (!gs_plugin_loader_call_vfunc (helper, plugin, NULL, NULL,
-						  GS_PLUGIN_REFINE_FLAGS_DEFAULT,
-						  cancellable, &error_local)) {
-			g_debug ("disabling %s as setup failed: %s",
-				 gs_plugin_get_name (plugin),
-				 error_local->message);
-			gs_plugin_set_enabled (plugin, FALSE);
-		}
-	}
+	graph = gs_plugin_loader_graph_new (plugin_loader,
+					    GS_PLUGIN_RULE_RUN_AFTER,
+					    GS_PLUGIN_RULE_RUN_BEFORE);
+	gs_plugin_loader_run_setup (helper, graph, cancellable);
 
 	/* now we can load the install-queue */
 	if (!load_install_queue (plugin_loader, error))
@@ -2596,6 +4163,13 @@ gs_plugin_loader_setup (GsPluginLoader *plugin_loader,
 						 "gnome-software",
 						 "setup",
 						 NULL);
+
+		/* sample the counters for as long as the capture runs */
+		if (plugin_loader->sysprof_sampler == NULL) {
+			plugin_loader->sysprof_sampler = g_thread_new ("gs-sysprof-sampler",
+								       gs_plugin_loader_sysprof_sampler_cb,
+								       plugin_loader);
+		}
 	}
 #endif  /* HAVE_SYSPROF */
 
@@ -2667,6 +4241,16 @@ gs_plugin_loader_dispose (GObject *object)
 {
 	GsPluginLoader *plugin_loader = GS_PLUGIN_LOADER (object);
 
+#ifdef HAVE_SYSPROF
+	gs_plugin_loader_sysprof_sampler_stop (plugin_loader);
+#endif
+
+	/* nothing the plugins attached while setting up can run after this */
+	g_mutex_lock (&plugin_loader->setup_sources_mutex);
+	g_clear_pointer (&plugin_loader->setup_sources, g_ptr_array_unref);
+	g_mutex_unlock (&plugin_loader->setup_sources_mutex);
+	g_clear_pointer (&plugin_loader->setup_context, g_main_context_unref);
+
 	if (plugin_loader->plugins != NULL) {
 		g_autoptr(GsPluginLoaderHelper) helper = NULL;
 		g_autoptr(GsPluginJob) plugin_job = NULL;
@@ -2694,11 +4278,36 @@ gs_plugin_loader_dispose (GObject *object)
 					     plugin_loader->network_metered_notify_handler);
 		plugin_loader->network_metered_notify_handler = 0;
 	}
-	if (plugin_loader->queued_ops_pool != NULL) {
-		/* stop accepting more requests and wait until any currently
+	if (plugin_loader->jobs_pool != NULL) {
+		GThreadPool *jobs_pool;
+
+		/* stop dispatching more requests and wait until any currently
 		 * running ones are finished */
-		g_thread_pool_free (plugin_loader->queued_ops_pool, TRUE, TRUE);
-		plugin_loader->queued_ops_pool = NULL;
+		g_mutex_lock (&plugin_loader->scheduler_mutex);
+		jobs_pool = g_steal_pointer (&plugin_loader->jobs_pool);
+		g_mutex_unlock (&plugin_loader->scheduler_mutex);
+		g_thread_pool_free (jobs_pool, TRUE, TRUE);
+
+		/* anything still queued is never going to run */
+		for (guint i = 0; i < GS_PLUGIN_LOADER_LANE_LAST; i++) {
+			GsPluginLoaderQueuedJob *job;
+			while ((job = g_queue_pop_head (&plugin_loader->scheduler_queue[i])) != NULL) {
+				g_autoptr(GError) error = NULL;
+				g_set_error_literal (&error,
+						     GS_PLUGIN_ERROR,
+						     GS_PLUGIN_ERROR_CANCELLED,
+						     "plugin loader was disposed");
+				if (job->inflight != NULL)
+					gs_plugin_loader_inflight_complete (job->inflight, NULL, error);
+				else
+					g_task_return_error (job->task, g_steal_pointer (&error));
+				gs_plugin_loader_queued_job_free (job);
+			}
+		}
+	}
+	if (plugin_loader->plugins_pool != NULL) {
+		g_thread_pool_free (plugin_loader->plugins_pool, TRUE, TRUE);
+		plugin_loader->plugins_pool = NULL;
 	}
 	g_clear_object (&plugin_loader->network_monitor);
 	g_clear_object (&plugin_loader->soup_session);
@@ -2728,7 +4337,20 @@ gs_plugin_loader_finalize (GObject *object)
 	g_clear_object (&plugin_loader->as_pool);
 
 	g_mutex_clear (&plugin_loader->pending_apps_mutex);
+	g_mutex_clear (&plugin_loader->scheduler_mutex);
+	g_rec_mutex_clear (&plugin_loader->inflight_mutex);
+	g_hash_table_unref (plugin_loader->inflight_jobs);
 	g_mutex_clear (&plugin_loader->events_by_id_mutex);
+	g_hash_table_unref (plugin_loader->stats);
+	g_mutex_clear (&plugin_loader->stats_mutex);
+	g_hash_table_unref (plugin_loader->breakers);
+	g_mutex_clear (&plugin_loader->breakers_mutex);
+	g_mutex_clear (&plugin_loader->setup_sources_mutex);
+	g_mutex_clear (&plugin_loader->thaw_mutex);
+#ifdef HAVE_SYSPROF
+	g_mutex_clear (&plugin_loader->sysprof_sampler_mutex);
+	g_cond_clear (&plugin_loader->sysprof_sampler_cond);
+#endif
 
 	G_OBJECT_CLASS (gs_plugin_loader_parent_class)->finalize (object);
 }
@@ -2832,16 +4454,38 @@ gs_plugin_loader_init (GsPluginLoader *plugin_loader)
 
 #ifdef HAVE_SYSPROF
 	plugin_loader->sysprof_writer = sysprof_capture_writer_new_from_env (0);
+	g_mutex_init (&plugin_loader->sysprof_sampler_mutex);
+	g_cond_init (&plugin_loader->sysprof_sampler_cond);
 #endif  /* HAVE_SYSPROF */
 
 	plugin_loader->scale = 1;
 	plugin_loader->plugins = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
 	plugin_loader->pending_apps = g_ptr_array_new_with_free_func ((GFreeFunc) g_object_unref);
-	plugin_loader->queued_ops_pool = g_thread_pool_new (gs_plugin_loader_process_in_thread_pool_cb,
-						   NULL,
-						   get_max_parallel_ops (),
-						   FALSE,
-						   NULL);
+	g_mutex_init (&plugin_loader->scheduler_mutex);
+	for (i = 0; i < GS_PLUGIN_LOADER_LANE_LAST; i++)
+		g_queue_init (&plugin_loader->scheduler_queue[i]);
+	plugin_loader->scheduler_ops_max = get_max_parallel_ops ();
+	g_rec_mutex_init (&plugin_loader->inflight_mutex);
+	plugin_loader->inflight_jobs = g_hash_table_new (g_str_hash, g_str_equal);
+	g_mutex_init (&plugin_loader->stats_mutex);
+	plugin_loader->stats = g_hash_table_new_full (g_str_hash, g_str_equal,
+						      g_free, (GDestroyNotify) gs_plugin_loader_stats_free);
+	g_mutex_init (&plugin_loader->thaw_mutex);
+	g_queue_init (&plugin_loader->thaw_queue);
+	g_mutex_init (&plugin_loader->breakers_mutex);
+	plugin_loader->breakers = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	g_mutex_init (&plugin_loader->setup_sources_mutex);
+	plugin_loader->setup_sources = g_ptr_array_new_with_free_func ((GDestroyNotify) gs_plugin_loader_setup_source_free);
+	plugin_loader->jobs_pool = g_thread_pool_new (gs_plugin_loader_process_in_thread_pool_cb,
+						      NULL,
+						      -1,
+						      FALSE,
+						      NULL);
+	plugin_loader->plugins_pool = g_thread_pool_new (gs_plugin_loader_run_shard_cb,
+							 NULL,
+							 GS_PLUGIN_LOADER_PLUGIN_THREADS_MAX,
+							 FALSE,
+							 NULL);
 	plugin_loader->file_monitors = g_ptr_array_new_with_free_func ((GFreeFunc) g_object_unref);
 	plugin_loader->locations = g_ptr_array_new_with_free_func (g_free);
 	plugin_loader->settings = g_settings_new ("org.gnome.software");
@@ -2968,6 +4612,9 @@ gs_plugin_loader_network_changed_cb (GNetworkMonitor *monitor,
 	g_object_notify (G_OBJECT (plugin_loader), "network-available");
 	g_object_notify (G_OBJECT (plugin_loader), "network-metered");
 
+	/* plugins may be able to refine more now */
+	gs_plugin_advance_refine_generation ();
+
 	if (available && !metered) {
 		g_autoptr(GsAppList) queue = NULL;
 		g_mutex_lock (&plugin_loader->pending_apps_mutex);
@@ -3117,78 +4764,306 @@ gs_plugin_loader_generic_update (GsPluginLoader *plugin_loader,
 	return TRUE;
 }
 
-static void
-gs_plugin_loader_process_thread_cb (GTask *task,
-				    gpointer object,
-				    gpointer task_data,
-				    GCancellable *cancellable)
+/* the first phase of a job with max-results: refine the results with just the
+ * filter flags the sort_func needs, then sort and truncate them so that only
+ * the top @max_results get refined with the expensive refine flags */
+static gboolean
+gs_plugin_loader_job_rank_candidates (GsPluginLoaderHelper *helper,
+				      GsAppList *list,
+				      guint max_results,
+				      GCancellable *cancellable,
+				      GError **error)
 {
-	GError *error = NULL;
-	GsPluginLoaderHelper *helper = (GsPluginLoaderHelper *) task_data;
 	GsAppListFilterFlags dedupe_flags;
-	GsAppList *list = gs_plugin_job_get_list (helper->plugin_job);
-	GsPluginAction action = gs_plugin_job_get_action (helper->plugin_job);
-	GsPluginLoader *plugin_loader = GS_PLUGIN_LOADER (object);
 	GsPluginRefineFlags filter_flags;
-	GsPluginRefineFlags refine_flags;
-	gboolean add_to_pending_array = FALSE;
-	guint max_results;
-	GsAppListSortFunc sort_func;
-	g_autoptr(GMainContext) context = g_main_context_new ();
-	g_autoptr(GsMainContextPusher) pusher = gs_main_context_pusher_new (context);
-#ifdef HAVE_SYSPROF
-	gint64 begin_time_nsec G_GNUC_UNUSED = SYSPROF_CAPTURE_CURRENT_TIME;
-#endif
-
-	/* these change the pending count on the installed panel */
-	switch (action) {
-	case GS_PLUGIN_ACTION_INSTALL:
-	case GS_PLUGIN_ACTION_REMOVE:
-		add_to_pending_array = TRUE;
-		break;
-	default:
-		break;
-	}
+	guint generation = gs_plugin_get_refine_generation ();
 
-	/* add to pending list */
-	if (add_to_pending_array)
-		gs_plugin_loader_pending_apps_add (plugin_loader, helper);
+	/* nothing to rank */
+	if (list == NULL || max_results == 0)
+		return TRUE;
 
-	/* run each plugin */
-	if (action != GS_PLUGIN_ACTION_REFINE) {
-		if (!gs_plugin_loader_run_results (helper, cancellable, &error)) {
-			if (add_to_pending_array) {
-				gs_app_set_state_recover (gs_plugin_job_get_app (helper->plugin_job));
-				gs_plugin_loader_pending_apps_remove (plugin_loader, helper);
-			}
-			gs_utils_error_convert_gio (&error);
-			g_task_return_error (task, error);
-			return;
-		}
-	}
+	/* refine with enough data so that the sort_func in
+	 * gs_plugin_loader_job_sorted_truncation() can do what it needs */
+	filter_flags = gs_plugin_job_get_filter_flags (helper->plugin_job);
+	if (filter_flags > 0 && gs_plugin_loader_job_has_sort (helper->plugin_job)) {
+		g_autoptr(GsPluginLoaderHelper) helper2 = NULL;
+		g_autoptr(GsPluginJob) plugin_job = NULL;
+		plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_REFINE,
+						 "list", list,
+						 "refine-flags", filter_flags,
+						 NULL);
+		helper2 = gs_plugin_loader_helper_new (helper->plugin_loader, plugin_job);
+		helper2->function_name_parent = helper->function_name;
+		g_debug ("running filter flags with early refine");
+		if (!gs_plugin_loader_run_refine_filter (helper2, list,
+							 filter_flags,
+							 cancellable, error))
+			return FALSE;
+
+		/* the second phase only has to add the expensive data */
+		for (guint i = 0; i < gs_app_list_length (list); i++) {
+			GsApp *app = gs_app_list_index (list, i);
+			if (g_atomic_int_get (&helper2->plugin_failed))
+				break;
+			gs_app_add_refined_flags (app, generation, filter_flags);
+		}
+	}
+
+	/* already small enough */
+	if (gs_app_list_length (list) <= max_results)
+		return TRUE;
+
+	/* don't let duplicates take the place of other results */
+	dedupe_flags = gs_plugin_job_get_dedupe_flags (helper->plugin_job);
+	if (dedupe_flags != GS_APP_LIST_FILTER_FLAG_NONE) {
+		gs_app_list_filter (list, gs_plugin_loader_app_set_prio, helper->plugin_loader);
+		gs_app_list_filter_duplicates (list, dedupe_flags);
+	}
+
+	/* filter to reduce to a sane set */
+	gs_plugin_loader_job_sorted_truncation (helper, list, max_results);
+	return TRUE;
+}
+
+static void
+gs_plugin_loader_filter_results (GsPluginLoaderHelper *helper, GsAppList *list)
+{
+	GsPluginAction action = gs_plugin_job_get_action (helper->plugin_job);
+	GsPluginLoader *plugin_loader = helper->plugin_loader;
+
+	switch (action) {
+	case GS_PLUGIN_ACTION_URL_TO_APP:
+		gs_app_list_filter (list, gs_plugin_loader_app_is_valid, helper);
+		break;
+	case GS_PLUGIN_ACTION_SEARCH:
+	case GS_PLUGIN_ACTION_SEARCH_FILES:
+	case GS_PLUGIN_ACTION_SEARCH_PROVIDES:
+	case GS_PLUGIN_ACTION_GET_ALTERNATES:
+		gs_app_list_filter (list, gs_plugin_loader_app_is_valid, helper);
+		gs_app_list_filter (list, gs_plugin_loader_filter_qt_for_gtk, NULL);
+		gs_app_list_filter (list, gs_plugin_loader_get_app_is_compatible, plugin_loader);
+		break;
+	case GS_PLUGIN_ACTION_GET_CATEGORY_APPS:
+		gs_app_list_filter (list, gs_plugin_loader_app_is_valid, helper);
+		gs_app_list_filter (list, gs_plugin_loader_filter_qt_for_gtk, NULL);
+		gs_app_list_filter (list, gs_plugin_loader_get_app_is_compatible, plugin_loader);
+		break;
+	case GS_PLUGIN_ACTION_GET_INSTALLED:
+		gs_app_list_filter (list, gs_plugin_loader_app_is_valid, helper);
+		gs_app_list_filter (list, gs_plugin_loader_app_is_valid_installed, helper);
+		break;
+	case GS_PLUGIN_ACTION_GET_FEATURED:
+		if (g_getenv ("GNOME_SOFTWARE_FEATURED") != NULL) {
+			gs_app_list_filter (list, gs_plugin_loader_featured_debug, NULL);
+		} else {
+			gs_app_list_filter (list, gs_plugin_loader_app_is_valid, helper);
+			gs_app_list_filter (list, gs_plugin_loader_get_app_is_compatible, plugin_loader);
+		}
+		break;
+	case GS_PLUGIN_ACTION_GET_UPDATES:
+		gs_app_list_filter (list, gs_plugin_loader_app_is_valid_updatable, helper);
+		break;
+	case GS_PLUGIN_ACTION_GET_RECENT:
+		gs_app_list_filter (list, gs_plugin_loader_app_is_non_compulsory, NULL);
+		gs_app_list_filter (list, gs_plugin_loader_app_is_valid, helper);
+		gs_app_list_filter (list, gs_plugin_loader_filter_qt_for_gtk, NULL);
+		gs_app_list_filter (list, gs_plugin_loader_get_app_is_compatible, plugin_loader);
+		break;
+	case GS_PLUGIN_ACTION_REFINE:
+		gs_app_list_filter (list, gs_plugin_loader_app_is_valid, helper);
+		break;
+	case GS_PLUGIN_ACTION_GET_POPULAR:
+		gs_app_list_filter (list, gs_plugin_loader_app_is_valid, helper);
+		gs_app_list_filter (list, gs_plugin_loader_filter_qt_for_gtk, NULL);
+		gs_app_list_filter (list, gs_plugin_loader_get_app_is_compatible, plugin_loader);
+		break;
+	default:
+		break;
+	}
+}
+
+/* results sent to the caller before the job has finished */
+typedef struct {
+	GsPluginLoader		*plugin_loader;
+	GsPluginLoaderBatchFunc	 batch_func;
+	gpointer		 batch_data;
+	GCancellable		*cancellable;
+	GsAppList		*list;
+} GsPluginLoaderBatch;
+
+static void
+gs_plugin_loader_batch_free (gpointer user_data)
+{
+	GsPluginLoaderBatch *batch = (GsPluginLoaderBatch *) user_data;
+	g_object_unref (batch->plugin_loader);
+	g_object_unref (batch->cancellable);
+	g_object_unref (batch->list);
+	g_slice_free (GsPluginLoaderBatch, batch);
+}
+
+static gboolean
+gs_plugin_loader_batch_cb (gpointer user_data)
+{
+	GsPluginLoaderBatch *batch = (GsPluginLoaderBatch *) user_data;
+
+	/* the caller has already moved on */
+	if (g_cancellable_is_cancelled (batch->cancellable))
+		return G_SOURCE_REMOVE;
+	batch->batch_func (batch->plugin_loader, batch->list, batch->batch_data);
+	return G_SOURCE_REMOVE;
+}
+
+/* refine, filter and send any apps in @list that have not been seen before;
+ * the apps keep the refine flags they were given here so the refine at the
+ * end of the job does not do the same work again */
+static void
+gs_plugin_loader_emit_batch (GsPluginLoaderHelper *helper,
+			     GsAppList *list,
+			     GCancellable *cancellable)
+{
+	GsPluginLoaderBatch *batch;
+	guint max_results;
+	g_autoptr(GError) error_local = NULL;
+	g_autoptr(GsAppList) new_list = NULL;
+
+	/* not streaming */
+	if (helper->batch_func == NULL)
+		return;
+	if (!gs_plugin_loader_action_is_parallel (gs_plugin_job_get_action (helper->plugin_job)))
+		return;
+	if (g_cancellable_is_cancelled (cancellable))
+		return;
+
+	/* the caller cannot show any more than this */
+	max_results = gs_plugin_job_get_max_results (helper->plugin_job);
+	if (max_results > 0 && helper->batch_cnt >= max_results)
+		return;
+
+	new_list = gs_app_list_new ();
+	for (guint i = 0; i < gs_app_list_length (list); i++) {
+		GsApp *app = gs_app_list_index (list, i);
+		if (g_hash_table_contains (helper->batch_apps, app))
+			continue;
+		g_hash_table_add (helper->batch_apps, g_object_ref (app));
+		gs_app_list_add (new_list, app);
+	}
+	if (gs_app_list_length (new_list) == 0)
+		return;
+
+	/* only refine the apps that can still be shown */
+	if (max_results > 0 &&
+	    !gs_plugin_loader_job_rank_candidates (helper, new_list,
+						   max_results - helper->batch_cnt,
+						   cancellable, &error_local)) {
+		g_debug ("not sending batch of %u apps: %s",
+			 gs_app_list_length (new_list),
+			 error_local->message);
+		return;
+	}
+	if (gs_plugin_job_get_refine_flags (helper->plugin_job) != 0 &&
+	    !gs_plugin_loader_run_refine (helper, new_list, cancellable, &error_local)) {
+		g_debug ("not sending batch of %u apps: %s",
+			 gs_app_list_length (new_list),
+			 error_local->message);
+		return;
+	}
+	gs_plugin_loader_filter_results (helper, new_list);
+	gs_app_list_filter (new_list, gs_plugin_loader_app_set_prio, helper->plugin_loader);
+	gs_app_list_filter_duplicates_incremental (new_list,
+						   helper->batch_keys,
+						   gs_plugin_job_get_dedupe_flags (helper->plugin_job));
+	gs_plugin_loader_job_sort (helper->plugin_job, new_list);
+	if (max_results > 0 &&
+	    helper->batch_cnt + gs_app_list_length (new_list) > max_results)
+		gs_app_list_truncate (new_list, max_results - helper->batch_cnt);
+	if (gs_app_list_length (new_list) == 0)
+		return;
+	helper->batch_cnt += gs_app_list_length (new_list);
+
+	g_debug ("sending batch of %u apps for %s",
+		 gs_app_list_length (new_list),
+		 gs_plugin_action_to_string (gs_plugin_job_get_action (helper->plugin_job)));
+	batch = g_slice_new0 (GsPluginLoaderBatch);
+	batch->plugin_loader = g_object_ref (helper->plugin_loader);
+	batch->batch_func = helper->batch_func;
+	batch->batch_data = helper->batch_data;
+	batch->cancellable = g_object_ref (helper->cancellable);
+	batch->list = g_steal_pointer (&new_list);
+	g_main_context_invoke_full (helper->batch_context,
+				    G_PRIORITY_DEFAULT,
+				    gs_plugin_loader_batch_cb,
+				    batch,
+				    gs_plugin_loader_batch_free);
+}
+
+static GsAppList *
+gs_plugin_loader_process_job (GsPluginLoaderHelper *helper,
+			      GCancellable *cancellable,
+			      GError **error)
+{
+	GsAppListFilterFlags dedupe_flags;
+	GsAppList *list = gs_plugin_job_get_list (helper->plugin_job);
+	GsPluginAction action = gs_plugin_job_get_action (helper->plugin_job);
+	GsPluginLoader *plugin_loader = helper->plugin_loader;
+	GsPluginRefineFlags refine_flags;
+	gboolean add_to_pending_array = FALSE;
+	g_autoptr(GMainContext) context = g_main_context_new ();
+	g_autoptr(GsMainContextPusher) pusher = gs_main_context_pusher_new (context);
+#ifdef HAVE_SYSPROF
+	gint64 begin_time_nsec G_GNUC_UNUSED = SYSPROF_CAPTURE_CURRENT_TIME;
+#endif
+
+	/* these change the pending count on the installed panel */
+	switch (action) {
+	case GS_PLUGIN_ACTION_INSTALL:
+	case GS_PLUGIN_ACTION_REMOVE:
+		add_to_pending_array = TRUE;
+		break;
+	default:
+		break;
+	}
+
+	/* add to pending list */
+	if (add_to_pending_array)
+		gs_plugin_loader_pending_apps_add (plugin_loader, helper);
+
+	/* run each plugin */
+	if (action != GS_PLUGIN_ACTION_REFINE) {
+		if (!gs_plugin_loader_run_results (helper, cancellable, error)) {
+			if (add_to_pending_array) {
+				gs_plugin_advance_refine_generation ();
+				gs_app_set_state_recover (gs_plugin_job_get_app (helper->plugin_job));
+				gs_plugin_loader_pending_apps_remove (plugin_loader, helper);
+			}
+			gs_utils_error_convert_gio (error);
+			return NULL;
+		}
+	}
 
 	/* run per-app version */
 	if (action == GS_PLUGIN_ACTION_UPDATE) {
 		helper->function_name = "gs_plugin_update_app";
 		if (!gs_plugin_loader_generic_update (plugin_loader, helper,
-						      cancellable, &error)) {
-			gs_utils_error_convert_gio (&error);
-			g_task_return_error (task, error);
-			return;
+						      cancellable, error)) {
+			gs_utils_error_convert_gio (error);
+			return NULL;
 		}
 	} else if (action == GS_PLUGIN_ACTION_DOWNLOAD) {
 		helper->function_name = "gs_plugin_download_app";
 		if (!gs_plugin_loader_generic_update (plugin_loader, helper,
-						      cancellable, &error)) {
-			gs_utils_error_convert_gio (&error);
-			g_task_return_error (task, error);
-			return;
+						      cancellable, error)) {
+			gs_utils_error_convert_gio (error);
+			return NULL;
 		}
 	}
 
 	if (action == GS_PLUGIN_ACTION_UPGRADE_TRIGGER)
 		gs_utils_set_online_updates_timestamp (plugin_loader->settings);
 
+	/* anything refined before the install or remove may now be wrong */
+	if (add_to_pending_array || action == GS_PLUGIN_ACTION_UPDATE)
+		gs_plugin_advance_refine_generation ();
+
 	/* remove from pending list */
 	if (add_to_pending_array)
 		gs_plugin_loader_pending_apps_remove (plugin_loader, helper);
@@ -3208,13 +5083,12 @@ gs_plugin_loader_process_thread_cb (GTask *task,
 	case GS_PLUGIN_ACTION_SETUP:
 	case GS_PLUGIN_ACTION_UPDATE:
 		if (!helper->anything_ran) {
-			g_set_error (&error,
+			g_set_error (error,
 				     GS_PLUGIN_ERROR,
 				     GS_PLUGIN_ERROR_NOT_SUPPORTED,
 				     "no plugin could handle %s",
 				     gs_plugin_action_to_string (action));
-			g_task_return_error (task, error);
-			return;
+			return NULL;
 		}
 		break;
 	case GS_PLUGIN_ACTION_REFINE:
@@ -3250,33 +5124,15 @@ gs_plugin_loader_process_thread_cb (GTask *task,
 		break;
 	}
 
-	/* refine with enough data so that the sort_func in
-	 * gs_plugin_loader_job_sorted_truncation() can do what it needs */
-	filter_flags = gs_plugin_job_get_filter_flags (helper->plugin_job);
-	max_results = gs_plugin_job_get_max_results (helper->plugin_job);
-	sort_func = gs_plugin_job_get_sort_func (helper->plugin_job);
-	if (filter_flags > 0 && max_results > 0 && sort_func != NULL) {
-		g_autoptr(GsPluginLoaderHelper) helper2 = NULL;
-		g_autoptr(GsPluginJob) plugin_job = NULL;
-		plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_REFINE,
-						 "list", list,
-						 "refine-flags", filter_flags,
-						 NULL);
-		helper2 = gs_plugin_loader_helper_new (helper->plugin_loader, plugin_job);
-		helper2->function_name_parent = helper->function_name;
-		g_debug ("running filter flags with early refine");
-		if (!gs_plugin_loader_run_refine_filter (helper2, list,
-							 filter_flags,
-							 cancellable, &error)) {
-			gs_utils_error_convert_gio (&error);
-			g_task_return_error (task, error);
-			return;
-		}
+	/* rank the results cheaply so only the ones that will be shown get
+	 * refined with the full refine flags */
+	if (!gs_plugin_loader_job_rank_candidates (helper, list,
+						   gs_plugin_job_get_max_results (helper->plugin_job),
+						   cancellable, error)) {
+		gs_utils_error_convert_gio (error);
+		return NULL;
 	}
 
-	/* filter to reduce to a sane set */
-	gs_plugin_loader_job_sorted_truncation (helper);
-
 	/* set the local file on any of the returned results */
 	switch (action) {
 	case GS_PLUGIN_ACTION_FILE_TO_APP:
@@ -3303,10 +5159,9 @@ gs_plugin_loader_process_thread_cb (GTask *task,
 
 	/* run refine() on each one if required */
 	if (gs_plugin_job_get_refine_flags (helper->plugin_job) != 0) {
-		if (!gs_plugin_loader_run_refine (helper, list, cancellable, &error)) {
-			gs_utils_error_convert_gio (&error);
-			g_task_return_error (task, error);
-			return;
+		if (!gs_plugin_loader_run_refine (helper, list, cancellable, error)) {
+			gs_utils_error_convert_gio (error);
+			return NULL;
 		}
 	} else {
 		g_debug ("no refine flags set for transaction");
@@ -3334,10 +5189,9 @@ gs_plugin_loader_process_thread_cb (GTask *task,
 		refine_flags = gs_plugin_job_get_refine_flags (helper->plugin_job);
 		gs_plugin_job_set_refine_flags (helper->plugin_job,
 						GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON);
-		if (!gs_plugin_loader_run_refine (helper, list, cancellable, &error)) {
-			gs_utils_error_convert_gio (&error);
-			g_task_return_error (task, error);
-			return;
+		if (!gs_plugin_loader_run_refine (helper, list, cancellable, error)) {
+			gs_utils_error_convert_gio (error);
+			return NULL;
 		}
 		/* restore the refine flags so that gs_app_list_filter sees the right thing */
 		gs_plugin_job_set_refine_flags (helper->plugin_job, refine_flags);
@@ -3347,55 +5201,7 @@ gs_plugin_loader_process_thread_cb (GTask *task,
 	}
 
 	/* filter package list */
-	switch (action) {
-	case GS_PLUGIN_ACTION_URL_TO_APP:
-		gs_app_list_filter (list, gs_plugin_loader_app_is_valid, helper);
-		break;
-	case GS_PLUGIN_ACTION_SEARCH:
-	case GS_PLUGIN_ACTION_SEARCH_FILES:
-	case GS_PLUGIN_ACTION_SEARCH_PROVIDES:
-	case GS_PLUGIN_ACTION_GET_ALTERNATES:
-		gs_app_list_filter (list, gs_plugin_loader_app_is_valid, helper);
-		gs_app_list_filter (list, gs_plugin_loader_filter_qt_for_gtk, NULL);
-		gs_app_list_filter (list, gs_plugin_loader_get_app_is_compatible, plugin_loader);
-		break;
-	case GS_PLUGIN_ACTION_GET_CATEGORY_APPS:
-		gs_app_list_filter (list, gs_plugin_loader_app_is_valid, helper);
-		gs_app_list_filter (list, gs_plugin_loader_filter_qt_for_gtk, NULL);
-		gs_app_list_filter (list, gs_plugin_loader_get_app_is_compatible, plugin_loader);
-		break;
-	case GS_PLUGIN_ACTION_GET_INSTALLED:
-		gs_app_list_filter (list, gs_plugin_loader_app_is_valid, helper);
-		gs_app_list_filter (list, gs_plugin_loader_app_is_valid_installed, helper);
-		break;
-	case GS_PLUGIN_ACTION_GET_FEATURED:
-		if (g_getenv ("GNOME_SOFTWARE_FEATURED") != NULL) {
-			gs_app_list_filter (list, gs_plugin_loader_featured_debug, NULL);
-		} else {
-			gs_app_list_filter (list, gs_plugin_loader_app_is_valid, helper);
-			gs_app_list_filter (list, gs_plugin_loader_get_app_is_compatible, plugin_loader);
-		}
-		break;
-	case GS_PLUGIN_ACTION_GET_UPDATES:
-		gs_app_list_filter (list, gs_plugin_loader_app_is_valid_updatable, helper);
-		break;
-	case GS_PLUGIN_ACTION_GET_RECENT:
-		gs_app_list_filter (list, gs_plugin_loader_app_is_non_compulsory, NULL);
-		gs_app_list_filter (list, gs_plugin_loader_app_is_valid, helper);
-		gs_app_list_filter (list, gs_plugin_loader_filter_qt_for_gtk, NULL);
-		gs_app_list_filter (list, gs_plugin_loader_get_app_is_compatible, plugin_loader);
-		break;
-	case GS_PLUGIN_ACTION_REFINE:
-		gs_app_list_filter (list, gs_plugin_loader_app_is_valid, helper);
-		break;
-	case GS_PLUGIN_ACTION_GET_POPULAR:
-		gs_app_list_filter (list, gs_plugin_loader_app_is_valid, helper);
-		gs_app_list_filter (list, gs_plugin_loader_filter_qt_for_gtk, NULL);
-		gs_app_list_filter (list, gs_plugin_loader_get_app_is_compatible, plugin_loader);
-		break;
-	default:
-		break;
-	}
+	gs_plugin_loader_filter_results (helper, list);
 
 	/* only allow one result */
 	if (action == GS_PLUGIN_ACTION_URL_TO_APP ||
@@ -3410,8 +5216,8 @@ gs_plugin_loader_process_thread_cb (GTask *task,
 				     "no application was created for %s", str);
 			event = gs_plugin_job_to_failed_event (helper->plugin_job, error_local);
 			gs_plugin_loader_add_event (plugin_loader, event);
-			g_task_return_error (task, g_steal_pointer (&error_local));
-			return;
+			g_propagate_error (error, g_steal_pointer (&error_local));
+			return NULL;
 		}
 		if (gs_app_list_length (list) > 1) {
 			g_autofree gchar *str = gs_plugin_job_to_string (helper->plugin_job);
@@ -3448,34 +5254,137 @@ gs_plugin_loader_process_thread_cb (GTask *task,
 	}
 #endif  /* HAVE_SYSPROF */
 
+	/* some plugins were skipped or cut off */
+	if (g_atomic_int_get (&helper->partial))
+		gs_app_list_add_flag (list, GS_APP_LIST_FLAG_IS_PARTIAL);
+
 	/* show elapsed time */
 	gs_plugin_loader_job_debug (helper);
 
 	/* success */
-	g_task_return_pointer (task, g_object_ref (list), (GDestroyNotify) g_object_unref);
+	return g_object_ref (list);
+}
+
+static void
+gs_plugin_loader_process_thread_cb (GTask *task,
+				    gpointer object,
+				    gpointer task_data,
+				    GCancellable *cancellable)
+{
+	GsPluginLoaderHelper *helper = (GsPluginLoaderHelper *) task_data;
+	GError *error = NULL;
+	GsAppList *list;
+
+	list = gs_plugin_loader_process_job (helper, cancellable, &error);
+	if (list == NULL) {
+		g_task_return_error (task, error);
+		return;
+	}
+	g_task_return_pointer (task, list, (GDestroyNotify) g_object_unref);
+}
+
+/* must be called with scheduler_mutex held */
+static void
+gs_plugin_loader_scheduler_dispatch_locked (GsPluginLoader *plugin_loader)
+{
+	gint64 now = g_get_monotonic_time ();
+
+	while (plugin_loader->jobs_pool != NULL) {
+		GsPluginLoaderQueuedJob *job;
+		GQueue *best_queue = NULL;
+		GList *best_link = NULL;
+		gint64 best_priority = G_MAXINT64;
+
+		/* consider the oldest runnable job of each lane that is under
+		 * its limit; jobs are promoted by one lane for each aging
+		 * period they have been waiting so background work is not
+		 * starved forever by a busy foreground */
+		for (guint i = 0; i < GS_PLUGIN_LOADER_LANE_LAST; i++) {
+			GQueue *queue = &plugin_loader->scheduler_queue[i];
+			if (plugin_loader->scheduler_running[i] >= gs_plugin_loader_lane_max[i])
+				continue;
+			for (GList *l = queue->head; l != NULL; l = l->next) {
+				gint64 priority;
+				job = l->data;
+				if (job->is_op &&
+				    plugin_loader->scheduler_ops_running >= plugin_loader->scheduler_ops_max)
+					continue;
+				priority = (gint64) i - (now - job->queued) /
+					   (GS_PLUGIN_LOADER_LANE_AGING_TIME * G_USEC_PER_SEC);
+				if (priority < best_priority) {
+					best_priority = priority;
+					best_queue = queue;
+					best_link = l;
+				}
+				break;
+			}
+		}
+		if (best_link == NULL)
+			break;
+
+		job = best_link->data;
+		g_queue_delete_link (best_queue, best_link);
+		gs_plugin_loader_scheduler_run_locked (plugin_loader, job);
+	}
+}
+
+/* must be called with scheduler_mutex held */
+static void
+gs_plugin_loader_scheduler_run_locked (GsPluginLoader *plugin_loader,
+				       GsPluginLoaderQueuedJob *job)
+{
+	plugin_loader->scheduler_running[job->lane]++;
+	plugin_loader->scheduler_running_total++;
+	if (job->is_op)
+		plugin_loader->scheduler_ops_running++;
+	g_thread_pool_push (plugin_loader->jobs_pool, job, NULL);
 }
 
 static void
 gs_plugin_loader_process_in_thread_pool_cb (gpointer data,
 					    gpointer user_data)
 {
-	GTask *task = data;
-	gpointer source_object = g_task_get_source_object (task);
-	gpointer task_data = g_task_get_task_data (task);
-	GCancellable *cancellable = g_task_get_cancellable (task);
-	GsPluginLoaderHelper *helper = g_task_get_task_data (task);
+	GsPluginLoaderQueuedJob *job = data;
+	GsPluginLoaderHelper *helper = job->helper;
+	GsPluginLoader *plugin_loader = helper->plugin_loader;
 	GsApp *app = gs_plugin_job_get_app (helper->plugin_job);
 	GsPluginAction action = gs_plugin_job_get_action (helper->plugin_job);
 
-	gs_ioprio_init ();
+	g_private_set (&gs_plugin_loader_job_thread, job);
+
+	/* threads are shared between lanes, so set this for every job */
+	if (job->is_op || job->lane == GS_PLUGIN_LOADER_LANE_BACKGROUND)
+		gs_ioprio_init ();
+	else
+		gs_ioprio_reset ();
 
-	gs_plugin_loader_process_thread_cb (task, source_object, task_data, cancellable);
+	if (job->inflight != NULL) {
+		g_autoptr(GError) error = NULL;
+		g_autoptr(GsAppList) list = NULL;
+		list = gs_plugin_loader_process_job (helper, helper->cancellable, &error);
+		gs_plugin_loader_inflight_complete (job->inflight, list, error);
+	} else {
+		gs_plugin_loader_process_thread_cb (job->task,
+						    plugin_loader,
+						    helper,
+						    g_task_get_cancellable (job->task));
+	}
 
-	/* Clear any pending action set in gs_plugin_loader_schedule_task() */
-	if (app != NULL && gs_app_get_pending_action (app) == action)
+	/* Clear any pending action set in gs_plugin_loader_schedule_job() */
+	if (job->is_op && app != NULL && gs_app_get_pending_action (app) == action)
 		gs_app_set_pending_action (app, GS_PLUGIN_ACTION_UNKNOWN);
 
-	g_object_unref (task);
+	/* let the next job have this thread */
+	g_private_set (&gs_plugin_loader_job_thread, NULL);
+	g_mutex_lock (&plugin_loader->scheduler_mutex);
+	plugin_loader->scheduler_running[job->lane]--;
+	plugin_loader->scheduler_running_total--;
+	if (job->is_op)
+		plugin_loader->scheduler_ops_running--;
+	gs_plugin_loader_scheduler_dispatch_locked (plugin_loader);
+	g_mutex_unlock (&plugin_loader->scheduler_mutex);
+
+	gs_plugin_loader_queued_job_free (job);
 }
 
 static gboolean
@@ -3503,40 +5412,121 @@ gs_plugin_loader_cancelled_cb (GCancellable *cancellable, GsPluginLoaderHelper *
 	g_cancellable_cancel (helper->cancellable);
 }
 
+static gboolean
+gs_plugin_loader_job_can_coalesce (GsPluginJob *plugin_job)
+{
+	/* jobs that modify their input list or have side effects can't be
+	 * shared between callers */
+	if (gs_app_list_length (gs_plugin_job_get_list (plugin_job)) > 0)
+		return FALSE;
+	switch (gs_plugin_job_get_action (plugin_job)) {
+	case GS_PLUGIN_ACTION_GET_ALTERNATES:
+	case GS_PLUGIN_ACTION_GET_CATEGORY_APPS:
+	case GS_PLUGIN_ACTION_GET_DISTRO_UPDATES:
+	case GS_PLUGIN_ACTION_GET_FEATURED:
+	case GS_PLUGIN_ACTION_GET_INSTALLED:
+	case GS_PLUGIN_ACTION_GET_LANGPACKS:
+	case GS_PLUGIN_ACTION_GET_POPULAR:
+	case GS_PLUGIN_ACTION_GET_RECENT:
+	case GS_PLUGIN_ACTION_GET_SOURCES:
+	case GS_PLUGIN_ACTION_GET_UNVOTED_REVIEWS:
+	case GS_PLUGIN_ACTION_GET_UPDATES:
+	case GS_PLUGIN_ACTION_GET_UPDATES_HISTORICAL:
+	case GS_PLUGIN_ACTION_SEARCH:
+	case GS_PLUGIN_ACTION_SEARCH_FILES:
+	case GS_PLUGIN_ACTION_SEARCH_PROVIDES:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+static GsPluginLoaderLane
+gs_plugin_loader_get_lane (GsPluginJob *plugin_job)
+{
+	if (gs_plugin_job_get_interactive (plugin_job))
+		return GS_PLUGIN_LOADER_LANE_INTERACTIVE;
+	switch (gs_plugin_job_get_action (plugin_job)) {
+	case GS_PLUGIN_ACTION_DOWNLOAD:
+	case GS_PLUGIN_ACTION_INSTALL:
+	case GS_PLUGIN_ACTION_REFRESH:
+	case GS_PLUGIN_ACTION_REMOVE:
+	case GS_PLUGIN_ACTION_UPDATE:
+	case GS_PLUGIN_ACTION_UPGRADE_DOWNLOAD:
+		return GS_PLUGIN_LOADER_LANE_BACKGROUND;
+	default:
+		return GS_PLUGIN_LOADER_LANE_FOREGROUND;
+	}
+}
+
+static gboolean
+gs_plugin_loader_action_is_queued_op (GsPluginAction action)
+{
+	/* we want to limit the number of these running in parallel whatever
+	 * lane they are in, see gs_plugin_loader_set_max_parallel_ops() */
+	switch (action) {
+	case GS_PLUGIN_ACTION_INSTALL:
+	case GS_PLUGIN_ACTION_UPDATE:
+	case GS_PLUGIN_ACTION_UPGRADE_DOWNLOAD:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
 static void
-gs_plugin_loader_schedule_task (GsPluginLoader *plugin_loader,
-				GTask *task)
+gs_plugin_loader_schedule_job (GsPluginLoader *plugin_loader,
+			       GsPluginLoaderHelper *helper,
+			       GTask *task,
+			       GsPluginLoaderInflight *inflight)
 {
-	GsPluginLoaderHelper *helper = g_task_get_task_data (task);
 	GsApp *app = gs_plugin_job_get_app (helper->plugin_job);
+	GsPluginAction action = gs_plugin_job_get_action (helper->plugin_job);
+	GsPluginLoaderQueuedJob *job = g_slice_new0 (GsPluginLoaderQueuedJob);
 
-	if (app != NULL) {
-		/* set the pending-action to the app */
-		GsPluginAction action = gs_plugin_job_get_action (helper->plugin_job);
+	job->helper = helper;
+	job->task = task != NULL ? g_object_ref (task) : NULL;
+	job->inflight = inflight;
+	job->lane = gs_plugin_loader_get_lane (helper->plugin_job);
+	job->is_op = gs_plugin_loader_action_is_queued_op (action);
+	job->queued = g_get_monotonic_time ();
+
+	/* set the pending-action to the app */
+	if (job->is_op && app != NULL)
 		gs_app_set_pending_action (app, action);
+
+	g_mutex_lock (&plugin_loader->scheduler_mutex);
+
+	/* the calling job holds a thread until this one finishes, so waiting
+	 * for a free slot could deadlock */
+	if (g_private_get (&gs_plugin_loader_job_thread) != NULL &&
+	    plugin_loader->jobs_pool != NULL) {
+		g_debug ("running nested %s in lane %u now", helper->function_name, job->lane);
+		gs_plugin_loader_scheduler_run_locked (plugin_loader, job);
+		g_mutex_unlock (&plugin_loader->scheduler_mutex);
+		return;
 	}
-	g_thread_pool_push (plugin_loader->queued_ops_pool, g_object_ref (task), NULL);
+	g_queue_push_tail (&plugin_loader->scheduler_queue[job->lane], job);
+	g_debug ("queued %s in lane %u, %u waiting, %u running",
+		 helper->function_name, job->lane,
+		 plugin_loader->scheduler_queue[job->lane].length,
+		 plugin_loader->scheduler_running[job->lane]);
+	gs_plugin_loader_scheduler_dispatch_locked (plugin_loader);
+	g_mutex_unlock (&plugin_loader->scheduler_mutex);
 }
 
-/**
- * gs_plugin_loader_job_process_async:
- * @plugin_loader: A #GsPluginLoader
- * @plugin_job: job to process
- * @cancellable: a #GCancellable, or %NULL
- * @callback: function to call when complete
- * @user_data: user data to pass to @callback
- *
- * This method calls all plugins.
- **/
-void
-gs_plugin_loader_job_process_async (GsPluginLoader *plugin_loader,
-				    GsPluginJob *plugin_job,
-				    GCancellable *cancellable,
-				    GAsyncReadyCallback callback,
-				    gpointer user_data)
+static void
+gs_plugin_loader_job_process_internal (GsPluginLoader *plugin_loader,
+				       GsPluginJob *plugin_job,
+				       GCancellable *cancellable,
+				       GsPluginLoaderBatchFunc batch_func,
+				       gpointer batch_data,
+				       GAsyncReadyCallback callback,
+				       gpointer user_data)
 {
 	GsPluginAction action;
 	GsPluginLoaderHelper *helper;
+	GsPluginLoaderInflight *inflight = NULL;
 	g_autoptr(GTask) task = NULL;
 	g_autoptr(GCancellable) cancellable_job = g_cancellable_new ();
 #if GLIB_CHECK_VERSION(2, 60, 0)
@@ -3609,6 +5599,11 @@ gs_plugin_loader_job_process_async (GsPluginLoader *plugin_loader,
 		gs_plugin_job_add_refine_flags (plugin_job,
 						GS_PLUGIN_REFINE_FLAGS_REQUIRE_ORIGIN);
 	}
+	if (gs_plugin_job_has_refine_flags (plugin_job,
+					    GS_PLUGIN_REFINE_FLAGS_REQUIRE_KEY_COLORS)) {
+		gs_plugin_job_add_refine_flags (plugin_job,
+						GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON);
+	}
 	if (gs_plugin_job_has_refine_flags (plugin_job,
 					    GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE)) {
 		gs_plugin_job_add_refine_flags (plugin_job,
@@ -3669,31 +5664,31 @@ gs_plugin_loader_job_process_async (GsPluginLoader *plugin_loader,
 	/* sorting fallbacks */
 	switch (action) {
 	case GS_PLUGIN_ACTION_SEARCH:
-		if (gs_plugin_job_get_sort_func (plugin_job) == NULL) {
+		if (!gs_plugin_loader_job_has_sort (plugin_job)) {
 			gs_plugin_job_set_sort_func (plugin_job,
 						     gs_plugin_loader_app_sort_match_value_cb);
 		}
 		break;
 	case GS_PLUGIN_ACTION_GET_RECENT:
-		if (gs_plugin_job_get_sort_func (plugin_job) == NULL) {
+		if (!gs_plugin_loader_job_has_sort (plugin_job)) {
 			gs_plugin_job_set_sort_func (plugin_job,
 						     gs_plugin_loader_app_sort_kind_cb);
 		}
 		break;
 	case GS_PLUGIN_ACTION_GET_CATEGORY_APPS:
-		if (gs_plugin_job_get_sort_func (plugin_job) == NULL) {
-			gs_plugin_job_set_sort_func (plugin_job,
-						     gs_plugin_loader_app_sort_name_cb);
+		if (!gs_plugin_loader_job_has_sort (plugin_job)) {
+			gs_plugin_job_set_sort_key_func (plugin_job,
+							 gs_plugin_loader_app_sort_name_key_cb);
 		}
 		break;
 	case GS_PLUGIN_ACTION_GET_ALTERNATES:
-		if (gs_plugin_job_get_sort_func (plugin_job) == NULL) {
+		if (!gs_plugin_loader_job_has_sort (plugin_job)) {
 			gs_plugin_job_set_sort_func (plugin_job,
 						     gs_plugin_loader_app_sort_prio_cb);
 		}
 		break;
 	case GS_PLUGIN_ACTION_GET_DISTRO_UPDATES:
-		if (gs_plugin_job_get_sort_func (plugin_job) == NULL) {
+		if (!gs_plugin_loader_job_has_sort (plugin_job)) {
 			gs_plugin_job_set_sort_func (plugin_job,
 						     gs_plugin_loader_app_sort_version_cb);
 		}
@@ -3702,14 +5697,42 @@ gs_plugin_loader_job_process_async (GsPluginLoader *plugin_loader,
 		break;
 	}
 
-	/* save helper */
-	helper = gs_plugin_loader_helper_new (plugin_loader, plugin_job);
-	g_task_set_task_data (task, helper, (GDestroyNotify) gs_plugin_loader_helper_free);
-
 	/* let the task cancel itself */
 	g_task_set_check_cancellable (task, FALSE);
 	g_task_set_return_on_cancel (task, FALSE);
 
+	/* share the results of an identical job if one is already running;
+	 * each streaming caller needs its own batches so is never shared, and
+	 * a job started from inside another job might wait on a shared job
+	 * that is still queued */
+	if (batch_func == NULL &&
+	    g_private_get (&gs_plugin_loader_job_thread) == NULL &&
+	    gs_plugin_loader_job_can_coalesce (plugin_job)) {
+		g_autofree gchar *key = gs_plugin_job_to_key (plugin_job);
+		if (key != NULL &&
+		    gs_plugin_loader_inflight_join (plugin_loader, key, task,
+						    cancellable, &inflight))
+			return;
+	}
+
+	/* save helper */
+	helper = gs_plugin_loader_helper_new (plugin_loader, plugin_job);
+	if (inflight != NULL)
+		inflight->helper = helper;
+	else
+		g_task_set_task_data (task, helper, (GDestroyNotify) gs_plugin_loader_helper_free);
+
+	/* send partial results back to the context the caller is using */
+	if (batch_func != NULL) {
+		helper->batch_func = batch_func;
+		helper->batch_data = batch_data;
+		helper->batch_context = g_main_context_ref_thread_default ();
+		helper->batch_apps = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+							    (GDestroyNotify) g_object_unref, NULL);
+		helper->batch_keys = g_hash_table_new_full (g_str_hash, g_str_equal,
+							    g_free, NULL);
+	}
+
 	/* AppStream metadata pool, we only need it to create good search tokens */
 	if (plugin_loader->as_pool == NULL)
 		plugin_loader->as_pool = as_pool_new ();
@@ -3719,18 +5742,30 @@ gs_plugin_loader_job_process_async (GsPluginLoader *plugin_loader,
 		const gchar *search = gs_plugin_job_get_search (plugin_job);
 		helper->tokens = as_pool_build_search_tokens (plugin_loader->as_pool, search);
 		if (helper->tokens == NULL) {
-			g_task_return_new_error (task,
-						 GS_PLUGIN_ERROR,
-						 GS_PLUGIN_ERROR_NOT_SUPPORTED,
-						 "failed to tokenize %s", search);
+			g_autoptr(GError) error = NULL;
+			g_set_error (&error,
+				     GS_PLUGIN_ERROR,
+				     GS_PLUGIN_ERROR_NOT_SUPPORTED,
+				     "failed to tokenize %s", search);
+			if (inflight != NULL) {
+				gs_plugin_loader_inflight_complete (inflight, NULL, error);
+				gs_plugin_loader_inflight_free (inflight);
+				return;
+			}
+			g_task_return_error (task, g_steal_pointer (&error));
 			return;
 		}
 	}
 
-	/* jobs always have a valid cancellable, so proxy the caller */
-	helper->cancellable = g_object_ref (cancellable_job);
-	g_debug ("Chaining cancellation from %p to %p", cancellable, cancellable_job);
-	if (cancellable != NULL) {
+	/* jobs always have a valid cancellable, so proxy the caller; shared
+	 * jobs are only cancelled when every caller has cancelled */
+	if (inflight != NULL) {
+		helper->cancellable = g_object_ref (inflight->cancellable);
+	} else {
+		helper->cancellable = g_object_ref (cancellable_job);
+		g_debug ("Chaining cancellation from %p to %p", cancellable, cancellable_job);
+	}
+	if (inflight == NULL && cancellable != NULL) {
 		helper->cancellable_caller = g_object_ref (cancellable);
 		helper->cancellable_id =
 			g_cancellable_connect (helper->cancellable_caller,
@@ -3753,25 +5788,78 @@ gs_plugin_loader_job_process_async (GsPluginLoader *plugin_loader,
 			g_timeout_add_seconds (gs_plugin_job_get_timeout (plugin_job),
 					       gs_plugin_loader_job_timeout_cb,
 					       helper);
+		if (gs_plugin_job_get_timeout (plugin_job) > 0) {
+			gint64 timeout_usec = (gint64) gs_plugin_job_get_timeout (plugin_job) * G_USEC_PER_SEC;
+			helper->deadline = g_get_monotonic_time () + timeout_usec;
+			helper->deadline_reserve = timeout_usec / 4;
+		}
 		break;
 	default:
 		break;
 	}
 
-	switch (action) {
-	case GS_PLUGIN_ACTION_INSTALL:
-	case GS_PLUGIN_ACTION_UPDATE:
-	case GS_PLUGIN_ACTION_UPGRADE_DOWNLOAD:
-		/* these actions must be performed by the thread pool because we
-		 * want to limit the number of them running in parallel */
-		gs_plugin_loader_schedule_task (plugin_loader, task);
-		return;
-	default:
-		break;
-	}
+	/* run in a thread once the scheduler has a free slot in the lane */
+	if (inflight != NULL)
+		gs_plugin_loader_schedule_job (plugin_loader, helper, NULL, inflight);
+	else
+		gs_plugin_loader_schedule_job (plugin_loader, helper, task, NULL);
+}
 
-	/* run in a thread */
-	g_task_run_in_thread (task, gs_plugin_loader_process_thread_cb);
+/**
+ * gs_plugin_loader_job_process_async:
+ * @plugin_loader: A #GsPluginLoader
+ * @plugin_job: job to process
+ * @cancellable: a #GCancellable, or %NULL
+ * @callback: function to call when complete
+ * @user_data: user data to pass to @callback
+ *
+ * This method calls all plugins.
+ **/
+void
+gs_plugin_loader_job_process_async (GsPluginLoader *plugin_loader,
+				    GsPluginJob *plugin_job,
+				    GCancellable *cancellable,
+				    GAsyncReadyCallback callback,
+				    gpointer user_data)
+{
+	gs_plugin_loader_job_process_internal (plugin_loader, plugin_job, cancellable,
+					       NULL, NULL, callback, user_data);
+}
+
+/**
+ * gs_plugin_loader_job_process_streaming_async:
+ * @plugin_loader: A #GsPluginLoader
+ * @plugin_job: job to process
+ * @cancellable: a #GCancellable, or %NULL
+ * @batch_func: function to call with each batch of partial results
+ * @batch_data: user data to pass to @batch_func
+ * @callback: function to call when complete
+ * @user_data: user data to pass to @callback
+ *
+ * This method calls all plugins, like gs_plugin_loader_job_process_async(),
+ * but also calls @batch_func in the thread-default main context of the caller
+ * each time a plugin returns results that have not been seen before.
+ *
+ * Each batch is refined and filtered like the final results, and apps that
+ * are duplicates of an app in an earlier batch according to the
+ * #GsPluginJob:dedupe-flags are not sent again. Batches are never sent after
+ * @cancellable has been cancelled, and the list passed to @callback is still
+ * the complete, sorted and truncated result that should replace them.
+ *
+ * Only actions that return a list of results send batches.
+ **/
+void
+gs_plugin_loader_job_process_streaming_async (GsPluginLoader *plugin_loader,
+					      GsPluginJob *plugin_job,
+					      GCancellable *cancellable,
+					      GsPluginLoaderBatchFunc batch_func,
+					      gpointer batch_data,
+					      GAsyncReadyCallback callback,
+					      gpointer user_data)
+{
+	g_return_if_fail (batch_func != NULL);
+	gs_plugin_loader_job_process_internal (plugin_loader, plugin_job, cancellable,
+					       batch_func, batch_data, callback, user_data);
 }
 
 /******************************************************************************/
@@ -3873,12 +5961,12 @@ void
 gs_plugin_loader_set_max_parallel_ops (GsPluginLoader *plugin_loader,
 				       guint max_ops)
 {
-	g_autoptr(GError) error = NULL;
 	if (max_ops == 0)
 		max_ops = get_max_parallel_ops ();
-	if (!g_thread_pool_set_max_threads (plugin_loader->queued_ops_pool, max_ops, &error))
-		g_warning ("Failed to set the maximum number of ops in parallel: %s",
-			   error->message);
+	g_mutex_lock (&plugin_loader->scheduler_mutex);
+	plugin_loader->scheduler_ops_max = max_ops;
+	gs_plugin_loader_scheduler_dispatch_locked (plugin_loader);
+	g_mutex_unlock (&plugin_loader->scheduler_mutex);
 }
 
 const gchar *
@@ -23,12 +23,31 @@ G_BEGIN_DECLS
 #define GS_TYPE_PLUGIN_LOADER		(gs_plugin_loader_get_type ())
 G_DECLARE_FINAL_TYPE (GsPluginLoader, gs_plugin_loader, GS, PLUGIN_LOADER, GObject)
 
+/**
+ * GsPluginLoaderBatchFunc:
+ * @plugin_loader: A #GsPluginLoader
+ * @list: the new results
+ * @user_data: user data passed to gs_plugin_loader_job_process_streaming_async()
+ *
+ * Called with each batch of partial results of a streaming job.
+ **/
+typedef void	 (*GsPluginLoaderBatchFunc)		(GsPluginLoader	*plugin_loader,
+							 GsAppList	*list,
+							 gpointer	 user_data);
+
 GsPluginLoader	*gs_plugin_loader_new			(void);
 void		 gs_plugin_loader_job_process_async	(GsPluginLoader	*plugin_loader,
 							 GsPluginJob	*plugin_job,
 							 GCancellable	*cancellable,
 							 GAsyncReadyCallback callback,
 							 gpointer	 user_data);
+void		 gs_plugin_loader_job_process_streaming_async (GsPluginLoader *plugin_loader,
+							 GsPluginJob	*plugin_job,
+							 GCancellable	*cancellable,
+							 GsPluginLoaderBatchFunc batch_func,
+							 gpointer	 batch_data,
+							 GAsyncReadyCallback callback,
+							 gpointer	 user_data);
 GsAppList	*gs_plugin_loader_job_process_finish	(GsPluginLoader	*plugin_loader,
 							 GAsyncResult	*res,
 							 GError		**error);
@@ -63,6 +82,8 @@ gboolean	 gs_plugin_loader_get_network_metered	(GsPluginLoader *plugin_loader);
 gboolean	 gs_plugin_loader_get_plugin_supported	(GsPluginLoader	*plugin_loader,
 							 const gchar	*function_name);
 
+GVariant	*gs_plugin_loader_get_stats		(GsPluginLoader	*plugin_loader);
+
 GPtrArray	*gs_plugin_loader_get_events		(GsPluginLoader	*plugin_loader);
 GsPluginEvent	*gs_plugin_loader_get_event_default	(GsPluginLoader	*plugin_loader);
 void		 gs_plugin_loader_remove_events		(GsPluginLoader	*plugin_loader);
@@ -45,9 +45,24 @@ GPtrArray	*gs_plugin_get_rules			(GsPlugin	*plugin,
 							 GsPluginRule	 rule);
 gpointer	 gs_plugin_get_symbol			(GsPlugin	*plugin,
 							 const gchar	*function_name);
+gboolean	 gs_plugin_get_setup_lazy		(GsPlugin	*plugin);
+gboolean	 gs_plugin_has_setup_action		(GsPlugin	*plugin,
+							 GsPluginAction	 action);
+gboolean	 gs_plugin_get_setup_done		(GsPlugin	*plugin);
+gboolean	 gs_plugin_ensure_setup			(GsPlugin	*plugin,
+							 GCancellable	*cancellable,
+							 GError		**error);
+void		 gs_plugin_set_setup_done		(GsPlugin	*plugin);
+guint		 gs_plugin_get_setup_serial		(GsPlugin	*plugin);
+void		 gs_plugin_reset_setup			(GsPlugin	*plugin);
+guint		 gs_plugin_get_cache_hits		(GsPlugin	*plugin);
+guint		 gs_plugin_get_cache_misses		(GsPlugin	*plugin);
+guint		 gs_plugin_get_silo_rebuilds		(GsPlugin	*plugin);
 void		 gs_plugin_interactive_inc		(GsPlugin	*plugin);
 void		 gs_plugin_interactive_dec		(GsPlugin	*plugin);
 gchar		*gs_plugin_refine_flags_to_string	(GsPluginRefineFlags refine_flags);
+guint		 gs_plugin_get_refine_generation	(void);
+void		 gs_plugin_advance_refine_generation	(void);
 void		 gs_plugin_set_network_monitor		(GsPlugin		*plugin,
 							 GNetworkMonitor	*monitor);
 
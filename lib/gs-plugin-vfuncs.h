@@ -166,6 +166,11 @@ gboolean	 gs_plugin_add_alternates		(GsPlugin	*plugin,
  *
  * This function will also not be called if gs_plugin_initialize() self-disabled.
  *
+ * This is called from a worker thread with a new thread-default #GMainContext
+ * pushed. Anything still attached to that context when this returns, such as
+ * a #GFileMonitor, is dispatched from the context the plugin loader was set up
+ * from.
+ *
  * Returns: %TRUE for success
  **/
 gboolean	 gs_plugin_setup			(GsPlugin	*plugin,
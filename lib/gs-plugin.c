@@ -51,6 +51,9 @@ typedef struct
 {
 	GHashTable		*cache;
 	GMutex			 cache_mutex;
+	guint			 cache_hits;		/* atomic */
+	guint			 cache_misses;		/* atomic */
+	guint			 silo_rebuilds;		/* atomic */
 	GModule			*module;
 	GsPluginData		*data;			/* for gs-plugin-{name}.c */
 	GsPluginFlags		 flags;
@@ -71,8 +74,14 @@ typedef struct
 	guint			 timer_id;
 	GMutex			 timer_mutex;
 	GNetworkMonitor		*network_monitor;
+	guint64			 setup_actions;		/* bitfield of GsPluginAction */
+	gboolean		 setup_done;
+	guint			 setup_serial;
+	GMutex			 setup_mutex;
 } GsPluginPrivate;
 
+static gint gs_plugin_setup_serial = 0;	/* atomic, see gs_plugin_get_setup_serial() */
+
 G_DEFINE_TYPE_WITH_PRIVATE (GsPlugin, gs_plugin, G_TYPE_OBJECT)
 
 G_DEFINE_QUARK (gs-plugin-error-quark, gs_plugin_error)
@@ -96,6 +105,9 @@ enum {
 static guint signals [SIGNAL_LAST] = { 0 };
 
 typedef const gchar	**(*GsPluginGetDepsFunc)	(GsPlugin	*plugin);
+typedef gboolean	 (*GsPluginSetupFunc)		(GsPlugin	*plugin,
+							 GCancellable	*cancellable,
+							 GError		**error);
 
 /**
  * gs_plugin_status_to_string:
@@ -221,6 +233,7 @@ gs_plugin_finalize (GObject *object)
 	g_mutex_clear (&priv->interactive_mutex);
 	g_mutex_clear (&priv->timer_mutex);
 	g_mutex_clear (&priv->vfuncs_mutex);
+	g_mutex_clear (&priv->setup_mutex);
 #ifndef RUNNING_ON_VALGRIND
 	if (priv->module != NULL)
 		g_module_close (priv->module);
@@ -741,8 +754,8 @@ gs_plugin_remove_flags (GsPlugin *plugin, GsPluginFlags flags)
  * for example the plugin specified by @name will be ordered after this plugin
  * when %GS_PLUGIN_RULE_RUN_AFTER is used.
  *
- * NOTE: The depsolver is iterative and may not solve overly-complicated rules;
- * If depsolving fails then gnome-software will not start.
+ * NOTE: If the rules contain a cycle then depsolving fails and gnome-software
+ * will not start.
  *
  * Since: 3.22
  **/
@@ -753,6 +766,158 @@ gs_plugin_add_rule (GsPlugin *plugin, GsPluginRule rule, const gchar *name)
 	g_ptr_array_add (priv->rules[rule], g_strdup (name));
 }
 
+/**
+ * gs_plugin_add_setup_action:
+ * @plugin: a #GsPlugin
+ * @action: a #GsPluginAction, e.g. %GS_PLUGIN_ACTION_SEARCH
+ *
+ * Declares that the plugin has to be set up before it can be used for
+ * @action. A plugin that declares any actions is set up lazily: rather than
+ * when the plugin loader starts, gs_plugin_setup() is called the first time a
+ * job with one of these actions needs the plugin. Until then the plugin is
+ * skipped for any action it did not declare.
+ *
+ * If %GS_PLUGIN_ACTION_REFINE is declared, refining only sets up the plugin
+ * if one of the applications being refined is managed by it.
+ *
+ * This should be called from gs_plugin_initialize().
+ *
+ * Since: 40
+ **/
+void
+gs_plugin_add_setup_action (GsPlugin *plugin, GsPluginAction action)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	g_return_if_fail (GS_IS_PLUGIN (plugin));
+	g_return_if_fail (action > GS_PLUGIN_ACTION_UNKNOWN && action < GS_PLUGIN_ACTION_LAST);
+	priv->setup_actions |= (guint64) 1 << action;
+}
+
+/**
+ * gs_plugin_get_setup_lazy:
+ * @plugin: a #GsPlugin
+ *
+ * Gets if the plugin is only set up when it is first needed.
+ *
+ * Returns: %TRUE if gs_plugin_add_setup_action() has been used
+ **/
+gboolean
+gs_plugin_get_setup_lazy (GsPlugin *plugin)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	return priv->setup_actions != 0;
+}
+
+/**
+ * gs_plugin_has_setup_action:
+ * @plugin: a #GsPlugin
+ * @action: a #GsPluginAction, e.g. %GS_PLUGIN_ACTION_SEARCH
+ *
+ * Gets if the plugin declared it has to be set up for @action.
+ *
+ * Returns: %TRUE if gs_plugin_add_setup_action() was used for @action
+ **/
+gboolean
+gs_plugin_has_setup_action (GsPlugin *plugin, GsPluginAction action)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	return (priv->setup_actions & ((guint64) 1 << action)) > 0;
+}
+
+/**
+ * gs_plugin_get_setup_done:
+ * @plugin: a #GsPlugin
+ *
+ * Gets if gs_plugin_ensure_setup() has succeeded.
+ *
+ * Returns: %TRUE if the plugin has been set up
+ **/
+gboolean
+gs_plugin_get_setup_done (GsPlugin *plugin)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->setup_mutex);
+	return priv->setup_done;
+}
+
+/**
+ * gs_plugin_ensure_setup:
+ * @plugin: a #GsPlugin
+ * @cancellable: a #GCancellable, or %NULL
+ * @error: a #GError, or %NULL
+ *
+ * Calls gs_plugin_setup() if it has not already succeeded. This is safe to
+ * call from several threads at once; all but one will wait for it to finish.
+ *
+ * Returns: %TRUE if the plugin is set up
+ **/
+gboolean
+gs_plugin_ensure_setup (GsPlugin *plugin, GCancellable *cancellable, GError **error)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	GsPluginSetupFunc plugin_func;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->setup_mutex);
+
+	if (priv->setup_done)
+		return TRUE;
+	plugin_func = gs_plugin_get_symbol (plugin, "gs_plugin_setup");
+	if (plugin_func != NULL && !plugin_func (plugin, cancellable, error))
+		return FALSE;
+	priv->setup_done = TRUE;
+	priv->setup_serial = (guint) g_atomic_int_add (&gs_plugin_setup_serial, 1) + 1;
+	return TRUE;
+}
+
+/**
+ * gs_plugin_set_setup_done:
+ * @plugin: a #GsPlugin
+ *
+ * Records that gs_plugin_setup() has succeeded, for plugins that the plugin
+ * loader sets up itself rather than with gs_plugin_ensure_setup().
+ **/
+void
+gs_plugin_set_setup_done (GsPlugin *plugin)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->setup_mutex);
+	priv->setup_done = TRUE;
+	priv->setup_serial = (guint) g_atomic_int_add (&gs_plugin_setup_serial, 1) + 1;
+}
+
+/**
+ * gs_plugin_get_setup_serial:
+ * @plugin: a #GsPlugin
+ *
+ * Gets when the plugin was set up compared to the other plugins in the
+ * process, which is only really useful in the self tests.
+ *
+ * Returns: a number that is larger for plugins set up later, or 0 if the
+ * plugin has not been set up
+ **/
+guint
+gs_plugin_get_setup_serial (GsPlugin *plugin)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->setup_mutex);
+	return priv->setup_serial;
+}
+
+/**
+ * gs_plugin_reset_setup:
+ * @plugin: a #GsPlugin
+ *
+ * Forgets that a lazily set up plugin has been set up, for instance after
+ * gs_plugin_destroy() has been called.
+ **/
+void
+gs_plugin_reset_setup (GsPlugin *plugin)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->setup_mutex);
+	priv->setup_done = FALSE;
+	priv->setup_serial = 0;
+}
+
 /**
  * gs_plugin_get_rules:
  * @plugin: a #GsPlugin
@@ -993,6 +1158,7 @@ gs_plugin_updates_changed_cb (gpointer user_data)
 void
 gs_plugin_updates_changed (GsPlugin *plugin)
 {
+	gs_plugin_advance_refine_generation ();
 	g_idle_add (gs_plugin_updates_changed_cb, plugin);
 }
 
@@ -1020,6 +1186,7 @@ void
 gs_plugin_reload (GsPlugin *plugin)
 {
 	g_debug ("emitting ::reload in idle");
+	gs_plugin_advance_refine_generation ();
 	g_idle_add (gs_plugin_reload_cb, plugin);
 }
 
@@ -1395,11 +1562,53 @@ gs_plugin_cache_lookup (GsPlugin *plugin, const gchar *key)
 
 	locker = g_mutex_locker_new (&priv->cache_mutex);
 	app = g_hash_table_lookup (priv->cache, key);
-	if (app == NULL)
+	if (app == NULL) {
+		g_atomic_int_inc (&priv->cache_misses);
 		return NULL;
+	}
+	g_atomic_int_inc (&priv->cache_hits);
 	return g_object_ref (app);
 }
 
+/* only used for profiling */
+guint
+gs_plugin_get_cache_hits (GsPlugin *plugin)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	return (guint) g_atomic_int_get (&priv->cache_hits);
+}
+
+guint
+gs_plugin_get_cache_misses (GsPlugin *plugin)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	return (guint) g_atomic_int_get (&priv->cache_misses);
+}
+
+/**
+ * gs_plugin_silo_rebuilt:
+ * @plugin: a #GsPlugin
+ *
+ * Records that the plugin has rebuilt its #XbSilo, so that this can be
+ * shown when profiling.
+ *
+ * Since: 40
+ **/
+void
+gs_plugin_silo_rebuilt (GsPlugin *plugin)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	g_return_if_fail (GS_IS_PLUGIN (plugin));
+	g_atomic_int_inc (&priv->silo_rebuilds);
+}
+
+guint
+gs_plugin_get_silo_rebuilds (GsPlugin *plugin)
+{
+	GsPluginPrivate *priv = gs_plugin_get_instance_private (plugin);
+	return (guint) g_atomic_int_get (&priv->silo_rebuilds);
+}
+
 /**
  * gs_plugin_cache_remove:
  * @plugin: a #GsPlugin
@@ -1485,6 +1694,53 @@ gs_plugin_cache_invalidate (GsPlugin *plugin)
 
 	locker = g_mutex_locker_new (&priv->cache_mutex);
 	g_hash_table_remove_all (priv->cache);
+	gs_plugin_advance_refine_generation ();
+}
+
+/* bumped whenever data previously returned by refine may be out of date */
+static gint gs_plugin_refine_generation = 1;
+
+/**
+ * gs_plugin_get_refine_generation:
+ *
+ * Gets the current refine generation; refine flags recorded on a #GsApp for an
+ * older generation have to be requested again.
+ *
+ * Returns: a generation number
+ **/
+guint
+gs_plugin_get_refine_generation (void)
+{
+	return (guint) g_atomic_int_get (&gs_plugin_refine_generation);
+}
+
+/**
+ * gs_plugin_advance_refine_generation:
+ *
+ * Invalidates the refine flags recorded on every #GsApp.
+ **/
+void
+gs_plugin_advance_refine_generation (void)
+{
+	g_atomic_int_inc (&gs_plugin_refine_generation);
+}
+
+/**
+ * gs_plugin_refine_invalidate:
+ * @plugin: a #GsPlugin
+ *
+ * Tells the plugin loader that data returned from gs_plugin_refine() may have
+ * changed, for instance because the metadata it came from has been rebuilt.
+ * Applications will then be refined again the next time they are used, rather
+ * than only for the refine flags they have not been refined with before.
+ *
+ * Since: 40
+ **/
+void
+gs_plugin_refine_invalidate (GsPlugin *plugin)
+{
+	g_return_if_fail (GS_IS_PLUGIN (plugin));
+	gs_plugin_advance_refine_generation ();
 }
 
 /**
@@ -1911,6 +2167,8 @@ gs_plugin_refine_flags_to_string (GsPluginRefineFlags refine_flags)
 		g_ptr_array_add (cstrs, "require-reviews");
 	if (refine_flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_REVIEW_RATINGS)
 		g_ptr_array_add (cstrs, "require-review-ratings");
+	if (refine_flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_KEY_COLORS)
+		g_ptr_array_add (cstrs, "require-key-colors");
 	if (refine_flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON)
 		g_ptr_array_add (cstrs, "require-icon");
 	if (refine_flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_PERMISSIONS)
@@ -2048,6 +2306,7 @@ gs_plugin_init (GsPlugin *plugin)
 	g_mutex_init (&priv->interactive_mutex);
 	g_mutex_init (&priv->timer_mutex);
 	g_mutex_init (&priv->vfuncs_mutex);
+	g_mutex_init (&priv->setup_mutex);
 }
 
 /**
@@ -79,6 +79,8 @@ void		 gs_plugin_set_soup_session		(GsPlugin	*plugin,
 void		 gs_plugin_add_rule			(GsPlugin	*plugin,
 							 GsPluginRule	 rule,
 							 const gchar	*name);
+void		 gs_plugin_add_setup_action		(GsPlugin	*plugin,
+							 GsPluginAction	 action);
 
 /* helpers */
 GBytes		*gs_plugin_download_data		(GsPlugin	*plugin,
@@ -108,6 +110,8 @@ void		 gs_plugin_cache_add			(GsPlugin	*plugin,
 void		 gs_plugin_cache_remove			(GsPlugin	*plugin,
 							 const gchar	*key);
 void		 gs_plugin_cache_invalidate		(GsPlugin	*plugin);
+void		 gs_plugin_silo_rebuilt			(GsPlugin	*plugin);
+void		 gs_plugin_refine_invalidate		(GsPlugin	*plugin);
 void		 gs_plugin_status_update		(GsPlugin	*plugin,
 							 GsApp		*app,
 							 GsPluginStatus	 status);
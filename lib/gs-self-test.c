@@ -9,6 +9,8 @@
 
 #include "config.h"
 
+#include <string.h>
+
 #include "gnome-software-private.h"
 
 #include "gs-debug.h"
@@ -646,6 +648,34 @@ gs_app_addons_func (void)
 	gs_app_remove_addon (app, addon);
 }
 
+static void
+gs_app_refined_flags_func (void)
+{
+	g_autoptr(GsApp) app = gs_app_new ("test.desktop");
+	GsPluginRefineFlags refined_flags;
+	guint generation = gs_plugin_get_refine_generation ();
+
+	/* never refined */
+	g_assert_false (gs_app_get_refined_flags (app, generation, &refined_flags));
+	g_assert_cmpint (refined_flags, ==, GS_PLUGIN_REFINE_FLAGS_DEFAULT);
+
+	/* flags add up within a generation */
+	gs_app_add_refined_flags (app, generation, GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON);
+	gs_app_add_refined_flags (app, generation, GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE);
+	g_assert_true (gs_app_get_refined_flags (app, generation, &refined_flags));
+	g_assert_cmpint (refined_flags, ==, GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON |
+					    GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE);
+
+	/* and are forgotten when the generation changes */
+	gs_plugin_advance_refine_generation ();
+	g_assert_cmpint (gs_plugin_get_refine_generation (), !=, generation);
+	generation = gs_plugin_get_refine_generation ();
+	g_assert_false (gs_app_get_refined_flags (app, generation, &refined_flags));
+	gs_app_add_refined_flags (app, generation, GS_PLUGIN_REFINE_FLAGS_REQUIRE_ORIGIN);
+	g_assert_true (gs_app_get_refined_flags (app, generation, &refined_flags));
+	g_assert_cmpint (refined_flags, ==, GS_PLUGIN_REFINE_FLAGS_REQUIRE_ORIGIN);
+}
+
 static void
 gs_app_func (void)
 {
@@ -711,6 +741,63 @@ gs_app_func (void)
 	gs_app_set_state_recover (app);
 }
 
+static void
+gs_app_interned_func (void)
+{
+	g_autoptr(GsApp) app1 = gs_app_new ("app1");
+	g_autoptr(GsApp) app2 = gs_app_new ("app2");
+	g_autofree gchar *origin = g_strdup ("fedora");
+	g_autofree gchar *key = g_strdup ("GnomeSoftware::Test");
+
+	/* the same value is only stored once */
+	gs_app_set_origin (app1, "fedora");
+	gs_app_set_origin (app2, origin);
+	g_assert_cmpstr (gs_app_get_origin (app2), ==, "fedora");
+	g_assert_true (gs_app_get_origin (app1) == gs_app_get_origin (app2));
+	gs_app_set_branch (app1, "stable");
+	gs_app_set_branch (app2, "stable");
+	g_assert_true (gs_app_get_branch (app1) == gs_app_get_branch (app2));
+
+	/* and can still be unset */
+	gs_app_set_branch (app1, NULL);
+	g_assert_null (gs_app_get_branch (app1));
+
+	/* metadata keys can be looked up with any copy */
+	gs_app_set_metadata (app1, "GnomeSoftware::Test", "value");
+	g_assert_cmpstr (gs_app_get_metadata_item (app1, key), ==, "value");
+	gs_app_set_metadata (app2, key, "value2");
+	g_assert_cmpstr (gs_app_get_metadata_item (app2, "GnomeSoftware::Test"), ==, "value2");
+
+	/* and removed again */
+	gs_app_set_metadata (app1, key, NULL);
+	g_assert_null (gs_app_get_metadata_item (app1, "GnomeSoftware::Test"));
+	g_assert_cmpstr (gs_app_get_metadata_item (app2, "GnomeSoftware::Test"), ==, "value2");
+}
+
+static void
+gs_app_list_randomize_func (void)
+{
+	g_autoptr(GsAppList) list1 = gs_app_list_new ();
+	g_autoptr(GsAppList) list2 = NULL;
+
+	for (guint i = 0; i < 20; i++) {
+		g_autofree gchar *id = g_strdup_printf ("app%u", i);
+		g_autoptr(GsApp) app = gs_app_new (id);
+		gs_app_list_add (list1, app);
+	}
+	list2 = gs_app_list_copy (list1);
+
+	/* the order only changes once a day */
+	gs_app_list_randomize (list1);
+	gs_app_list_randomize (list2);
+	g_assert_true (gs_app_list_has_flag (list1, GS_APP_LIST_FLAG_IS_RANDOMIZED));
+	g_assert_cmpint (gs_app_list_length (list1), ==, 20);
+	for (guint i = 0; i < gs_app_list_length (list1); i++) {
+		GsApp *app = gs_app_list_index (list1, i);
+		g_assert_true (app == gs_app_list_index (list2, i));
+	}
+}
+
 static void
 gs_app_progress_clamping_func (void)
 {
@@ -741,6 +828,54 @@ gs_app_list_wildcard_dedupe_func (void)
 	g_assert_cmpint (gs_app_list_length (list), ==, 1);
 }
 
+static void
+gs_app_list_wildcard_dedupe_no_id_func (void)
+{
+	g_autoptr(GsAppList) list = gs_app_list_new ();
+	g_autoptr(GsApp) app1 = gs_app_new (NULL);
+	g_autoptr(GsApp) app2 = gs_app_new (NULL);
+
+	gs_app_add_quirk (app1, GS_APP_QUIRK_IS_WILDCARD);
+	gs_app_list_add (list, app1);
+	gs_app_add_quirk (app2, GS_APP_QUIRK_IS_WILDCARD);
+	gs_app_list_add (list, app2);
+	g_assert_cmpint (gs_app_list_length (list), ==, 1);
+}
+
+static void
+gs_app_list_lookup_func (void)
+{
+	g_autoptr(GsAppList) list = gs_app_list_new ();
+	g_autoptr(GsApp) app = gs_app_new ("app1");
+
+	gs_app_list_add (list, app);
+	g_assert (gs_app_list_lookup (list, "*/*/*/app1/*") == app);
+
+	/* filled in during refine */
+	gs_app_set_origin (app, "fedora");
+	g_assert (gs_app_list_lookup (list, "*/*/fedora/app1/*") == app);
+	g_assert_null (gs_app_list_lookup (list, "*/*/rawhide/app1/*"));
+
+	/* renamed after being added */
+	gs_app_set_id (app, "app2");
+	g_assert_null (gs_app_list_lookup (list, "*/*/*/app1/*"));
+	g_assert (gs_app_list_lookup (list, "*/*/*/app2/*") == app);
+}
+
+static void
+gs_app_list_lookup_order_func (void)
+{
+	g_autoptr(GsAppList) list = gs_app_list_new ();
+	g_autoptr(GsApp) app1 = gs_app_new ("other");
+	g_autoptr(GsApp) app2 = gs_app_new ("app");
+
+	/* a wildcard ID earlier in the list wins over an exact match */
+	gs_app_list_add (list, app1);
+	gs_app_list_add (list, app2);
+	gs_app_set_id (app1, "*");
+	g_assert (gs_app_list_lookup (list, "*/*/*/app/*") == app1);
+}
+
 static void
 gs_app_list_func (void)
 {
@@ -772,26 +907,132 @@ gs_app_list_func (void)
 	g_assert_cmpint (gs_app_list_get_state (list), ==, GS_APP_STATE_UNKNOWN);
 }
 
+static void
+gs_app_list_snapshot_func (void)
+{
+	g_autoptr(GsAppList) list = gs_app_list_new ();
+	g_autoptr(GsAppList) list_copy = NULL;
+	g_autoptr(GsApp) app1 = gs_app_new ("app1");
+	g_autoptr(GsApp) app2 = gs_app_new ("app2");
+	g_autoptr(GPtrArray) snapshot = NULL;
+
+	gs_app_list_add (list, app1);
+	gs_app_list_add (list, app2);
+
+	/* the snapshot does not see later changes */
+	snapshot = gs_app_list_snapshot (list);
+	gs_app_list_remove (list, app1);
+	g_assert_cmpint (snapshot->len, ==, 2);
+	g_assert_true (g_ptr_array_index (snapshot, 0) == app1);
+	g_assert_cmpint (gs_app_list_length (list), ==, 1);
+	g_assert_true (gs_app_list_index (list, 0) == app2);
+
+	/* nor do copies of each other */
+	list_copy = gs_app_list_copy (list);
+	gs_app_list_add (list_copy, app1);
+	g_assert_cmpint (gs_app_list_length (list), ==, 1);
+	g_assert_cmpint (gs_app_list_length (list_copy), ==, 2);
+	gs_app_list_remove_all (list);
+	g_assert_cmpint (gs_app_list_length (list), ==, 0);
+	g_assert_cmpint (gs_app_list_length (list_copy), ==, 2);
+	g_assert_cmpint (snapshot->len, ==, 2);
+}
+
+static void
+gs_app_list_sort_key_cb (GsApp *app, GByteArray *key, gpointer user_data)
+{
+	const gchar *sort_key = gs_app_get_name_sort_key (app);
+	if (sort_key != NULL)
+		g_byte_array_append (key, (const guint8 *) sort_key, strlen (sort_key));
+}
+
+static void
+gs_app_list_sort_key_func (void)
+{
+	g_autoptr(GsAppList) list = gs_app_list_new ();
+	const gchar *names[] = { "zeta", "Alpha", "beta", "alpha", NULL };
+	const gchar *sort_key;
+
+	for (guint i = 0; names[i] != NULL; i++) {
+		g_autofree gchar *id = g_strdup_printf ("app%u", i);
+		g_autoptr(GsApp) app = gs_app_new (id);
+		gs_app_set_name (app, GS_APP_QUALITY_NORMAL, names[i]);
+		gs_app_list_add (list, app);
+	}
+
+	/* case-insensitive, and stable for equal keys */
+	gs_app_list_sort_by_key (list, gs_app_list_sort_key_cb, NULL);
+	g_assert_cmpstr (gs_app_get_id (gs_app_list_index (list, 0)), ==, "app1");
+	g_assert_cmpstr (gs_app_get_id (gs_app_list_index (list, 1)), ==, "app3");
+	g_assert_cmpstr (gs_app_get_id (gs_app_list_index (list, 2)), ==, "app2");
+	g_assert_cmpstr (gs_app_get_id (gs_app_list_index (list, 3)), ==, "app0");
+
+	/* the cached key follows the name */
+	sort_key = gs_app_get_name_sort_key (gs_app_list_index (list, 3));
+	g_assert_true (sort_key == gs_app_get_name_sort_key (gs_app_list_index (list, 3)));
+	gs_app_set_name (gs_app_list_index (list, 3), GS_APP_QUALITY_HIGHEST, "aardvark");
+	gs_app_list_sort_by_key (list, gs_app_list_sort_key_cb, NULL);
+	g_assert_cmpstr (gs_app_get_id (gs_app_list_index (list, 0)), ==, "app0");
+}
+
 static void
 gs_app_list_performance_func (void)
 {
 	g_autoptr(GPtrArray) apps = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
 	g_autoptr(GsAppList) list = gs_app_list_new ();
 	g_autoptr(GTimer) timer = NULL;
+	guint n_apps = g_test_slow () ? 50000 : 5000;
 
-	/* create a few apps */
-	for (guint i = 0; i < 500; i++) {
-		g_autofree gchar *id = g_strdup_printf ("%03u.desktop", i);
+	/* create enough apps that a quadratic list would be noticeable */
+	for (guint i = 0; i < n_apps; i++) {
+		g_autofree gchar *id = g_strdup_printf ("%05u.desktop", i);
 		g_ptr_array_add (apps, gs_app_new (id));
 	}
 
-	/* add them to the list */
+	/* add them to the list, each checking for duplicates */
 	timer = g_timer_new ();
 	for (guint i = 0; i < apps->len; i++) {
 		GsApp *app = g_ptr_array_index (apps, i);
 		gs_app_list_add (list, app);
 	}
-	g_print ("%.2fms ", g_timer_elapsed (timer, NULL) * 1000);
+	g_assert_cmpint (gs_app_list_length (list), ==, apps->len);
+	g_print ("add: %.2fms ", g_timer_elapsed (timer, NULL) * 1000);
+
+	/* adding them again does nothing */
+	g_timer_reset (timer);
+	for (guint i = 0; i < apps->len; i++) {
+		GsApp *app = g_ptr_array_index (apps, i);
+		gs_app_list_add (list, app);
+	}
+	g_assert_cmpint (gs_app_list_length (list), ==, apps->len);
+	g_print ("dupe: %.2fms ", g_timer_elapsed (timer, NULL) * 1000);
+
+	/* look up using the wildcard rules */
+	g_timer_reset (timer);
+	for (guint i = 0; i < apps->len; i++) {
+		GsApp *app = g_ptr_array_index (apps, i);
+		g_autofree gchar *unique_id = NULL;
+		unique_id = g_strdup_printf ("system/flatpak/flathub/%s/stable",
+					     gs_app_get_id (app));
+		g_assert (gs_app_list_lookup (list, unique_id) == app);
+	}
+	g_print ("lookup: %.2fms ", g_timer_elapsed (timer, NULL) * 1000);
+
+	/* remove some of them */
+	g_timer_reset (timer);
+	for (guint i = 0; i < 2000; i += 2) {
+		GsApp *app = g_ptr_array_index (apps, i);
+		gs_app_list_remove (list, app);
+	}
+	g_assert_cmpint (gs_app_list_length (list), ==, apps->len - 1000);
+	g_assert_null (gs_app_list_lookup (list, "*/*/*/00000.desktop/*"));
+	g_assert_nonnull (gs_app_list_lookup (list, "*/*/*/00001.desktop/*"));
+	g_print ("remove: %.2fms ", g_timer_elapsed (timer, NULL) * 1000);
+
+	g_timer_reset (timer);
+	gs_app_list_filter_duplicates (list, GS_APP_LIST_FILTER_FLAG_NONE);
+	g_assert_cmpint (gs_app_list_length (list), ==, apps->len - 1000);
+	g_print ("filter: %.2fms ", g_timer_elapsed (timer, NULL) * 1000);
 }
 
 static void
@@ -814,6 +1055,57 @@ gs_app_list_related_func (void)
 	g_assert_cmpint (gs_app_list_get_progress (list), ==, 50);
 }
 
+static void
+gs_app_list_watch_func (void)
+{
+	g_autoptr(GsAppList) list = gs_app_list_new ();
+	g_autoptr(GsApp) app1 = gs_app_new ("app1");
+	g_autoptr(GsApp) app2 = gs_app_new ("app2");
+	g_autoptr(GsApp) app3 = gs_app_new ("app3");
+	g_autoptr(GsApp) addon = gs_app_new ("addon");
+
+	gs_app_list_add_flag (list,
+			      GS_APP_LIST_FLAG_WATCH_APPS |
+			      GS_APP_LIST_FLAG_WATCH_APPS_ADDONS);
+	gs_app_set_progress (app1, 10);
+	gs_app_set_progress (app2, 20);
+	gs_app_set_progress (app3, 90);
+	gs_app_set_state (app3, GS_APP_STATE_AVAILABLE);
+	gs_app_set_state (app3, GS_APP_STATE_INSTALLING);
+	gs_app_list_add (list, app1);
+	gs_app_list_add (list, app2);
+	gs_app_list_add (list, app3);
+	gs_test_flush_main_context ();
+	g_assert_cmpint (gs_app_list_get_progress (list), ==, 40);
+	g_assert_cmpint (gs_app_list_get_state (list), ==, GS_APP_STATE_INSTALLING);
+
+	/* truncated apps are no longer counted */
+	gs_app_list_truncate (list, 2);
+	g_assert_cmpint (gs_app_list_get_progress (list), ==, 15);
+	g_assert_cmpint (gs_app_list_get_state (list), ==, GS_APP_STATE_UNKNOWN);
+	gs_app_set_progress (app3, 0);
+	gs_test_flush_main_context ();
+	g_assert_cmpint (gs_app_list_get_progress (list), ==, 15);
+
+	/* addons added after the app are counted too, once back in the main
+	 * context */
+	gs_app_set_progress (addon, 50);
+	gs_app_add_addon (app1, addon);
+	gs_test_flush_main_context ();
+	g_assert_cmpint (gs_app_list_get_progress (list), ==, 26);
+
+	/* removing the app stops counting its addons */
+	gs_app_list_remove (list, app1);
+	g_assert_cmpint (gs_app_list_get_progress (list), ==, 20);
+	gs_app_set_progress (addon, 100);
+	gs_test_flush_main_context ();
+	g_assert_cmpint (gs_app_list_get_progress (list), ==, 20);
+
+	gs_app_list_remove (list, app2);
+	g_assert_cmpint (gs_app_list_get_progress (list), ==, GS_APP_PROGRESS_UNKNOWN);
+	g_assert_cmpint (gs_app_list_get_state (list), ==, GS_APP_STATE_UNKNOWN);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -837,14 +1129,23 @@ main (int argc, char **argv)
 	g_test_add_func ("/gnome-software/lib/utils{parse-evr}", gs_utils_parse_evr_func);
 	g_test_add_func ("/gnome-software/lib/os-release", gs_os_release_func);
 	g_test_add_func ("/gnome-software/lib/app", gs_app_func);
+	g_test_add_func ("/gnome-software/lib/app/interned", gs_app_interned_func);
+	g_test_add_func ("/gnome-software/lib/app{list-randomize}", gs_app_list_randomize_func);
 	g_test_add_func ("/gnome-software/lib/app/progress-clamping", gs_app_progress_clamping_func);
 	g_test_add_func ("/gnome-software/lib/app{addons}", gs_app_addons_func);
 	g_test_add_func ("/gnome-software/lib/app{unique-id}", gs_app_unique_id_func);
+	g_test_add_func ("/gnome-software/lib/app{refined-flags}", gs_app_refined_flags_func);
 	g_test_add_data_func ("/gnome-software/lib/app{thread}", debug, gs_app_thread_func);
 	g_test_add_func ("/gnome-software/lib/app{list}", gs_app_list_func);
+	g_test_add_func ("/gnome-software/lib/app{list-lookup}", gs_app_list_lookup_func);
+	g_test_add_func ("/gnome-software/lib/app{list-lookup-order}", gs_app_list_lookup_order_func);
+	g_test_add_func ("/gnome-software/lib/app{list-snapshot}", gs_app_list_snapshot_func);
+	g_test_add_func ("/gnome-software/lib/app{list-sort-key}", gs_app_list_sort_key_func);
 	g_test_add_func ("/gnome-software/lib/app{list-wildcard-dedupe}", gs_app_list_wildcard_dedupe_func);
+	g_test_add_func ("/gnome-software/lib/app{list-wildcard-dedupe-no-id}", gs_app_list_wildcard_dedupe_no_id_func);
 	g_test_add_func ("/gnome-software/lib/app{list-performance}", gs_app_list_performance_func);
 	g_test_add_func ("/gnome-software/lib/app{list-related}", gs_app_list_related_func);
+	g_test_add_func ("/gnome-software/lib/app{list-watch}", gs_app_list_watch_func);
 	g_test_add_func ("/gnome-software/lib/plugin", gs_plugin_func);
 	g_test_add_func ("/gnome-software/lib/plugin{download-rewrite}", gs_plugin_download_rewrite_func);
 
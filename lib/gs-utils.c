@@ -160,8 +160,13 @@ gs_utils_get_cache_filename (const gchar *kind,
 
 	/* in the self tests */
 	tmp = g_getenv ("GS_SELF_TEST_CACHEDIR");
-	if (tmp != NULL)
-		return g_build_filename (tmp, kind, resource, NULL);
+	if (tmp != NULL) {
+		g_autofree gchar *fn = g_build_filename (tmp, kind, resource, NULL);
+		if ((flags & GS_UTILS_CACHE_FLAG_CREATE_DIRECTORY) &&
+		    !gs_mkdir_parent (fn, error))
+			return NULL;
+		return g_steal_pointer (&fn);
+	}
 
 	/* get basename */
 	if (flags & GS_UTILS_CACHE_FLAG_USE_HASH) {
@@ -0,0 +1,719 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2021 Richard Hughes <richard@hughsie.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+/*
+ * An inverted index of the words used in each component of a silo.
+ *
+ * Searching the silo with XPath means running a stem() query against every
+ * field of every component for each search token, which is slow when there
+ * are tens of thousands of components. Instead, all the searchable words are
+ * collected once when the silo is compiled, and the posting lists of the
+ * components containing each word are saved next to the silo blob so they
+ * can be reused until the silo GUID changes.
+ *
+ * Matching emulates the `~=` operator in libxmlb, i.e. a search token matches
+ * a case-insensitive prefix of any whitespace-separated word in the field.
+ * IDs are also split on dots and dashes, so that `fedora` matches
+ * `org.fedoraproject.Fedora-25`.
+ *
+ * The components in each desktop category are collected in the same pass, so
+ * that the category sizes and the apps in each category can be found without
+ * running an XPath query per category.
+ *
+ * Components are also looked up by ID and package name when refining, so
+ * those are kept in hash tables built when the silo is loaded; these are
+ * cheap to build and are not saved.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "gs-appstream-index.h"
+
+struct _GsAppstreamIndex
+{
+	GObject			 parent_instance;
+	GPtrArray		*components;	/* (element-type XbNode) */
+	GVariant		*tokens;	/* a(sa(uq)), sorted by word */
+	GVariant		*categories;	/* a(sau), sorted by category */
+	GHashTable		*category_postings;	/* category:au, both borrowed from @categories */
+	GHashTable		*ids;		/* id:GPtrArray of XbNode, for components/component */
+	GHashTable		*installed_ids;	/* id:GPtrArray of XbNode, for component */
+	GHashTable		*pkgnames;	/* pkgname:GPtrArray of XbNode, for components/component */
+};
+
+G_DEFINE_TYPE (GsAppstreamIndex, gs_appstream_index, G_TYPE_OBJECT)
+
+#define GS_APPSTREAM_INDEX_FORMAT	"(sua(sa(uq))a(sau))"
+
+/* bump when the words added for each component change */
+#define GS_APPSTREAM_INDEX_VERSION	2
+
+typedef struct {
+	guint32		 idx;
+	guint16		 match_value;
+} GsAppstreamIndexPosting;
+
+static const struct {
+	AsSearchTokenMatch	 match_value;
+	const gchar		*xpath;
+} gs_appstream_index_fields[] = {
+	{ AS_SEARCH_TOKEN_MATCH_MIMETYPE,	"mimetypes/mimetype" },
+	{ AS_SEARCH_TOKEN_MATCH_PKGNAME,	"pkgname" },
+	{ AS_SEARCH_TOKEN_MATCH_SUMMARY,	"summary" },
+	{ AS_SEARCH_TOKEN_MATCH_NAME,		"name" },
+	{ AS_SEARCH_TOKEN_MATCH_KEYWORD,	"keywords/keyword" },
+	{ AS_SEARCH_TOKEN_MATCH_ID,		"id" },
+	{ AS_SEARCH_TOKEN_MATCH_ID,		"launchable" },
+	{ AS_SEARCH_TOKEN_MATCH_NONE,		NULL }
+};
+
+static void
+gs_appstream_index_add_word (GHashTable *words,
+			     const gchar *word,
+			     guint32 idx,
+			     guint16 match_value)
+{
+	GArray *postings = g_hash_table_lookup (words, word);
+	GsAppstreamIndexPosting posting = { idx, match_value };
+
+	if (postings == NULL) {
+		postings = g_array_new (FALSE, FALSE, sizeof (GsAppstreamIndexPosting));
+		g_hash_table_insert (words, g_strdup (word), postings);
+	} else {
+		/* components are added in order, so only the last can match */
+		GsAppstreamIndexPosting *last;
+		last = &g_array_index (postings, GsAppstreamIndexPosting, postings->len - 1);
+		if (last->idx == idx) {
+			last->match_value |= match_value;
+			return;
+		}
+	}
+	g_array_append_val (postings, posting);
+}
+
+static void
+gs_appstream_index_add_text (GHashTable *words,
+			     const gchar *text,
+			     guint32 idx,
+			     guint16 match_value)
+{
+	g_auto(GStrv) split = NULL;
+
+	if (text == NULL)
+		return;
+	split = g_strsplit_set (text, " \t\n\r\f\v", -1);
+	for (guint i = 0; split[i] != NULL; i++) {
+		const gchar *word = split[i];
+		g_autofree gchar *folded = NULL;
+
+		/* xb_string_search() skips leading punctuation */
+		while (*word != '\0' && !g_ascii_isalnum (*word))
+			word++;
+		if (*word == '\0')
+			continue;
+		folded = g_ascii_strdown (word, -1);
+		gs_appstream_index_add_word (words, folded, idx, match_value);
+
+		/* each part of a reverse-DNS ID is a word too */
+		if (match_value == AS_SEARCH_TOKEN_MATCH_ID &&
+		    strpbrk (folded, ".-") != NULL) {
+			g_auto(GStrv) parts = g_strsplit_set (folded, ".-", -1);
+			for (guint j = 0; parts[j] != NULL; j++) {
+				if (parts[j][0] == '\0')
+					continue;
+				gs_appstream_index_add_word (words, parts[j], idx, match_value);
+			}
+		}
+	}
+}
+
+static void
+gs_appstream_index_add_component (GHashTable *words, XbNode *component, guint32 idx)
+{
+	g_autoptr(XbNode) parent = xb_node_get_parent (component);
+
+	for (guint i = 0; gs_appstream_index_fields[i].xpath != NULL; i++) {
+		g_autoptr(GPtrArray) nodes = NULL;
+		nodes = xb_node_query (component, gs_appstream_index_fields[i].xpath, 0, NULL);
+		if (nodes == NULL)
+			continue;
+		for (guint j = 0; j < nodes->len; j++) {
+			XbNode *n = g_ptr_array_index (nodes, j);
+			gs_appstream_index_add_text (words, xb_node_get_text (n), idx,
+						     gs_appstream_index_fields[i].match_value);
+		}
+	}
+
+	/* the origin is set on the parent <components> */
+	if (parent != NULL) {
+		gs_appstream_index_add_text (words, xb_node_get_attr (parent, "origin"),
+					     idx, AS_SEARCH_TOKEN_MATCH_ORIGIN);
+	}
+}
+
+static void
+gs_appstream_index_add_categories (GHashTable *categories, XbNode *component, guint32 idx)
+{
+	g_autoptr(GPtrArray) nodes = NULL;
+
+	nodes = xb_node_query (component, "categories/category", 0, NULL);
+	if (nodes == NULL)
+		return;
+	for (guint i = 0; i < nodes->len; i++) {
+		XbNode *n = g_ptr_array_index (nodes, i);
+		const gchar *category = xb_node_get_text (n);
+		GArray *postings;
+
+		if (category == NULL)
+			continue;
+		postings = g_hash_table_lookup (categories, category);
+		if (postings == NULL) {
+			postings = g_array_new (FALSE, FALSE, sizeof (guint32));
+			g_hash_table_insert (categories, g_strdup (category), postings);
+		} else if (g_array_index (postings, guint32, postings->len - 1) == idx) {
+			/* listed twice in the same component */
+			continue;
+		}
+		g_array_append_val (postings, idx);
+	}
+}
+
+/* the keys are borrowed from the silo, which outlives the index */
+static void
+gs_appstream_index_add_lookup (GHashTable *hash, XbSilo *silo, const gchar *xpath)
+{
+	g_autoptr(GPtrArray) nodes = xb_silo_query (silo, xpath, 0, NULL);
+
+	if (nodes == NULL)
+		return;
+	for (guint i = 0; i < nodes->len; i++) {
+		XbNode *n = g_ptr_array_index (nodes, i);
+		const gchar *key = xb_node_get_text (n);
+		GPtrArray *components;
+
+		if (key == NULL)
+			continue;
+		components = g_hash_table_lookup (hash, key);
+		if (components == NULL) {
+			components = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+			g_hash_table_insert (hash, (gpointer) key, components);
+		}
+		g_ptr_array_add (components, xb_node_get_parent (n));
+	}
+}
+
+static gint
+gs_appstream_index_word_sort_cb (gconstpointer a, gconstpointer b)
+{
+	const gchar *sa = *((const gchar **) a);
+	const gchar *sb = *((const gchar **) b);
+	return strcmp (sa, sb);
+}
+
+static GVariant *
+gs_appstream_index_build (GPtrArray *components, const gchar *guid)
+{
+	GVariantBuilder builder;
+	GVariantBuilder builder_categories;
+	guint n_words = 0;
+	guint n_categories = 0;
+	g_autofree const gchar **sorted = NULL;
+	g_autofree const gchar **sorted_categories = NULL;
+	g_autoptr(GHashTable) words = NULL;
+	g_autoptr(GHashTable) categories = NULL;
+
+	words = g_hash_table_new_full (g_str_hash, g_str_equal,
+				       g_free, (GDestroyNotify) g_array_unref);
+	categories = g_hash_table_new_full (g_str_hash, g_str_equal,
+					    g_free, (GDestroyNotify) g_array_unref);
+	for (guint i = 0; i < components->len; i++) {
+		XbNode *component = g_ptr_array_index (components, i);
+		gs_appstream_index_add_component (words, component, i);
+		gs_appstream_index_add_categories (categories, component, i);
+	}
+
+	/* sort so that all the words sharing a prefix are adjacent */
+	sorted = (const gchar **) g_hash_table_get_keys_as_array (words, &n_words);
+	qsort (sorted, n_words, sizeof (gchar *), gs_appstream_index_word_sort_cb);
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sa(uq))"));
+	for (guint i = 0; i < n_words; i++) {
+		GArray *postings = g_hash_table_lookup (words, sorted[i]);
+		g_variant_builder_open (&builder, G_VARIANT_TYPE ("(sa(uq))"));
+		g_variant_builder_add (&builder, "s", sorted[i]);
+		g_variant_builder_open (&builder, G_VARIANT_TYPE ("a(uq)"));
+		for (guint j = 0; j < postings->len; j++) {
+			GsAppstreamIndexPosting *posting;
+			posting = &g_array_index (postings, GsAppstreamIndexPosting, j);
+			g_variant_builder_add (&builder, "(uq)",
+					       posting->idx,
+					       posting->match_value);
+		}
+		g_variant_builder_close (&builder);
+		g_variant_builder_close (&builder);
+	}
+
+	/* the postings are in silo order, so can be intersected by merging */
+	sorted_categories = (const gchar **) g_hash_table_get_keys_as_array (categories, &n_categories);
+	qsort (sorted_categories, n_categories, sizeof (gchar *), gs_appstream_index_word_sort_cb);
+	g_variant_builder_init (&builder_categories, G_VARIANT_TYPE ("a(sau)"));
+	for (guint i = 0; i < n_categories; i++) {
+		GArray *postings = g_hash_table_lookup (categories, sorted_categories[i]);
+		g_variant_builder_add (&builder_categories, "(s@au)",
+				       sorted_categories[i],
+				       g_variant_new_fixed_array (G_VARIANT_TYPE_UINT32,
+								  postings->data,
+								  postings->len,
+								  sizeof (guint32)));
+	}
+	return g_variant_ref_sink (g_variant_new (GS_APPSTREAM_INDEX_FORMAT,
+						  guid,
+						  (guint32) components->len,
+						  &builder,
+						  &builder_categories));
+}
+
+static GVariant *
+gs_appstream_index_load (GFile *file,
+			 const gchar *guid,
+			 guint n_components,
+			 GCancellable *cancellable)
+{
+	const gchar *guid_tmp = NULL;
+	gchar *data = NULL;
+	gsize len = 0;
+	guint32 n_components_tmp = 0;
+	g_autoptr(GError) error_local = NULL;
+	g_autoptr(GVariant) blob = NULL;
+
+	if (!g_file_load_contents (file, cancellable, &data, &len, NULL, &error_local)) {
+		if (!g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+			g_debug ("failed to load search index: %s", error_local->message);
+		return NULL;
+	}
+	blob = g_variant_ref_sink (g_variant_new_from_data (G_VARIANT_TYPE (GS_APPSTREAM_INDEX_FORMAT),
+							    data, len, FALSE,
+							    g_free, data));
+
+	/* the posting lists are only valid for the silo they were built from */
+	g_variant_get_child (blob, 0, "&s", &guid_tmp);
+	g_variant_get_child (blob, 1, "u", &n_components_tmp);
+	if (g_strcmp0 (guid_tmp, guid) != 0 || n_components_tmp != n_components) {
+		g_debug ("search index is for silo %s, not %s", guid_tmp, guid);
+		return NULL;
+	}
+	return g_steal_pointer (&blob);
+}
+
+static void
+gs_appstream_index_set_blob (GsAppstreamIndex *self, GVariant *blob)
+{
+	GVariantIter iter;
+	const gchar *category;
+	GVariant *postings;
+
+	self->tokens = g_variant_get_child_value (blob, 2);
+	self->categories = g_variant_get_child_value (blob, 3);
+
+	/* there are only a few hundred of these */
+	self->category_postings = g_hash_table_new_full (g_str_hash, g_str_equal,
+							 NULL, (GDestroyNotify) g_variant_unref);
+	g_variant_iter_init (&iter, self->categories);
+	while (g_variant_iter_next (&iter, "(&s@au)", &category, &postings))
+		g_hash_table_insert (self->category_postings, (gpointer) category, postings);
+}
+
+/**
+ * gs_appstream_index_new:
+ * @silo: a #XbSilo
+ * @file: (nullable): a #GFile to use as a persistent cache
+ * @cancellable: a #GCancellable, or %NULL
+ * @error: a #GError, or %NULL
+ *
+ * Loads the search index for @silo from @file, or builds it from the silo
+ * contents if it is missing or out of date, saving it back to @file.
+ *
+ * The index holds references to the components of @silo, so it must be
+ * destroyed before the silo itself.
+ *
+ * Returns: (transfer full): a #GsAppstreamIndex, or %NULL for error
+ **/
+GsAppstreamIndex *
+gs_appstream_index_new (XbSilo *silo,
+			GFile *file,
+			GCancellable *cancellable,
+			GError **error)
+{
+	g_autofree gchar *guid = g_strdup_printf ("%s:%u", xb_silo_get_guid (silo),
+						  (guint) GS_APPSTREAM_INDEX_VERSION);
+	g_autoptr(GError) error_local = NULL;
+	g_autoptr(GsAppstreamIndex) self = g_object_new (GS_TYPE_APPSTREAM_INDEX, NULL);
+	g_autoptr(GTimer) timer = g_timer_new ();
+	g_autoptr(GVariant) blob = NULL;
+
+	/* the posting lists refer to components by position */
+	self->components = xb_silo_query (silo, "components/component", 0, &error_local);
+	if (self->components == NULL) {
+		if (!g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND) &&
+		    !g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT)) {
+			g_propagate_error (error, g_steal_pointer (&error_local));
+			return NULL;
+		}
+		self->components = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	}
+
+	/* one query for each table, in silo order */
+	gs_appstream_index_add_lookup (self->ids, silo, "components/component/id");
+	gs_appstream_index_add_lookup (self->installed_ids, silo, "component/id");
+	gs_appstream_index_add_lookup (self->pkgnames, silo, "components/component/pkgname");
+
+	/* try the cache first */
+	if (file != NULL) {
+		blob = gs_appstream_index_load (file, guid,
+						self->components->len,
+						cancellable);
+		if (blob != NULL) {
+			gs_appstream_index_set_blob (self, blob);
+			g_debug ("loaded search index of %" G_GSIZE_FORMAT " words in %fms",
+				 g_variant_n_children (self->tokens),
+				 g_timer_elapsed (timer, NULL) * 1000);
+			return g_steal_pointer (&self);
+		}
+	}
+
+	/* build from scratch */
+	blob = gs_appstream_index_build (self->components, guid);
+	gs_appstream_index_set_blob (self, blob);
+	g_debug ("built search index of %" G_GSIZE_FORMAT " words and %" G_GSIZE_FORMAT " categories for %u components in %fms",
+		 g_variant_n_children (self->tokens),
+		 g_variant_n_children (self->categories),
+		 self->components->len,
+		 g_timer_elapsed (timer, NULL) * 1000);
+
+	/* not fatal, we can just rebuild it next time */
+	if (file != NULL &&
+	    !g_file_replace_contents (file,
+				      g_variant_get_data (blob),
+				      g_variant_get_size (blob),
+				      NULL, FALSE,
+				      G_FILE_CREATE_NONE,
+				      NULL, cancellable,
+				      &error_local)) {
+		g_debug ("failed to save search index: %s", error_local->message);
+	}
+	return g_steal_pointer (&self);
+}
+
+static guint
+gs_appstream_index_lower_bound (GsAppstreamIndex *self, const gchar *value)
+{
+	guint lo = 0;
+	guint hi = g_variant_n_children (self->tokens);
+
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+		const gchar *word = NULL;
+		g_autoptr(GVariant) child = g_variant_get_child_value (self->tokens, mid);
+		g_variant_get_child (child, 0, "&s", &word);
+		if (strcmp (word, value) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static void
+gs_appstream_index_search_value (GsAppstreamIndex *self,
+				 const gchar *value,
+				 guint16 *matches)
+{
+	gsize value_len;
+	guint n_words = g_variant_n_children (self->tokens);
+	g_autofree gchar *folded = g_ascii_strdown (value, -1);
+
+	/* xb_string_search() never matches the empty string */
+	value_len = strlen (folded);
+	if (value_len == 0)
+		return;
+
+	/* every word with @value as a prefix is adjacent */
+	for (guint i = gs_appstream_index_lower_bound (self, folded); i < n_words; i++) {
+		const gchar *word = NULL;
+		guint32 idx;
+		guint16 match_value;
+		GVariantIter iter;
+		g_autoptr(GVariant) child = g_variant_get_child_value (self->tokens, i);
+		g_autoptr(GVariant) postings = NULL;
+
+		g_variant_get (child, "(&s@a(uq))", &word, &postings);
+		if (strncmp (word, folded, value_len) != 0)
+			break;
+		g_variant_iter_init (&iter, postings);
+		while (g_variant_iter_next (&iter, "(uq)", &idx, &match_value)) {
+			if (idx < self->components->len)
+				matches[idx] |= match_value;
+		}
+	}
+}
+
+/**
+ * gs_appstream_index_search:
+ * @self: a #GsAppstreamIndex
+ * @values: the search tokens
+ *
+ * Finds all the components that match *all* of @values in any field.
+ *
+ * Returns: (transfer full) (element-type GsAppstreamIndexMatch): matches, in silo order
+ **/
+GArray *
+gs_appstream_index_search (GsAppstreamIndex *self, const gchar * const *values)
+{
+	GArray *results = g_array_new (FALSE, FALSE, sizeof (GsAppstreamIndexMatch));
+	guint n_components = self->components->len;
+	g_autofree guint16 *matches_sum = NULL;
+
+	g_return_val_if_fail (GS_IS_APPSTREAM_INDEX (self), results);
+
+	if (values == NULL || values[0] == NULL || n_components == 0)
+		return results;
+
+	/* intersect the components of each token, OR'ing the fields matched */
+	matches_sum = g_new0 (guint16, n_components);
+	for (guint i = 0; values[i] != NULL; i++) {
+		g_autofree guint16 *matches = g_new0 (guint16, n_components);
+		gs_appstream_index_search_value (self, values[i], matches);
+		for (guint j = 0; j < n_components; j++) {
+			if (matches[j] == 0 || (i > 0 && matches_sum[j] == 0))
+				matches_sum[j] = 0;
+			else
+				matches_sum[j] |= matches[j];
+		}
+	}
+	for (guint j = 0; j < n_components; j++) {
+		GsAppstreamIndexMatch match;
+		if (matches_sum[j] == 0)
+			continue;
+		match.component = g_ptr_array_index (self->components, j);
+		match.match_value = matches_sum[j];
+		g_array_append_val (results, match);
+	}
+	return results;
+}
+
+static const guint32 *
+gs_appstream_index_get_category_postings (GsAppstreamIndex *self,
+					  const gchar *category,
+					  gsize *n_postings)
+{
+	GVariant *postings = g_hash_table_lookup (self->category_postings, category);
+	if (postings == NULL) {
+		*n_postings = 0;
+		return NULL;
+	}
+	return g_variant_get_fixed_array (postings, n_postings, sizeof (guint32));
+}
+
+/* marks every component in @desktop_group, which is either a single category
+ * such as "Game" or a pair such as "Game::Shooter" which both have to match */
+static void
+gs_appstream_index_mark_desktop_group (GsAppstreamIndex *self,
+				       const gchar *desktop_group,
+				       guint8 *marks)
+{
+	const guint32 *postings1;
+	const guint32 *postings2;
+	gsize n_postings1 = 0;
+	gsize n_postings2 = 0;
+	g_auto(GStrv) split = g_strsplit (desktop_group, "::", -1);
+
+	if (g_strv_length (split) == 1) {
+		postings1 = gs_appstream_index_get_category_postings (self, split[0], &n_postings1);
+		for (gsize i = 0; i < n_postings1; i++) {
+			if (postings1[i] < self->components->len)
+				marks[postings1[i]] = 1;
+		}
+		return;
+	}
+	if (g_strv_length (split) != 2)
+		return;
+
+	/* both lists are sorted, so intersect by merging */
+	postings1 = gs_appstream_index_get_category_postings (self, split[0], &n_postings1);
+	postings2 = gs_appstream_index_get_category_postings (self, split[1], &n_postings2);
+	for (gsize i = 0, j = 0; i < n_postings1 && j < n_postings2;) {
+		if (postings1[i] < postings2[j]) {
+			i++;
+		} else if (postings1[i] > postings2[j]) {
+			j++;
+		} else {
+			if (postings1[i] < self->components->len)
+				marks[postings1[i]] = 1;
+			i++;
+			j++;
+		}
+	}
+}
+
+static guint8 *
+gs_appstream_index_mark_desktop_groups (GsAppstreamIndex *self, GPtrArray *desktop_groups)
+{
+	guint8 *marks = g_new0 (guint8, self->components->len);
+	for (guint i = 0; i < desktop_groups->len; i++) {
+		const gchar *desktop_group = g_ptr_array_index (desktop_groups, i);
+		gs_appstream_index_mark_desktop_group (self, desktop_group, marks);
+	}
+	return marks;
+}
+
+/**
+ * gs_appstream_index_count_category:
+ * @self: a #GsAppstreamIndex
+ * @desktop_groups: (element-type utf8): desktop groups, e.g. "Game::Shooter"
+ *
+ * Counts the components in any of @desktop_groups. Components in more than one
+ * of the groups are only counted once.
+ *
+ * Returns: the number of components
+ **/
+guint
+gs_appstream_index_count_category (GsAppstreamIndex *self, GPtrArray *desktop_groups)
+{
+	guint cnt = 0;
+	g_autofree guint8 *marks = NULL;
+
+	g_return_val_if_fail (GS_IS_APPSTREAM_INDEX (self), 0);
+
+	/* a single category is just the length of its posting list */
+	if (desktop_groups->len == 1 &&
+	    strstr (g_ptr_array_index (desktop_groups, 0), "::") == NULL) {
+		gsize n_postings = 0;
+		gs_appstream_index_get_category_postings (self,
+							  g_ptr_array_index (desktop_groups, 0),
+							  &n_postings);
+		return (guint) n_postings;
+	}
+
+	marks = gs_appstream_index_mark_desktop_groups (self, desktop_groups);
+	for (guint i = 0; i < self->components->len; i++)
+		cnt += marks[i];
+	return cnt;
+}
+
+/**
+ * gs_appstream_index_get_category_components:
+ * @self: a #GsAppstreamIndex
+ * @desktop_groups: (element-type utf8): desktop groups, e.g. "Game::Shooter"
+ *
+ * Finds the components in any of @desktop_groups.
+ *
+ * Returns: (transfer container) (element-type XbNode): components, in silo order
+ **/
+GPtrArray *
+gs_appstream_index_get_category_components (GsAppstreamIndex *self, GPtrArray *desktop_groups)
+{
+	GPtrArray *components = g_ptr_array_new ();
+	g_autofree guint8 *marks = NULL;
+
+	g_return_val_if_fail (GS_IS_APPSTREAM_INDEX (self), components);
+
+	marks = gs_appstream_index_mark_desktop_groups (self, desktop_groups);
+	for (guint i = 0; i < self->components->len; i++) {
+		if (marks[i])
+			g_ptr_array_add (components, g_ptr_array_index (self->components, i));
+	}
+	return components;
+}
+
+/**
+ * gs_appstream_index_lookup_id:
+ * @self: a #GsAppstreamIndex
+ * @id: a component ID
+ *
+ * Finds the components in the `components/component` collection with @id.
+ *
+ * Returns: (transfer none) (element-type XbNode) (nullable): components, in silo order
+ **/
+GPtrArray *
+gs_appstream_index_lookup_id (GsAppstreamIndex *self, const gchar *id)
+{
+	g_return_val_if_fail (GS_IS_APPSTREAM_INDEX (self), NULL);
+	return g_hash_table_lookup (self->ids, id);
+}
+
+/**
+ * gs_appstream_index_lookup_installed_id:
+ * @self: a #GsAppstreamIndex
+ * @id: a component ID
+ *
+ * Finds the top-level components with @id, i.e. those from installed
+ * AppData or desktop files.
+ *
+ * Returns: (transfer none) (element-type XbNode) (nullable): components, in silo order
+ **/
+GPtrArray *
+gs_appstream_index_lookup_installed_id (GsAppstreamIndex *self, const gchar *id)
+{
+	g_return_val_if_fail (GS_IS_APPSTREAM_INDEX (self), NULL);
+	return g_hash_table_lookup (self->installed_ids, id);
+}
+
+/**
+ * gs_appstream_index_lookup_pkgname:
+ * @self: a #GsAppstreamIndex
+ * @pkgname: a package name
+ *
+ * Finds the components in the `components/component` collection that are
+ * shipped in @pkgname.
+ *
+ * Returns: (transfer none) (element-type XbNode) (nullable): components, in silo order
+ **/
+GPtrArray *
+gs_appstream_index_lookup_pkgname (GsAppstreamIndex *self, const gchar *pkgname)
+{
+	g_return_val_if_fail (GS_IS_APPSTREAM_INDEX (self), NULL);
+	return g_hash_table_lookup (self->pkgnames, pkgname);
+}
+
+static void
+gs_appstream_index_finalize (GObject *object)
+{
+	GsAppstreamIndex *self = GS_APPSTREAM_INDEX (object);
+	g_hash_table_unref (self->ids);
+	g_hash_table_unref (self->installed_ids);
+	g_hash_table_unref (self->pkgnames);
+	if (self->components != NULL)
+		g_ptr_array_unref (self->components);
+	if (self->category_postings != NULL)
+		g_hash_table_unref (self->category_postings);
+	if (self->categories != NULL)
+		g_variant_unref (self->categories);
+	if (self->tokens != NULL)
+		g_variant_unref (self->tokens);
+	G_OBJECT_CLASS (gs_appstream_index_parent_class)->finalize (object);
+}
+
+static void
+gs_appstream_index_class_init (GsAppstreamIndexClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	object_class->finalize = gs_appstream_index_finalize;
+}
+
+static void
+gs_appstream_index_init (GsAppstreamIndex *self)
+{
+	self->ids = g_hash_table_new_full (g_str_hash, g_str_equal,
+					   NULL, (GDestroyNotify) g_ptr_array_unref);
+	self->installed_ids = g_hash_table_new_full (g_str_hash, g_str_equal,
+						     NULL, (GDestroyNotify) g_ptr_array_unref);
+	self->pkgnames = g_hash_table_new_full (g_str_hash, g_str_equal,
+						NULL, (GDestroyNotify) g_ptr_array_unref);
+}
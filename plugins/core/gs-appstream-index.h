@@ -0,0 +1,43 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ * vi:set noexpandtab tabstop=8 shiftwidth=8:
+ *
+ * Copyright (C) 2021 Richard Hughes <richard@hughsie.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+#pragma once
+
+#include <gnome-software.h>
+#include <xmlb.h>
+
+G_BEGIN_DECLS
+
+#define GS_TYPE_APPSTREAM_INDEX (gs_appstream_index_get_type ())
+
+G_DECLARE_FINAL_TYPE (GsAppstreamIndex, gs_appstream_index, GS, APPSTREAM_INDEX, GObject)
+
+typedef struct {
+	XbNode		*component;	/* (not owned) */
+	guint16		 match_value;	/* AsSearchTokenMatch */
+} GsAppstreamIndexMatch;
+
+GsAppstreamIndex *gs_appstream_index_new		(XbSilo		*silo,
+							 GFile		*file,
+							 GCancellable	*cancellable,
+							 GError		**error);
+GArray		*gs_appstream_index_search		(GsAppstreamIndex *self,
+							 const gchar * const *values);
+guint		 gs_appstream_index_count_category	(GsAppstreamIndex *self,
+							 GPtrArray	*desktop_groups);
+GPtrArray	*gs_appstream_index_get_category_components
+							(GsAppstreamIndex *self,
+							 GPtrArray	*desktop_groups);
+GPtrArray	*gs_appstream_index_lookup_id		(GsAppstreamIndex *self,
+							 const gchar	*id);
+GPtrArray	*gs_appstream_index_lookup_installed_id	(GsAppstreamIndex *self,
+							 const gchar	*id);
+GPtrArray	*gs_appstream_index_lookup_pkgname	(GsAppstreamIndex *self,
+							 const gchar	*pkgname);
+
+G_END_DECLS
@@ -15,6 +15,158 @@
 
 #define	GS_APPSTREAM_MAX_SCREENSHOTS	5
 
+/* queries compiled once for each silo by gs_appstream_prepare_queries() */
+typedef enum {
+	GS_APPSTREAM_QUERY_ID,
+	GS_APPSTREAM_QUERY_NAME,
+	GS_APPSTREAM_QUERY_SUMMARY,
+	GS_APPSTREAM_QUERY_METADATA_LICENSE,
+	GS_APPSTREAM_QUERY_INFO_FILENAME,
+	GS_APPSTREAM_QUERY_INFO_SCOPE,
+	GS_APPSTREAM_QUERY_KEYWORD,
+	GS_APPSTREAM_QUERY_ICON_HIDPI,
+	GS_APPSTREAM_QUERY_KUDO_POPULAR,
+	GS_APPSTREAM_QUERY_CATEGORY_FEATURED,
+	GS_APPSTREAM_QUERY_MY_LANGUAGE,
+	GS_APPSTREAM_QUERY_SEARCH_MIMETYPE,
+	GS_APPSTREAM_QUERY_SEARCH_PKGNAME,
+	GS_APPSTREAM_QUERY_SEARCH_SUMMARY,
+	GS_APPSTREAM_QUERY_SEARCH_NAME,
+	GS_APPSTREAM_QUERY_SEARCH_KEYWORD,
+	GS_APPSTREAM_QUERY_SEARCH_ID,
+	GS_APPSTREAM_QUERY_SEARCH_LAUNCHABLE,
+	GS_APPSTREAM_QUERY_SEARCH_ORIGIN,
+	GS_APPSTREAM_QUERY_LAST
+} GsAppstreamQuery;
+
+/* in the same order as GsAppstreamQuery */
+static const struct {
+	const gchar		*xpath;
+	AsSearchTokenMatch	 match_value;
+} gs_appstream_queries[] = {
+	{ "id",						AS_SEARCH_TOKEN_MATCH_NONE },
+	{ "name",					AS_SEARCH_TOKEN_MATCH_NONE },
+	{ "summary",					AS_SEARCH_TOKEN_MATCH_NONE },
+	{ "metadata_license",				AS_SEARCH_TOKEN_MATCH_NONE },
+	{ "../info/filename",				AS_SEARCH_TOKEN_MATCH_NONE },
+	{ "../info/scope",				AS_SEARCH_TOKEN_MATCH_NONE },
+	{ "keywords/keyword",				AS_SEARCH_TOKEN_MATCH_NONE },
+	{ "icon[@width='128']",				AS_SEARCH_TOKEN_MATCH_NONE },
+	{ "kudos/kudo[text()='GnomeSoftware::popular']",	AS_SEARCH_TOKEN_MATCH_NONE },
+	{ "categories/category[text()='Featured']",	AS_SEARCH_TOKEN_MATCH_NONE },
+	{ NULL,	/* depends on the locale */		AS_SEARCH_TOKEN_MATCH_NONE },
+	{ "mimetypes/mimetype[text()~=stem(?)]",	AS_SEARCH_TOKEN_MATCH_MIMETYPE },
+	{ "pkgname[text()~=stem(?)]",			AS_SEARCH_TOKEN_MATCH_PKGNAME },
+	{ "summary[text()~=stem(?)]",			AS_SEARCH_TOKEN_MATCH_SUMMARY },
+	{ "name[text()~=stem(?)]",			AS_SEARCH_TOKEN_MATCH_NAME },
+	{ "keywords/keyword[text()~=stem(?)]",		AS_SEARCH_TOKEN_MATCH_KEYWORD },
+	{ "id[text()~=stem(?)]",			AS_SEARCH_TOKEN_MATCH_ID },
+	{ "launchable[text()~=stem(?)]",		AS_SEARCH_TOKEN_MATCH_ID },
+	{ "../components[@origin~=stem(?)]",		AS_SEARCH_TOKEN_MATCH_ORIGIN },
+};
+
+G_STATIC_ASSERT (G_N_ELEMENTS (gs_appstream_queries) == GS_APPSTREAM_QUERY_LAST);
+
+static gboolean _gs_utils_locale_has_translations (const gchar *locale);
+
+static void
+gs_appstream_query_free (XbQuery *query)
+{
+	/* queries that failed to compile are left as NULL */
+	if (query != NULL)
+		g_object_unref (query);
+}
+
+static gchar *
+gs_appstream_my_language_xpath (GsPlugin *plugin)
+{
+	const gchar *locale = gs_plugin_get_locale (plugin);
+	g_autoptr(GString) xpath = g_string_new (NULL);
+	g_auto(GStrv) variants = NULL;
+
+	if (!_gs_utils_locale_has_translations (locale))
+		return NULL;
+
+	/* @variants includes @locale */
+	variants = g_get_locale_variants (locale);
+	for (gsize i = 0; variants[i] != NULL; i++)
+		xb_string_append_union (xpath, "languages/lang[text()='%s'][@percentage>50]", variants[i]);
+	return g_string_free (g_steal_pointer (&xpath), FALSE);
+}
+
+/**
+ * gs_appstream_prepare_queries:
+ * @plugin: a #GsPlugin
+ * @silo: a #XbSilo
+ *
+ * Compiles the queries used when refining and searching, and attaches them
+ * to @silo. This should be called once when the silo has been built and
+ * before it is shared with other threads; silos without prepared queries
+ * fall back to compiling each XPath when it is used.
+ **/
+void
+gs_appstream_prepare_queries (GsPlugin *plugin, XbSilo *silo)
+{
+	g_autoptr(GPtrArray) queries = NULL;
+
+	queries = g_ptr_array_new_full (GS_APPSTREAM_QUERY_LAST, (GDestroyNotify) gs_appstream_query_free);
+	for (guint i = 0; i < GS_APPSTREAM_QUERY_LAST; i++) {
+		g_autofree gchar *xpath = NULL;
+		g_autoptr(GError) error_local = NULL;
+		XbQuery *query = NULL;
+
+		if (i == GS_APPSTREAM_QUERY_MY_LANGUAGE)
+			xpath = gs_appstream_my_language_xpath (plugin);
+		else
+			xpath = g_strdup (gs_appstream_queries[i].xpath);
+		if (xpath != NULL) {
+			query = xb_query_new (silo, xpath, &error_local);
+			if (query == NULL)
+				g_debug ("ignoring %s: %s", xpath, error_local->message);
+		}
+
+		/* only the first result, or whether there is one, is ever
+		 * used, so stop looking once it has been found */
+#if LIBXMLB_CHECK_VERSION(0, 3, 0)
+		G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+		if (query != NULL)
+			xb_query_set_limit (query, 1);
+		G_GNUC_END_IGNORE_DEPRECATIONS
+#elif LIBXMLB_CHECK_VERSION(0, 2, 0)
+		if (query != NULL)
+			xb_query_set_limit (query, 1);
+#endif
+		g_ptr_array_add (queries, query);
+	}
+	g_object_set_data_full (G_OBJECT (silo), "GsAppstreamQueries",
+				g_steal_pointer (&queries),
+				(GDestroyNotify) g_ptr_array_unref);
+}
+
+static XbQuery *
+gs_appstream_get_query (XbSilo *silo, GsAppstreamQuery idx)
+{
+	GPtrArray *queries = g_object_get_data (G_OBJECT (silo), "GsAppstreamQueries");
+	if (queries == NULL)
+		return NULL;
+	return g_ptr_array_index (queries, idx);
+}
+
+/* like xb_node_query_text(), but using the prepared query if available */
+static const gchar *
+gs_appstream_query_text (XbSilo *silo, XbNode *component, GsAppstreamQuery idx)
+{
+	XbQuery *query = gs_appstream_get_query (silo, idx);
+	g_autoptr(GPtrArray) results = NULL;
+
+	if (query == NULL)
+		return xb_node_query_text (component, gs_appstream_queries[idx].xpath, NULL);
+	results = xb_node_query_full (component, query, NULL);
+	if (results == NULL)
+		return NULL;
+	return xb_node_get_text (g_ptr_array_index (results, 0));
+}
+
 GsApp *
 gs_appstream_create_app (GsPlugin *plugin, XbSilo *silo, XbNode *component, GError **error)
 {
@@ -265,7 +417,7 @@ gs_appstream_refine_icon (GsPlugin *plugin, GsApp *app, XbNode *component)
 	}
 }
 
-static gboolean
+gboolean
 gs_appstream_refine_add_addons (GsPlugin *plugin,
 				GsApp *app,
 				XbSilo *silo,
@@ -492,18 +644,30 @@ gs_appstream_copy_metadata (GsApp *app, XbNode *component, GError **error)
 	return TRUE;
 }
 
-static gboolean
+/**
+ * gs_appstream_refine_app_updates:
+ * @plugin: a #GsPlugin
+ * @app: a #GsApp
+ * @component: the catalog component for @app
+ * @installed: (element-type XbNode) (nullable): the installed components
+ *   for @app, which may be from a different silo to @component
+ * @error: a #GError, or %NULL
+ *
+ * Sets the update details, urgency and version of @app from the releases in
+ * @component that are not in any of @installed.
+ *
+ * Returns: %TRUE for success
+ **/
+gboolean
 gs_appstream_refine_app_updates (GsPlugin *plugin,
 				 GsApp *app,
-				 XbSilo *silo,
 				 XbNode *component,
+				 GPtrArray *installed,
 				 GError **error)
 {
 	AsUrgencyKind urgency_best = AS_URGENCY_KIND_UNKNOWN;
-	g_autofree gchar *xpath = NULL;
 	g_autoptr(GError) error_local = NULL;
-	g_autoptr(GHashTable) installed = g_hash_table_new (g_str_hash, g_str_equal);
-	g_autoptr(GPtrArray) releases_inst = NULL;
+	g_autoptr(GHashTable) installed_versions = g_hash_table_new (g_str_hash, g_str_equal);
 	g_autoptr(GPtrArray) releases = NULL;
 	g_autoptr(GPtrArray) updates_list = g_ptr_array_new ();
 
@@ -512,24 +676,19 @@ gs_appstream_refine_app_updates (GsPlugin *plugin,
 		return TRUE;
 
 	/* find out which releases are already installed */
-	xpath = g_strdup_printf ("component/id[text()='%s']/../releases/*[@version]",
-				 gs_app_get_id (app));
-	releases_inst = xb_silo_query (silo, xpath, 0, &error_local);
-	if (releases_inst == NULL) {
-		if (!g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND) &&
-		    !g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT)) {
-			g_propagate_error (error, g_steal_pointer (&error_local));
-			return FALSE;
-		}
-	} else {
+	for (guint j = 0; installed != NULL && j < installed->len; j++) {
+		XbNode *component_inst = g_ptr_array_index (installed, j);
+		g_autoptr(GPtrArray) releases_inst = NULL;
+
+		releases_inst = xb_node_query (component_inst, "releases/*[@version]", 0, NULL);
+		if (releases_inst == NULL)
+			continue;
 		for (guint i = 0; i < releases_inst->len; i++) {
 			XbNode *release = g_ptr_array_index (releases_inst, i);
-			g_hash_table_insert (installed,
-					     (gpointer) xb_node_get_attr (release, "version"),
-					     (gpointer) release);
+			g_hash_table_add (installed_versions,
+					  (gpointer) xb_node_get_attr (release, "version"));
 		}
 	}
-	g_clear_error (&error_local);
 
 	/* get all components */
 	releases = xb_node_query (component, "releases/*", 0, &error_local);
@@ -552,12 +711,12 @@ gs_appstream_refine_app_updates (GsPlugin *plugin,
 			continue;
 
 		/* already installed */
-		if (g_hash_table_lookup (installed, version) != NULL)
+		if (g_hash_table_contains (installed_versions, version))
 			continue;
 
 		/* limit this to three versions backwards if there has never
 		 * been a detected installed version */
-		if (g_hash_table_size (installed) == 0 && i >= 3)
+		if (g_hash_table_size (installed_versions) == 0 && i >= 3)
 			break;
 
 		/* use the 'worst' urgency, e.g. critical over enhancement */
@@ -869,24 +1028,24 @@ gs_appstream_refine_app (GsPlugin *plugin,
 
 	/* try to detect old-style AppStream 'override'
 	 * files without the merge attribute */
-	if (xb_node_query_text (component, "name", NULL) == NULL &&
-	    xb_node_query_text (component, "metadata_license", NULL) == NULL) {
+	if (gs_appstream_query_text (silo, component, GS_APPSTREAM_QUERY_NAME) == NULL &&
+	    gs_appstream_query_text (silo, component, GS_APPSTREAM_QUERY_METADATA_LICENSE) == NULL) {
 		gs_app_add_quirk (app, GS_APP_QUIRK_IS_WILDCARD);
 	}
 
 	/* set id */
-	tmp = xb_node_query_text (component, "id", NULL);
+	tmp = gs_appstream_query_text (silo, component, GS_APPSTREAM_QUERY_ID);
 	if (tmp != NULL && gs_app_get_id (app) == NULL)
 		gs_app_set_id (app, tmp);
 
 	/* set source */
-	tmp = xb_node_query_text (component, "../info/filename", NULL);
+	tmp = gs_appstream_query_text (silo, component, GS_APPSTREAM_QUERY_INFO_FILENAME);
 	if (tmp != NULL && gs_app_get_metadata_item (app, "appstream::source-file") == NULL) {
 		gs_app_set_metadata (app, "appstream::source-file", tmp);
 	}
 
 	/* set scope */
-	tmp = xb_node_query_text (component, "../info/scope", NULL);
+	tmp = gs_appstream_query_text (silo, component, GS_APPSTREAM_QUERY_INFO_SCOPE);
 	if (tmp != NULL)
 		gs_app_set_scope (app, as_component_scope_from_string (tmp));
 
@@ -897,12 +1056,12 @@ gs_appstream_refine_app (GsPlugin *plugin,
 	}
 
 	/* set name */
-	tmp = xb_node_query_text (component, "name", NULL);
+	tmp = gs_appstream_query_text (silo, component, GS_APPSTREAM_QUERY_NAME);
 	if (tmp != NULL)
 		gs_app_set_name (app, GS_APP_QUALITY_HIGHEST, tmp);
 
 	/* set summary */
-	tmp = xb_node_query_text (component, "summary", NULL);
+	tmp = gs_appstream_query_text (silo, component, GS_APPSTREAM_QUERY_SUMMARY);
 	if (tmp != NULL)
 		gs_app_set_summary (app, GS_APP_QUALITY_HIGHEST, tmp);
 
@@ -1099,29 +1258,26 @@ gs_appstream_refine_app (GsPlugin *plugin,
 
 	/* add kudos */
 	if (refine_flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_KUDOS) {
-		g_autoptr(GPtrArray) kudos = NULL;
+		XbQuery *query = gs_appstream_get_query (silo, GS_APPSTREAM_QUERY_MY_LANGUAGE);
 		tmp = gs_plugin_get_locale (plugin);
 		if (!_gs_utils_locale_has_translations (tmp)) {
 			gs_app_add_kudo (app, GS_APP_KUDO_MY_LANGUAGE);
+		} else if (query != NULL) {
+			g_autoptr(GPtrArray) langs = xb_node_query_full (component, query, NULL);
+			if (langs != NULL)
+				gs_app_add_kudo (app, GS_APP_KUDO_MY_LANGUAGE);
 		} else {
-
-			g_autoptr(GString) xpath = g_string_new (NULL);
-			g_auto(GStrv) variants = g_get_locale_variants (tmp);
-
-			/* @variants includes @tmp */
-			for (gsize i = 0; variants[i] != NULL; i++)
-				xb_string_append_union (xpath, "languages/lang[text()='%s'][@percentage>50]", variants[i]);
-
-			if (xb_node_query_text (component, xpath->str, NULL) != NULL)
+			g_autofree gchar *xpath = gs_appstream_my_language_xpath (plugin);
+			if (xb_node_query_text (component, xpath, NULL) != NULL)
 				gs_app_add_kudo (app, GS_APP_KUDO_MY_LANGUAGE);
 		}
 
 		/* any keywords */
-		if (xb_node_query_text (component, "keywords/keyword", NULL) != NULL)
+		if (gs_appstream_query_text (silo, component, GS_APPSTREAM_QUERY_KEYWORD) != NULL)
 			gs_app_add_kudo (app, GS_APP_KUDO_HAS_KEYWORDS);
 
 		/* HiDPI icon */
-		if (xb_node_query_text (component, "icon[@width='128']", NULL) != NULL)
+		if (gs_appstream_query_text (silo, component, GS_APPSTREAM_QUERY_ICON_HIDPI) != NULL)
 			gs_app_add_kudo (app, GS_APP_KUDO_HI_DPI_ICON);
 
 		/* was this application released recently */
@@ -1129,9 +1285,9 @@ gs_appstream_refine_app (GsPlugin *plugin,
 			gs_app_add_kudo (app, GS_APP_KUDO_RECENT_RELEASE);
 
 		/* add a kudo to featured and popular apps */
-		if (xb_node_query_text (component, "kudos/kudo[text()='GnomeSoftware::popular']", NULL) != NULL)
+		if (gs_appstream_query_text (silo, component, GS_APPSTREAM_QUERY_KUDO_POPULAR) != NULL)
 			gs_app_add_kudo (app, GS_APP_KUDO_FEATURED_RECOMMENDED);
-		if (xb_node_query_text (component, "categories/category[text()='Featured']", NULL) != NULL)
+		if (gs_appstream_query_text (silo, component, GS_APPSTREAM_QUERY_CATEGORY_FEATURED) != NULL)
 			gs_app_add_kudo (app, GS_APP_KUDO_FEATURED_RECOMMENDED);
 	}
 
@@ -1147,11 +1303,25 @@ gs_appstream_refine_app (GsPlugin *plugin,
 	}
 
 	/* is there any update information */
-	if (refine_flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_UPDATE_DETAILS) {
+	if ((refine_flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_UPDATE_DETAILS) > 0 &&
+	    gs_app_is_updatable (app)) {
+		g_autofree gchar *xpath = NULL;
+		g_autoptr(GError) error_local = NULL;
+		g_autoptr(GPtrArray) installed = NULL;
+
+		xpath = g_strdup_printf ("component/id[text()='%s']/..",
+					 gs_app_get_id (app));
+		installed = xb_silo_query (silo, xpath, 0, &error_local);
+		if (installed == NULL &&
+		    !g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND) &&
+		    !g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT)) {
+			g_propagate_error (error, g_steal_pointer (&error_local));
+			return FALSE;
+		}
 		if (!gs_appstream_refine_app_updates (plugin,
 						      app,
-						      silo,
 						      component,
+						      installed,
 						      error))
 			return FALSE;
 	}
@@ -1182,6 +1352,7 @@ gs_appstream_silo_search_component2 (GPtrArray *array, XbNode *component, const
 		GsAppstreamSearchHelper *helper = g_ptr_array_index (array, i);
 #if LIBXMLB_CHECK_VERSION(0, 3, 0)
 		g_auto(XbQueryContext) context = XB_QUERY_CONTEXT_INIT ();
+		xb_query_context_set_limit (&context, 1);
 		xb_value_bindings_bind_str (xb_query_context_get_bindings (&context), 0, search, NULL);
 		n = xb_node_query_with_context (component, helper->query, &context, NULL);
 #else
@@ -1209,9 +1380,32 @@ gs_appstream_silo_search_component (GPtrArray *array, XbNode *component, const g
 	return matches_sum;
 }
 
+static gboolean
+gs_appstream_search_add_app (GsPlugin *plugin,
+			     XbSilo *silo,
+			     XbNode *component,
+			     guint16 match_value,
+			     GsAppList *list,
+			     GError **error)
+{
+	g_autoptr(GsApp) app = gs_appstream_create_app (plugin, silo, component, error);
+	if (app == NULL)
+		return FALSE;
+	if (gs_app_has_quirk (app, GS_APP_QUIRK_IS_WILDCARD)) {
+		g_debug ("not returning wildcard %s",
+			 gs_app_get_unique_id (app));
+		return TRUE;
+	}
+	g_debug ("add %s", gs_app_get_unique_id (app));
+	gs_app_set_match_value (app, match_value);
+	gs_app_list_add (list, app);
+	return TRUE;
+}
+
 gboolean
 gs_appstream_search (GsPlugin *plugin,
 		     XbSilo *silo,
+		     GsAppstreamIndex *index,
 		     const gchar * const *values,
 		     GsAppList *list,
 		     GCancellable *cancellable,
@@ -1221,28 +1415,39 @@ gs_appstream_search (GsPlugin *plugin,
 	g_autoptr(GPtrArray) array = g_ptr_array_new_with_free_func ((GDestroyNotify) gs_appstream_search_helper_free);
 	g_autoptr(GPtrArray) components = NULL;
 	g_autoptr(GTimer) timer = g_timer_new ();
-	const struct {
-		AsSearchTokenMatch	match_value;
-		const gchar		*xpath;
-	} queries[] = {
-		{ AS_SEARCH_TOKEN_MATCH_MIMETYPE,	"mimetypes/mimetype[text()~=stem(?)]" },
-		{ AS_SEARCH_TOKEN_MATCH_PKGNAME,	"pkgname[text()~=stem(?)]" },
-		{ AS_SEARCH_TOKEN_MATCH_SUMMARY,	"summary[text()~=stem(?)]" },
-		{ AS_SEARCH_TOKEN_MATCH_NAME,	"name[text()~=stem(?)]" },
-		{ AS_SEARCH_TOKEN_MATCH_KEYWORD,	"keywords/keyword[text()~=stem(?)]" },
-		{ AS_SEARCH_TOKEN_MATCH_ID,	"id[text()~=stem(?)]" },
-		{ AS_SEARCH_TOKEN_MATCH_ID,	"launchable[text()~=stem(?)]" },
-		{ AS_SEARCH_TOKEN_MATCH_ORIGIN,	"../components[@origin~=stem(?)]" },
-		{ AS_SEARCH_TOKEN_MATCH_NONE,	NULL }
-	};
+
+	/* use the prebuilt token index if available */
+	if (index != NULL) {
+		g_autoptr(GArray) matches = gs_appstream_index_search (index, values);
+		for (guint i = 0; i < matches->len; i++) {
+			GsAppstreamIndexMatch *match = &g_array_index (matches, GsAppstreamIndexMatch, i);
+			if (!gs_appstream_search_add_app (plugin, silo,
+							  match->component,
+							  match->match_value,
+							  list, error))
+				return FALSE;
+		}
+		g_debug ("indexed search took %fms", g_timer_elapsed (timer, NULL) * 1000);
+		return TRUE;
+	}
 
 	/* add some weighted queries */
-	for (guint i = 0; queries[i].xpath != NULL; i++) {
+	for (guint i = GS_APPSTREAM_QUERY_SEARCH_MIMETYPE; i <= GS_APPSTREAM_QUERY_SEARCH_ORIGIN; i++) {
 		g_autoptr(GError) error_query = NULL;
-		g_autoptr(XbQuery) query = xb_query_new (silo, queries[i].xpath, &error_query);
+		g_autoptr(XbQuery) query = NULL;
+
+#if LIBXMLB_CHECK_VERSION(0, 3, 0)
+		/* the search term is bound in a per-call context, so the
+		 * prepared query can be shared between threads */
+		query = gs_appstream_get_query (silo, i);
+		if (query != NULL)
+			g_object_ref (query);
+#endif
+		if (query == NULL)
+			query = xb_query_new (silo, gs_appstream_queries[i].xpath, &error_query);
 		if (query != NULL) {
 			GsAppstreamSearchHelper *helper = g_new0 (GsAppstreamSearchHelper, 1);
-			helper->match_value = queries[i].match_value;
+			helper->match_value = gs_appstream_queries[i].match_value;
 			helper->query = g_steal_pointer (&query);
 			g_ptr_array_add (array, helper);
 		} else {
@@ -1264,26 +1469,34 @@ gs_appstream_search (GsPlugin *plugin,
 		XbNode *component = g_ptr_array_index (components, i);
 		guint16 match_value = gs_appstream_silo_search_component (array, component, values);
 		if (match_value != 0) {
-			g_autoptr(GsApp) app = gs_appstream_create_app (plugin, silo, component, error);
-			if (app == NULL)
+			if (!gs_appstream_search_add_app (plugin, silo, component,
+							  match_value, list, error))
 				return FALSE;
-			if (gs_app_has_quirk (app, GS_APP_QUIRK_IS_WILDCARD)) {
-				g_debug ("not returning wildcard %s",
-					 gs_app_get_unique_id (app));
-				continue;
-			}
-			g_debug ("add %s", gs_app_get_unique_id (app));
-			gs_app_set_match_value (app, match_value);
-			gs_app_list_add (list, app);
 		}
 	}
 	g_debug ("search took %fms", g_timer_elapsed (timer, NULL) * 1000);
 	return TRUE;
 }
 
+static void
+gs_appstream_add_category_components (GPtrArray *components, GsAppList *list)
+{
+	for (guint i = 0; i < components->len; i++) {
+		XbNode *component = g_ptr_array_index (components, i);
+		g_autoptr(GsApp) app = NULL;
+		const gchar *id = xb_node_query_text (component, "id", NULL);
+		if (id == NULL)
+			continue;
+		app = gs_app_new (id);
+		gs_app_add_quirk (app, GS_APP_QUIRK_IS_WILDCARD);
+		gs_app_list_add (list, app);
+	}
+}
+
 gboolean
 gs_appstream_add_category_apps (GsPlugin *plugin,
 				XbSilo *silo,
+				GsAppstreamIndex *index,
 				GsCategory *category,
 				GsAppList *list,
 				GCancellable *cancellable,
@@ -1297,6 +1510,15 @@ gs_appstream_add_category_apps (GsPlugin *plugin,
 		g_warning ("no desktop_groups for %s", gs_category_get_id (category));
 		return TRUE;
 	}
+
+	/* use the prebuilt category index if available */
+	if (index != NULL) {
+		g_autoptr(GPtrArray) components = NULL;
+		components = gs_appstream_index_get_category_components (index, desktop_groups);
+		gs_appstream_add_category_components (components, list);
+		return TRUE;
+	}
+
 	for (guint j = 0; j < desktop_groups->len; j++) {
 		const gchar *desktop_group = g_ptr_array_index (desktop_groups, j);
 		g_autofree gchar *xpath = NULL;
@@ -1325,17 +1547,7 @@ gs_appstream_add_category_apps (GsPlugin *plugin,
 		}
 
 		/* create app */
-		for (guint i = 0; i < components->len; i++) {
-			XbNode *component = g_ptr_array_index (components, i);
-			g_autoptr(GsApp) app = NULL;
-			const gchar *id = xb_node_query_text (component, "id", NULL);
-			if (id == NULL)
-				continue;
-			app = gs_app_new (id);
-			gs_app_add_quirk (app, GS_APP_QUIRK_IS_WILDCARD);
-			gs_app_list_add (list, app);
-		}
-
+		gs_appstream_add_category_components (components, list);
 	}
 	return TRUE;
 }
@@ -1379,10 +1591,35 @@ gs_appstream_count_component_for_groups (GsPlugin *plugin, XbSilo *silo, const g
 gboolean
 gs_appstream_add_categories (GsPlugin *plugin,
 			     XbSilo *silo,
+			     GsAppstreamIndex *index,
 			     GPtrArray *list,
 			     GCancellable *cancellable,
 			     GError **error)
 {
+	/* the index has exact counts, and apps in more than one of the
+	 * groups of a category are only counted once */
+	if (index != NULL) {
+		for (guint j = 0; j < list->len; j++) {
+			GsCategory *parent = GS_CATEGORY (g_ptr_array_index (list, j));
+			GPtrArray *children = gs_category_get_children (parent);
+			g_autoptr(GPtrArray) parent_groups = g_ptr_array_new ();
+
+			for (guint i = 0; i < children->len; i++) {
+				GsCategory *cat = g_ptr_array_index (children, i);
+				GPtrArray *groups = gs_category_get_desktop_groups (cat);
+				for (guint k = 0; k < groups->len; k++)
+					g_ptr_array_add (parent_groups, g_ptr_array_index (groups, k));
+				if (children->len > 1) {
+					guint cnt = gs_appstream_index_count_category (index, groups);
+					gs_category_add_size (cat, cnt);
+				}
+			}
+			gs_category_add_size (parent,
+					      gs_appstream_index_count_category (index, parent_groups));
+		}
+		return TRUE;
+	}
+
 	for (guint j = 0; j < list->len; j++) {
 		GsCategory *parent = GS_CATEGORY (g_ptr_array_index (list, j));
 		GPtrArray *children = gs_category_get_children (parent);
@@ -11,8 +11,12 @@
 #include <gnome-software.h>
 #include <xmlb.h>
 
+#include "gs-appstream-index.h"
+
 G_BEGIN_DECLS
 
+void		 gs_appstream_prepare_queries		(GsPlugin	*plugin,
+							 XbSilo		*silo);
 GsApp		*gs_appstream_create_app		(GsPlugin	*plugin,
 							 XbSilo		*silo,
 							 XbNode		*component,
@@ -23,19 +27,31 @@ gboolean	 gs_appstream_refine_app		(GsPlugin	*plugin,
 							 XbNode		*component,
 							 GsPluginRefineFlags flags,
 							 GError		**error);
+gboolean	 gs_appstream_refine_add_addons		(GsPlugin	*plugin,
+							 GsApp		*app,
+							 XbSilo		*silo,
+							 GError		**error);
+gboolean	 gs_appstream_refine_app_updates	(GsPlugin	*plugin,
+							 GsApp		*app,
+							 XbNode		*component,
+							 GPtrArray	*installed,
+							 GError		**error);
 gboolean	 gs_appstream_search			(GsPlugin	*plugin,
 							 XbSilo		*silo,
+							 GsAppstreamIndex *index,
 							 const gchar * const *values,
 							 GsAppList	*list,
 							 GCancellable	*cancellable,
 							 GError		**error);
 gboolean	 gs_appstream_add_categories		(GsPlugin	*plugin,
 							 XbSilo		*silo,
+							 GsAppstreamIndex *index,
 							 GPtrArray	*list,
 							 GCancellable	*cancellable,
 							 GError		**error);
 gboolean	 gs_appstream_add_category_apps		(GsPlugin	*plugin,
 							 XbSilo		*silo,
+							 GsAppstreamIndex *index,
 							 GsCategory	*category,
 							 GsAppList	*list,
 							 GCancellable	*cancellable,
@@ -9,7 +9,9 @@
 
 #include <config.h>
 
+#include <errno.h>
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 #include <gnome-software.h>
 #include <xmlb.h>
 
@@ -26,20 +28,64 @@
  * Refines:     | [source]->[name,summary,pixbuf,id,kind]
  */
 
-struct GsPluginData {
+/* each AppStream catalog file, appdata directory and desktop directory is
+ * compiled into its own silo so that installing one package only recompiles
+ * the source that actually changed */
+typedef struct {
+	gchar			*path;
 	XbSilo			*silo;
+	GsAppstreamIndex	*index;
+} GsPluginAppstreamPart;
+
+struct GsPluginData {
+	GPtrArray		*parts;		/* (element-type GsPluginAppstreamPart) */
+	GPtrArray		*monitors;	/* (element-type GFileMonitor) */
+	gint			 layout_changed;	/* (atomic) */
+	gint			 rebuilding;	/* (atomic) */
 	GRWLock			 silo_lock;
+	GMutex			 rebuild_mutex;
+	GCond			 rebuild_cond;	/* signalled when @rebuilding is cleared */
+	GCancellable		*rebuild_cancellable;
+	guint			 rebuild_failures;	/* protected by @rebuild_mutex */
+	gint			 rebuild_retry_time;	/* (atomic): monotonic seconds */
 	GSettings		*settings;
 };
 
+/* seconds to wait before retrying a failed rebuild, doubled for each failure
+ * in a row up to GS_PLUGIN_APPSTREAM_REBUILD_FAILURES_MAX */
+#define GS_PLUGIN_APPSTREAM_REBUILD_BACKOFF		5
+#define GS_PLUGIN_APPSTREAM_REBUILD_FAILURES_MAX	7
+
+typedef gboolean (*GsPluginAppstreamLoadFunc)	(GsPlugin	*plugin,
+						 XbBuilder	*builder,
+						 const gchar	*path,
+						 GCancellable	*cancellable,
+						 GError		**error);
+
+static void
+gs_plugin_appstream_part_free (GsPluginAppstreamPart *part)
+{
+	g_free (part->path);
+	g_clear_object (&part->index);
+	g_clear_object (&part->silo);
+	g_free (part);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(GsPluginAppstreamPart, gs_plugin_appstream_part_free)
+
 void
 gs_plugin_initialize (GsPlugin *plugin)
 {
 	GsPluginData *priv = gs_plugin_alloc_data (plugin, sizeof(GsPluginData));
 
 	/* XbSilo needs external locking as we destroy the silo and build a new
-	 * one when something changes */
+	 * one when something changes; the new one is built without holding
+	 * the lock so that readers only ever wait for the swap */
 	g_rw_lock_init (&priv->silo_lock);
+	g_mutex_init (&priv->rebuild_mutex);
+	g_cond_init (&priv->rebuild_cond);
+	priv->rebuild_cancellable = g_cancellable_new ();
+	priv->parts = g_ptr_array_new_with_free_func ((GDestroyNotify) gs_plugin_appstream_part_free);
 
 	/* need package name */
 	gs_plugin_add_rule (plugin, GS_PLUGIN_RULE_RUN_AFTER, "dpkg");
@@ -52,9 +98,22 @@ void
 gs_plugin_destroy (GsPlugin *plugin)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
-	g_object_unref (priv->silo);
+
+	/* stop any rebuild in the background, and wait until it lets go */
+	g_cancellable_cancel (priv->rebuild_cancellable);
+	g_mutex_lock (&priv->rebuild_mutex);
+	while (g_atomic_int_get (&priv->rebuilding))
+		g_cond_wait (&priv->rebuild_cond, &priv->rebuild_mutex);
+	g_mutex_unlock (&priv->rebuild_mutex);
+
+	if (priv->monitors != NULL)
+		g_ptr_array_unref (priv->monitors);
+	g_ptr_array_unref (priv->parts);
 	g_object_unref (priv->settings);
+	g_object_unref (priv->rebuild_cancellable);
 	g_rw_lock_clear (&priv->silo_lock);
+	g_mutex_clear (&priv->rebuild_mutex);
+	g_cond_clear (&priv->rebuild_cond);
 }
 
 static const gchar *
@@ -365,13 +424,11 @@ gs_plugin_appstream_load_appstream_fn (GsPlugin *plugin,
 				       gs_plugin_appstream_load_dep11_cb,
 				       NULL, NULL);
 
-	/* add source */
+	/* add source; only watch the file itself, as watching the directory
+	 * would invalidate the part of every other catalog file in it, and
+	 * added or removed files are picked up by the directory monitors */
 	if (!xb_builder_source_load_file (source, file,
-#if LIBXMLB_CHECK_VERSION(0, 2, 0)
-					  XB_BUILDER_SOURCE_FLAG_WATCH_DIRECTORY,
-#else
 					  XB_BUILDER_SOURCE_FLAG_WATCH_FILE,
-#endif
 					  cancellable,
 					  error)) {
 		return FALSE;
@@ -410,11 +467,218 @@ gs_plugin_appstream_load_appstream_fn (GsPlugin *plugin,
 }
 
 static gboolean
-gs_plugin_appstream_load_appstream (GsPlugin *plugin,
-				    XbBuilder *builder,
-				    const gchar *path,
-				    GCancellable *cancellable,
-				    GError **error)
+gs_plugin_appstream_load_test_xml (GsPlugin *plugin,
+				   XbBuilder *builder,
+				   const gchar *xml,
+				   GCancellable *cancellable,
+				   GError **error)
+{
+	g_autoptr(XbBuilderFixup) fixup1 = NULL;
+	g_autoptr(XbBuilderFixup) fixup2 = NULL;
+	g_autoptr(XbBuilderSource) source = xb_builder_source_new ();
+
+	if (!xb_builder_source_load_xml (source, xml,
+					 XB_BUILDER_SOURCE_FLAG_NONE,
+					 error))
+		return FALSE;
+	fixup1 = xb_builder_fixup_new ("AddOriginKeywords",
+				       gs_plugin_appstream_add_origin_keyword_cb,
+				       plugin, NULL);
+	xb_builder_fixup_set_max_depth (fixup1, 1);
+	xb_builder_source_add_fixup (source, fixup1);
+	fixup2 = xb_builder_fixup_new ("AddIcons",
+				       gs_plugin_appstream_add_icons_cb,
+				       plugin, NULL);
+	xb_builder_fixup_set_max_depth (fixup2, 2);
+	xb_builder_source_add_fixup (source, fixup2);
+	xb_builder_import_source (builder, source);
+	return TRUE;
+}
+
+static XbBuilder *
+gs_plugin_appstream_builder_new (void)
+{
+	const gchar *locale;
+	XbBuilder *builder = xb_builder_new ();
+
+	/* verbose profiling */
+	if (g_getenv ("GS_XMLB_VERBOSE") != NULL) {
+		xb_builder_set_profile_flags (builder,
+					      XB_SILO_PROFILE_FLAG_XPATH |
+					      XB_SILO_PROFILE_FLAG_DEBUG);
+	}
+
+	/* add current locales */
+	locale = g_getenv ("GS_SELF_TEST_LOCALE");
+	if (locale == NULL) {
+		const gchar *const *locales = g_get_language_names ();
+		for (guint i = 0; locales[i] != NULL; i++)
+			xb_builder_add_locale (builder, locales[i]);
+	} else {
+		xb_builder_add_locale (builder, locale);
+	}
+
+	/* regenerate with each minor release */
+	xb_builder_append_guid (builder, PACKAGE_VERSION);
+	return builder;
+}
+
+static GsPluginAppstreamPart *
+gs_plugin_appstream_part_compile (GsPlugin *plugin,
+				  const gchar *path,
+				  GsPluginAppstreamLoadFunc load_func,
+				  gboolean watch_path,
+				  GCancellable *cancellable,
+				  GError **error)
+{
+	g_autofree gchar *blobfn = NULL;
+	g_autofree gchar *blobname = NULL;
+	g_autofree gchar *hash = g_compute_checksum_for_string (G_CHECKSUM_SHA1, path, -1);
+	g_autofree gchar *idxfn = NULL;
+	g_autofree gchar *idxname = NULL;
+	g_autoptr(GError) error_index = NULL;
+	g_autoptr(GFile) file = NULL;
+	g_autoptr(GFile) idxfile = NULL;
+	g_autoptr(GsPluginAppstreamPart) part = g_new0 (GsPluginAppstreamPart, 1);
+	g_autoptr(XbBuilder) builder = gs_plugin_appstream_builder_new ();
+
+	if (!load_func (plugin, builder, path, cancellable, error))
+		return NULL;
+
+	/* create per-user cache, keyed on the source */
+	blobname = g_strdup_printf ("components-%s.xmlb", hash);
+	blobfn = gs_utils_get_cache_filename ("appstream", blobname,
+					      GS_UTILS_CACHE_FLAG_WRITEABLE |
+					      GS_UTILS_CACHE_FLAG_CREATE_DIRECTORY,
+					      error);
+	if (blobfn == NULL)
+		return NULL;
+	file = g_file_new_for_path (blobfn);
+	g_debug ("ensuring %s", blobfn);
+	part->path = g_strdup (path);
+	part->silo = xb_builder_ensure (builder, file,
+					XB_BUILDER_COMPILE_FLAG_IGNORE_INVALID |
+					XB_BUILDER_COMPILE_FLAG_SINGLE_LANG,
+					NULL, error);
+	if (part->silo == NULL)
+		return NULL;
+	gs_appstream_prepare_queries (plugin, part->silo);
+
+	/* watch the directory too */
+	if (watch_path) {
+		g_autoptr(GFile) file_tmp = g_file_new_for_path (path);
+		if (!xb_silo_watch_file (part->silo, file_tmp, cancellable, error))
+			return NULL;
+	}
+
+	/* build the search index, falling back to XPath if this fails */
+	idxname = g_strdup_printf ("components-%s.idx", hash);
+	idxfn = gs_utils_get_cache_filename ("appstream", idxname,
+					     GS_UTILS_CACHE_FLAG_WRITEABLE |
+					     GS_UTILS_CACHE_FLAG_CREATE_DIRECTORY,
+					     error);
+	if (idxfn == NULL)
+		return NULL;
+	idxfile = g_file_new_for_path (idxfn);
+	part->index = gs_appstream_index_new (part->silo, idxfile,
+					      cancellable, &error_index);
+	if (part->index == NULL)
+		g_warning ("failed to build search index for %s: %s", path, error_index->message);
+	return g_steal_pointer (&part);
+}
+
+/* each source has its own cache files, so remove those of sources that have
+ * gone away rather than letting them pile up */
+static void
+gs_plugin_appstream_remove_stale_caches (GPtrArray *parts)
+{
+	const gchar *fn;
+	g_autofree gchar *blobfn = NULL;
+	g_autofree gchar *cachedir = NULL;
+	g_autoptr(GDir) dir = NULL;
+	g_autoptr(GHashTable) keep = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	blobfn = gs_utils_get_cache_filename ("appstream", "components.xmlb",
+					      GS_UTILS_CACHE_FLAG_WRITEABLE,
+					      NULL);
+	if (blobfn == NULL)
+		return;
+	cachedir = g_path_get_dirname (blobfn);
+	dir = g_dir_open (cachedir, 0, NULL);
+	if (dir == NULL)
+		return;
+	for (guint i = 0; i < parts->len; i++) {
+		GsPluginAppstreamPart *part = g_ptr_array_index (parts, i);
+		g_autofree gchar *hash = g_compute_checksum_for_string (G_CHECKSUM_SHA1, part->path, -1);
+		g_hash_table_add (keep, g_strdup_printf ("components-%s.xmlb", hash));
+		g_hash_table_add (keep, g_strdup_printf ("components-%s.idx", hash));
+	}
+	while ((fn = g_dir_read_name (dir)) != NULL) {
+		g_autofree gchar *filename = NULL;
+
+		/* also the single silo used before sources were split */
+		if (g_strcmp0 (fn, "components.xmlb") != 0) {
+			if (!g_str_has_prefix (fn, "components-"))
+				continue;
+			if (!g_str_has_suffix (fn, ".xmlb") &&
+			    !g_str_has_suffix (fn, ".idx"))
+				continue;
+			if (g_hash_table_contains (keep, fn))
+				continue;
+		}
+		filename = g_build_filename (cachedir, fn, NULL);
+		g_debug ("removing stale %s", filename);
+		if (g_unlink (filename) != 0)
+			g_debug ("failed to remove %s: %s", filename, g_strerror (errno));
+	}
+}
+
+/* reuses the part for @path from @parts_old if it is still valid, otherwise
+ * compiles a new one */
+static gboolean
+gs_plugin_appstream_ensure_part (GsPlugin *plugin,
+				 GPtrArray *parts,
+				 GPtrArray *parts_old,
+				 const gchar *path,
+				 GsPluginAppstreamLoadFunc load_func,
+				 gboolean watch_path,
+				 gboolean *changed,
+				 GCancellable *cancellable,
+				 GError **error)
+{
+	GsPluginAppstreamPart *part;
+
+	for (guint i = 0; i < parts_old->len; i++) {
+		GsPluginAppstreamPart *part_old = g_ptr_array_index (parts_old, i);
+		if (g_strcmp0 (part_old->path, path) != 0)
+			continue;
+		if (!xb_silo_is_valid (part_old->silo))
+			break;
+		part = g_new0 (GsPluginAppstreamPart, 1);
+		part->path = g_strdup (path);
+		part->silo = g_object_ref (part_old->silo);
+		if (part_old->index != NULL)
+			part->index = g_object_ref (part_old->index);
+		g_ptr_array_add (parts, part);
+		return TRUE;
+	}
+	part = gs_plugin_appstream_part_compile (plugin, path, load_func,
+						 watch_path, cancellable, error);
+	if (part == NULL)
+		return FALSE;
+	g_ptr_array_add (parts, part);
+	*changed = TRUE;
+	return TRUE;
+}
+
+static gboolean
+gs_plugin_appstream_ensure_appstream_parts (GsPlugin *plugin,
+					    GPtrArray *parts,
+					    GPtrArray *parts_old,
+					    const gchar *path,
+					    gboolean *changed,
+					    GCancellable *cancellable,
+					    GError **error)
 {
 	const gchar *fn;
 	g_autoptr(GDir) dir = NULL;
@@ -433,11 +697,10 @@ gs_plugin_appstream_load_appstream (GsPlugin *plugin,
 		    g_str_has_suffix (fn, ".xml.gz")) {
 			g_autofree gchar *filename = g_build_filename (path, fn, NULL);
 			g_autoptr(GError) error_local = NULL;
-			if (!gs_plugin_appstream_load_appstream_fn (plugin,
-								    builder,
-								    filename,
-								    cancellable,
-								    &error_local)) {
+			if (!gs_plugin_appstream_ensure_part (plugin, parts, parts_old, filename,
+							      gs_plugin_appstream_load_appstream_fn,
+							      FALSE, changed,
+							      cancellable, &error_local)) {
 				g_debug ("ignoring %s: %s", filename, error_local->message);
 				continue;
 			}
@@ -448,72 +711,109 @@ gs_plugin_appstream_load_appstream (GsPlugin *plugin,
 	return TRUE;
 }
 
+static void
+gs_plugin_appstream_dir_changed_cb (GFileMonitor *monitor,
+				    GFile *file,
+				    GFile *other_file,
+				    GFileMonitorEvent event_type,
+				    gpointer user_data)
+{
+	GsPluginData *priv = (GsPluginData *) user_data;
+
+	/* catalog files added or removed, the existing parts are still fine */
+	if (event_type == G_FILE_MONITOR_EVENT_CREATED ||
+	    event_type == G_FILE_MONITOR_EVENT_DELETED ||
+	    event_type == G_FILE_MONITOR_EVENT_MOVED_IN ||
+	    event_type == G_FILE_MONITOR_EVENT_MOVED_OUT)
+		g_atomic_int_set (&priv->layout_changed, TRUE);
+}
+
+static void
+gs_plugin_appstream_watch_dirs (GsPlugin *plugin, GPtrArray *dirs)
+{
+	GsPluginData *priv = gs_plugin_get_data (plugin);
+
+	if (priv->monitors != NULL)
+		return;
+	priv->monitors = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	for (guint i = 0; i < dirs->len; i++) {
+		const gchar *fn = g_ptr_array_index (dirs, i);
+		g_autoptr(GError) error_local = NULL;
+		g_autoptr(GFile) file = g_file_new_for_path (fn);
+		g_autoptr(GFileMonitor) monitor = NULL;
+
+		monitor = g_file_monitor_directory (file, G_FILE_MONITOR_WATCH_MOVES,
+						    NULL, &error_local);
+		if (monitor == NULL) {
+			g_debug ("failed to watch %s: %s", fn, error_local->message);
+			continue;
+		}
+		g_signal_connect (monitor, "changed",
+				  G_CALLBACK (gs_plugin_appstream_dir_changed_cb), priv);
+		g_ptr_array_add (priv->monitors, g_steal_pointer (&monitor));
+	}
+}
+
+static gboolean
+gs_plugin_appstream_parts_valid (GsPluginData *priv)
+{
+	if (priv->parts->len == 0)
+		return FALSE;
+	if (g_atomic_int_get (&priv->layout_changed))
+		return FALSE;
+	for (guint i = 0; i < priv->parts->len; i++) {
+		GsPluginAppstreamPart *part = g_ptr_array_index (priv->parts, i);
+		if (!xb_silo_is_valid (part->silo))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* called with the rebuild mutex held, and only takes the silo lock to swap */
 static gboolean
-gs_plugin_appstream_check_silo (GsPlugin *plugin,
-				GCancellable *cancellable,
-				GError **error)
+gs_plugin_appstream_rebuild_silo (GsPlugin *plugin,
+				  GCancellable *cancellable,
+				  GError **error)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
-	const gchar *locale;
+	GPtrArray *parts_old = priv->parts;
+	const gchar *test_dir;
 	const gchar *test_xml;
-	g_autofree gchar *blobfn = NULL;
-	g_autoptr(XbBuilder) builder = xb_builder_new ();
-	g_autoptr(XbNode) n = NULL;
-	g_autoptr(GFile) file = NULL;
-	g_autoptr(GRWLockReaderLocker) reader_locker = NULL;
+	gboolean changed = FALSE;
+	gboolean found = FALSE;
+	gboolean had_parts = parts_old->len > 0;
+	g_autoptr(GPtrArray) parts = NULL;
 	g_autoptr(GRWLockWriterLocker) writer_locker = NULL;
 	g_autoptr(GPtrArray) parent_appdata = g_ptr_array_new_with_free_func (g_free);
 	g_autoptr(GPtrArray) parent_appstream = g_ptr_array_new_with_free_func (g_free);
+	g_autoptr(GPtrArray) parent_desktop = g_ptr_array_new_with_free_func (g_free);
 
-
-	reader_locker = g_rw_lock_reader_locker_new (&priv->silo_lock);
-	/* everything is okay */
-	if (priv->silo != NULL && xb_silo_is_valid (priv->silo))
+	/* another thread may have just done this */
+	if (gs_plugin_appstream_parts_valid (priv))
 		return TRUE;
-	g_clear_pointer (&reader_locker, g_rw_lock_reader_locker_free);
-
-	/* drat! silo needs regenerating */
-	writer_locker = g_rw_lock_writer_locker_new (&priv->silo_lock);
-	g_clear_object (&priv->silo);
-
-	/* verbose profiling */
-	if (g_getenv ("GS_XMLB_VERBOSE") != NULL) {
-		xb_builder_set_profile_flags (builder,
-					      XB_SILO_PROFILE_FLAG_XPATH |
-					      XB_SILO_PROFILE_FLAG_DEBUG);
-	}
-
-	/* add current locales */
-	locale = g_getenv ("GS_SELF_TEST_LOCALE");
-	if (locale == NULL) {
-		const gchar *const *locales = g_get_language_names ();
-		for (guint i = 0; locales[i] != NULL; i++)
-			xb_builder_add_locale (builder, locales[i]);
-	} else {
-		xb_builder_add_locale (builder, locale);
-	}
+	g_atomic_int_set (&priv->layout_changed, FALSE);
+	parts = g_ptr_array_new_with_free_func ((GDestroyNotify) gs_plugin_appstream_part_free);
 
 	/* only when in self test */
 	test_xml = g_getenv ("GS_SELF_TEST_APPSTREAM_XML");
 	if (test_xml != NULL) {
-		g_autoptr(XbBuilderFixup) fixup1 = NULL;
-		g_autoptr(XbBuilderFixup) fixup2 = NULL;
-		g_autoptr(XbBuilderSource) source = xb_builder_source_new ();
-		if (!xb_builder_source_load_xml (source, test_xml,
-						 XB_BUILDER_SOURCE_FLAG_NONE,
-						 error))
+		/* the XML itself is the key for the cache */
+		if (!gs_plugin_appstream_ensure_part (plugin, parts, parts_old, test_xml,
+						      gs_plugin_appstream_load_test_xml,
+						      FALSE, &changed,
+						      cancellable, error))
 			return FALSE;
-		fixup1 = xb_builder_fixup_new ("AddOriginKeywords",
-					       gs_plugin_appstream_add_origin_keyword_cb,
-					       plugin, NULL);
-		xb_builder_fixup_set_max_depth (fixup1, 1);
-		xb_builder_source_add_fixup (source, fixup1);
-		fixup2 = xb_builder_fixup_new ("AddIcons",
-					       gs_plugin_appstream_add_icons_cb,
-					       plugin, NULL);
-		xb_builder_fixup_set_max_depth (fixup2, 2);
-		xb_builder_source_add_fixup (source, fixup2);
-		xb_builder_import_source (builder, source);
+
+		/* catalog files, to test rebuilding only what changed */
+		test_dir = g_getenv ("GS_SELF_TEST_APPSTREAM_DIR");
+		if (test_dir != NULL) {
+			g_ptr_array_add (parent_appstream, g_strdup (test_dir));
+			if (!gs_plugin_appstream_ensure_appstream_parts (plugin, parts, parts_old, test_dir,
+									 &changed,
+									 cancellable, error))
+				return FALSE;
+			gs_plugin_appstream_watch_dirs (plugin, parent_appstream);
+		}
 	} else {
 		/* add search paths */
 		g_ptr_array_add (parent_appstream,
@@ -524,6 +824,8 @@ gs_plugin_appstream_check_silo (GsPlugin *plugin,
 				 g_build_filename (DATADIR, "appdata", NULL));
 		g_ptr_array_add (parent_appdata,
 				 g_build_filename (DATADIR, "metainfo", NULL));
+		g_ptr_array_add (parent_desktop,
+				 g_build_filename (DATADIR, "applications", NULL));
 		g_ptr_array_add (parent_appstream,
 				 g_build_filename (LOCALSTATEDIR, "cache", "app-info", "xmls", NULL));
 		g_ptr_array_add (parent_appstream,
@@ -546,6 +848,8 @@ gs_plugin_appstream_check_silo (GsPlugin *plugin,
 					 g_build_filename ("/usr/share", "appdata", NULL));
 			g_ptr_array_add (parent_appdata,
 					 g_build_filename ("/usr/share", "metainfo", NULL));
+			g_ptr_array_add (parent_desktop,
+					 g_build_filename ("/usr/share", "applications", NULL));
 		}
 		if (g_strcmp0 (LOCALSTATEDIR, "/var") != 0) {
 			g_ptr_array_add (parent_appstream,
@@ -558,68 +862,62 @@ gs_plugin_appstream_check_silo (GsPlugin *plugin,
 					 g_build_filename ("/var", "lib", "app-info", "yaml", NULL));
 		}
 
-		/* import all files */
+		/* import all sources, reusing anything unchanged */
 		for (guint i = 0; i < parent_appstream->len; i++) {
 			const gchar *fn = g_ptr_array_index (parent_appstream, i);
-			if (!gs_plugin_appstream_load_appstream (plugin, builder, fn,
-								 cancellable, error))
+			if (!gs_plugin_appstream_ensure_appstream_parts (plugin, parts, parts_old, fn,
+									 &changed,
+									 cancellable, error))
 				return FALSE;
 		}
 		for (guint i = 0; i < parent_appdata->len; i++) {
 			const gchar *fn = g_ptr_array_index (parent_appdata, i);
-			if (!gs_plugin_appstream_load_appdata (plugin, builder, fn,
-							       cancellable, error))
+			if (!gs_plugin_appstream_ensure_part (plugin, parts, parts_old, fn,
+							      gs_plugin_appstream_load_appdata,
+							      TRUE, &changed,
+							      cancellable, error))
 				return FALSE;
 		}
-		if (!gs_plugin_appstream_load_desktop (plugin, builder,
-						       DATADIR "/applications",
-						       cancellable, error)) {
-			return FALSE;
-		}
-		if (g_strcmp0 (DATADIR, "/usr/share") != 0 &&
-		    !gs_plugin_appstream_load_desktop (plugin, builder,
-						       "/usr/share/applications",
-						       cancellable, error)) {
-			return FALSE;
+		for (guint i = 0; i < parent_desktop->len; i++) {
+			const gchar *fn = g_ptr_array_index (parent_desktop, i);
+			if (!gs_plugin_appstream_ensure_part (plugin, parts, parts_old, fn,
+							      gs_plugin_appstream_load_desktop,
+							      FALSE, &changed,
+							      cancellable, error))
+				return FALSE;
 		}
+
+		/* catalog files can come and go without touching the others */
+		gs_plugin_appstream_watch_dirs (plugin, parent_appstream);
 	}
 
-	/* regenerate with each minor release */
-	xb_builder_append_guid (builder, PACKAGE_VERSION);
+	/* if nothing was compiled then only removals can differ */
+	if (parts->len != parts_old->len)
+		changed = TRUE;
 
-	/* create per-user cache */
-	blobfn = gs_utils_get_cache_filename ("appstream", "components.xmlb",
-					      GS_UTILS_CACHE_FLAG_WRITEABLE |
-					      GS_UTILS_CACHE_FLAG_CREATE_DIRECTORY,
-					      error);
-	if (blobfn == NULL)
-		return FALSE;
-	file = g_file_new_for_path (blobfn);
-	g_debug ("ensuring %s", blobfn);
-	priv->silo = xb_builder_ensure (builder, file,
-					XB_BUILDER_COMPILE_FLAG_IGNORE_INVALID |
-					XB_BUILDER_COMPILE_FLAG_SINGLE_LANG,
-					NULL, error);
-	if (priv->silo == NULL)
-		return FALSE;
-
-	/* watch all directories too */
-	for (guint i = 0; i < parent_appstream->len; i++) {
-		const gchar *fn = g_ptr_array_index (parent_appstream, i);
-		g_autoptr(GFile) file_tmp = g_file_new_for_path (fn);
-		if (!xb_silo_watch_file (priv->silo, file_tmp, cancellable, error))
-			return FALSE;
-	}
-	for (guint i = 0; i < parent_appdata->len; i++) {
-		const gchar *fn = g_ptr_array_index (parent_appdata, i);
-		g_autoptr(GFile) file_tmp = g_file_new_for_path (fn);
-		if (!xb_silo_watch_file (priv->silo, file_tmp, cancellable, error))
-			return FALSE;
+	/* test we found something */
+	for (guint i = 0; i < parts->len && !found; i++) {
+		GsPluginAppstreamPart *part = g_ptr_array_index (parts, i);
+		g_autoptr(XbNode) n = xb_silo_query_first (part->silo, "components/component", NULL);
+		found = n != NULL;
 	}
 
-	/* test we found something */
-	n = xb_silo_query_first (priv->silo, "components/component", NULL);
-	if (n == NULL) {
+	/* swap in the new silos, readers only ever wait for this */
+	writer_locker = g_rw_lock_writer_locker_new (&priv->silo_lock);
+	g_ptr_array_unref (priv->parts);
+	priv->parts = g_steal_pointer (&parts);
+	if (changed)
+		gs_plugin_refine_invalidate (plugin);
+	g_clear_pointer (&writer_locker, g_rw_lock_writer_locker_free);
+	if (changed) {
+		gs_plugin_appstream_remove_stale_caches (priv->parts);
+		gs_plugin_silo_rebuilt (plugin);
+
+		/* anything shown from the old silos may be out of date */
+		if (had_parts)
+			gs_plugin_reload (plugin);
+	}
+	if (!found) {
 		g_warning ("No AppStream data, try 'make install-sample-data' in data/");
 		g_set_error (error,
 			     GS_PLUGIN_ERROR,
@@ -632,6 +930,83 @@ gs_plugin_appstream_check_silo (GsPlugin *plugin,
 	return TRUE;
 }
 
+static void
+gs_plugin_appstream_rebuild_silo_thread_cb (GTask *task,
+					    gpointer source_object,
+					    gpointer task_data,
+					    GCancellable *cancellable)
+{
+	GsPlugin *plugin = GS_PLUGIN (source_object);
+	GsPluginData *priv = gs_plugin_get_data (plugin);
+	const gchar *delay;
+	g_autoptr(GError) error_local = NULL;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->rebuild_mutex);
+
+	/* only when in self test, so there is time to query the old silos */
+	delay = g_getenv ("GS_SELF_TEST_APPSTREAM_REBUILD_DELAY");
+	if (delay != NULL)
+		g_usleep (g_ascii_strtoull (delay, NULL, 10) * 1000);
+
+	if (g_cancellable_is_cancelled (cancellable)) {
+		g_debug ("not rebuilding silo as the plugin is being destroyed");
+	} else if (gs_plugin_appstream_rebuild_silo (plugin, cancellable, &error_local)) {
+		priv->rebuild_failures = 0;
+		g_atomic_int_set (&priv->rebuild_retry_time, 0);
+	} else if (!g_cancellable_is_cancelled (cancellable)) {
+		guint backoff;
+
+		/* don't try again on every query */
+		priv->rebuild_failures = MIN (priv->rebuild_failures + 1,
+					      GS_PLUGIN_APPSTREAM_REBUILD_FAILURES_MAX);
+		backoff = GS_PLUGIN_APPSTREAM_REBUILD_BACKOFF << (priv->rebuild_failures - 1);
+		g_warning ("failed to rebuild silo, retrying in %us: %s",
+			   backoff, error_local->message);
+		g_atomic_int_set (&priv->rebuild_retry_time,
+				  (gint) (g_get_monotonic_time () / G_USEC_PER_SEC + backoff));
+	}
+
+	/* nothing touches the plugin data after this */
+	g_atomic_int_set (&priv->rebuilding, FALSE);
+	g_cond_broadcast (&priv->rebuild_cond);
+	g_clear_pointer (&locker, g_mutex_locker_free);
+	g_task_return_boolean (task, TRUE);
+}
+
+static gboolean
+gs_plugin_appstream_check_silo (GsPlugin *plugin,
+				GCancellable *cancellable,
+				GError **error)
+{
+	GsPluginData *priv = gs_plugin_get_data (plugin);
+	g_autoptr(GMutexLocker) locker = NULL;
+	g_autoptr(GRWLockReaderLocker) reader_locker = NULL;
+	g_autoptr(GTask) task = NULL;
+
+	reader_locker = g_rw_lock_reader_locker_new (&priv->silo_lock);
+	/* everything is okay */
+	if (gs_plugin_appstream_parts_valid (priv))
+		return TRUE;
+
+	/* keep serving the old silos while the new ones are compiled, or
+	 * until it is time to retry if that failed */
+	if (priv->parts->len > 0) {
+		g_clear_pointer (&reader_locker, g_rw_lock_reader_locker_free);
+		if (g_get_monotonic_time () / G_USEC_PER_SEC < g_atomic_int_get (&priv->rebuild_retry_time))
+			return TRUE;
+		if (!g_atomic_int_compare_and_exchange (&priv->rebuilding, FALSE, TRUE))
+			return TRUE;
+		task = g_task_new (plugin, priv->rebuild_cancellable, NULL, NULL);
+		g_task_set_source_tag (task, gs_plugin_appstream_check_silo);
+		g_task_run_in_thread (task, gs_plugin_appstream_rebuild_silo_thread_cb);
+		return TRUE;
+	}
+	g_clear_pointer (&reader_locker, g_rw_lock_reader_locker_free);
+
+	/* nothing to serve yet, so wait for it */
+	locker = g_mutex_locker_new (&priv->rebuild_mutex);
+	return gs_plugin_appstream_rebuild_silo (plugin, cancellable, error);
+}
+
 gboolean
 gs_plugin_setup (GsPlugin *plugin, GCancellable *cancellable, GError **error)
 {
@@ -639,6 +1014,126 @@ gs_plugin_setup (GsPlugin *plugin, GCancellable *cancellable, GError **error)
 	return gs_plugin_appstream_check_silo (plugin, cancellable, error);
 }
 
+/* runs @xpath on the silo of @part, returning an empty array if nothing
+ * matched; used when the part has no index */
+static GPtrArray *
+gs_plugin_appstream_part_query (GsPluginAppstreamPart *part,
+				const gchar *xpath,
+				guint limit,
+				GError **error)
+{
+	g_autoptr(GError) error_local = NULL;
+	GPtrArray *components;
+
+	components = xb_silo_query (part->silo, xpath, limit, &error_local);
+	if (components == NULL) {
+		if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND) ||
+		    g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT))
+			return g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+		g_propagate_error (error, g_steal_pointer (&error_local));
+		return NULL;
+	}
+	return components;
+}
+
+static gboolean
+gs_plugin_appstream_component_has_pkgname (XbNode *component)
+{
+	XbNode *n = xb_node_get_child (component);
+
+	while (n != NULL) {
+		XbNode *next;
+		if (g_strcmp0 (xb_node_get_element (n), "pkgname") == 0) {
+			g_object_unref (n);
+			return TRUE;
+		}
+		next = xb_node_get_next (n);
+		g_object_unref (n);
+		n = next;
+	}
+	return FALSE;
+}
+
+/* catalog components with @id that have a package name, or webapps, then
+ * any installed AppData or desktop file with @id */
+static GPtrArray *
+gs_plugin_appstream_part_find_id (GsPluginAppstreamPart *part,
+				  const gchar *id,
+				  GError **error)
+{
+	GPtrArray *catalog;
+	GPtrArray *installed;
+	GPtrArray *components;
+	g_autoptr(GString) xpath = NULL;
+
+	if (part->index == NULL) {
+		xpath = g_string_new (NULL);
+		xb_string_append_union (xpath, "components/component/id[text()='%s']/../pkgname/..", id);
+		xb_string_append_union (xpath, "components/component[@type='webapp']/id[text()='%s']/..", id);
+		xb_string_append_union (xpath, "component/id[text()='%s']/..", id);
+		return gs_plugin_appstream_part_query (part, xpath->str, 0, error);
+	}
+
+	components = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	catalog = gs_appstream_index_lookup_id (part->index, id);
+	if (catalog != NULL) {
+		for (guint i = 0; i < catalog->len; i++) {
+			XbNode *component = g_ptr_array_index (catalog, i);
+			if (gs_plugin_appstream_component_has_pkgname (component))
+				g_ptr_array_add (components, g_object_ref (component));
+		}
+		for (guint i = 0; i < catalog->len; i++) {
+			XbNode *component = g_ptr_array_index (catalog, i);
+			if (g_strcmp0 (xb_node_get_attr (component, "type"), "webapp") == 0 &&
+			    !gs_plugin_appstream_component_has_pkgname (component))
+				g_ptr_array_add (components, g_object_ref (component));
+		}
+	}
+	installed = gs_appstream_index_lookup_installed_id (part->index, id);
+	if (installed != NULL) {
+		for (guint i = 0; i < installed->len; i++)
+			g_ptr_array_add (components, g_object_ref (g_ptr_array_index (installed, i)));
+	}
+	return components;
+}
+
+/* the best catalog component shipped in @pkgname, preferring actual apps;
+ * returns %NULL if there is none, or if @error is set */
+static XbNode *
+gs_plugin_appstream_part_find_pkgname (GsPluginAppstreamPart *part,
+				       const gchar *pkgname,
+				       GError **error)
+{
+	const gchar *kinds[] = { "desktop", "console", "webapp", NULL };
+	GPtrArray *catalog;
+	g_autoptr(GPtrArray) components = NULL;
+	g_autoptr(GString) xpath = NULL;
+
+	if (part->index == NULL) {
+		xpath = g_string_new (NULL);
+		xb_string_append_union (xpath, "components/component[@type='desktop']/pkgname[text()='%s']/..", pkgname);
+		xb_string_append_union (xpath, "components/component[@type='console']/pkgname[text()='%s']/..", pkgname);
+		xb_string_append_union (xpath, "components/component[@type='webapp']/pkgname[text()='%s']/..", pkgname);
+		xb_string_append_union (xpath, "components/component/pkgname[text()='%s']/..", pkgname);
+		components = gs_plugin_appstream_part_query (part, xpath->str, 1, error);
+		if (components == NULL || components->len == 0)
+			return NULL;
+		return g_object_ref (g_ptr_array_index (components, 0));
+	}
+
+	catalog = gs_appstream_index_lookup_pkgname (part->index, pkgname);
+	if (catalog == NULL || catalog->len == 0)
+		return NULL;
+	for (guint j = 0; kinds[j] != NULL; j++) {
+		for (guint i = 0; i < catalog->len; i++) {
+			XbNode *component = g_ptr_array_index (catalog, i);
+			if (g_strcmp0 (xb_node_get_attr (component, "type"), kinds[j]) == 0)
+				return g_object_ref (component);
+		}
+	}
+	return g_object_ref (g_ptr_array_index (catalog, 0));
+}
+
 gboolean
 gs_plugin_url_to_app (GsPlugin *plugin,
 		      GsAppList *list,
@@ -651,8 +1146,6 @@ gs_plugin_url_to_app (GsPlugin *plugin,
 	g_autofree gchar *scheme = NULL;
 	g_autofree gchar *xpath = NULL;
 	g_autoptr(GRWLockReaderLocker) locker = NULL;
-	g_autoptr(GsApp) app = NULL;
-	g_autoptr(XbNode) component = NULL;
 
 	/* check silo is valid */
 	if (!gs_plugin_appstream_check_silo (plugin, cancellable, error))
@@ -668,14 +1161,21 @@ gs_plugin_url_to_app (GsPlugin *plugin,
 	/* create app */
 	path = gs_utils_get_url_path (url);
 	xpath = g_strdup_printf ("components/component/id[text()='%s']", path);
-	component = xb_silo_query_first (priv->silo, xpath, NULL);
-	if (component == NULL)
-		return TRUE;
-	app = gs_appstream_create_app (plugin, priv->silo, component, error);
-	if (app == NULL)
-		return FALSE;
-	gs_app_set_scope (app, AS_COMPONENT_SCOPE_SYSTEM);
-	gs_app_list_add (list, app);
+	for (guint i = 0; i < priv->parts->len; i++) {
+		GsPluginAppstreamPart *part = g_ptr_array_index (priv->parts, i);
+		g_autoptr(GsApp) app = NULL;
+		g_autoptr(XbNode) component = NULL;
+
+		component = xb_silo_query_first (part->silo, xpath, NULL);
+		if (component == NULL)
+			continue;
+		app = gs_appstream_create_app (plugin, part->silo, component, error);
+		if (app == NULL)
+			return FALSE;
+		gs_app_set_scope (app, AS_COMPONENT_SCOPE_SYSTEM);
+		gs_app_list_add (list, app);
+		break;
+	}
 	return TRUE;
 }
 
@@ -729,23 +1229,111 @@ gs_plugin_appstream_refine_state (GsPlugin *plugin, GsApp *app, GError **error)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
 	g_autofree gchar *xpath = NULL;
-	g_autoptr(GError) error_local = NULL;
 	g_autoptr(GRWLockReaderLocker) locker = NULL;
-	g_autoptr(XbNode) component = NULL;
 
 	locker = g_rw_lock_reader_locker_new (&priv->silo_lock);
 
-	xpath = g_strdup_printf ("component/id[text()='%s']", gs_app_get_id (app));
-	component = xb_silo_query_first (priv->silo, xpath, &error_local);
-	if (component == NULL) {
-		if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
-			return TRUE;
-		if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT))
-			return TRUE;
-		g_propagate_error (error, g_steal_pointer (&error_local));
+	for (guint i = 0; i < priv->parts->len; i++) {
+		GsPluginAppstreamPart *part = g_ptr_array_index (priv->parts, i);
+		g_autoptr(GPtrArray) components = NULL;
+
+		if (part->index != NULL) {
+			GPtrArray *installed = gs_appstream_index_lookup_installed_id (part->index,
+										     gs_app_get_id (app));
+			if (installed == NULL || installed->len == 0)
+				continue;
+		} else {
+			if (xpath == NULL)
+				xpath = g_strdup_printf ("component/id[text()='%s']", gs_app_get_id (app));
+			components = gs_plugin_appstream_part_query (part, xpath, 1, error);
+			if (components == NULL)
+				return FALSE;
+			if (components->len == 0)
+				continue;
+		}
+		gs_app_set_state (app, GS_APP_STATE_INSTALLED);
+		break;
+	}
+	return TRUE;
+}
+
+/* the installed components for @id in all the parts; the silo lock must be
+ * held while the returned nodes are used */
+static GPtrArray *
+gs_plugin_appstream_find_installed (GsPlugin *plugin,
+				    const gchar *id,
+				    GError **error)
+{
+	GsPluginData *priv = gs_plugin_get_data (plugin);
+	g_autofree gchar *xpath = NULL;
+	g_autoptr(GPtrArray) installed = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+
+	for (guint i = 0; i < priv->parts->len; i++) {
+		GsPluginAppstreamPart *part = g_ptr_array_index (priv->parts, i);
+		g_autoptr(GPtrArray) components = NULL;
+
+		if (part->index != NULL) {
+			components = gs_appstream_index_lookup_installed_id (part->index, id);
+			if (components == NULL)
+				continue;
+			g_ptr_array_ref (components);
+		} else {
+			if (xpath == NULL)
+				xpath = g_strdup_printf ("component/id[text()='%s']/..", id);
+			components = gs_plugin_appstream_part_query (part, xpath, 0, error);
+			if (components == NULL)
+				return NULL;
+		}
+		for (guint j = 0; j < components->len; j++)
+			g_ptr_array_add (installed, g_object_ref (g_ptr_array_index (components, j)));
+	}
+	return g_steal_pointer (&installed);
+}
+
+/* refines @app from @component, except that the installed releases are looked
+ * up in every part, as the catalog and the installed metadata are compiled
+ * into different silos */
+static gboolean
+gs_plugin_appstream_refine_app (GsPlugin *plugin,
+				GsApp *app,
+				GsPluginAppstreamPart *part,
+				XbNode *component,
+				GsPluginRefineFlags flags,
+				GError **error)
+{
+	g_autoptr(GPtrArray) installed = NULL;
+
+	if (!gs_appstream_refine_app (plugin, app, part->silo, component,
+				      flags & ~(GS_PLUGIN_REFINE_FLAGS_REQUIRE_ADDONS |
+						GS_PLUGIN_REFINE_FLAGS_REQUIRE_UPDATE_DETAILS),
+				      error))
+		return FALSE;
+
+	if ((flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_UPDATE_DETAILS) == 0 ||
+	    !gs_app_is_updatable (app))
+		return TRUE;
+	installed = gs_plugin_appstream_find_installed (plugin, gs_app_get_id (app), error);
+	if (installed == NULL)
 		return FALSE;
+	return gs_appstream_refine_app_updates (plugin, app, component, installed, error);
+}
+
+/* addons may be shipped in a different source to the app they extend */
+static gboolean
+gs_plugin_appstream_refine_addons (GsPlugin *plugin,
+				   GsApp *app,
+				   GsPluginRefineFlags flags,
+				   GError **error)
+{
+	GsPluginData *priv = gs_plugin_get_data (plugin);
+
+	if ((flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_ADDONS) == 0)
+		return TRUE;
+	for (guint i = 0; i < priv->parts->len; i++) {
+		GsPluginAppstreamPart *part = g_ptr_array_index (priv->parts, i);
+		if (!gs_appstream_refine_add_addons (plugin, app, part->silo, error))
+			return FALSE;
 	}
-	gs_app_set_state (app, GS_APP_STATE_INSTALLED);
 	return TRUE;
 }
 
@@ -758,10 +1346,8 @@ gs_plugin_refine_from_id (GsPlugin *plugin,
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
 	const gchar *id;
-	g_autoptr(GError) error_local = NULL;
+	gboolean found_component = FALSE;
 	g_autoptr(GRWLockReaderLocker) locker = NULL;
-	g_autoptr(GString) xpath = g_string_new (NULL);
-	g_autoptr(GPtrArray) components = NULL;
 
 	/* not enough info to find */
 	id = gs_app_get_id (app);
@@ -771,25 +1357,28 @@ gs_plugin_refine_from_id (GsPlugin *plugin,
 	locker = g_rw_lock_reader_locker_new (&priv->silo_lock);
 
 	/* look in AppStream then fall back to AppData */
-	xb_string_append_union (xpath, "components/component/id[text()='%s']/../pkgname/..", id);
-	xb_string_append_union (xpath, "components/component[@type='webapp']/id[text()='%s']/..", id);
-	xb_string_append_union (xpath, "component/id[text()='%s']/..", id);
-	components = xb_silo_query (priv->silo, xpath->str, 0, &error_local);
-	if (components == NULL) {
-		if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
-			return TRUE;
-		if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT))
-			return TRUE;
-		g_propagate_error (error, g_steal_pointer (&error_local));
-		return FALSE;
-	}
-	for (guint i = 0; i < components->len; i++) {
-		XbNode *component = g_ptr_array_index (components, i);
-		if (!gs_appstream_refine_app (plugin, app, priv->silo,
-					      component, flags, error))
+	for (guint j = 0; j < priv->parts->len; j++) {
+		GsPluginAppstreamPart *part = g_ptr_array_index (priv->parts, j);
+		g_autoptr(GPtrArray) components = NULL;
+
+		components = gs_plugin_appstream_part_find_id (part, id, error);
+		if (components == NULL)
 			return FALSE;
-		gs_plugin_appstream_set_compulsory_quirk (app, component);
+		if (components->len == 0)
+			continue;
+		for (guint i = 0; i < components->len; i++) {
+			XbNode *component = g_ptr_array_index (components, i);
+			if (!gs_plugin_appstream_refine_app (plugin, app, part,
+							     component, flags, error))
+				return FALSE;
+			gs_plugin_appstream_set_compulsory_quirk (app, component);
+		}
+		found_component = TRUE;
 	}
+	if (!found_component)
+		return TRUE;
+	if (!gs_plugin_appstream_refine_addons (plugin, app, flags, error))
+		return FALSE;
 
 	/* if an installed desktop or appdata file exists set to installed */
 	if (gs_app_get_state (app) == GS_APP_STATE_UNKNOWN) {
@@ -810,7 +1399,6 @@ gs_plugin_refine_from_pkgname (GsPlugin *plugin,
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
 	GPtrArray *sources = gs_app_get_sources (app);
-	g_autoptr(GError) error_local = NULL;
 
 	/* not enough info to find */
 	if (sources->len == 0)
@@ -820,28 +1408,29 @@ gs_plugin_refine_from_pkgname (GsPlugin *plugin,
 	for (guint j = 0; j < sources->len; j++) {
 		const gchar *pkgname = g_ptr_array_index (sources, j);
 		g_autoptr(GRWLockReaderLocker) locker = NULL;
-		g_autoptr(GString) xpath = g_string_new (NULL);
-		g_autoptr(XbNode) component = NULL;
 
 		locker = g_rw_lock_reader_locker_new (&priv->silo_lock);
 
 		/* prefer actual apps and then fallback to anything else */
-		xb_string_append_union (xpath, "components/component[@type='desktop']/pkgname[text()='%s']/..", pkgname);
-		xb_string_append_union (xpath, "components/component[@type='console']/pkgname[text()='%s']/..", pkgname);
-		xb_string_append_union (xpath, "components/component[@type='webapp']/pkgname[text()='%s']/..", pkgname);
-		xb_string_append_union (xpath, "components/component/pkgname[text()='%s']/..", pkgname);
-		component = xb_silo_query_first (priv->silo, xpath->str, &error_local);
-		if (component == NULL) {
-			if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
-				continue;
-			if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT))
-				continue;
-			g_propagate_error (error, g_steal_pointer (&error_local));
-			return FALSE;
+		for (guint i = 0; i < priv->parts->len; i++) {
+			GsPluginAppstreamPart *part = g_ptr_array_index (priv->parts, i);
+			g_autoptr(GError) error_local = NULL;
+			g_autoptr(XbNode) component = NULL;
+
+			component = gs_plugin_appstream_part_find_pkgname (part, pkgname, &error_local);
+			if (component == NULL) {
+				if (error_local == NULL)
+					continue;
+				g_propagate_error (error, g_steal_pointer (&error_local));
+				return FALSE;
+			}
+			if (!gs_plugin_appstream_refine_app (plugin, app, part, component, flags, error))
+				return FALSE;
+			gs_plugin_appstream_set_compulsory_quirk (app, component);
+			if (!gs_plugin_appstream_refine_addons (plugin, app, flags, error))
+				return FALSE;
+			break;
 		}
-		if (!gs_appstream_refine_app (plugin, app, priv->silo, component, flags, error))
-			return FALSE;
-		gs_plugin_appstream_set_compulsory_quirk (app, component);
 	}
 
 	/* success */
@@ -893,9 +1482,7 @@ gs_plugin_refine_wildcard (GsPlugin *plugin,
 	GsPluginData *priv = gs_plugin_get_data (plugin);
 	const gchar *id;
 	g_autofree gchar *xpath = NULL;
-	g_autoptr(GError) error_local = NULL;
 	g_autoptr(GRWLockReaderLocker) locker = NULL;
-	g_autoptr(GPtrArray) components = NULL;
 
 	/* check silo is valid */
 	if (!gs_plugin_appstream_check_silo (plugin, cancellable, error))
@@ -909,30 +1496,43 @@ gs_plugin_refine_wildcard (GsPlugin *plugin,
 	locker = g_rw_lock_reader_locker_new (&priv->silo_lock);
 
 	/* find all app with package names when matching any prefixes */
-	xpath = g_strdup_printf ("components/component/id[text()='%s']/../pkgname/..", id);
-	components = xb_silo_query (priv->silo, xpath, 0, &error_local);
-	if (components == NULL) {
-		if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
-			return TRUE;
-		if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT))
-			return TRUE;
-		g_propagate_error (error, g_steal_pointer (&error_local));
-		return FALSE;
-	}
-	for (guint i = 0; i < components->len; i++) {
-		XbNode *component = g_ptr_array_index (components, i);
-		g_autoptr(GsApp) new = NULL;
+	for (guint j = 0; j < priv->parts->len; j++) {
+		GsPluginAppstreamPart *part = g_ptr_array_index (priv->parts, j);
+		g_autoptr(GPtrArray) components = NULL;
 
-		/* new app */
-		new = gs_appstream_create_app (plugin, priv->silo, component, error);
-		if (new == NULL)
-			return FALSE;
-		gs_app_set_scope (new, AS_COMPONENT_SCOPE_SYSTEM);
-		gs_app_subsume_metadata (new, app);
-		if (!gs_appstream_refine_app (plugin, new, priv->silo, component,
-					      refine_flags, error))
-			return FALSE;
-		gs_app_list_add (list, new);
+		if (part->index != NULL) {
+			components = gs_appstream_index_lookup_id (part->index, id);
+			if (components == NULL)
+				continue;
+			g_ptr_array_ref (components);
+		} else {
+			if (xpath == NULL)
+				xpath = g_strdup_printf ("components/component/id[text()='%s']/../pkgname/..", id);
+			components = gs_plugin_appstream_part_query (part, xpath, 0, error);
+			if (components == NULL)
+				return FALSE;
+		}
+		for (guint i = 0; i < components->len; i++) {
+			XbNode *component = g_ptr_array_index (components, i);
+			g_autoptr(GsApp) new = NULL;
+
+			if (part->index != NULL &&
+			    !gs_plugin_appstream_component_has_pkgname (component))
+				continue;
+
+			/* new app */
+			new = gs_appstream_create_app (plugin, part->silo, component, error);
+			if (new == NULL)
+				return FALSE;
+			gs_app_set_scope (new, AS_COMPONENT_SCOPE_SYSTEM);
+			gs_app_subsume_metadata (new, app);
+			if (!gs_plugin_appstream_refine_app (plugin, new, part, component,
+							     refine_flags, error))
+				return FALSE;
+			if (!gs_plugin_appstream_refine_addons (plugin, new, refine_flags, error))
+				return FALSE;
+			gs_app_list_add (list, new);
+		}
 	}
 
 	/* success */
@@ -953,12 +1553,18 @@ gs_plugin_add_category_apps (GsPlugin *plugin,
 		return FALSE;
 
 	locker = g_rw_lock_reader_locker_new (&priv->silo_lock);
-	return gs_appstream_add_category_apps (plugin,
-					       priv->silo,
-					       category,
-					       list,
-					       cancellable,
-					       error);
+	for (guint i = 0; i < priv->parts->len; i++) {
+		GsPluginAppstreamPart *part = g_ptr_array_index (priv->parts, i);
+		if (!gs_appstream_add_category_apps (plugin,
+						     part->silo,
+						     part->index,
+						     category,
+						     list,
+						     cancellable,
+						     error))
+			return FALSE;
+	}
+	return TRUE;
 }
 
 gboolean
@@ -975,12 +1581,18 @@ gs_plugin_add_search (GsPlugin *plugin,
 		return FALSE;
 
 	locker = g_rw_lock_reader_locker_new (&priv->silo_lock);
-	return gs_appstream_search (plugin,
-				    priv->silo,
-				    (const gchar * const *) values,
-				    list,
-				    cancellable,
-				    error);
+	for (guint i = 0; i < priv->parts->len; i++) {
+		GsPluginAppstreamPart *part = g_ptr_array_index (priv->parts, i);
+		if (!gs_appstream_search (plugin,
+					  part->silo,
+					  part->index,
+					  (const gchar * const *) values,
+					  list,
+					  cancellable,
+					  error))
+			return FALSE;
+	}
+	return TRUE;
 }
 
 gboolean
@@ -991,7 +1603,6 @@ gs_plugin_add_installed (GsPlugin *plugin,
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
 	g_autoptr(GRWLockReaderLocker) locker = NULL;
-	g_autoptr(GPtrArray) components = NULL;
 
 	/* check silo is valid */
 	if (!gs_plugin_appstream_check_silo (plugin, cancellable, error))
@@ -1000,17 +1611,22 @@ gs_plugin_add_installed (GsPlugin *plugin,
 	locker = g_rw_lock_reader_locker_new (&priv->silo_lock);
 
 	/* get all installed appdata files (notice no 'components/' prefix...) */
-	components = xb_silo_query (priv->silo, "component/description/..", 0, NULL);
-	if (components == NULL)
-		return TRUE;
-	for (guint i = 0; i < components->len; i++) {
-		XbNode *component = g_ptr_array_index (components, i);
-		g_autoptr(GsApp) app = gs_appstream_create_app (plugin, priv->silo, component, error);
-		if (app == NULL)
-			return FALSE;
-		gs_app_set_state (app, GS_APP_STATE_INSTALLED);
-		gs_app_set_scope (app, AS_COMPONENT_SCOPE_SYSTEM);
-		gs_app_list_add (list, app);
+	for (guint j = 0; j < priv->parts->len; j++) {
+		GsPluginAppstreamPart *part = g_ptr_array_index (priv->parts, j);
+		g_autoptr(GPtrArray) components = NULL;
+
+		components = xb_silo_query (part->silo, "component/description/..", 0, NULL);
+		if (components == NULL)
+			continue;
+		for (guint i = 0; i < components->len; i++) {
+			XbNode *component = g_ptr_array_index (components, i);
+			g_autoptr(GsApp) app = gs_appstream_create_app (plugin, part->silo, component, error);
+			if (app == NULL)
+				return FALSE;
+			gs_app_set_state (app, GS_APP_STATE_INSTALLED);
+			gs_app_set_scope (app, AS_COMPONENT_SCOPE_SYSTEM);
+			gs_app_list_add (list, app);
+		}
 	}
 	return TRUE;
 }
@@ -1028,8 +1644,13 @@ gs_plugin_add_categories (GsPlugin *plugin,
 		return FALSE;
 
 	locker = g_rw_lock_reader_locker_new (&priv->silo_lock);
-	return gs_appstream_add_categories (plugin, priv->silo, list,
-					    cancellable, error);
+	for (guint i = 0; i < priv->parts->len; i++) {
+		GsPluginAppstreamPart *part = g_ptr_array_index (priv->parts, i);
+		if (!gs_appstream_add_categories (plugin, part->silo, part->index,
+						  list, cancellable, error))
+			return FALSE;
+	}
+	return TRUE;
 }
 
 gboolean
@@ -1045,7 +1666,12 @@ gs_plugin_add_popular (GsPlugin *plugin,
 		return FALSE;
 
 	locker = g_rw_lock_reader_locker_new (&priv->silo_lock);
-	return gs_appstream_add_popular (plugin, priv->silo, list, cancellable, error);
+	for (guint i = 0; i < priv->parts->len; i++) {
+		GsPluginAppstreamPart *part = g_ptr_array_index (priv->parts, i);
+		if (!gs_appstream_add_popular (plugin, part->silo, list, cancellable, error))
+			return FALSE;
+	}
+	return TRUE;
 }
 
 gboolean
@@ -1061,7 +1687,12 @@ gs_plugin_add_featured (GsPlugin *plugin,
 		return FALSE;
 
 	locker = g_rw_lock_reader_locker_new (&priv->silo_lock);
-	return gs_appstream_add_featured (plugin, priv->silo, list, cancellable, error);
+	for (guint i = 0; i < priv->parts->len; i++) {
+		GsPluginAppstreamPart *part = g_ptr_array_index (priv->parts, i);
+		if (!gs_appstream_add_featured (plugin, part->silo, list, cancellable, error))
+			return FALSE;
+	}
+	return TRUE;
 }
 
 gboolean
@@ -1078,8 +1709,13 @@ gs_plugin_add_recent (GsPlugin *plugin,
 		return FALSE;
 
 	locker = g_rw_lock_reader_locker_new (&priv->silo_lock);
-	return gs_appstream_add_recent (plugin, priv->silo, list, age,
-					cancellable, error);
+	for (guint i = 0; i < priv->parts->len; i++) {
+		GsPluginAppstreamPart *part = g_ptr_array_index (priv->parts, i);
+		if (!gs_appstream_add_recent (plugin, part->silo, list, age,
+					      cancellable, error))
+			return FALSE;
+	}
+	return TRUE;
 }
 
 gboolean
@@ -1096,8 +1732,13 @@ gs_plugin_add_alternates (GsPlugin *plugin,
 		return FALSE;
 
 	locker = g_rw_lock_reader_locker_new (&priv->silo_lock);
-	return gs_appstream_add_alternates (plugin, priv->silo, app, list,
-					    cancellable, error);
+	for (guint i = 0; i < priv->parts->len; i++) {
+		GsPluginAppstreamPart *part = g_ptr_array_index (priv->parts, i);
+		if (!gs_appstream_add_alternates (plugin, part->silo, app, list,
+						  cancellable, error))
+			return FALSE;
+	}
+	return TRUE;
 }
 
 gboolean
@@ -178,9 +178,385 @@ gs_plugins_core_generic_updates_func (GsPluginLoader *plugin_loader)
 	}
 }
 
+static void
+gs_plugins_core_appstream_index_func (void)
+{
+	GPtrArray *lookup;
+	GsAppstreamIndexMatch *match;
+	const gchar *xml;
+	const gchar *search_both[] = { "Fedora", "work", NULL };
+	const gchar *search_none[] = { "fedora", "arachne", NULL };
+	const gchar *search_pkgname[] = { "arach", NULL };
+	const gchar *search_id[] = { "fedorap", NULL };
+	g_autofree gchar *fn = NULL;
+	g_autoptr(GArray) matches = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GFile) file = NULL;
+	g_autoptr(GPtrArray) components = NULL;
+	g_autoptr(GPtrArray) groups = g_ptr_array_new ();
+	g_autoptr(GsAppstreamIndex) index = NULL;
+	g_autoptr(GsAppstreamIndex) index_cached = NULL;
+	g_autoptr(XbBuilder) builder = xb_builder_new ();
+	g_autoptr(XbBuilderSource) source = xb_builder_source_new ();
+	g_autoptr(XbSilo) silo = NULL;
+
+	xml = "<components origin=\"yellow\">\n"
+		"  <component type=\"desktop\">\n"
+		"    <id>arachne.desktop</id>\n"
+		"    <name>test</name>\n"
+		"    <pkgname>arachne</pkgname>\n"
+		"    <categories>\n"
+		"      <category>Network</category>\n"
+		"      <category>WebBrowser</category>\n"
+		"    </categories>\n"
+		"  </component>\n"
+		"  <component type=\"os-upgrade\">\n"
+		"    <id>org.fedoraproject.Fedora-25</id>\n"
+		"    <name>Fedora</name>\n"
+		"    <summary>Fedora Workstation</summary>\n"
+		"    <categories>\n"
+		"      <category>Network</category>\n"
+		"    </categories>\n"
+		"  </component>\n"
+		"</components>\n";
+	g_assert_true (xb_builder_source_load_xml (source, xml, XB_BUILDER_SOURCE_FLAG_NONE, &error));
+	g_assert_no_error (error);
+	xb_builder_import_source (builder, source);
+	silo = xb_builder_compile (builder, XB_BUILDER_COMPILE_FLAG_NONE, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (silo);
+
+	/* build from scratch and save */
+	fn = g_build_filename (g_getenv ("GS_SELF_TEST_CACHEDIR"), "components.idx", NULL);
+	file = g_file_new_for_path (fn);
+	g_file_delete (file, NULL, NULL);
+	index = gs_appstream_index_new (silo, file, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (index);
+	g_assert_true (g_file_test (fn, G_FILE_TEST_EXISTS));
+
+	/* all the tokens have to match, in any field */
+	matches = gs_appstream_index_search (index, search_both);
+	g_assert_cmpint (matches->len, ==, 1);
+	match = &g_array_index (matches, GsAppstreamIndexMatch, 0);
+	g_assert_cmpstr (xb_node_query_text (match->component, "id", NULL), ==, "org.fedoraproject.Fedora-25");
+	g_assert_cmpint (match->match_value, ==, AS_SEARCH_TOKEN_MATCH_NAME | AS_SEARCH_TOKEN_MATCH_SUMMARY | AS_SEARCH_TOKEN_MATCH_ID);
+	g_clear_pointer (&matches, g_array_unref);
+
+	/* each part of a dotted ID is matched */
+	matches = gs_appstream_index_search (index, search_id);
+	g_assert_cmpint (matches->len, ==, 1);
+	match = &g_array_index (matches, GsAppstreamIndexMatch, 0);
+	g_assert_cmpint (match->match_value, ==, AS_SEARCH_TOKEN_MATCH_ID);
+	g_clear_pointer (&matches, g_array_unref);
+	matches = gs_appstream_index_search (index, search_none);
+	g_assert_cmpint (matches->len, ==, 0);
+	g_clear_pointer (&matches, g_array_unref);
+
+	/* load from the cache, and match on word prefix */
+	index_cached = gs_appstream_index_new (silo, file, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (index_cached);
+	matches = gs_appstream_index_search (index_cached, search_pkgname);
+	g_assert_cmpint (matches->len, ==, 1);
+	match = &g_array_index (matches, GsAppstreamIndexMatch, 0);
+	g_assert_cmpint (match->match_value, ==, AS_SEARCH_TOKEN_MATCH_PKGNAME | AS_SEARCH_TOKEN_MATCH_ID);
+
+	/* categories, with both halves of a pair having to match */
+	g_ptr_array_add (groups, (gpointer) "Network");
+	g_assert_cmpint (gs_appstream_index_count_category (index_cached, groups), ==, 2);
+	g_ptr_array_set_size (groups, 0);
+	g_ptr_array_add (groups, (gpointer) "Network::WebBrowser");
+	g_assert_cmpint (gs_appstream_index_count_category (index_cached, groups), ==, 1);
+	components = gs_appstream_index_get_category_components (index_cached, groups);
+	g_assert_cmpint (components->len, ==, 1);
+	g_assert_cmpstr (xb_node_query_text (g_ptr_array_index (components, 0), "id", NULL), ==, "arachne.desktop");
+
+	/* apps in more than one group are only counted once */
+	g_ptr_array_add (groups, (gpointer) "Network");
+	g_ptr_array_add (groups, (gpointer) "Game");
+	g_assert_cmpint (gs_appstream_index_count_category (index_cached, groups), ==, 2);
+
+	/* lookups by ID and package name */
+	lookup = gs_appstream_index_lookup_id (index_cached, "org.fedoraproject.Fedora-25");
+	g_assert_nonnull (lookup);
+	g_assert_cmpint (lookup->len, ==, 1);
+	g_assert_cmpstr (xb_node_get_attr (g_ptr_array_index (lookup, 0), "type"), ==, "os-upgrade");
+	lookup = gs_appstream_index_lookup_pkgname (index_cached, "arachne");
+	g_assert_nonnull (lookup);
+	g_assert_cmpint (lookup->len, ==, 1);
+	g_assert_cmpstr (xb_node_query_text (g_ptr_array_index (lookup, 0), "id", NULL), ==, "arachne.desktop");
+	g_assert_null (gs_appstream_index_lookup_id (index_cached, "arachne"));
+	g_assert_null (gs_appstream_index_lookup_installed_id (index_cached, "arachne.desktop"));
+}
+
+static XbSilo *
+gs_plugins_core_compile_silo (const gchar *xml)
+{
+	g_autoptr(GError) error = NULL;
+	g_autoptr(XbBuilder) builder = xb_builder_new ();
+	g_autoptr(XbBuilderSource) source = xb_builder_source_new ();
+	g_autoptr(XbSilo) silo = NULL;
+
+	g_assert_true (xb_builder_source_load_xml (source, xml, XB_BUILDER_SOURCE_FLAG_NONE, &error));
+	g_assert_no_error (error);
+	xb_builder_import_source (builder, source);
+	silo = xb_builder_compile (builder, XB_BUILDER_COMPILE_FLAG_NONE, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (silo);
+	return g_steal_pointer (&silo);
+}
+
+static void
+gs_plugins_core_appstream_prepared_queries_func (void)
+{
+	const gchar *xml;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GPtrArray) components = NULL;
+	g_autoptr(GPtrArray) components_prepared = NULL;
+	g_autoptr(GsPlugin) plugin = gs_plugin_new ();
+	g_autoptr(XbSilo) silo = NULL;
+	g_autoptr(XbSilo) silo_prepared = NULL;
+
+	xml = "<components origin=\"yellow\">\n"
+		"  <info>\n"
+		"    <scope>user</scope>\n"
+		"    <filename>/tmp/yellow.xml</filename>\n"
+		"  </info>\n"
+		"  <component type=\"desktop\">\n"
+		"    <id>arachne.desktop</id>\n"
+		"    <name>Arachne</name>\n"
+		"    <summary>Web browser</summary>\n"
+		"    <metadata_license>CC0-1.0</metadata_license>\n"
+		"    <keywords>\n"
+		"      <keyword>web</keyword>\n"
+		"      <keyword>browser</keyword>\n"
+		"    </keywords>\n"
+		"    <icon type=\"cached\" width=\"128\" height=\"128\">arachne.png</icon>\n"
+		"    <icon type=\"cached\" width=\"128\" height=\"128\">arachne-alt.png</icon>\n"
+		"    <kudos>\n"
+		"      <kudo>GnomeSoftware::popular</kudo>\n"
+		"    </kudos>\n"
+		"    <categories>\n"
+		"      <category>Featured</category>\n"
+		"      <category>Network</category>\n"
+		"    </categories>\n"
+		"    <languages>\n"
+		"      <lang percentage=\"90\">de_DE</lang>\n"
+		"      <lang percentage=\"80\">de</lang>\n"
+		"    </languages>\n"
+		"  </component>\n"
+		"  <component type=\"desktop\">\n"
+		"    <id>chiron.desktop</id>\n"
+		"    <languages>\n"
+		"      <lang percentage=\"20\">de</lang>\n"
+		"    </languages>\n"
+		"  </component>\n"
+		"</components>\n";
+	gs_plugin_set_name (plugin, "self-test");
+	gs_plugin_set_locale (plugin, "de_DE");
+	silo = gs_plugins_core_compile_silo (xml);
+	silo_prepared = gs_plugins_core_compile_silo (xml);
+	gs_appstream_prepare_queries (plugin, silo_prepared);
+
+	components = xb_silo_query (silo, "components/component", 0, &error);
+	g_assert_no_error (error);
+	components_prepared = xb_silo_query (silo_prepared, "components/component", 0, &error);
+	g_assert_no_error (error);
+	g_assert_cmpint (components->len, ==, 2);
+	g_assert_cmpint (components_prepared->len, ==, components->len);
+
+	/* the prepared queries give the same results as the plain XPath */
+	for (guint i = 0; i < components->len; i++) {
+		g_autoptr(GsApp) app = gs_app_new (NULL);
+		g_autoptr(GsApp) app_prepared = gs_app_new (NULL);
+
+		g_assert_true (gs_appstream_refine_app (plugin, app, silo,
+							g_ptr_array_index (components, i),
+							GS_PLUGIN_REFINE_FLAGS_REQUIRE_KUDOS,
+							&error));
+		g_assert_no_error (error);
+		g_assert_true (gs_appstream_refine_app (plugin, app_prepared, silo_prepared,
+							g_ptr_array_index (components_prepared, i),
+							GS_PLUGIN_REFINE_FLAGS_REQUIRE_KUDOS,
+							&error));
+		g_assert_no_error (error);
+		g_assert_cmpstr (gs_app_get_id (app_prepared), ==, gs_app_get_id (app));
+		g_assert_cmpstr (gs_app_get_name (app_prepared), ==, gs_app_get_name (app));
+		g_assert_cmpstr (gs_app_get_summary (app_prepared), ==, gs_app_get_summary (app));
+		g_assert_cmpstr (gs_app_get_metadata_item (app_prepared, "appstream::source-file"), ==,
+				 gs_app_get_metadata_item (app, "appstream::source-file"));
+		g_assert_cmpint (gs_app_get_scope (app_prepared), ==, gs_app_get_scope (app));
+		g_assert_cmpint (gs_app_has_quirk (app_prepared, GS_APP_QUIRK_IS_WILDCARD), ==,
+				 gs_app_has_quirk (app, GS_APP_QUIRK_IS_WILDCARD));
+		g_assert_cmpint (gs_app_get_kudos (app_prepared), ==, gs_app_get_kudos (app));
+	}
+}
+
+static void
+gs_plugins_core_write_catalog (const gchar *dir, const gchar *name, const gchar *summary)
+{
+	g_autoptr(GError) error = NULL;
+	g_autofree gchar *basename = g_strdup_printf ("%s.xml", name);
+	g_autofree gchar *fn = g_build_filename (dir, basename, NULL);
+	g_autofree gchar *xml = NULL;
+
+	xml = g_strdup_printf ("<?xml version=\"1.0\"?>\n"
+			       "<components origin=\"%s\" version=\"0.9\">\n"
+			       "  <component type=\"desktop\">\n"
+			       "    <id>%s.desktop</id>\n"
+			       "    <name>%s</name>\n"
+			       "    <summary>%s</summary>\n"
+			       "    <pkgname>%s</pkgname>\n"
+			       "  </component>\n"
+			       "</components>\n",
+			       name, name, name, summary, name);
+	g_file_set_contents (fn, xml, -1, &error);
+	g_assert_no_error (error);
+}
+
+static gchar *
+gs_plugins_core_catalog_cache_filename (const gchar *name)
+{
+	g_autofree gchar *basename = g_strdup_printf ("%s.xml", name);
+	g_autofree gchar *fn = g_build_filename (g_getenv ("GS_SELF_TEST_APPSTREAM_DIR"), basename, NULL);
+	g_autofree gchar *hash = g_compute_checksum_for_string (G_CHECKSUM_SHA1, fn, -1);
+	g_autofree gchar *blobname = g_strdup_printf ("components-%s.xmlb", hash);
+	return g_build_filename (g_getenv ("GS_SELF_TEST_CACHEDIR"), "appstream", blobname, NULL);
+}
+
+/* any query checks the silos, and rebuilds them in the background */
+static void
+gs_plugins_core_appstream_query (GsPluginLoader *plugin_loader)
+{
+	g_autoptr(GsAppList) list = NULL;
+	g_autoptr(GsPluginJob) plugin_job = NULL;
+
+	plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_SEARCH,
+					 "search", "red",
+					 NULL);
+	list = gs_plugin_loader_job_process (plugin_loader, plugin_job, NULL, NULL);
+	gs_test_flush_main_context ();
+	g_usleep (50 * G_TIME_SPAN_MILLISECOND);
+	gs_test_flush_main_context ();
+}
+
+static void
+gs_plugins_core_appstream_parts_func (GsPluginLoader *plugin_loader)
+{
+	const gchar *dir = g_getenv ("GS_SELF_TEST_APPSTREAM_DIR");
+	g_autofree gchar *blue_fn = g_build_filename (dir, "blue.xml", NULL);
+	g_autofree gchar *blue_cache = gs_plugins_core_catalog_cache_filename ("blue");
+	g_autofree gchar *green_cache = gs_plugins_core_catalog_cache_filename ("green");
+	g_autofree gchar *red_cache = gs_plugins_core_catalog_cache_filename ("red");
+
+	/* each catalog file was compiled on its own when set up */
+	g_assert_true (g_file_test (blue_cache, G_FILE_TEST_EXISTS));
+	g_assert_true (g_file_test (green_cache, G_FILE_TEST_EXISTS));
+	g_assert_true (g_file_test (red_cache, G_FILE_TEST_EXISTS));
+
+	/* editing one only recompiles that one */
+	g_assert_cmpint (g_unlink (green_cache), ==, 0);
+	g_assert_cmpint (g_unlink (red_cache), ==, 0);
+	gs_plugins_core_write_catalog (dir, "red", "Edited");
+	for (guint i = 0; i < 100 && !g_file_test (red_cache, G_FILE_TEST_EXISTS); i++)
+		gs_plugins_core_appstream_query (plugin_loader);
+	g_assert_true (g_file_test (red_cache, G_FILE_TEST_EXISTS));
+	g_assert_false (g_file_test (green_cache, G_FILE_TEST_EXISTS));
+
+	/* the cache of a removed one is removed too */
+	g_assert_cmpint (g_unlink (blue_fn), ==, 0);
+	for (guint i = 0; i < 100 && g_file_test (blue_cache, G_FILE_TEST_EXISTS); i++)
+		gs_plugins_core_appstream_query (plugin_loader);
+	g_assert_false (g_file_test (blue_cache, G_FILE_TEST_EXISTS));
+}
+
+static void
+gs_plugins_core_appstream_update_details_func (GsPluginLoader *plugin_loader)
+{
+	gboolean ret;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GsApp) app = gs_app_new ("purple.desktop");
+	g_autoptr(GsPluginJob) plugin_job = NULL;
+
+	/* the installed releases are in a different part to the catalog */
+	gs_app_set_state (app, GS_APP_STATE_UPDATABLE);
+	plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_REFINE,
+					 "app", app,
+					 "refine-flags", GS_PLUGIN_REFINE_FLAGS_REQUIRE_UPDATE_DETAILS,
+					 NULL);
+	ret = gs_plugin_loader_job_action (plugin_loader, plugin_job, NULL, &error);
+	gs_test_flush_main_context ();
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpstr (gs_app_get_update_version (app), ==, "1.2");
+	g_assert_nonnull (gs_app_get_update_details (app));
+	g_assert_nonnull (g_strstr_len (gs_app_get_update_details (app), -1, "Fixes the colour"));
+	g_assert_null (g_strstr_len (gs_app_get_update_details (app), -1, "Installed fix"));
+}
+
+static gchar *
+gs_plugins_core_refine_summary (GsPluginLoader *plugin_loader, const gchar *id)
+{
+	gboolean ret;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GsApp) app = gs_app_new (id);
+	g_autoptr(GsPluginJob) plugin_job = NULL;
+
+	plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_REFINE,
+					 "app", app,
+					 "refine-flags", GS_PLUGIN_REFINE_FLAGS_REQUIRE_URL,
+					 NULL);
+	ret = gs_plugin_loader_job_action (plugin_loader, plugin_job, NULL, &error);
+	gs_test_flush_main_context ();
+	g_assert_no_error (error);
+	g_assert (ret);
+	return g_strdup (gs_app_get_summary (app));
+}
+
+static void
+gs_plugins_core_appstream_rebuild_func (GsPluginLoader *plugin_loader)
+{
+	GsPlugin *plugin = gs_plugin_loader_find_plugin (plugin_loader, "appstream");
+	guint rebuilds;
+	g_autofree gchar *summary = NULL;
+
+	g_assert_nonnull (plugin);
+	summary = gs_plugins_core_refine_summary (plugin_loader, "green.desktop");
+	g_assert_cmpstr (summary, ==, "Green");
+
+	/* let the file monitor invalidate the silo */
+	rebuilds = gs_plugin_get_silo_rebuilds (plugin);
+	gs_plugins_core_write_catalog (g_getenv ("GS_SELF_TEST_APPSTREAM_DIR"), "green", "Greener");
+	for (guint i = 0; i < 5; i++) {
+		g_usleep (20 * G_TIME_SPAN_MILLISECOND);
+		gs_test_flush_main_context ();
+	}
+
+	/* the rebuild is delayed, so these are served from the old silo
+	 * rather than waiting for the new one */
+	for (guint i = 0; i < 2; i++) {
+		g_clear_pointer (&summary, g_free);
+		summary = gs_plugins_core_refine_summary (plugin_loader, "green.desktop");
+		g_assert_cmpstr (summary, ==, "Green");
+	}
+	g_assert_cmpint (gs_plugin_get_silo_rebuilds (plugin), ==, rebuilds);
+
+	/* and then from the new one */
+	for (guint i = 0; i < 100 && gs_plugin_get_silo_rebuilds (plugin) == rebuilds; i++)
+		gs_plugins_core_appstream_query (plugin_loader);
+	g_assert_cmpint (gs_plugin_get_silo_rebuilds (plugin), >, rebuilds);
+	g_clear_pointer (&summary, g_free);
+	summary = gs_plugins_core_refine_summary (plugin_loader, "green.desktop");
+	g_assert_cmpstr (summary, ==, "Greener");
+}
+
 int
 main (int argc, char **argv)
 {
+	g_autofree gchar *appstream_dir = NULL;
+	g_autofree gchar *purple_fn = NULL;
+	g_autofree gchar *purple_installed_fn = NULL;
 	g_autofree gchar *tmp_root = NULL;
 	gboolean ret;
 	int retval;
@@ -246,6 +622,49 @@ main (int argc, char **argv)
 		"</components>\n";
 	g_setenv ("GS_SELF_TEST_APPSTREAM_XML", xml, TRUE);
 
+	/* and some catalog files, each compiled into its own silo */
+	appstream_dir = g_dir_make_tmp ("gnome-software-core-appstream-XXXXXX", NULL);
+	g_assert (appstream_dir != NULL);
+	g_setenv ("GS_SELF_TEST_APPSTREAM_DIR", appstream_dir, TRUE);
+	gs_plugins_core_write_catalog (appstream_dir, "blue", "Blue");
+	gs_plugins_core_write_catalog (appstream_dir, "green", "Green");
+	gs_plugins_core_write_catalog (appstream_dir, "red", "Red");
+
+	/* an app with some of its releases installed */
+	purple_fn = g_build_filename (appstream_dir, "purple.xml", NULL);
+	ret = g_file_set_contents (purple_fn,
+		"<?xml version=\"1.0\"?>\n"
+		"<components origin=\"purple\" version=\"0.9\">\n"
+		"  <component type=\"desktop\">\n"
+		"    <id>purple.desktop</id>\n"
+		"    <name>Purple</name>\n"
+		"    <summary>Purple</summary>\n"
+		"    <pkgname>purple</pkgname>\n"
+		"    <releases>\n"
+		"      <release version=\"1.2\"><description><p>Fixes the colour</p></description></release>\n"
+		"      <release version=\"1.1\"><description><p>Installed fix</p></description></release>\n"
+		"      <release version=\"1.0\"/>\n"
+		"    </releases>\n"
+		"  </component>\n"
+		"</components>\n", -1, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	purple_installed_fn = g_build_filename (appstream_dir, "purple-installed.xml", NULL);
+	ret = g_file_set_contents (purple_installed_fn,
+		"<?xml version=\"1.0\"?>\n"
+		"<component type=\"desktop\">\n"
+		"  <id>purple.desktop</id>\n"
+		"  <releases>\n"
+		"    <release version=\"1.1\"/>\n"
+		"    <release version=\"1.0\"/>\n"
+		"  </releases>\n"
+		"</component>\n", -1, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+
+	/* give the tests time to query while the silos are rebuilt */
+	g_setenv ("GS_SELF_TEST_APPSTREAM_REBUILD_DELAY", "1000", TRUE);
+
 	/* only critical and error are fatal */
 	g_log_set_fatal_mask (NULL, G_LOG_LEVEL_ERROR | G_LOG_LEVEL_CRITICAL);
 
@@ -261,6 +680,19 @@ main (int argc, char **argv)
 	g_assert (ret);
 
 	/* plugin tests go here */
+	g_test_add_func ("/gnome-software/plugins/core/appstream-index",
+			 gs_plugins_core_appstream_index_func);
+	g_test_add_func ("/gnome-software/plugins/core/appstream-prepared-queries",
+			 gs_plugins_core_appstream_prepared_queries_func);
+	g_test_add_data_func ("/gnome-software/plugins/core/appstream-update-details",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_core_appstream_update_details_func);
+	g_test_add_data_func ("/gnome-software/plugins/core/appstream-parts",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_core_appstream_parts_func);
+	g_test_add_data_func ("/gnome-software/plugins/core/appstream-rebuild",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_core_appstream_rebuild_func);
 	g_test_add_data_func ("/gnome-software/plugins/core/search-repo-name",
 			      plugin_loader,
 			      (GTestDataFunc) gs_plugins_core_search_repo_name_func);
@@ -274,6 +706,7 @@ main (int argc, char **argv)
 
 	/* Clean up. */
 	gs_utils_rmtree (tmp_root, NULL);
+	gs_utils_rmtree (appstream_dir, NULL);
 
 	return retval;
 }
@@ -23,6 +23,7 @@ struct GsPluginData {
 	GsApp			*cached_origin;
 	GHashTable		*installed_apps;	/* id:1 */
 	GHashTable		*available_apps;	/* id:1 */
+	gboolean		 setup_lazy;
 };
 
 /* just flip-flop this every few seconds */
@@ -78,6 +79,12 @@ gs_plugin_initialize (GsPlugin *plugin)
 			     g_strdup ("com.hughski.ColorHug2.driver"),
 			     GUINT_TO_POINTER (1));
 
+	/* only set up when searching */
+	if (g_getenv ("GS_SELF_TEST_DUMMY_SETUP_LAZY") != NULL) {
+		priv->setup_lazy = TRUE;
+		gs_plugin_add_setup_action (plugin, GS_PLUGIN_ACTION_SEARCH);
+	}
+
 	/* need help from appstream */
 	gs_plugin_add_rule (plugin, GS_PLUGIN_RULE_RUN_AFTER, "appstream");
 	gs_plugin_add_rule (plugin, GS_PLUGIN_RULE_RUN_AFTER, "os-release");
@@ -98,6 +105,40 @@ gs_plugin_destroy (GsPlugin *plugin)
 		g_object_unref (priv->cached_origin);
 }
 
+static gboolean
+gs_plugin_dummy_setup_idle_cb (gpointer user_data)
+{
+	GsPlugin *plugin = GS_PLUGIN (user_data);
+	g_autoptr(GsApp) app = gs_app_new ("dummy-setup");
+	gs_plugin_cache_add (plugin, "dummy-setup", app);
+	return G_SOURCE_REMOVE;
+}
+
+gboolean
+gs_plugin_setup (GsPlugin *plugin, GCancellable *cancellable, GError **error)
+{
+	GsPluginData *priv = gs_plugin_get_data (plugin);
+	GMainContext *context = g_main_context_get_thread_default ();
+	g_autoptr(GSource) source = NULL;
+
+	/* the plugin loader pushes a main context of our own */
+	if (context == NULL) {
+		g_set_error_literal (error,
+				     GS_PLUGIN_ERROR,
+				     GS_PLUGIN_ERROR_FAILED,
+				     "no main context pushed for setup");
+		return FALSE;
+	}
+
+	/* the self test waits for this to be dispatched after setup */
+	if (priv->setup_lazy) {
+		source = g_idle_source_new ();
+		g_source_set_callback (source, gs_plugin_dummy_setup_idle_cb, plugin, NULL);
+		g_source_attach (source, context);
+	}
+	return TRUE;
+}
+
 void
 gs_plugin_adopt_app (GsPlugin *plugin, GsApp *app)
 {
@@ -288,6 +329,16 @@ gs_plugin_add_search (GsPlugin *plugin,
 		return TRUE;
 	}
 
+	/* just long enough for the self tests to start a second search */
+	if (g_strcmp0 (values[0], "slow") == 0) {
+		gs_plugin_dummy_timeout_add (200, cancellable);
+		if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
+			gs_utils_error_convert_gio (error);
+			return FALSE;
+		}
+		return TRUE;
+	}
+
 	/* we're very specific */
 	if (g_strcmp0 (values[0], "chiron") != 0)
 		return TRUE;
@@ -11,6 +11,7 @@
 #include <glib/gstdio.h>
 
 #include "gnome-software-private.h"
+#include "gs-plugin-job-private.h"
 
 #include "gs-test.h"
 
@@ -19,6 +20,7 @@ static guint _status_changed_cnt = 0;
 typedef struct {
 	GError *error;
 	GMainLoop *loop;
+	GsAppList *streamed;
 } GsDummyTestHelper;
 
 static GsDummyTestHelper *
@@ -34,6 +36,8 @@ gs_dummy_test_helper_free (GsDummyTestHelper *helper)
 		g_error_free (helper->error);
 	if (helper->loop != NULL)
 		g_main_loop_unref (helper->loop);
+	if (helper->streamed != NULL)
+		g_object_unref (helper->streamed);
 	g_free (helper);
 }
 
@@ -222,7 +226,7 @@ gs_plugins_dummy_key_colors_func (GsPluginLoader *plugin_loader)
 	app = gs_app_new ("chiron.desktop");
 	plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_REFINE,
 					 "app", app,
-					 "refine-flags", GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON,
+					 "refine-flags", GS_PLUGIN_REFINE_FLAGS_REQUIRE_KEY_COLORS,
 					 NULL);
 	ret = gs_plugin_loader_job_action (plugin_loader, plugin_job, NULL, &error);
 	gs_test_flush_main_context ();
@@ -245,6 +249,114 @@ gs_plugins_dummy_key_colors_func (GsPluginLoader *plugin_loader)
 	}
 }
 
+static GsApp *
+gs_plugins_dummy_refine_key_colors (GsPluginLoader *plugin_loader, GIcon *icon)
+{
+	gboolean ret;
+	g_autoptr(GsApp) app = NULL;
+	g_autoptr(GsPluginJob) plugin_job = NULL;
+	g_autoptr(GError) error = NULL;
+
+	app = gs_app_new ("key-colors-cache.desktop");
+	gs_app_add_icon (app, icon);
+	plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_REFINE,
+					 "app", app,
+					 "refine-flags", GS_PLUGIN_REFINE_FLAGS_REQUIRE_KEY_COLORS,
+					 NULL);
+	ret = gs_plugin_loader_job_action (plugin_loader, plugin_job, NULL, &error);
+	gs_test_flush_main_context ();
+	g_assert_no_error (error);
+	g_assert (ret);
+	return g_steal_pointer (&app);
+}
+
+static void
+gs_plugins_dummy_key_colors_cache_func (GsPluginLoader *plugin_loader)
+{
+	GArray *array;
+	const GdkRGBA *kc;
+	gboolean ret;
+	gint fd;
+	gsize len = 0;
+	g_autofree gchar *icon_fn = NULL;
+	g_autofree gchar *data = NULL;
+	g_autofree gchar *checksum = NULL;
+	g_autofree gchar *cache_fn = NULL;
+	g_autoptr(GdkPixbuf) pb = NULL;
+	g_autoptr(GdkPixbuf) pb_bottom = NULL;
+	g_autoptr(GFile) cache_file = NULL;
+	g_autoptr(GFile) icon_file = NULL;
+	g_autoptr(GIcon) icon = NULL;
+	g_autoptr(GsApp) app1 = NULL;
+	g_autoptr(GsApp) app2 = NULL;
+	g_autoptr(GsApp) app3 = NULL;
+	g_autoptr(GVariant) fake = NULL;
+	g_autoptr(GError) error = NULL;
+
+	/* a two-color icon on disk, so it is loadable rather than themed */
+	fd = g_file_open_tmp ("gs-key-colors-XXXXXX.png", &icon_fn, &error);
+	g_assert_no_error (error);
+	g_close (fd, NULL);
+	pb = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, 64, 64);
+	gdk_pixbuf_fill (pb, 0xff0000ff);
+	pb_bottom = gdk_pixbuf_new_subpixbuf (pb, 0, 32, 64, 32);
+	gdk_pixbuf_fill (pb_bottom, 0x0000ffff);
+	ret = gdk_pixbuf_save (pb, icon_fn, "png", &error, NULL);
+	g_assert_no_error (error);
+	g_assert (ret);
+	icon_file = g_file_new_for_path (icon_fn);
+	icon = g_file_icon_new (icon_file);
+	gs_icon_set_width (icon, 64);
+
+	/* the first refine calculates the colors on the worker thread and
+	 * caches them by the hash of the icon data */
+	ret = g_file_get_contents (icon_fn, &data, &len, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA256, (const guchar *) data, len);
+	cache_fn = g_build_filename (g_getenv ("GS_SELF_TEST_CACHEDIR"),
+				     "key-colors", checksum, NULL);
+	g_unlink (cache_fn);
+	app1 = gs_plugins_dummy_refine_key_colors (plugin_loader, icon);
+	array = gs_app_get_key_colors (app1);
+	g_assert_cmpint (array->len, >, 0);
+	g_assert (g_file_test (cache_fn, G_FILE_TEST_EXISTS));
+
+	/* replace the cache with colors the icon cannot produce, so a second
+	 * refine which used them cannot have recalculated anything */
+	fake = g_variant_ref_sink (g_variant_new_parsed ("[(0.25, 0.5, 0.75, 1.0)]"));
+	ret = g_file_set_contents (cache_fn,
+				   g_variant_get_data (fake),
+				   (gssize) g_variant_get_size (fake),
+				   &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	app2 = gs_plugins_dummy_refine_key_colors (plugin_loader, icon);
+	array = gs_app_get_key_colors (app2);
+	g_assert_cmpint (array->len, ==, 1);
+	kc = &g_array_index (array, GdkRGBA, 0);
+	g_assert_cmpfloat (kc->red, ==, 0.25);
+	g_assert_cmpfloat (kc->green, ==, 0.5);
+	g_assert_cmpfloat (kc->blue, ==, 0.75);
+
+	/* an expired entry is ignored and replaced */
+	cache_file = g_file_new_for_path (cache_fn);
+	ret = g_file_set_attribute_uint64 (cache_file,
+					   G_FILE_ATTRIBUTE_TIME_MODIFIED,
+					   (guint64) g_get_real_time () / G_USEC_PER_SEC - 60 * 24 * 60 * 60,
+					   G_FILE_QUERY_INFO_NONE, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	app3 = gs_plugins_dummy_refine_key_colors (plugin_loader, icon);
+	array = gs_app_get_key_colors (app3);
+	g_assert_cmpint (array->len, >, 0);
+	kc = &g_array_index (array, GdkRGBA, 0);
+	g_assert_cmpfloat (kc->red, !=, 0.25);
+	g_assert_cmpint (gs_utils_get_file_age (cache_file), <, 60 * 60);
+
+	g_unlink (icon_fn);
+}
+
 static void
 gs_plugins_dummy_updates_func (GsPluginLoader *plugin_loader)
 {
@@ -483,8 +595,233 @@ gs_plugins_dummy_hang_func (GsPluginLoader *plugin_loader)
 					 NULL);
 	list = gs_plugin_loader_job_process (plugin_loader, plugin_job, cancellable, &error);
 	gs_test_flush_main_context ();
-	g_assert_error (error, GS_PLUGIN_ERROR, GS_PLUGIN_ERROR_TIMED_OUT);
-	g_assert (list == NULL);
+
+	/* the hanging plugin is cut off when its budget runs out, rather
+	 * than failing the whole search */
+	g_assert_no_error (error);
+	g_assert_nonnull (list);
+	g_assert_true (gs_app_list_has_flag (list, GS_APP_LIST_FLAG_IS_PARTIAL));
+}
+
+static void
+plugin_job_process_cb (GObject *source,
+		       GAsyncResult *res,
+		       gpointer user_data)
+{
+	GsPluginLoader *plugin_loader = GS_PLUGIN_LOADER (source);
+	GsDummyTestHelper *helper = (GsDummyTestHelper *) user_data;
+	g_autoptr(GsAppList) list = NULL;
+
+	list = gs_plugin_loader_job_process_finish (plugin_loader, res, &helper->error);
+	if (helper->loop != NULL)
+		g_main_loop_quit (helper->loop);
+}
+
+static void
+gs_plugins_dummy_coalesce_func (GsPluginLoader *plugin_loader)
+{
+	g_autoptr(GCancellable) cancellable = g_cancellable_new ();
+	g_autoptr(GMainContext) context = g_main_context_new ();
+	g_autoptr(GsDummyTestHelper) helper1 = gs_dummy_test_helper_new ();
+	g_autoptr(GsDummyTestHelper) helper2 = gs_dummy_test_helper_new ();
+	g_autoptr(GsPluginJob) plugin_job1 = NULL;
+	g_autoptr(GsPluginJob) plugin_job2 = NULL;
+	g_autoptr(GsPluginJob) plugin_job3 = NULL;
+	g_autoptr(GsPluginJob) plugin_job4 = NULL;
+	g_autoptr(GsApp) app1 = NULL;
+	g_autoptr(GsApp) app2 = NULL;
+	g_autofree gchar *key1 = NULL;
+	g_autofree gchar *key2 = NULL;
+
+	helper1->loop = g_main_loop_new (context, FALSE);
+	helper2->loop = g_main_loop_new (context, FALSE);
+	g_main_context_push_thread_default (context);
+
+	/* the second search is identical, so it shares the first one */
+	plugin_job1 = gs_plugin_job_newv (GS_PLUGIN_ACTION_SEARCH,
+					  "search", "slow",
+					  NULL);
+	gs_plugin_loader_job_process_async (plugin_loader, plugin_job1, cancellable,
+					    plugin_job_process_cb, helper1);
+	plugin_job2 = gs_plugin_job_newv (GS_PLUGIN_ACTION_SEARCH,
+					  "search", "slow",
+					  NULL);
+	gs_plugin_loader_job_process_async (plugin_loader, plugin_job2, NULL,
+					    plugin_job_process_cb, helper2);
+
+	/* cancelling one caller does not cancel the job for the other */
+	g_cancellable_cancel (cancellable);
+	g_main_loop_run (helper1->loop);
+	g_assert_error (helper1->error, GS_PLUGIN_ERROR, GS_PLUGIN_ERROR_CANCELLED);
+	g_main_loop_run (helper2->loop);
+	g_assert_no_error (helper2->error);
+
+	/* objects are matched by ID, not by address */
+	app1 = gs_app_new ("chiron.desktop");
+	app2 = gs_app_new ("chiron.desktop");
+	plugin_job3 = gs_plugin_job_newv (GS_PLUGIN_ACTION_GET_ALTERNATES,
+					  "app", app1,
+					  NULL);
+	plugin_job4 = gs_plugin_job_newv (GS_PLUGIN_ACTION_GET_ALTERNATES,
+					  "app", app2,
+					  NULL);
+	key1 = gs_plugin_job_to_key (plugin_job3);
+	key2 = gs_plugin_job_to_key (plugin_job4);
+	g_assert_cmpstr (key1, ==, key2);
+	gs_app_set_id (app2, "zeus.desktop");
+	g_free (key2);
+	key2 = gs_plugin_job_to_key (plugin_job4);
+	g_assert_cmpstr (key1, !=, key2);
+
+	g_main_context_pop_thread_default (context);
+}
+
+static void
+plugin_job_count_cb (GObject *source,
+		     GAsyncResult *res,
+		     gpointer user_data)
+{
+	guint *pending = (guint *) user_data;
+	g_autoptr(GError) error = NULL;
+
+	/* these are cancelled, so the result does not matter */
+	gs_plugin_loader_job_action_finish (GS_PLUGIN_LOADER (source), res, &error);
+	(*pending)--;
+}
+
+static void
+gs_plugins_dummy_lanes_func (GsPluginLoader *plugin_loader)
+{
+	gboolean ret;
+	guint pending = 0;
+	g_autoptr(GCancellable) cancellable = g_cancellable_new ();
+	g_autoptr(GMainContext) context = g_main_context_new ();
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GsApp) app = gs_app_new ("chiron.desktop");
+	g_autoptr(GsPluginJob) plugin_job = NULL;
+	g_autoptr(GTimer) timer = NULL;
+
+	g_main_context_push_thread_default (context);
+
+	/* fill the background lane with slow refreshes, and queue more */
+	for (guint i = 0; i < 8; i++) {
+		g_autoptr(GsPluginJob) refresh_job = NULL;
+		refresh_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_REFRESH,
+						  "age", (guint64) 0,
+						  NULL);
+		gs_plugin_loader_job_process_async (plugin_loader, refresh_job, cancellable,
+						    plugin_job_count_cb, &pending);
+		pending++;
+	}
+
+	/* an interactive job does not wait for any of them */
+	timer = g_timer_new ();
+	gs_app_set_management_plugin (app, "dummy");
+	plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_REFINE,
+					 "app", app,
+					 "interactive", TRUE,
+					 "refine-flags", GS_PLUGIN_REFINE_FLAGS_REQUIRE_LICENSE,
+					 NULL);
+	ret = gs_plugin_loader_job_action (plugin_loader, plugin_job, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	g_assert_cmpstr (gs_app_get_license (app), ==, "GPL-2.0+");
+	g_assert_cmpfloat (g_timer_elapsed (timer, NULL), <, 3.0);
+
+	g_cancellable_cancel (cancellable);
+	while (pending > 0)
+		g_main_context_iteration (context, TRUE);
+	g_main_context_pop_thread_default (context);
+}
+
+static void
+plugin_job_batch_cb (GsPluginLoader *plugin_loader,
+		     GsAppList *list,
+		     gpointer user_data)
+{
+	GsDummyTestHelper *helper = (GsDummyTestHelper *) user_data;
+
+	/* later batches never repeat an earlier result */
+	for (guint i = 0; i < gs_app_list_length (list); i++) {
+		GsApp *app = gs_app_list_index (list, i);
+		for (guint j = 0; j < gs_app_list_length (helper->streamed); j++) {
+			GsApp *app_tmp = gs_app_list_index (helper->streamed, j);
+			g_assert_cmpstr (gs_app_get_id (app), !=, gs_app_get_id (app_tmp));
+		}
+	}
+	gs_app_list_add_list (helper->streamed, list);
+}
+
+static void
+gs_plugins_dummy_search_streaming_func (GsPluginLoader *plugin_loader)
+{
+	gboolean found = FALSE;
+	g_autoptr(GMainContext) context = g_main_context_new ();
+	g_autoptr(GsDummyTestHelper) helper = gs_dummy_test_helper_new ();
+	g_autoptr(GsPluginJob) plugin_job = NULL;
+
+	helper->loop = g_main_loop_new (context, FALSE);
+	helper->streamed = gs_app_list_new ();
+	g_main_context_push_thread_default (context);
+
+	/* the results are sent in batches before the job completes */
+	plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_SEARCH,
+					 "search", "zeus",
+					 "refine-flags", GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON,
+					 NULL);
+	gs_plugin_loader_job_process_streaming_async (plugin_loader, plugin_job, NULL,
+						      plugin_job_batch_cb, helper,
+						      plugin_job_process_cb, helper);
+	g_main_loop_run (helper->loop);
+	g_assert_no_error (helper->error);
+	g_main_context_pop_thread_default (context);
+
+	for (guint i = 0; i < gs_app_list_length (helper->streamed); i++) {
+		GsApp *app = gs_app_list_index (helper->streamed, i);
+		if (g_strcmp0 (gs_app_get_id (app), "zeus.desktop") == 0)
+			found = TRUE;
+	}
+	g_assert_true (found);
+}
+
+static void
+gs_plugins_dummy_stats_func (GsPluginLoader *plugin_loader)
+{
+	GVariantIter iter;
+	const gchar *plugin_name;
+	const gchar *action;
+	guint32 calls, errors, cancellations, p50, p95, p99;
+	gboolean found = FALSE;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GsAppList) list = NULL;
+	g_autoptr(GsPluginJob) plugin_job = NULL;
+	g_autoptr(GVariant) stats = NULL;
+
+	/* run a search so there is at least one sample */
+	plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_SEARCH,
+					 "search", "Black",
+					 NULL);
+	list = gs_plugin_loader_job_process (plugin_loader, plugin_job, NULL, &error);
+	gs_test_flush_main_context ();
+	g_assert_no_error (error);
+	g_assert_nonnull (list);
+
+	stats = gs_plugin_loader_get_stats (plugin_loader);
+	g_assert_true (g_variant_is_of_type (stats, G_VARIANT_TYPE ("a(ssuuuuuu)")));
+	g_variant_iter_init (&iter, stats);
+	while (g_variant_iter_next (&iter, "(&s&suuuuuu)",
+				    &plugin_name, &action,
+				    &calls, &errors, &cancellations,
+				    &p50, &p95, &p99)) {
+		g_assert_cmpint (p50, <=, p95);
+		g_assert_cmpint (p95, <=, p99);
+		if (g_strcmp0 (plugin_name, "dummy") == 0 &&
+		    g_strcmp0 (action, "search") == 0) {
+			g_assert_cmpint (calls, >=, 1);
+			found = TRUE;
+		}
+	}
+	g_assert_true (found);
 }
 
 static void
@@ -714,6 +1051,79 @@ gs_plugins_dummy_limit_parallel_ops_func (GsPluginLoader *plugin_loader)
 	gs_plugin_loader_set_max_parallel_ops (plugin_loader, 0);
 }
 
+static void
+gs_plugins_dummy_setup_order_func (GsPluginLoader *plugin_loader)
+{
+	GsPlugin *appstream = gs_plugin_loader_find_plugin (plugin_loader, "appstream");
+	GsPlugin *dummy = gs_plugin_loader_find_plugin (plugin_loader, "dummy");
+
+	/* dummy has to run after appstream, so is only set up after it */
+	g_assert_nonnull (appstream);
+	g_assert_nonnull (dummy);
+	g_assert_cmpuint (gs_plugin_get_setup_serial (appstream), >, 0);
+	g_assert_cmpuint (gs_plugin_get_setup_serial (dummy), >,
+			  gs_plugin_get_setup_serial (appstream));
+}
+
+static void
+gs_plugins_dummy_setup_lazy_func (void)
+{
+	GsApp *app;
+	GsPlugin *plugin;
+	gboolean ret;
+	guint cnt = 0;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GsApp) app_setup = NULL;
+	g_autoptr(GsAppList) list = NULL;
+	g_autoptr(GsPluginJob) plugin_job = NULL;
+	g_autoptr(GsPluginLoader) plugin_loader = NULL;
+	const gchar *allowlist[] = { "dummy", NULL };
+
+	/* a loader of its own, where dummy is only set up when searching */
+	g_setenv ("GS_SELF_TEST_DUMMY_SETUP_LAZY", "1", TRUE);
+	plugin_loader = gs_plugin_loader_new ();
+	gs_plugin_loader_add_location (plugin_loader, LOCALPLUGINDIR);
+	ret = gs_plugin_loader_setup (plugin_loader,
+				      (gchar**) allowlist,
+				      NULL,
+				      NULL,
+				      &error);
+	g_unsetenv ("GS_SELF_TEST_DUMMY_SETUP_LAZY");
+	g_assert_no_error (error);
+	g_assert (ret);
+	plugin = gs_plugin_loader_find_plugin (plugin_loader, "dummy");
+	g_assert_nonnull (plugin);
+	g_assert_false (gs_plugin_get_setup_done (plugin));
+
+	/* anything else skips the plugin without setting it up */
+	plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_GET_INSTALLED, NULL);
+	list = gs_plugin_loader_job_process (plugin_loader, plugin_job, NULL, &error);
+	gs_test_flush_main_context ();
+	g_assert_error (error, GS_PLUGIN_ERROR, GS_PLUGIN_ERROR_NOT_SUPPORTED);
+	g_assert (list == NULL);
+	g_assert_false (gs_plugin_get_setup_done (plugin));
+	g_clear_error (&error);
+	g_clear_object (&plugin_job);
+
+	/* the first search sets it up, with a main context of its own */
+	plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_SEARCH,
+					 "search", "chiron",
+					 NULL);
+	list = gs_plugin_loader_job_process (plugin_loader, plugin_job, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (list != NULL);
+	g_assert_true (gs_plugin_get_setup_done (plugin));
+	g_assert_cmpint (gs_app_list_length (list), ==, 1);
+	app = gs_app_list_index (list, 0);
+	g_assert_cmpstr (gs_app_get_id (app), ==, "chiron.desktop");
+
+	/* what the plugin left attached to that context is dispatched from
+	 * the one the plugin loader was set up from */
+	while ((app_setup = gs_plugin_cache_lookup (plugin, "dummy-setup")) == NULL && cnt++ < 100)
+		g_main_context_iteration (NULL, FALSE);
+	g_assert_nonnull (app_setup);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -842,6 +1252,11 @@ main (int argc, char **argv)
 	g_assert (gs_plugin_loader_get_enabled (plugin_loader, "dummy"));
 
 	/* plugin tests go here */
+	g_test_add_data_func ("/gnome-software/plugins/dummy/setup-order",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_dummy_setup_order_func);
+	g_test_add_func ("/gnome-software/plugins/dummy/setup-lazy",
+			 gs_plugins_dummy_setup_lazy_func);
 	g_test_add_data_func ("/gnome-software/plugins/dummy/wildcard",
 			      plugin_loader,
 			      (GTestDataFunc) gs_plugins_dummy_wildcard_func);
@@ -851,6 +1266,9 @@ main (int argc, char **argv)
 	g_test_add_data_func ("/gnome-software/plugins/dummy/key-colors",
 			      plugin_loader,
 			      (GTestDataFunc) gs_plugins_dummy_key_colors_func);
+	g_test_add_data_func ("/gnome-software/plugins/dummy/key-colors-cache",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_dummy_key_colors_cache_func);
 	g_test_add_data_func ("/gnome-software/plugins/dummy/search",
 			      plugin_loader,
 			      (GTestDataFunc) gs_plugins_dummy_search_func);
@@ -860,6 +1278,18 @@ main (int argc, char **argv)
 	g_test_add_data_func ("/gnome-software/plugins/dummy/hang",
 			      plugin_loader,
 			      (GTestDataFunc) gs_plugins_dummy_hang_func);
+	g_test_add_data_func ("/gnome-software/plugins/dummy/lanes",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_dummy_lanes_func);
+	g_test_add_data_func ("/gnome-software/plugins/dummy/coalesce",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_dummy_coalesce_func);
+	g_test_add_data_func ("/gnome-software/plugins/dummy/search{streaming}",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_dummy_search_streaming_func);
+	g_test_add_data_func ("/gnome-software/plugins/dummy/stats",
+			      plugin_loader,
+			      (GTestDataFunc) gs_plugins_dummy_stats_func);
 	g_test_add_data_func ("/gnome-software/plugins/dummy/search{invalid}",
 			      plugin_loader,
 			      (GTestDataFunc) gs_plugins_dummy_search_invalid_func);
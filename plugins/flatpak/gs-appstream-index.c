@@ -0,0 +1 @@
+../core/gs-appstream-index.c
\ No newline at end of file
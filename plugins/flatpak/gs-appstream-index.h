@@ -0,0 +1 @@
+../core/gs-appstream-index.h
\ No newline at end of file
@@ -36,7 +36,13 @@ struct _GsFlatpak {
 	AsComponentScope	 scope;
 	GsPlugin		*plugin;
 	XbSilo			*silo;
+	GsAppstreamIndex	*index;
 	GRWLock			 silo_lock;
+	GMutex			 rebuild_mutex;
+	gint			 rebuilding;	/* (atomic) */
+	GCancellable		*rebuild_cancellable;
+	gint			 rebuild_failures;	/* (atomic) */
+	gint			 rebuild_retry_time;	/* (atomic): monotonic seconds */
 	gchar			*id;
 	guint			 changed_id;
 	GHashTable		*app_silos;
@@ -47,6 +53,11 @@ struct _GsFlatpak {
 
 G_DEFINE_TYPE (GsFlatpak, gs_flatpak, G_TYPE_OBJECT)
 
+/* seconds to wait before retrying a failed rebuild, doubled for each failure
+ * in a row up to GS_FLATPAK_REBUILD_FAILURES_MAX */
+#define GS_FLATPAK_REBUILD_BACKOFF		5
+#define GS_FLATPAK_REBUILD_FAILURES_MAX		7
+
 static gboolean
 gs_flatpak_refresh_appstream (GsFlatpak *self, guint cache_age,
 			      GCancellable *cancellable, GError **error);
@@ -838,28 +849,31 @@ gs_flatpak_rescan_installed (GsFlatpak *self,
 	}
 }
 
+/* compiles the new silo without holding the silo lock, which is only taken
+ * to swap it in; callers always wait for the result */
 static gboolean
-gs_flatpak_rescan_appstream_store (GsFlatpak *self,
-				   GCancellable *cancellable,
-				   GError **error)
+gs_flatpak_rebuild_appstream_store (GsFlatpak *self,
+				    GCancellable *cancellable,
+				    GError **error)
 {
 	const gchar *const *locales = g_get_language_names ();
+	gboolean had_silo;
 	g_autofree gchar *blobfn = NULL;
+	g_autofree gchar *idxfn = NULL;
+	g_autoptr(GError) error_index = NULL;
 	g_autoptr(GFile) file = NULL;
+	g_autoptr(GFile) idxfile = NULL;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&self->rebuild_mutex);
 	g_autoptr(GPtrArray) xremotes = NULL;
-	g_autoptr(GRWLockReaderLocker) reader_locker = NULL;
 	g_autoptr(GRWLockWriterLocker) writer_locker = NULL;
+	g_autoptr(GsAppstreamIndex) index = NULL;
 	g_autoptr(XbBuilder) builder = xb_builder_new ();
+	g_autoptr(XbSilo) silo = NULL;
 
-	reader_locker = g_rw_lock_reader_locker_new (&self->silo_lock);
-	/* everything is okay */
+	/* another thread may have just done this; only we ever replace the
+	 * silo, so no need to take the lock to look at it */
 	if (self->silo != NULL && xb_silo_is_valid (self->silo))
 		return TRUE;
-	g_clear_pointer (&reader_locker, g_rw_lock_reader_locker_free);
-
-	/* drat! silo needs regenerating */
-	writer_locker = g_rw_lock_writer_locker_new (&self->silo_lock);
-	g_clear_object (&self->silo);
 
 	/* verbose profiling */
 	if (g_getenv ("GS_XMLB_VERBOSE") != NULL) {
@@ -906,17 +920,119 @@ gs_flatpak_rescan_appstream_store (GsFlatpak *self,
 		return FALSE;
 	file = g_file_new_for_path (blobfn);
 	g_debug ("ensuring %s", blobfn);
-	self->silo = xb_builder_ensure (builder, file,
-					XB_BUILDER_COMPILE_FLAG_IGNORE_INVALID |
-					XB_BUILDER_COMPILE_FLAG_SINGLE_LANG,
-					NULL, error);
-	if (self->silo == NULL)
+	silo = xb_builder_ensure (builder, file,
+				  XB_BUILDER_COMPILE_FLAG_IGNORE_INVALID |
+				  XB_BUILDER_COMPILE_FLAG_SINGLE_LANG,
+				  NULL, error);
+	if (silo == NULL)
 		return FALSE;
+	gs_appstream_prepare_queries (self->plugin, silo);
+
+	/* build the search index, falling back to XPath if this fails */
+	idxfn = gs_utils_get_cache_filename (gs_flatpak_get_id (self),
+					     "components.idx",
+					     GS_UTILS_CACHE_FLAG_WRITEABLE |
+					     GS_UTILS_CACHE_FLAG_CREATE_DIRECTORY,
+					     error);
+	if (idxfn == NULL)
+		return FALSE;
+	idxfile = g_file_new_for_path (idxfn);
+	index = gs_appstream_index_new (silo, idxfile, cancellable, &error_index);
+	if (index == NULL)
+		g_warning ("failed to build search index: %s", error_index->message);
+
+	/* swap it in, readers only ever wait for this */
+	writer_locker = g_rw_lock_writer_locker_new (&self->silo_lock);
+	had_silo = self->silo != NULL;
+	g_clear_object (&self->index);
+	g_clear_object (&self->silo);
+	self->silo = g_steal_pointer (&silo);
+	self->index = g_steal_pointer (&index);
+	gs_plugin_refine_invalidate (self->plugin);
+	g_clear_pointer (&writer_locker, g_rw_lock_writer_locker_free);
+	gs_plugin_silo_rebuilt (self->plugin);
+
+	/* anything shown from the old silo may be out of date */
+	if (had_silo)
+		gs_plugin_reload (self->plugin);
 
 	/* success */
 	return TRUE;
 }
 
+static void
+gs_flatpak_rebuild_appstream_store_thread_cb (GTask *task,
+					      gpointer source_object,
+					      gpointer task_data,
+					      GCancellable *cancellable)
+{
+	GsFlatpak *self = GS_FLATPAK (source_object);
+	g_autoptr(GError) error_local = NULL;
+
+	if (g_cancellable_is_cancelled (cancellable)) {
+		g_debug ("not rebuilding silo as the plugin is being destroyed");
+	} else if (gs_flatpak_rebuild_appstream_store (self, cancellable, &error_local)) {
+		g_atomic_int_set (&self->rebuild_failures, 0);
+		g_atomic_int_set (&self->rebuild_retry_time, 0);
+	} else if (!g_cancellable_is_cancelled (cancellable)) {
+		gint failures = g_atomic_int_get (&self->rebuild_failures);
+		guint backoff;
+
+		/* don't try again on every query */
+		failures = MIN (failures + 1, GS_FLATPAK_REBUILD_FAILURES_MAX);
+		g_atomic_int_set (&self->rebuild_failures, failures);
+		backoff = GS_FLATPAK_REBUILD_BACKOFF << (failures - 1);
+		g_warning ("failed to rebuild silo, retrying in %us: %s",
+			   backoff, error_local->message);
+		g_atomic_int_set (&self->rebuild_retry_time,
+				  (gint) (g_get_monotonic_time () / G_USEC_PER_SEC + backoff));
+	}
+	g_atomic_int_set (&self->rebuilding, FALSE);
+	g_task_return_boolean (task, TRUE);
+}
+
+static gboolean
+gs_flatpak_rescan_appstream_store (GsFlatpak *self,
+				   GCancellable *cancellable,
+				   GError **error)
+{
+	g_autoptr(GRWLockReaderLocker) reader_locker = NULL;
+	g_autoptr(GTask) task = NULL;
+
+	reader_locker = g_rw_lock_reader_locker_new (&self->silo_lock);
+	/* everything is okay */
+	if (self->silo != NULL && xb_silo_is_valid (self->silo))
+		return TRUE;
+
+	/* nothing to serve yet, so wait for it */
+	if (self->silo == NULL) {
+		g_clear_pointer (&reader_locker, g_rw_lock_reader_locker_free);
+		return gs_flatpak_rebuild_appstream_store (self, cancellable, error);
+	}
+	g_clear_pointer (&reader_locker, g_rw_lock_reader_locker_free);
+
+	/* drat! silo needs regenerating, but keep serving the old one, or
+	 * until it is time to retry if that failed */
+	if (g_get_monotonic_time () / G_USEC_PER_SEC < g_atomic_int_get (&self->rebuild_retry_time))
+		return TRUE;
+	if (!g_atomic_int_compare_and_exchange (&self->rebuilding, FALSE, TRUE))
+		return TRUE;
+	task = g_task_new (self, self->rebuild_cancellable, NULL, NULL);
+	g_task_set_source_tag (task, gs_flatpak_rescan_appstream_store);
+	g_task_run_in_thread (task, gs_flatpak_rebuild_appstream_store_thread_cb);
+	return TRUE;
+}
+
+/* waits for any rebuild that started before our own change */
+static void
+gs_flatpak_invalidate_silo (GsFlatpak *self)
+{
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&self->rebuild_mutex);
+	g_autoptr(GRWLockReaderLocker) reader_locker = g_rw_lock_reader_locker_new (&self->silo_lock);
+	if (self->silo != NULL)
+		xb_silo_invalidate (self->silo);
+}
+
 gboolean
 gs_flatpak_setup (GsFlatpak *self, GCancellable *cancellable, GError **error)
 {
@@ -1122,7 +1238,7 @@ gs_flatpak_refresh_appstream (GsFlatpak *self, guint cache_age,
 	}
 
 	/* ensure the AppStream silo is up to date */
-	if (!gs_flatpak_rescan_appstream_store (self, cancellable, error))
+	if (!gs_flatpak_rebuild_appstream_store (self, cancellable, error))
 		return FALSE;
 
 	return TRUE;
@@ -1450,6 +1566,7 @@ gs_flatpak_app_install_source (GsFlatpak *self, GsApp *app,
 			       GError **error)
 {
 	g_autoptr(FlatpakRemote) xremote = NULL;
+	g_autoptr(GError) error_local = NULL;
 
 	xremote = flatpak_installation_get_remote_by_name (self->installation,
 							   gs_app_get_id (app),
@@ -1475,11 +1592,10 @@ gs_flatpak_app_install_source (GsFlatpak *self, GsApp *app,
 		return FALSE;
 	}
 
-	/* invalidate cache */
-	g_rw_lock_reader_lock (&self->silo_lock);
-	if (self->silo != NULL)
-		xb_silo_invalidate (self->silo);
-	g_rw_lock_reader_unlock (&self->silo_lock);
+	/* invalidate cache, making sure the next query sees the change */
+	gs_flatpak_invalidate_silo (self);
+	if (!gs_flatpak_rebuild_appstream_store (self, cancellable, &error_local))
+		g_debug ("failed to rebuild silo: %s", error_local->message);
 
 	/* success */
 	gs_app_set_state (app, GS_APP_STATE_INSTALLED);
@@ -1687,17 +1803,14 @@ gs_flatpak_refresh (GsFlatpak *self,
 	g_mutex_unlock (&self->installed_refs_mutex);
 
 	/* manually do this in case we created the first appstream file */
-	g_rw_lock_reader_lock (&self->silo_lock);
-	if (self->silo != NULL)
-		xb_silo_invalidate (self->silo);
-	g_rw_lock_reader_unlock (&self->silo_lock);
+	gs_flatpak_invalidate_silo (self);
 
 	/* update AppStream metadata */
 	if (!gs_flatpak_refresh_appstream (self, cache_age, cancellable, error))
 		return FALSE;
 
 	/* ensure valid */
-	if (!gs_flatpak_rescan_appstream_store (self, cancellable, error))
+	if (!gs_flatpak_rebuild_appstream_store (self, cancellable, error))
 		return FALSE;
 
 	/* success */
@@ -2591,6 +2704,9 @@ gs_flatpak_refine_appstream_from_bytes (GsFlatpak *self,
 				   error);
 	if (silo == NULL)
 		return FALSE;
+
+	/* this is kept around for searches */
+	gs_appstream_prepare_queries (self->plugin, silo);
 	if (g_getenv ("GS_XMLB_VERBOSE") != NULL) {
 		g_autofree gchar *xml = NULL;
 		xml = xb_silo_export (silo,
@@ -3037,6 +3153,7 @@ gs_flatpak_app_remove_source (GsFlatpak *self,
 			      GError **error)
 {
 	g_autoptr(FlatpakRemote) xremote = NULL;
+	g_autoptr(GError) error_local = NULL;
 
 	/* find the remote */
 	xremote = flatpak_installation_get_remote_by_name (self->installation,
@@ -3061,11 +3178,10 @@ gs_flatpak_app_remove_source (GsFlatpak *self,
 		return FALSE;
 	}
 
-	/* invalidate cache */
-	g_rw_lock_reader_lock (&self->silo_lock);
-	if (self->silo != NULL)
-		xb_silo_invalidate (self->silo);
-	g_rw_lock_reader_unlock (&self->silo_lock);
+	/* invalidate cache, making sure the next query sees the change */
+	gs_flatpak_invalidate_silo (self);
+	if (!gs_flatpak_rebuild_appstream_store (self, cancellable, &error_local))
+		g_debug ("failed to rebuild silo: %s", error_local->message);
 
 	gs_app_set_state (app, GS_APP_STATE_UNAVAILABLE);
 	return TRUE;
@@ -3378,8 +3494,8 @@ gs_flatpak_search (GsFlatpak *self,
 		return FALSE;
 
 	locker = g_rw_lock_reader_locker_new (&self->silo_lock);
-	if (!gs_appstream_search (self->plugin, self->silo, values, list_tmp,
-				  cancellable, error))
+	if (!gs_appstream_search (self->plugin, self->silo, self->index,
+				  values, list_tmp, cancellable, error))
 		return FALSE;
 
 	gs_flatpak_ensure_remote_title (self, cancellable);
@@ -3417,8 +3533,8 @@ gs_flatpak_search (GsFlatpak *self,
 			continue;
 		}
 
-		if (!gs_appstream_search (self->plugin, app_silo, values, app_list_tmp,
-					  cancellable, error))
+		if (!gs_appstream_search (self->plugin, app_silo, NULL,
+					  values, app_list_tmp, cancellable, error))
 			return FALSE;
 
 		gs_flatpak_claim_app_list (self, app_list_tmp);
@@ -3443,7 +3559,7 @@ gs_flatpak_add_category_apps (GsFlatpak *self,
 	g_autoptr(GRWLockReaderLocker) locker = NULL;
 	locker = g_rw_lock_reader_locker_new (&self->silo_lock);
 	return gs_appstream_add_category_apps (self->plugin, self->silo,
-					       category, list,
+					       self->index, category, list,
 					       cancellable, error);
 }
 
@@ -3460,7 +3576,8 @@ gs_flatpak_add_categories (GsFlatpak *self,
 
 	locker = g_rw_lock_reader_locker_new (&self->silo_lock);
 	return gs_appstream_add_categories (self->plugin, self->silo,
-					    list, cancellable, error);
+					    self->index, list,
+					    cancellable, error);
 }
 
 gboolean
@@ -3584,6 +3701,14 @@ gs_flatpak_get_installation (GsFlatpak *self)
 	return self->installation;
 }
 
+/* stops any rebuild of the silo in the background, which keeps a reference
+ * to @self so may otherwise outlive the plugin being destroyed */
+void
+gs_flatpak_cancel_rebuild (GsFlatpak *self)
+{
+	g_cancellable_cancel (self->rebuild_cancellable);
+}
+
 static void
 gs_flatpak_finalize (GObject *object)
 {
@@ -3595,8 +3720,10 @@ gs_flatpak_finalize (GObject *object)
 		g_signal_handler_disconnect (self->monitor, self->changed_id);
 		self->changed_id = 0;
 	}
+	g_clear_object (&self->index);
 	if (self->silo != NULL)
 		g_object_unref (self->silo);
+	g_object_unref (self->rebuild_cancellable);
 
 	g_free (self->id);
 	g_object_unref (self->installation);
@@ -3606,6 +3733,7 @@ gs_flatpak_finalize (GObject *object)
 	g_hash_table_unref (self->broken_remotes);
 	g_mutex_clear (&self->broken_remotes_mutex);
 	g_rw_lock_clear (&self->silo_lock);
+	g_mutex_clear (&self->rebuild_mutex);
 	g_hash_table_unref (self->app_silos);
 	g_mutex_clear (&self->app_silos_mutex);
 	g_clear_pointer (&self->remote_title, g_hash_table_unref);
@@ -3625,8 +3753,11 @@ static void
 gs_flatpak_init (GsFlatpak *self)
 {
 	/* XbSilo needs external locking as we destroy the silo and build a new
-	 * one when something changes */
+	 * one when something changes; the new one is built without holding
+	 * the lock so that readers only ever wait for the swap */
 	g_rw_lock_init (&self->silo_lock);
+	g_mutex_init (&self->rebuild_mutex);
+	self->rebuild_cancellable = g_cancellable_new ();
 
 	g_mutex_init (&self->installed_refs_mutex);
 	self->installed_refs = NULL;
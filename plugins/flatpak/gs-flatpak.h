@@ -28,6 +28,7 @@ GsFlatpak	*gs_flatpak_new			(GsPlugin		*plugin,
 						 FlatpakInstallation	*installation,
 						 GsFlatpakFlags		 flags);
 FlatpakInstallation *gs_flatpak_get_installation (GsFlatpak		*self);
+void		gs_flatpak_cancel_rebuild	(GsFlatpak		*self);
 
 GsApp	*gs_flatpak_ref_to_app (GsFlatpak *self, const gchar *ref, GCancellable *cancellable, GError **error);
 
@@ -85,6 +85,8 @@ void
 gs_plugin_destroy (GsPlugin *plugin)
 {
 	GsPluginData *priv = gs_plugin_get_data (plugin);
+	for (guint i = 0; i < priv->flatpaks->len; i++)
+		gs_flatpak_cancel_rebuild (g_ptr_array_index (priv->flatpaks, i));
 	g_ptr_array_unref (priv->flatpaks);
 }
 
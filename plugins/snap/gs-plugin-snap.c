@@ -134,6 +134,20 @@ gs_plugin_initialize (GsPlugin *plugin)
 	/* Override hardcoded popular apps */
 	gs_plugin_add_rule (plugin, GS_PLUGIN_RULE_RUN_BEFORE, "hardcoded-popular");
 
+	/* talking to snapd is only needed for these */
+	gs_plugin_add_setup_action (plugin, GS_PLUGIN_ACTION_GET_ALTERNATES);
+	gs_plugin_add_setup_action (plugin, GS_PLUGIN_ACTION_GET_CATEGORY_APPS);
+	gs_plugin_add_setup_action (plugin, GS_PLUGIN_ACTION_GET_INSTALLED);
+	gs_plugin_add_setup_action (plugin, GS_PLUGIN_ACTION_GET_POPULAR);
+	gs_plugin_add_setup_action (plugin, GS_PLUGIN_ACTION_GET_UPDATES);
+	gs_plugin_add_setup_action (plugin, GS_PLUGIN_ACTION_INSTALL);
+	gs_plugin_add_setup_action (plugin, GS_PLUGIN_ACTION_LAUNCH);
+	gs_plugin_add_setup_action (plugin, GS_PLUGIN_ACTION_REFINE);
+	gs_plugin_add_setup_action (plugin, GS_PLUGIN_ACTION_REMOVE);
+	gs_plugin_add_setup_action (plugin, GS_PLUGIN_ACTION_SEARCH);
+	gs_plugin_add_setup_action (plugin, GS_PLUGIN_ACTION_UPDATE);
+	gs_plugin_add_setup_action (plugin, GS_PLUGIN_ACTION_URL_TO_APP);
+
 	/* set name of MetaInfo file */
 	gs_plugin_set_appstream_id (plugin, "org.gnome.Software.Plugin.Snap");
 }
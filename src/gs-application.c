@@ -52,6 +52,7 @@ struct _GsApplication {
 	GsDbusHelper	*dbus_helper;
 #endif
 	GsShellSearchProvider *search_provider;  /* (nullable) (owned) */
+	guint		 stats_registration_id;
 	GSettings       *settings;
 	GSimpleActionGroup	*action_map;
 	guint		 shell_loaded_handler_id;
@@ -204,6 +205,47 @@ gs_application_initialize_plugins (GsApplication *app)
 
 }
 
+static const gchar gs_application_stats_xml[] =
+	"<node>"
+	"  <interface name='org.gnome.Software.Stats'>"
+	"    <method name='GetPluginStats'>"
+	"      <arg type='a(ssuuuuuu)' name='stats' direction='out'/>"
+	"    </method>"
+	"  </interface>"
+	"</node>";
+
+static void
+gs_application_stats_method_call (GDBusConnection       *connection,
+                                  const gchar           *sender,
+                                  const gchar           *object_path,
+                                  const gchar           *interface_name,
+                                  const gchar           *method_name,
+                                  GVariant              *parameters,
+                                  GDBusMethodInvocation *invocation,
+                                  gpointer               user_data)
+{
+	GsApplication *app = GS_APPLICATION (user_data);
+	g_autoptr(GVariant) stats = NULL;
+
+	/* the plugin loader is only created on startup */
+	if (app->plugin_loader == NULL) {
+		g_dbus_method_invocation_return_error_literal (invocation,
+							       G_DBUS_ERROR,
+							       G_DBUS_ERROR_FAILED,
+							       "Plugins not loaded");
+		return;
+	}
+	stats = gs_plugin_loader_get_stats (app->plugin_loader);
+	g_dbus_method_invocation_return_value (invocation,
+					       g_variant_new_tuple (&stats, 1));
+}
+
+static const GDBusInterfaceVTable gs_application_stats_vtable = {
+	gs_application_stats_method_call,
+	NULL,
+	NULL,
+};
+
 static gboolean
 gs_application_dbus_register (GApplication    *application,
                               GDBusConnection *connection,
@@ -211,6 +253,20 @@ gs_application_dbus_register (GApplication    *application,
                               GError         **error)
 {
 	GsApplication *app = GS_APPLICATION (application);
+	g_autoptr(GDBusNodeInfo) info = NULL;
+
+	info = g_dbus_node_info_new_for_xml (gs_application_stats_xml, error);
+	if (info == NULL)
+		return FALSE;
+	app->stats_registration_id = g_dbus_connection_register_object (connection,
+									object_path,
+									info->interfaces[0],
+									&gs_application_stats_vtable,
+									app, NULL,
+									error);
+	if (app->stats_registration_id == 0)
+		return FALSE;
+
 	app->search_provider = gs_shell_search_provider_new ();
 	return gs_shell_search_provider_register (app->search_provider, connection, error);
 }
@@ -226,6 +282,10 @@ gs_application_dbus_unregister (GApplication    *application,
 		gs_shell_search_provider_unregister (app->search_provider);
 		g_clear_object (&app->search_provider);
 	}
+	if (app->stats_registration_id != 0) {
+		g_dbus_connection_unregister_object (connection, app->stats_registration_id);
+		app->stats_registration_id = 0;
+	}
 }
 
 static void
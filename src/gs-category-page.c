@@ -131,6 +131,7 @@ gs_category_page_get_apps_cb (GObject *source_object,
 	GsPluginLoader *plugin_loader = GS_PLUGIN_LOADER (source_object);
 	g_autoptr(GError) error = NULL;
 	g_autoptr(GsAppList) list = NULL;
+	g_autoptr(GPtrArray) apps = NULL;
 
 	/* show an empty space for no results */
 	gs_container_remove_all (GTK_CONTAINER (self->category_detail_box));
@@ -144,8 +145,9 @@ gs_category_page_get_apps_cb (GObject *source_object,
 		return;
 	}
 
-	for (i = 0; i < gs_app_list_length (list); i++) {
-		app = gs_app_list_index (list, i);
+	apps = gs_app_list_snapshot (list);
+	for (i = 0; i < apps->len; i++) {
+		app = g_ptr_array_index (apps, i);
 		if (g_strcmp0 (gs_category_get_id (self->category), "addons") == 0) {
 			tile = make_addon_tile_for_category (app, self->subcategory);
 		} else {
@@ -793,6 +793,7 @@ gs_details_page_get_alternates_cb (GObject *source_object,
 	GsPluginLoader *plugin_loader = GS_PLUGIN_LOADER (source_object);
 	g_autoptr(GError) error = NULL;
 	g_autoptr(GsAppList) list = NULL;
+	g_autoptr(GPtrArray) apps = NULL;
 	GtkWidget *origin_box;
 	GtkWidget *origin_button_label;
 	GtkWidget *origin_popover_list_box;
@@ -831,8 +832,9 @@ gs_details_page_get_alternates_cb (GObject *source_object,
 		return;
 	}
 
-	for (guint i = 0; i < gs_app_list_length (list); i++) {
-		GsApp *app = gs_app_list_index (list, i);
+	apps = gs_app_list_snapshot (list);
+	for (guint i = 0; i < apps->len; i++) {
+		GsApp *app = g_ptr_array_index (apps, i);
 		GtkWidget *row = gs_origin_popover_row_new (app);
 		gtk_widget_show (row);
 		if (app == self->app)
@@ -1502,17 +1504,17 @@ static void gs_details_page_addon_remove_cb (GsAppAddonRow *row, gpointer user_d
 static void
 gs_details_page_refresh_addons (GsDetailsPage *self)
 {
-	GsAppList *addons;
 	guint i;
+	g_autoptr(GPtrArray) addons = NULL;
 
 	gs_container_remove_all (GTK_CONTAINER (self->list_box_addons));
 
-	addons = gs_app_get_addons (self->app);
-	for (i = 0; i < gs_app_list_length (addons); i++) {
+	addons = gs_app_list_snapshot (gs_app_get_addons (self->app));
+	for (i = 0; i < addons->len; i++) {
 		GsApp *addon;
 		GtkWidget *row;
 
-		addon = gs_app_list_index (addons, i);
+		addon = g_ptr_array_index (addons, i);
 		if (gs_app_get_state (addon) == GS_APP_STATE_UNKNOWN ||
 		    gs_app_get_state (addon) == GS_APP_STATE_UNAVAILABLE)
 			continue;
@@ -2383,14 +2385,14 @@ static void
 gs_details_page_app_installed (GsPage *page, GsApp *app)
 {
 	GsDetailsPage *self = GS_DETAILS_PAGE (page);
-	GsAppList *addons;
 	guint i;
+	g_autoptr(GPtrArray) addons = NULL;
 
 	/* if the app is just an addon, no need for a full refresh */
-	addons = gs_app_get_addons (self->app);
-	for (i = 0; i < gs_app_list_length (addons); i++) {
+	addons = gs_app_list_snapshot (gs_app_get_addons (self->app));
+	for (i = 0; i < addons->len; i++) {
 		GsApp *addon;
-		addon = gs_app_list_index (addons, i);
+		addon = g_ptr_array_index (addons, i);
 		if (addon == app)
 			return;
 	}
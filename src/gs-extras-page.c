@@ -11,6 +11,7 @@
 
 #include "gs-extras-page.h"
 
+#include "gs-app-private.h"
 #include "gs-app-row.h"
 #include "gs-application.h"
 #include "gs-language.h"
@@ -554,6 +555,7 @@ search_files_cb (GObject *source_object,
 	SearchData *search_data = (SearchData *) user_data;
 	GsExtrasPage *self = search_data->self;
 	g_autoptr(GsAppList) list = NULL;
+	g_autoptr(GPtrArray) apps = NULL;
 	guint i;
 	GsPluginLoader *plugin_loader = GS_PLUGIN_LOADER (source_object);
 	g_autoptr(GError) error = NULL;
@@ -581,8 +583,9 @@ search_files_cb (GObject *source_object,
 		gs_app_list_add (list, app);
 	}
 
-	for (i = 0; i < gs_app_list_length (list); i++) {
-		GsApp *app = gs_app_list_index (list, i);
+	apps = gs_app_list_snapshot (list);
+	for (i = 0; i < apps->len; i++) {
+		GsApp *app = g_ptr_array_index (apps, i);
 
 		g_debug ("%s\n\n", gs_app_to_string (app));
 		gs_extras_page_add_app (self, app, list, search_data);
@@ -649,6 +652,7 @@ get_search_what_provides_cb (GObject *source_object,
 	SearchData *search_data = (SearchData *) user_data;
 	GsExtrasPage *self = search_data->self;
 	g_autoptr(GsAppList) list = NULL;
+	g_autoptr(GPtrArray) apps = NULL;
 	guint i;
 	GsPluginLoader *plugin_loader = GS_PLUGIN_LOADER (source_object);
 	g_autoptr(GError) error = NULL;
@@ -676,8 +680,9 @@ get_search_what_provides_cb (GObject *source_object,
 		gs_app_list_add (list, app);
 	}
 
-	for (i = 0; i < gs_app_list_length (list); i++) {
-		GsApp *app = gs_app_list_index (list, i);
+	apps = gs_app_list_snapshot (list);
+	for (i = 0; i < apps->len; i++) {
+		GsApp *app = g_ptr_array_index (apps, i);
 
 		g_debug ("%s\n\n", gs_app_to_string (app));
 		gs_extras_page_add_app (self, app, list, search_data);
@@ -1118,33 +1123,6 @@ row_activated_cb (GtkListBox *list_box,
 	}
 }
 
-static gchar *
-get_app_sort_key (GsApp *app)
-{
-	GString *key = NULL;
-	g_autofree gchar *sort_name = NULL;
-
-	key = g_string_sized_new (64);
-
-	/* sort missing applications as last */
-	switch (gs_app_get_state (app)) {
-	case GS_APP_STATE_UNAVAILABLE:
-		g_string_append (key, "9:");
-		break;
-	default:
-		g_string_append (key, "1:");
-		break;
-	}
-
-	/* finally, sort by short name */
-	if (gs_app_get_name (app) != NULL) {
-		sort_name = gs_utils_sort_key (gs_app_get_name (app));
-		g_string_append (key, sort_name);
-	}
-
-	return g_string_free (key, FALSE);
-}
-
 static gint
 list_sort_func (GtkListBoxRow *a,
                 GtkListBoxRow *b,
@@ -1152,11 +1130,16 @@ list_sort_func (GtkListBoxRow *a,
 {
 	GsApp *a1 = gs_app_row_get_app (GS_APP_ROW (a));
 	GsApp *a2 = gs_app_row_get_app (GS_APP_ROW (b));
-	g_autofree gchar *key1 = get_app_sort_key (a1);
-	g_autofree gchar *key2 = get_app_sort_key (a2);
+	gboolean missing1 = gs_app_get_state (a1) == GS_APP_STATE_UNAVAILABLE;
+	gboolean missing2 = gs_app_get_state (a2) == GS_APP_STATE_UNAVAILABLE;
+
+	/* sort missing applications as last */
+	if (missing1 != missing2)
+		return missing1 ? 1 : -1;
 
-	/* compare the keys according to the algorithm above */
-	return g_strcmp0 (key1, key2);
+	/* finally, sort by short name */
+	return g_strcmp0 (gs_app_get_name_sort_key (a1),
+			  gs_app_get_name_sort_key (a2));
 }
 
 static void
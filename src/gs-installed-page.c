@@ -13,6 +13,7 @@
 #include <string.h>
 #include <glib/gi18n.h>
 
+#include "gs-app-private.h"
 #include "gs-shell.h"
 #include "gs-installed-page.h"
 #include "gs-common.h"
@@ -193,6 +194,7 @@ gs_installed_page_get_installed_cb (GObject *source_object,
 	GsPluginLoader *plugin_loader = GS_PLUGIN_LOADER (source_object);
 	g_autoptr(GError) error = NULL;
 	g_autoptr(GsAppList) list = NULL;
+	g_autoptr(GPtrArray) apps = NULL;
 
 	gs_stop_spinner (GTK_SPINNER (self->spinner_install));
 	gtk_stack_set_visible_child_name (GTK_STACK (self->stack_install), "view");
@@ -208,8 +210,9 @@ gs_installed_page_get_installed_cb (GObject *source_object,
 			g_warning ("failed to get installed apps: %s", error->message);
 		goto out;
 	}
-	for (i = 0; i < gs_app_list_length (list); i++) {
-		app = gs_app_list_index (list, i);
+	apps = gs_app_list_snapshot (list);
+	for (i = 0; i < apps->len; i++) {
+		app = g_ptr_array_index (apps, i);
 		gs_installed_page_add_app (self, list, app);
 	}
 out:
@@ -300,9 +303,9 @@ gs_installed_page_switch_to (GsPage *page, gboolean scroll_up)
 }
 
 /**
- * gs_installed_page_get_app_sort_key:
+ * gs_installed_page_get_app_sort_rank:
  *
- * Get a sort key to achive this:
+ * Get a sort rank to achive this:
  *
  * 1. state:installing applications
  * 2. state: applications queued for installing
@@ -311,76 +314,69 @@ gs_installed_page_switch_to (GsPage *page, gboolean scroll_up)
  * 5. kind:system applications
  *
  * Within each of these groups, they are sorted by the install date and then
- * by name.
+ * by name, using the collation key cached on the app.
  **/
-static gchar *
-gs_installed_page_get_app_sort_key (GsApp *app)
+static guint
+gs_installed_page_get_app_sort_rank (GsApp *app)
 {
-	GString *key;
-	g_autofree gchar *sort_name = NULL;
-
-	key = g_string_sized_new (64);
+	guint rank;
 
 	/* sort installed, removing, other */
 	switch (gs_app_get_state (app)) {
 	case GS_APP_STATE_INSTALLING:
-		g_string_append (key, "1:");
+		rank = 1;
 		break;
 	case GS_APP_STATE_QUEUED_FOR_INSTALL:
-		g_string_append (key, "2:");
+		rank = 2;
 		break;
 	case GS_APP_STATE_REMOVING:
-		g_string_append (key, "3:");
+		rank = 3;
 		break;
 	default:
-		g_string_append (key, "4:");
+		rank = 4;
 		break;
 	}
 
 	/* sort apps by kind */
+	rank *= 10;
 	switch (gs_app_get_kind (app)) {
 	case AS_COMPONENT_KIND_DESKTOP_APP:
-		g_string_append (key, "2:");
+		rank += 2;
 		break;
 	case AS_COMPONENT_KIND_WEB_APP:
-		g_string_append (key, "3:");
+		rank += 3;
 		break;
 	case AS_COMPONENT_KIND_RUNTIME:
-		g_string_append (key, "4:");
+		rank += 4;
 		break;
 	case AS_COMPONENT_KIND_ADDON:
-		g_string_append (key, "5:");
+		rank += 5;
 		break;
 	case AS_COMPONENT_KIND_CODEC:
-		g_string_append (key, "6:");
+		rank += 6;
 		break;
 	case AS_COMPONENT_KIND_FONT:
-		g_string_append (key, "6:");
+		rank += 6;
 		break;
 	case AS_COMPONENT_KIND_INPUT_METHOD:
-		g_string_append (key, "7:");
+		rank += 7;
 		break;
 	default:
 		if (gs_app_get_special_kind (app) == GS_APP_SPECIAL_KIND_OS_UPDATE)
-			g_string_append (key, "1:");
+			rank += 1;
 		else
-			g_string_append (key, "8:");
+			rank += 8;
 		break;
 	}
 
 	/* sort normal, compulsory */
+	rank *= 10;
 	if (!gs_app_has_quirk (app, GS_APP_QUIRK_COMPULSORY))
-		g_string_append (key, "1:");
+		rank += 1;
 	else
-		g_string_append (key, "2:");
-
-	/* finally, sort by short name */
-	if (gs_app_get_name (app) != NULL) {
-		sort_name = gs_utils_sort_key (gs_app_get_name (app));
-		g_string_append (key, sort_name);
-	}
+		rank += 2;
 
-	return g_string_free (key, FALSE);
+	return rank;
 }
 
 static gint
@@ -389,8 +385,7 @@ gs_installed_page_sort_func (GtkListBoxRow *a,
                              gpointer user_data)
 {
 	GsApp *a1, *a2;
-	g_autofree gchar *key1 = NULL;
-	g_autofree gchar *key2 = NULL;
+	guint rank1, rank2;
 
 	/* check valid */
 	if (!GTK_IS_BIN(a) || !GTK_IS_BIN(b)) {
@@ -400,11 +395,16 @@ gs_installed_page_sort_func (GtkListBoxRow *a,
 
 	a1 = gs_app_row_get_app (GS_APP_ROW (a));
 	a2 = gs_app_row_get_app (GS_APP_ROW (b));
-	key1 = gs_installed_page_get_app_sort_key (a1);
-	key2 = gs_installed_page_get_app_sort_key (a2);
+	rank1 = gs_installed_page_get_app_sort_rank (a1);
+	rank2 = gs_installed_page_get_app_sort_rank (a2);
+
+	/* compare the ranks according to the algorithm above */
+	if (rank1 != rank2)
+		return rank1 < rank2 ? -1 : 1;
 
-	/* compare the keys according to the algorithm above */
-	return g_strcmp0 (key1, key2);
+	/* finally, sort by short name */
+	return g_strcmp0 (gs_app_get_name_sort_key (a1),
+			  gs_app_get_name_sort_key (a2));
 }
 
 typedef enum {
@@ -507,11 +507,13 @@ gs_installed_page_pending_apps_changed_cb (GsPluginLoader *plugin_loader,
 	guint i;
 	guint cnt = 0;
 	g_autoptr(GsAppList) pending = NULL;
+	g_autoptr(GPtrArray) apps = NULL;
 
 	/* add new apps to the list */
 	pending = gs_plugin_loader_get_pending (plugin_loader);
-	for (i = 0; i < gs_app_list_length (pending); i++) {
-		app = gs_app_list_index (pending, i);
+	apps = gs_app_list_snapshot (pending);
+	for (i = 0; i < apps->len; i++) {
+		app = g_ptr_array_index (apps, i);
 
 		/* never show OS upgrades, we handle the scheduling and
 		 * cancellation in GsUpgradeBanner */
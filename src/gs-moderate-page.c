@@ -170,6 +170,7 @@ gs_moderate_page_get_unvoted_reviews_cb (GObject *source_object,
 	GsPluginLoader *plugin_loader = GS_PLUGIN_LOADER (source_object);
 	g_autoptr(GError) error = NULL;
 	g_autoptr(GsAppList) list = NULL;
+	g_autoptr(GPtrArray) apps = NULL;
 
 	gs_stop_spinner (GTK_SPINNER (self->spinner_install));
 	gtk_stack_set_visible_child_name (GTK_STACK (self->stack_install), "view");
@@ -190,8 +191,9 @@ gs_moderate_page_get_unvoted_reviews_cb (GObject *source_object,
 		return;
 	}
 
-	for (i = 0; i < gs_app_list_length (list); i++) {
-		app = gs_app_list_index (list, i);
+	apps = gs_app_list_snapshot (list);
+	for (i = 0; i < apps->len; i++) {
+		app = g_ptr_array_index (apps, i);
 		gs_moderate_page_add_app (self, app);
 	}
 }
@@ -157,6 +157,7 @@ gs_overview_page_get_popular_cb (GObject *source_object,
 	GtkWidget *tile;
 	g_autoptr(GError) error = NULL;
 	g_autoptr(GsAppList) list = NULL;
+	g_autoptr(GPtrArray) apps = NULL;
 
 	/* get popular apps */
 	list = gs_plugin_loader_job_process_finish (plugin_loader, res, &error);
@@ -181,8 +182,9 @@ gs_overview_page_get_popular_cb (GObject *source_object,
 
 	gs_container_remove_all (GTK_CONTAINER (priv->box_popular));
 
-	for (i = 0; i < gs_app_list_length (list) && i < N_TILES; i++) {
-		app = gs_app_list_index (list, i);
+	apps = gs_app_list_snapshot (list);
+	for (i = 0; i < apps->len && i < N_TILES; i++) {
+		app = g_ptr_array_index (apps, i);
 		tile = gs_popular_tile_new (app);
 		g_signal_connect (tile, "clicked",
 			  G_CALLBACK (app_tile_clicked), self);
@@ -208,6 +210,7 @@ gs_overview_page_get_recent_cb (GObject *source_object, GAsyncResult *res, gpoin
 	GtkWidget *tile;
 	g_autoptr(GError) error = NULL;
 	g_autoptr(GsAppList) list = NULL;
+	g_autoptr(GPtrArray) apps = NULL;
 
 	/* get recent apps */
 	list = gs_plugin_loader_job_process_finish (plugin_loader, res, &error);
@@ -232,8 +235,9 @@ gs_overview_page_get_recent_cb (GObject *source_object, GAsyncResult *res, gpoin
 
 	gs_container_remove_all (GTK_CONTAINER (priv->box_recent));
 
-	for (i = 0; i < gs_app_list_length (list) && i < N_TILES; i++) {
-		app = gs_app_list_index (list, i);
+	apps = gs_app_list_snapshot (list);
+	for (i = 0; i < apps->len && i < N_TILES; i++) {
+		app = g_ptr_array_index (apps, i);
 		tile = gs_popular_tile_new (app);
 		g_signal_connect (tile, "clicked",
 			  G_CALLBACK (app_tile_clicked), self);
@@ -282,6 +286,7 @@ gs_overview_page_get_category_apps_cb (GObject *source_object,
 	GtkWidget *tile;
 	g_autoptr(GError) error = NULL;
 	g_autoptr(GsAppList) list = NULL;
+	g_autoptr(GPtrArray) apps = NULL;
 
 	/* get popular apps */
 	list = gs_plugin_loader_job_process_finish (plugin_loader, res, &error);
@@ -339,8 +344,9 @@ gs_overview_page_get_category_apps_cb (GObject *source_object,
 	gtk_container_add (GTK_CONTAINER (priv->box_popular_rotating), box);
 
 	/* add all the apps */
-	for (i = 0; i < gs_app_list_length (list) && i < N_TILES; i++) {
-		app = gs_app_list_index (list, i);
+	apps = gs_app_list_snapshot (list);
+	for (i = 0; i < apps->len && i < N_TILES; i++) {
+		app = g_ptr_array_index (apps, i);
 		tile = gs_popular_tile_new (app);
 		g_signal_connect (tile, "clicked",
 			  G_CALLBACK (app_tile_clicked), self);
@@ -638,7 +644,8 @@ gs_overview_page_load (GsOverviewPage *self)
 		priv->loading_featured = TRUE;
 		plugin_job = gs_plugin_job_newv (GS_PLUGIN_ACTION_GET_FEATURED,
 						 "max-results", 5,
-						 "refine-flags", GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON,
+						 "refine-flags", GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON |
+								 GS_PLUGIN_REFINE_FLAGS_REQUIRE_KEY_COLORS,
 						 "dedupe-flags", GS_APP_LIST_FILTER_FLAG_PREFER_INSTALLED |
 								 GS_APP_LIST_FILTER_FLAG_KEY_ID_PROVIDES,
 						 NULL);
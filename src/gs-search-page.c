@@ -37,6 +37,7 @@ struct _GsSearchPage
 	guint			 waiting_id;
 	guint			 max_results;
 	gboolean		 changed;
+	gboolean		 got_batch;
 
 	GtkWidget		*list_box_search;
 	GtkWidget		*scrolledwindow_search;
@@ -77,6 +78,48 @@ gs_search_page_waiting_cancel (GsSearchPage *self)
 	self->waiting_id = 0;
 }
 
+static void
+gs_search_page_add_app_row (GsSearchPage *self, GsApp *app)
+{
+	GtkWidget *app_row;
+
+	app_row = gs_app_row_new (app);
+	gs_app_row_set_show_rating (GS_APP_ROW (app_row), TRUE);
+	g_signal_connect (app_row, "button-clicked",
+			  G_CALLBACK (gs_search_page_app_row_clicked_cb),
+			  self);
+	gtk_container_add (GTK_CONTAINER (self->list_box_search), app_row);
+	gs_app_row_set_size_groups (GS_APP_ROW (app_row),
+				    self->sizegroup_image,
+				    self->sizegroup_name,
+				    self->sizegroup_desc,
+				    self->sizegroup_button);
+	gtk_widget_show (app_row);
+}
+
+static void
+gs_search_page_get_search_batch_cb (GsPluginLoader *plugin_loader,
+				    GsAppList *list,
+				    gpointer user_data)
+{
+	GsSearchPage *self = GS_SEARCH_PAGE (user_data);
+	g_autoptr(GPtrArray) apps = NULL;
+
+	/* the first results replace the old ones and the spinner */
+	if (!self->got_batch) {
+		self->got_batch = TRUE;
+		gs_search_page_waiting_cancel (self);
+		gs_container_remove_all (GTK_CONTAINER (self->list_box_search));
+		gs_stop_spinner (GTK_SPINNER (self->spinner_search));
+		gtk_stack_set_visible_child_name (GTK_STACK (self->stack_search), "results");
+	}
+
+	/* the complete results are shown in order when the search finishes */
+	apps = gs_app_list_snapshot (list);
+	for (guint i = 0; i < apps->len; i++)
+		gs_search_page_add_app_row (self, g_ptr_array_index (apps, i));
+}
+
 static void
 gs_search_page_get_search_cb (GObject *source_object,
                               GAsyncResult *res,
@@ -86,9 +129,9 @@ gs_search_page_get_search_cb (GObject *source_object,
 	GsApp *app;
 	GsSearchPage *self = GS_SEARCH_PAGE (user_data);
 	GsPluginLoader *plugin_loader = GS_PLUGIN_LOADER (source_object);
-	GtkWidget *app_row;
 	g_autoptr(GError) error = NULL;
 	g_autoptr(GsAppList) list = NULL;
+	g_autoptr(GPtrArray) apps = NULL;
 
 	/* don't do the delayed spinner */
 	gs_search_page_waiting_cancel (self);
@@ -105,6 +148,9 @@ gs_search_page_get_search_cb (GObject *source_object,
 		return;
 	}
 
+	/* remove old entries, including any rows streamed in by the batches */
+	gs_container_remove_all (GTK_CONTAINER (self->list_box_search));
+
 	/* no results */
 	if (gs_app_list_length (list) == 0) {
 		g_debug ("no search results to show");
@@ -112,25 +158,12 @@ gs_search_page_get_search_cb (GObject *source_object,
 		return;
 	}
 
-	/* remove old entries */
-	gs_container_remove_all (GTK_CONTAINER (self->list_box_search));
-
 	gs_stop_spinner (GTK_SPINNER (self->spinner_search));
 	gtk_stack_set_visible_child_name (GTK_STACK (self->stack_search), "results");
-	for (i = 0; i < gs_app_list_length (list); i++) {
-		app = gs_app_list_index (list, i);
-		app_row = gs_app_row_new (app);
-		gs_app_row_set_show_rating (GS_APP_ROW (app_row), TRUE);
-		g_signal_connect (app_row, "button-clicked",
-				  G_CALLBACK (gs_search_page_app_row_clicked_cb),
-				  self);
-		gtk_container_add (GTK_CONTAINER (self->list_box_search), app_row);
-		gs_app_row_set_size_groups (GS_APP_ROW (app_row),
-					    self->sizegroup_image,
-					    self->sizegroup_name,
-					    self->sizegroup_desc,
-					    self->sizegroup_button);
-		gtk_widget_show (app_row);
+	apps = gs_app_list_snapshot (list);
+	for (i = 0; i < apps->len; i++) {
+		app = g_ptr_array_index (apps, i);
+		gs_search_page_add_app_row (self, app);
 	}
 
 	/* too many results */
@@ -187,51 +220,37 @@ gs_search_page_waiting_show_cb (gpointer user_data)
 	return FALSE;
 }
 
-static gchar *
-gs_search_page_get_app_sort_key (GsApp *app)
+/* keys sort in ascending order, so values are inverted to put the best
+ * matches first; multi-byte values are stored big-endian */
+static void
+gs_search_page_get_app_sort_key (GsApp *app, GByteArray *key, gpointer user_data)
 {
-	GString *key = g_string_sized_new (64);
+	guint8 buf[4];
+	guint32 match_value;
+	gint rating;
 
 	/* sort apps before runtimes and extensions */
-	switch (gs_app_get_kind (app)) {
-	case AS_COMPONENT_KIND_DESKTOP_APP:
-		g_string_append (key, "9:");
-		break;
-	default:
-		g_string_append (key, "1:");
-		break;
-	}
+	buf[0] = gs_app_get_kind (app) == AS_COMPONENT_KIND_DESKTOP_APP ? 0 : 1;
 
 	/* sort missing codecs before applications */
-	switch (gs_app_get_state (app)) {
-	case GS_APP_STATE_UNAVAILABLE:
-		g_string_append (key, "9:");
-		break;
-	default:
-		g_string_append (key, "1:");
-		break;
-	}
+	buf[1] = gs_app_get_state (app) == GS_APP_STATE_UNAVAILABLE ? 0 : 1;
+	g_byte_array_append (key, buf, 2);
 
 	/* sort by the search key */
-	g_string_append_printf (key, "%05x:", gs_app_get_match_value (app));
+	match_value = G_MAXUINT32 - gs_app_get_match_value (app);
+	buf[0] = match_value >> 24;
+	buf[1] = match_value >> 16;
+	buf[2] = match_value >> 8;
+	buf[3] = match_value;
+	g_byte_array_append (key, buf, 4);
 
-	/* sort by rating */
-	g_string_append_printf (key, "%03i:", gs_app_get_rating (app));
+	/* sort by rating, with unknown ratings (-1) last */
+	rating = CLAMP (gs_app_get_rating (app), -1, 100);
+	buf[0] = 100 - rating;
 
 	/* sort by kudos */
-	g_string_append_printf (key, "%03u:", gs_app_get_kudos_percentage (app));
-
-	return g_string_free (key, FALSE);
-}
-
-static gboolean
-gs_search_page_sort_cb (GsApp *app1, GsApp *app2, gpointer user_data)
-{
-	g_autofree gchar *key1 = NULL;
-	g_autofree gchar *key2 = NULL;
-	key1 = gs_search_page_get_app_sort_key (app1);
-	key2 = gs_search_page_get_app_sort_key (app2);
-	return g_strcmp0 (key2, key1);
+	buf[1] = 100 - MIN (gs_app_get_kudos_percentage (app), 100);
+	g_byte_array_append (key, buf, 2);
 }
 
 static void
@@ -245,6 +264,7 @@ gs_search_page_load (GsSearchPage *self)
 	g_cancellable_cancel (self->search_cancellable);
 	g_clear_object (&self->search_cancellable);
 	self->search_cancellable = g_cancellable_new ();
+	self->got_batch = FALSE;
 
 	/* search for apps */
 	gs_search_page_waiting_cancel (self);
@@ -265,12 +285,14 @@ gs_search_page_load (GsSearchPage *self)
 					 "dedupe-flags", GS_APP_LIST_FILTER_FLAG_PREFER_INSTALLED |
 							 GS_APP_LIST_FILTER_FLAG_KEY_ID_PROVIDES,
 					 NULL);
-	gs_plugin_job_set_sort_func (plugin_job, gs_search_page_sort_cb);
+	gs_plugin_job_set_sort_key_func (plugin_job, gs_search_page_get_app_sort_key);
 	gs_plugin_job_set_sort_func_data (plugin_job, self);
-	gs_plugin_loader_job_process_async (self->plugin_loader, plugin_job,
-					    self->search_cancellable,
-					    gs_search_page_get_search_cb,
-					    self);
+	gs_plugin_loader_job_process_streaming_async (self->plugin_loader, plugin_job,
+						      self->search_cancellable,
+						      gs_search_page_get_search_batch_cb,
+						      self,
+						      gs_search_page_get_search_cb,
+						      self);
 }
 
 static void
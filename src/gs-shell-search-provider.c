@@ -69,6 +69,7 @@ search_done_cb (GObject *source,
 	guint i;
 	GVariantBuilder builder;
 	g_autoptr(GsAppList) list = NULL;
+	g_autoptr(GPtrArray) apps = NULL;
 
 	/* cache no longer valid */
 	gs_app_list_remove_all (self->search_results);
@@ -85,8 +86,9 @@ search_done_cb (GObject *source,
 	gs_app_list_sort (list, search_sort_by_kudo_cb, NULL);
 
 	g_variant_builder_init (&builder, G_VARIANT_TYPE ("as"));
-	for (i = 0; i < gs_app_list_length (list); i++) {
-		GsApp *app = gs_app_list_index (list, i);
+	apps = gs_app_list_snapshot (list);
+	for (i = 0; i < apps->len; i++) {
+		GsApp *app = g_ptr_array_index (apps, i);
 		if (gs_app_get_state (app) != GS_APP_STATE_AVAILABLE)
 			continue;
 		g_variant_builder_add (&builder, "s", gs_app_get_unique_id (app));
@@ -100,48 +102,37 @@ search_done_cb (GObject *source,
 	g_application_release (g_application_get_default ());
 }
 
-static gchar *
-gs_shell_search_provider_get_app_sort_key (GsApp *app)
+/* keys sort in ascending order, so every value is inverted to get the
+ * descending order we want */
+static void
+gs_shell_search_provider_get_app_sort_key (GsApp *app, GByteArray *key, gpointer user_data)
 {
-	GString *key = g_string_sized_new (64);
+	const gchar *unique_id = gs_app_get_unique_id (app);
+	guint8 buf[4];
+	guint32 match_value;
 
 	/* sort available apps before installed ones */
-	switch (gs_app_get_state (app)) {
-	case GS_APP_STATE_AVAILABLE:
-		g_string_append (key, "9:");
-		break;
-	default:
-		g_string_append (key, "1:");
-		break;
-	}
+	buf[0] = gs_app_get_state (app) == GS_APP_STATE_AVAILABLE ? 0 : 1;
 
 	/* sort apps before runtimes and extensions */
-	switch (gs_app_get_kind (app)) {
-	case AS_COMPONENT_KIND_DESKTOP_APP:
-		g_string_append (key, "9:");
-		break;
-	default:
-		g_string_append (key, "1:");
-		break;
-	}
+	buf[1] = gs_app_get_kind (app) == AS_COMPONENT_KIND_DESKTOP_APP ? 0 : 1;
+	g_byte_array_append (key, buf, 2);
 
 	/* sort by the search key */
-	g_string_append_printf (key, "%05x:", gs_app_get_match_value (app));
-
-	/* tie-break with id */
-	g_string_append (key, gs_app_get_unique_id (app));
-
-	return g_string_free (key, FALSE);
-}
-
-static gboolean
-gs_shell_search_provider_sort_cb (GsApp *app1, GsApp *app2, gpointer user_data)
-{
-	g_autofree gchar *key1 = NULL;
-	g_autofree gchar *key2 = NULL;
-	key1 = gs_shell_search_provider_get_app_sort_key (app1);
-	key2 = gs_shell_search_provider_get_app_sort_key (app2);
-	return g_strcmp0 (key2, key1);
+	match_value = G_MAXUINT32 - gs_app_get_match_value (app);
+	buf[0] = match_value >> 24;
+	buf[1] = match_value >> 16;
+	buf[2] = match_value >> 8;
+	buf[3] = match_value;
+	g_byte_array_append (key, buf, 4);
+
+	/* tie-break with id, terminated so that prefixes sort last */
+	for (gsize i = 0; unique_id != NULL && unique_id[i] != '\0'; i++) {
+		buf[0] = G_MAXUINT8 - (guint8) unique_id[i];
+		g_byte_array_append (key, buf, 1);
+	}
+	buf[0] = G_MAXUINT8;
+	g_byte_array_append (key, buf, 1);
 }
 
 static void
@@ -180,7 +171,7 @@ execute_search (GsShellSearchProvider  *self,
 					 "dedupe-flags", GS_APP_LIST_FILTER_FLAG_PREFER_INSTALLED |
 							 GS_APP_LIST_FILTER_FLAG_KEY_ID_PROVIDES,
 					 NULL);
-	gs_plugin_job_set_sort_func (plugin_job, gs_shell_search_provider_sort_cb);
+	gs_plugin_job_set_sort_key_func (plugin_job, gs_shell_search_provider_get_app_sort_key);
 	gs_plugin_job_set_sort_func_data (plugin_job, self);
 	gs_plugin_loader_job_process_async (self->plugin_loader, plugin_job,
 					    self->cancellable,
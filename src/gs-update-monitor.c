@@ -435,6 +435,7 @@ download_finished_cb (GObject *object, GAsyncResult *res, gpointer data)
 	g_autoptr(GsAppList) list = NULL;
 	g_autoptr(GsAppList) update_online = NULL;
 	g_autoptr(GsAppList) update_offline = NULL;
+	g_autoptr(GPtrArray) apps = NULL;
 
 	/* get result */
 	list = gs_plugin_loader_job_process_finish (GS_PLUGIN_LOADER (object), res, &error);
@@ -446,8 +447,9 @@ download_finished_cb (GObject *object, GAsyncResult *res, gpointer data)
 
 	update_online = gs_app_list_new ();
 	update_offline = gs_app_list_new ();
-	for (guint i = 0; i < gs_app_list_length (list); i++) {
-		GsApp *app = gs_app_list_index (list, i);
+	apps = gs_app_list_snapshot (list);
+	for (guint i = 0; i < apps->len; i++) {
+		GsApp *app = g_ptr_array_index (apps, i);
 		if (_should_auto_update (app)) {
 			g_debug ("auto-updating %s", gs_app_get_unique_id (app));
 			gs_app_list_add (update_online, app);
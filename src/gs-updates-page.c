@@ -159,10 +159,11 @@ static guint
 _get_num_updates (GsUpdatesPage *self)
 {
 	guint count = 0;
-	g_autoptr(GsAppList) apps = _get_all_apps (self);
+	g_autoptr(GsAppList) list = _get_all_apps (self);
+	g_autoptr(GPtrArray) apps = gs_app_list_snapshot (list);
 
-	for (guint i = 0; i < gs_app_list_length (apps); ++i) {
-		GsApp *app = gs_app_list_index (apps, i);
+	for (guint i = 0; i < apps->len; ++i) {
+		GsApp *app = g_ptr_array_index (apps, i);
 		if (gs_app_is_updatable (app) ||
 		    gs_app_get_state (app) == GS_APP_STATE_INSTALLING)
 			++count;
@@ -421,6 +422,7 @@ gs_updates_page_get_updates_cb (GsPluginLoader *plugin_loader,
 	GtkWidget *widget;
 	g_autoptr(GError) error = NULL;
 	g_autoptr(GsAppList) list = NULL;
+	g_autoptr(GPtrArray) apps = NULL;
 
 	self->cache_valid = TRUE;
 
@@ -440,8 +442,9 @@ gs_updates_page_get_updates_cb (GsPluginLoader *plugin_loader,
 	}
 
 	/* add the results */
-	for (guint i = 0; i < gs_app_list_length (list); i++) {
-		GsApp *app = gs_app_list_index (list, i);
+	apps = gs_app_list_snapshot (list);
+	for (guint i = 0; i < apps->len; i++) {
+		GsApp *app = g_ptr_array_index (apps, i);
 		GsUpdatesSectionKind section = _get_app_section (app);
 		gs_updates_section_add_app (GS_UPDATES_SECTION (self->sections[section]), app);
 	}
@@ -1040,11 +1043,11 @@ static void
 gs_updates_page_upgrade_install_cb (GsUpgradeBanner *upgrade_banner,
                                     GsUpdatesPage *self)
 {
-	GsAppList *removals;
 	GsApp *upgrade;
 	GtkWidget *dialog;
 	guint cnt = 0;
 	guint i;
+	g_autoptr(GPtrArray) removals = NULL;
 
 	upgrade = gs_upgrade_banner_get_app (GS_UPGRADE_BANNER (self->upgrade_banner));
 	if (upgrade == NULL) {
@@ -1053,9 +1056,9 @@ gs_updates_page_upgrade_install_cb (GsUpgradeBanner *upgrade_banner,
 	}
 
 	/* count the removals */
-	removals = gs_app_get_related (upgrade);
-	for (i = 0; i < gs_app_list_length (removals); i++) {
-		GsApp *app = gs_app_list_index (removals, i);
+	removals = gs_app_list_snapshot (gs_app_get_related (upgrade));
+	for (i = 0; i < removals->len; i++) {
+		GsApp *app = g_ptr_array_index (removals, i);
 		if (gs_app_get_state (app) != GS_APP_STATE_UNAVAILABLE)
 			continue;
 		cnt++;
@@ -1112,8 +1115,9 @@ static gboolean
 gs_shell_update_are_updates_in_progress (GsUpdatesPage *self)
 {
 	g_autoptr(GsAppList) list = _get_all_apps (self);
-	for (guint i = 0; i < gs_app_list_length (list); i++) {
-		GsApp *app = gs_app_list_index (list, i);
+	g_autoptr(GPtrArray) apps = gs_app_list_snapshot (list);
+	for (guint i = 0; i < apps->len; i++) {
+		GsApp *app = g_ptr_array_index (apps, i);
 		switch (gs_app_get_state (app)) {
 		case GS_APP_STATE_INSTALLING:
 		case GS_APP_STATE_REMOVING: